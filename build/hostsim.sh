@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+# Builds the firmware for the host against the shims in host/shims and runs
+# the link/network benchmark. Extra arguments are passed to the bench, e.g.
+#   bash build/hostsim.sh --iterations 5 --json bench.json
+set -euo pipefail
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+OUT="$ROOT/host/out"
+CXX="${CXX:-g++}"
+CXXFLAGS="${CXXFLAGS:--O2 -g}"
+mkdir -p "$OUT"
+
+FLAGS=(-std=gnu++17 -DHOST_SIM "-DSIM_REPO_ROOT=\"$ROOT\"" -I"$ROOT/host/shims" -I"$ROOT/esp32"
+       -funsigned-char -Wall -Wno-narrowing -Wno-unused-variable -Wno-unused-function)
+
+objs=()
+pids=()
+# newest header anywhere in the tree; objects older than it or their source are rebuilt
+newest_header="$(ls -t "$ROOT"/esp32/*.h "$ROOT"/host/shims/*.h "$ROOT"/host/shims/*/*/*.h "$ROOT"/host/sim/*.h | head -n 1)"
+compile() {
+  local src="$1" obj="$OUT/$(basename "$1").o"
+  shift
+  objs+=("$obj")
+  if [ "$obj" -nt "$src" ] && [ "$obj" -nt "$newest_header" ]; then
+    return
+  fi
+  "$CXX" $CXXFLAGS "${FLAGS[@]}" "$@" -c "$src" -o "$obj" &
+  pids+=($!)
+}
+
+compile "$ROOT/esp32/esp32.ino" -x c++
+for src in "$ROOT"/host/shims/*.cpp "$ROOT"/host/sim/*.cpp "$ROOT/host/bench.cpp"; do
+  compile "$src"
+done
+for pid in "${pids[@]}"; do
+  wait "$pid"
+done
+"$CXX" $CXXFLAGS "${objs[@]}" -lz -o "$OUT/ti32-bench"
+
+if [ "${HOSTSIM_BUILD_ONLY:-0}" != "1" ]; then
+  "$OUT/ti32-bench" "$@"
+fi
@@ -0,0 +1,18 @@
+#!/usr/bin/env bash
+# Builds host/picbench.cpp against esp32/pic_pipeline.h and runs it on the
+# pictures in test-images/. Extra arguments are passed to the bench, e.g.
+#   bash build/picbench.sh --iterations 50 car.jpg
+set -euo pipefail
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+OUT="$ROOT/host/out"
+CXX="${CXX:-g++}"
+CXXFLAGS="${CXXFLAGS:--O2 -g}"
+mkdir -p "$OUT"
+
+"$CXX" $CXXFLAGS -std=gnu++17 "-DSIM_REPO_ROOT=\"$ROOT\"" -I"$ROOT/esp32" -funsigned-char -Wall \
+  "$ROOT/host/picbench.cpp" -ljpeg -lpng -o "$OUT/picbench"
+
+if [ "${PICBENCH_BUILD_ONLY:-0}" != "1" ]; then
+  "$OUT/picbench" "$@"
+fi
@@ -0,0 +1,95 @@
+#ifndef ANSWER_PAGES_H
+#define ANSWER_PAGES_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// Answer Pages - A streamed GPT answer, kept as string-sized pages
+// ============================================================================
+//
+// The server streams an answer as the model writes it. gpt returns as soon
+// as the first page is full (or the answer ends), and the rest keeps
+// arriving in the background. Page n holds characters
+// (n - 1) * ANSWER_PAGE_LEN onwards, the most a single command result can
+// carry. get_gpt_chunk asks for a page by number, or for the page after the
+// one it read last.
+//
+// Text beyond ANSWER_PAGES pages is dropped. The buffer is allocated on
+// first use, in PSRAM when the board has it.
+//
+// Only the network task uses the pages; the calculator sees them through
+// command results.
+
+class AnswerPages : public Print {
+private:
+  char* text = NULL;
+  size_t len = 0;
+  size_t dropped = 0;
+  bool streaming = false;
+  int cursor = 0;  // the page read last
+
+public:
+  // Allocates the pages; false if there is no room for them
+  bool ready() {
+    if (!text) {
+      size_t size = ANSWER_PAGES * ANSWER_PAGE_LEN;
+      text = (char*)(psramFound() ? ps_malloc(size) : malloc(size));
+    }
+    return text != NULL;
+  }
+
+  // A new answer starts arriving
+  void begin() {
+    len = 0;
+    dropped = 0;
+    streaming = true;
+    cursor = 0;
+  }
+
+  // No more of it will arrive
+  void end() { streaming = false; }
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  // Always takes all n bytes, so the stream is read to its end
+  size_t write(const uint8_t* buf, size_t n) override {
+    size_t keep = min(n, ANSWER_PAGES * ANSWER_PAGE_LEN - len);
+    memcpy(&text[len], buf, keep);
+    len += keep;
+    dropped += n - keep;
+    return n;
+  }
+
+  bool more() { return streaming; }
+  size_t length() { return len; }
+  size_t droppedBytes() { return dropped; }
+  const char* data() { return text; }
+
+  // Pages with any text so far
+  int pages() { return (len + ANSWER_PAGE_LEN - 1) / ANSWER_PAGE_LEN; }
+
+  // The page after the one read last
+  int next() { return cursor + 1; }
+
+  // Page n will not change any more
+  bool complete(int n) { return !streaming || len >= (size_t)n * ANSWER_PAGE_LEN; }
+
+  // Copies page n (from 1) as far as it has arrived into out, which holds
+  // ANSWER_PAGE_LEN + 1 chars, and makes it the page read last. Returns its
+  // length; 0 for a page past the end.
+  size_t page(int n, char* out) {
+    out[0] = '\0';
+    if (n < 1 || (size_t)(n - 1) * ANSWER_PAGE_LEN >= len) {
+      return 0;
+    }
+    size_t start = (n - 1) * ANSWER_PAGE_LEN;
+    size_t count = min((size_t)ANSWER_PAGE_LEN, len - start);
+    memcpy(out, &text[start], count);
+    out[count] = '\0';
+    cursor = n;
+    return count;
+  }
+};
+
+#endif // ANSWER_PAGES_H
@@ -0,0 +1,126 @@
+#ifndef ASSET_FRAME_H
+#define ASSET_FRAME_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// Asset Frame - A program or picture with its metadata in one response
+// ============================================================================
+//
+// fetch_program used to ask /programs/get_name and then /programs/get, and
+// fetch_image had no way to tell a truncated picture from a whole one.
+// /programs/fetch and /image/fetch answer with a single frame:
+//
+//   nameLen:u8 name type:u8 size:u32 checksum:u16 body
+//
+// Integers are little-endian. type is the TI variable type the body is
+// sent as, size the body's length and checksum the low 16 bits of the sum
+// of its bytes (the link's own data checksum). The body is the variable's
+// data as it goes over the link.
+//
+// AssetReader parses a frame in one pass as it is written: the header is
+// kept, and the body is passed on to a sink and summed on the way. A whole
+// frame already in memory (the response cache's copy) is parsed the same
+// way into a NullPrint. The framing must match server/routes/util/asset.mjs.
+
+enum AssetType : uint8_t {
+  ASSET_PROGRAM = 0x05,
+  ASSET_PROTECTED_PROGRAM = 0x06,
+  ASSET_PICTURE = 0x07,
+};
+
+struct AssetHeader {
+  char name[ASSET_NAME_LEN + 1];
+  uint8_t type;
+  uint32_t size;
+  uint16_t checksum;
+};
+
+class AssetReader : public Print {
+private:
+  enum State { NAME_LEN, NAME, FIELDS, BODY, DONE };
+
+  Print* sink = NULL;
+  State state = DONE;
+  AssetHeader hdr;
+  uint8_t nameLen = 0;
+  uint8_t fields[7];   // type, size, checksum
+  size_t have = 0;     // bytes of the current header field
+  size_t headerLen = 0;
+  uint32_t passed = 0; // body bytes the sink took
+  uint16_t sum = 0;
+
+  void startBody() {
+    hdr.type = fields[0];
+    hdr.size = fields[1] | (fields[2] << 8) | (fields[3] << 16) | ((uint32_t)fields[4] << 24);
+    hdr.checksum = fields[5] | (fields[6] << 8);
+    state = hdr.size ? BODY : DONE;
+  }
+
+public:
+  // Starts a frame whose body goes to body
+  void begin(Print& body) {
+    sink = &body;
+    state = NAME_LEN;
+    memset(&hdr, 0, sizeof(hdr));
+    have = 0;
+    headerLen = 0;
+    passed = 0;
+    sum = 0;
+  }
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  // Takes fewer than n bytes when the sink overflows or bytes follow the
+  // body, so the read fails
+  size_t write(const uint8_t* src, size_t n) override {
+    size_t used = 0;
+    while (used < n && state < BODY) {
+      uint8_t c = src[used++];
+      headerLen++;
+      if (state == NAME_LEN) {
+        nameLen = c;
+        state = nameLen ? NAME : FIELDS;
+      } else if (state == NAME) {
+        if (have < ASSET_NAME_LEN) {
+          hdr.name[have] = c;
+        }
+        if (++have == nameLen) {
+          have = 0;
+          state = FIELDS;
+        }
+      } else {
+        fields[have++] = c;
+        if (have == sizeof(fields)) {
+          startBody();
+        }
+      }
+    }
+    if (state == BODY && used < n) {
+      size_t take = sink->write(src + used, min(n - used, (size_t)(hdr.size - passed)));
+      for (size_t i = 0; i < take; ++i) {
+        sum += src[used + i];
+      }
+      used += take;
+      passed += take;
+      if (passed == hdr.size) {
+        state = DONE;
+      }
+    }
+    return used;
+  }
+
+  // The header has been read; header() is valid from then on
+  bool started() { return state >= BODY; }
+  const AssetHeader& header() { return hdr; }
+  size_t headerLength() { return headerLen; }
+
+  // The whole body has been passed on
+  bool complete() { return state == DONE; }
+
+  // ... and its checksum matches the header's
+  bool verified() { return state == DONE && sum == hdr.checksum; }
+};
+
+#endif // ASSET_FRAME_H
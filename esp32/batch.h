@@ -0,0 +1,234 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <Arduino.h>
+#include <UrlEncode.h>
+#include "config.h"
+#include "response_cache.h"
+
+// ============================================================================
+// Batch - Several cacheable GETs in one round trip
+// ============================================================================
+//
+// A launcher flow queues a list page and then the items on it, and the
+// prefetcher guesses several items per page. Each of those GETs used to be
+// a round trip through the tunnel of its own. Before a command runs, the
+// network task collects the GETs it and the commands queued behind it are
+// about to make. When two or more of them are not fresh in the response
+// cache, it asks for all of them at once:
+//
+//   GET /batch?r0=<path>&e0=<etag>&r1=<path>&e1=<etag>...
+//
+// The server runs each path through its normal routes and answers with the
+// responses in order, each framed as
+//
+//   status:u16 etagLen:u8 etag length:u32 body
+//
+// Integers are little-endian and the bodies are not compressed (the batch
+// as a whole may be). The batch is the Print the response is written to:
+// it files each 200 into the response cache and marks each 304
+// revalidated, so the commands then find their responses there as if they
+// had fetched them one by one. A sub-request that fails is not cached, and
+// its command sends it again by itself. A server without /batch (404) is
+// not asked again until the server changes.
+//
+// The framing must match server/routes/batch.mjs. Only the network task
+// uses the batch.
+
+struct BatchStats {
+  uint32_t batches = 0;       // batch requests sent
+  uint32_t requests = 0;      // GETs they carried
+  uint32_t filed = 0;         // 200s stored in the cache
+  uint32_t revalidated = 0;   // 304s
+  uint32_t failed = 0;        // sub-requests that came back as errors
+  uint32_t unsupported = 0;   // servers that answered 404
+};
+
+class RequestBatch : public Print {
+private:
+  enum State { STATUS, ETAG, LENGTH, BODY, DONE };
+
+  String urls[BATCH_MAX_REQUESTS];
+  String etags[BATCH_MAX_REQUESTS];
+  bool arrived[BATCH_MAX_REQUESTS];  // cached or revalidated
+  int count = 0;
+  String refused;  // the server that answered 404
+  ResponseCache& cache;
+
+  // parsing the response
+  State state = DONE;
+  int index = 0;          // sub-response being read
+  uint8_t head[4];
+  size_t have = 0;        // bytes of the current header field
+  uint16_t status = 0;
+  size_t etagLen = 0;
+  String etag;
+  size_t left = 0;        // body bytes still to come
+  CacheFill fill;
+  BatchStats stats;
+
+  // The header of the current sub-response is complete
+  void beginBody() {
+    left = head[0] | (head[1] << 8) | (head[2] << 16) | ((size_t)head[3] << 24);
+    if (status == 200) {
+      cache.beginFill(fill, urls[index], etag, left);
+    }
+    state = BODY;
+    if (left == 0) {
+      endBody();
+    }
+  }
+
+  void endBody() {
+    ResponseCache::Entry* e = NULL;
+    if (status == 200 && cache.commit(fill)) {
+      stats.filed++;
+      arrived[index] = true;
+    } else if (status == 304 && (e = cache.find(urls[index]))) {
+      cache.revalidated(e);
+      stats.revalidated++;
+      arrived[index] = true;
+    } else {
+      cache.abort(fill);
+      stats.failed++;
+    }
+    have = 0;
+    etag = String();
+    state = ++index < count ? STATUS : DONE;
+  }
+
+public:
+  explicit RequestBatch(ResponseCache& c) : cache(c) {}
+
+  // Forgets the GETs added so far
+  void clear() {
+    for (int i = 0; i < count; ++i) {
+      urls[i] = String();
+      etags[i] = String();
+    }
+    count = 0;
+  }
+
+  // A GET of url, which is under the server the batch goes to, that will
+  // be served from the cache for freshMs. Skipped (and false) when it is
+  // already fresh, already in the batch, or the batch is full.
+  bool add(const String& url, unsigned long freshMs) {
+    ResponseCache::Entry* cached = cache.find(url);
+    if (count == BATCH_MAX_REQUESTS || (cached && cache.fresh(cached, freshMs))) {
+      return false;
+    }
+    for (int i = 0; i < count; ++i) {
+      if (urls[i] == url) {
+        return false;
+      }
+    }
+    urls[count] = url;
+    etags[count] = cached ? cached->etag : String();
+    arrived[count] = false;
+    count++;
+    return true;
+  }
+
+  int size() { return count; }
+  const String& url(int i) { return urls[i]; }
+
+  // Whether the i-th GET's response is in the cache now
+  bool served(int i) { return arrived[i]; }
+
+  // Whether server may be sent a batch; only URLs under it can be batched
+  bool usable(const char* server) {
+    return cache.getStats().budget && refused != server;
+  }
+
+  // The batch request for the GETs added under server
+  String request(const char* server) {
+    size_t base = strlen(server);
+    String u = String(server) + BATCH_PATH;
+    for (int i = 0; i < count; ++i) {
+      u += i == 0 ? "?r" : "&r";
+      u += String(i) + "=" + urlEncode(urls[i].substring(base));
+      if (etags[i].length()) {
+        u += "&e" + String(i) + "=" + urlEncode(etags[i]);
+      }
+    }
+    return u;
+  }
+
+  // ========================================================================
+  // The Response
+  // ========================================================================
+
+  // The batch was sent; its body is written here next
+  void begin() {
+    stats.batches++;
+    stats.requests += count;
+    index = 0;
+    have = 0;
+    etag = String();
+    state = count ? STATUS : DONE;
+  }
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  size_t write(const uint8_t* src, size_t n) override {
+    size_t used = 0;
+    while (used < n && state != DONE) {
+      switch (state) {
+        case STATUS:
+        case LENGTH:
+          head[have++] = src[used++];
+          if (state == STATUS && have == 3) {
+            status = head[0] | (head[1] << 8);
+            etagLen = head[2];
+            have = 0;
+            state = etagLen ? ETAG : LENGTH;
+          } else if (state == LENGTH && have == 4) {
+            beginBody();
+          }
+          break;
+        case ETAG:
+          etag += (char)src[used++];
+          if (etag.length() == etagLen) {
+            state = LENGTH;
+          }
+          break;
+        case BODY: {
+          size_t take = min(n - used, left);
+          if (fill.active()) {
+            fill.write(src + used, take);
+          }
+          used += take;
+          left -= take;
+          if (left == 0) {
+            endBody();
+          }
+          break;
+        }
+        default:
+          break;
+      }
+    }
+    // bytes past the last sub-response fail the read
+    return used < n ? 0 : n;
+  }
+
+  // After the response was read (code as fetchInto returns it): whether
+  // every sub-response came back. Those that did not are left uncached.
+  bool finish(int code, const char* server) {
+    if (code == 404) {
+      refused = server;
+      stats.unsupported++;
+    }
+    cache.abort(fill);
+    if (state != DONE || code != 0) {
+      stats.failed += count - index;
+      state = DONE;
+      return false;
+    }
+    return true;
+  }
+
+  const BatchStats& getStats() { return stats; }
+};
+
+#endif // BATCH_H
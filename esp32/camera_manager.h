@@ -0,0 +1,206 @@
+#ifndef CAMERA_MANAGER_H
+#define CAMERA_MANAGER_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "config.h"
+
+// ============================================================================
+// Camera Manager - Capture profiles, switched without a reboot
+// ============================================================================
+//
+// What the calculator shows is 96x63 and 1 bit deep, so snap has no use
+// for a VGA JPEG it would have to decode first: the pic profile grabs the
+// sensor's grayscale (its Y channel) at a small frame size. Vision uploads
+// want a JPEG the model can read, which the vision profile grabs.
+//
+// The driver sizes its frame buffers for the format and frame size it was
+// started with, so a switch stops the driver and starts it again with the
+// other profile, keeping the pins and clock of the first start. A buffer
+// still held by the caller would be freed under it, so the manager hands
+// out the frames itself and refuses to switch while one is out. The first
+// frames after a start are dropped while the sensor's exposure settles.
+//
+// Grabbing a frame on demand from a single buffer means waiting out the
+// frame in flight and then a fresh one, and the frame already waiting in
+// the buffer may be seconds old. Instead the camera runs in sessions: the
+// first grab starts the driver with CAMERA_SESSION_FBS buffers in PSRAM
+// and CAMERA_GRAB_LATEST, so it keeps capturing and a grab takes the
+// newest complete frame, at most one frame time away. A session ends when
+// nothing was grabbed for CAMERA_SESSION_IDLE_MS: the driver stops and the
+// sensor idles without a clock. Boards without PSRAM capture on demand
+// from one buffer in DRAM.
+//
+// Only the network task uses the camera.
+
+enum CameraProfile {
+  CAMERA_PROFILE_PIC,
+  CAMERA_PROFILE_VISION,
+  CAMERA_PROFILE_COUNT
+};
+
+struct CameraProfileDef {
+  const char* name;
+  pixformat_t format;
+  framesize_t size;
+  int jpegQuality;
+};
+
+// indexed by CameraProfile
+static const CameraProfileDef cameraProfiles[CAMERA_PROFILE_COUNT] = {
+  { "pic", CAMERA_PIC_FORMAT, CAMERA_PIC_FRAMESIZE, CAMERA_PIC_JPEG_QUALITY },
+  { "vision", PIXFORMAT_JPEG, CAMERA_VISION_FRAMESIZE, CAMERA_VISION_JPEG_QUALITY },
+};
+
+struct CameraStats {
+  uint32_t sessions = 0;
+  uint32_t grabs = 0;
+  uint32_t failed = 0;          // grabs that got no frame
+  uint32_t switches = 0;
+  uint32_t switchFailures = 0;  // the driver did not start with the new profile
+  unsigned long switchMs = 0;   // the last start or switch, with its settling frames
+  unsigned long frameAgeMs = 0; // how old the last frame was when it was handed out
+};
+
+class CameraManager {
+private:
+  camera_config_t base;
+  CameraProfile profile = CAMERA_PROFILE_PIC;
+  bool running = false;
+  camera_fb_t* held = NULL;
+  int settle = 0;  // frames to drop before the next one is handed out
+  unsigned long lastGrab = 0;
+  CameraStats stats;
+
+  bool start(CameraProfile p) {
+    camera_config_t config = base;
+    config.pixel_format = cameraProfiles[p].format;
+    config.frame_size = cameraProfiles[p].size;
+    config.jpeg_quality = cameraProfiles[p].jpegQuality;
+    if (psramFound()) {
+      config.fb_count = CAMERA_SESSION_FBS;
+      config.fb_location = CAMERA_FB_IN_PSRAM;
+      config.grab_mode = CAMERA_GRAB_LATEST;
+    } else {
+      config.fb_count = 1;
+      config.fb_location = CAMERA_FB_IN_DRAM;
+      config.grab_mode = CAMERA_GRAB_WHEN_EMPTY;
+    }
+    esp_err_t err = esp_camera_init(&config);
+    if (err != ESP_OK) {
+      Serial.printf("[CameraManager] %s profile failed to start: 0x%x\n", cameraProfiles[p].name, err);
+      return false;
+    }
+    profile = p;
+    running = true;
+    return true;
+  }
+
+  bool stop() {
+    if (!running) {
+      return true;
+    }
+    if (held) {
+      Serial.println("[CameraManager] frame still held, not stopping");
+      return false;
+    }
+    if (esp_camera_deinit() != ESP_OK) {
+      Serial.println("[CameraManager] driver did not stop");
+      return false;
+    }
+    running = false;
+    return true;
+  }
+
+  // Starts a session in p, or switches the running one to it; a failed
+  // switch goes back to the old profile
+  bool change(CameraProfile p) {
+    unsigned long t0 = millis();
+    bool switching = running;
+    CameraProfile old = profile;
+    if (!stop()) {
+      return false;
+    }
+    if (switching) {
+      stats.switches++;
+    } else {
+      stats.sessions++;
+    }
+    if (!start(p)) {
+      if (switching) {
+        stats.switchFailures++;
+        start(old);
+      }
+      return false;
+    }
+    settle = CAMERA_SETTLE_FRAMES;
+    stats.switchMs = millis() - t0;
+    Serial.print(switching ? "[CameraManager] switched to " : "[CameraManager] session started: ");
+    Serial.println(cameraProfiles[p].name);
+    return true;
+  }
+
+public:
+  // Checks that the camera starts with p (config holds the pins and
+  // clock), then lets it idle until the first grab
+  bool begin(const camera_config_t& config, CameraProfile p) {
+    base = config;
+    if (!start(p)) {
+      return false;
+    }
+    stop();
+    return true;
+  }
+
+  // Ends the session once nothing was grabbed for CAMERA_SESSION_IDLE_MS
+  void step() {
+    if (running && !held && millis() - lastGrab >= CAMERA_SESSION_IDLE_MS && stop()) {
+      Serial.println("[CameraManager] session ended, sensor idle");
+    }
+  }
+
+  // The newest frame in profile p, starting a session or switching to p
+  // first; release() it before the next grab. NULL when the camera does not
+  // start or a frame is still held.
+  camera_fb_t* grab(CameraProfile p) {
+    stats.grabs++;
+    lastGrab = millis();
+    if (held || ((p != profile || !running) && !change(p))) {
+      stats.failed++;
+      return NULL;
+    }
+    if (settle > 0) {
+      unsigned long t0 = millis();
+      for (; settle > 0; --settle) {
+        camera_fb_t* fb = esp_camera_fb_get();
+        if (fb) {
+          esp_camera_fb_return(fb);
+        }
+      }
+      stats.switchMs += millis() - t0;
+    }
+    held = esp_camera_fb_get();
+    if (!held) {
+      stats.failed++;
+      return NULL;
+    }
+    uint64_t taken = (uint64_t)held->timestamp.tv_sec * 1000000 + held->timestamp.tv_usec;
+    stats.frameAgeMs = (micros() - (unsigned long)taken) / 1000;
+    lastGrab = millis();
+    return held;
+  }
+
+  void release(camera_fb_t* fb) {
+    if (fb && fb == held) {
+      esp_camera_fb_return(fb);
+      held = NULL;
+    }
+  }
+
+  // A session is on: the sensor is capturing
+  bool active() { return running; }
+  CameraProfile current() { return profile; }
+  const CameraStats& getStats() { return stats; }
+};
+
+#endif // CAMERA_MANAGER_H
@@ -0,0 +1,676 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include <base64.h>
+#include "config.h"
+#include "mailbox.h"
+#include "wire.h"
+
+// ============================================================================
+// Channel - One persistent WebSocket to the server
+// ============================================================================
+//
+// Through ngrok, every HTTP request carries its request line, headers and
+// Basic auth. The channel upgrades one connection to a WebSocket at
+// CHANNEL_PATH, authenticated once, and multiplexes everything over it:
+//
+//   device -> server (text)    GET <id> <etag|-> <path> [gzip]
+//                                                         a server request
+//                              RESULT <json>              a dashboard result
+//                              LOG <text>                 a line for the device log
+//   server -> device (text)    CMD <id> <command>         a dashboard command, pushed
+//   server -> device (binary)  id:u32 status:u16 length:u32 etagLen:u8 etag body
+//                                                         the answer to a GET
+//
+// Binary fields are little-endian; bit 15 of the status marks a gzip body,
+// sent only to a request that asked for one. A body the server streams (a
+// GPT answer) comes as several frames with the same id, each carrying the
+// next part of it; bit 14 of the status says more follow. A request then
+// costs one round trip and a few bytes of framing, and the dashboard's
+// commands arrive without being polled for. When the server accepts
+// WIRE_PROTOCOL in the upgrade, requests built as a WireRequest go as
+// compact binary frames instead of a text GET (wire.h).
+//
+// Pings keep the connection alive when nothing else is sent. When nothing
+// has been heard for CHANNEL_DEAD_MS, the connection is dropped and opened
+// again, with the retry delay doubling from CHANNEL_RETRY_MS. A server
+// without the channel answers the upgrade with an error and is asked again
+// after CHANNEL_RETRY_MAX_MS. While the channel is down, everything falls
+// back to plain HTTP and mailbox polling.
+//
+// Pushed commands wait here until the network task runs them, one at a
+// time, under the same gate as polled ones: only while the calculator has
+// left the link quiet, and in flight so onRequest holds its results back.
+// One pushed while MAILBOX_COMMANDS are waiting is answered "device busy".
+//
+// Only the network task uses the channel.
+
+struct ChannelStats {
+  uint32_t connects = 0;
+  uint32_t drops = 0;
+  uint32_t requests = 0;
+  uint32_t commands = 0;
+  uint32_t refused = 0;  // pushed while MAILBOX_COMMANDS were waiting
+  uint32_t results = 0;
+  uint32_t pings = 0;
+  unsigned long lastRttMs = 0;  // ping to pong
+};
+
+template <typename Client>
+class Channel {
+private:
+  enum Opcode : uint8_t { OP_TEXT = 0x1, OP_BINARY = 0x2, OP_CLOSE = 0x8, OP_PING = 0x9, OP_PONG = 0xA };
+  enum Part { HEAD, PAYLOAD };
+  enum Response { NONE, WAITING, HEAD_READY, DONE };
+
+  Client client;
+  bool up = false;
+  bool compact = false;  // the server accepted WIRE_PROTOCOL
+
+  String server;  // as given, to notice a new ngrok URL
+  String host;
+  uint16_t port = 0;
+  String basePath;
+  String auth;
+
+  unsigned long nextAttempt = 0;
+  unsigned long retryMs = CHANNEL_RETRY_MS;
+  unsigned long lastHeard = 0;
+  unsigned long lastSent = 0;
+  unsigned long pingSent = 0;
+
+  // the frame being read
+  Part part = HEAD;
+  uint8_t head[10];
+  size_t headLen = 0;
+  uint8_t opcode = 0;
+  uint64_t left = 0;
+  char text[CHANNEL_TEXT_LEN + 1];
+  size_t textLen = 0;
+
+  // the response being read (binary frames)
+  uint8_t respHead[11];
+  size_t respHeadLen = 0;
+  uint32_t respId = 0;
+  uint8_t respEtagLeft = 0;
+  uint32_t awaitedId = 0;
+  uint32_t requestSeq = 0;
+  Response response = NONE;
+  int respStatus = 0;
+  bool respGzip = false;
+  bool respMore = false;      // the frame being read is not the last of the body
+  bool respStreamed = false;  // the body comes in several frames
+  uint32_t respLength = 0;
+  String respEtag;
+  Print* bodySink = NULL;
+  size_t bodyRead = 0;
+  bool bodyOverflow = false;
+
+  // pushed commands not run yet
+  MailboxCommand commands[MAILBOX_COMMANDS];
+  int commandHead = 0;
+  int commandCount = 0;
+
+  ChannelStats stats;
+
+  static void prepare(WiFiClientSecure& c) { c.setInsecure(); }
+  static void prepare(WiFiClient& c) { (void)c; }
+
+  static uint32_t le32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+  bool setServer(const char* url) {
+    drop();
+    server = url;
+    retryMs = CHANNEL_RETRY_MS;
+    nextAttempt = millis();
+    String u = server;
+    int scheme = u.indexOf("://");
+    if (scheme < 0) {
+      host = String();
+      return false;
+    }
+    port = u.startsWith("https") ? 443 : 80;
+    int start = scheme + 3;
+    int slash = u.indexOf('/', start);
+    String authority = slash < 0 ? u.substring(start) : u.substring(start, slash);
+    basePath = slash < 0 ? String() : u.substring(slash);
+    while (basePath.endsWith("/")) {
+      basePath.remove(basePath.length() - 1);
+    }
+    int colon = authority.indexOf(':');
+    if (colon >= 0) {
+      port = authority.substring(colon + 1).toInt();
+      authority = authority.substring(0, colon);
+    }
+    host = authority;
+    return host.length() > 0;
+  }
+
+  // ========================================================================
+  // Connecting
+  // ========================================================================
+
+  // Connects and upgrades; returns the status of the upgrade response and
+  // whether the server accepted compact requests
+  int open(bool* wire) {
+    *wire = false;
+    prepare(client);
+    if (!client.connect(host.c_str(), port)) {
+      return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+    uint8_t nonce[16];
+    for (int i = 0; i < 16; i += 4) {
+      uint32_t r = esp_random();
+      memcpy(&nonce[i], &r, 4);
+    }
+    String req = "GET " + basePath + CHANNEL_PATH + " HTTP/1.1\r\nHost: " + host +
+                 "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: " +
+                 base64::encode(nonce, sizeof(nonce)) + "\r\nSec-WebSocket-Protocol: " WIRE_PROTOCOL "\r\n";
+    if (auth.length()) {
+      req += "Authorization: Basic " + auth + "\r\n";
+    }
+    req += "\r\n";
+    if (client.write((const uint8_t*)req.c_str(), req.length()) != req.length()) {
+      return HTTPC_ERROR_SEND_HEADER_FAILED;
+    }
+
+    // status line and headers, up to the blank line
+    int status = 0;
+    char line[64];
+    size_t len = 0;
+    unsigned long start = millis();
+    while (millis() - start < CHANNEL_CONNECT_TIMEOUT_MS) {
+      if (client.available() <= 0) {
+        if (!client.connected()) {
+          return HTTPC_ERROR_CONNECTION_LOST;
+        }
+        delay(1);
+        continue;
+      }
+      int c = client.read();
+      if (c == '\r') {
+        continue;
+      }
+      if (c != '\n') {
+        if (len < sizeof(line) - 1) {
+          line[len++] = c;
+        }
+        continue;
+      }
+      line[len] = '\0';
+      if (len == 0) {
+        return status;
+      }
+      if (status == 0) {
+        const char* space = strchr(line, ' ');
+        status = space ? atoi(space + 1) : -1;
+      } else if (strncasecmp(line, "Sec-WebSocket-Protocol:", 23) == 0) {
+        const char* value = line + 23;
+        while (*value == ' ') {
+          ++value;
+        }
+        *wire = strcmp(value, WIRE_PROTOCOL) == 0;
+      }
+      len = 0;
+    }
+    return HTTPC_ERROR_READ_TIMEOUT;
+  }
+
+  void connect() {
+    bool wire;
+    int status = open(&wire);
+    if (status == 101) {
+      up = true;
+      compact = wire;
+      part = HEAD;
+      headLen = 0;
+      response = NONE;
+      awaitedId = 0;
+      lastHeard = lastSent = millis();
+      pingSent = 0;
+      retryMs = CHANNEL_RETRY_MS;
+      stats.connects++;
+      Serial.println(compact ? "[Channel] Connected (compact requests)" : "[Channel] Connected");
+      return;
+    }
+    client.stop();
+    Serial.print("[Channel] Upgrade failed: ");
+    Serial.println(status);
+    if (status > 0) {
+      // the server answered but has no channel
+      retryMs = CHANNEL_RETRY_MAX_MS;
+    }
+    nextAttempt = millis() + retryMs;
+    retryMs = min(retryMs * 2, (unsigned long)CHANNEL_RETRY_MAX_MS);
+  }
+
+  void drop() {
+    if (up) {
+      stats.drops++;
+      Serial.println("[Channel] Dropped");
+      nextAttempt = millis() + retryMs;
+      retryMs = min(retryMs * 2, (unsigned long)CHANNEL_RETRY_MAX_MS);
+    }
+    up = false;
+    client.stop();
+  }
+
+  // ========================================================================
+  // Frames
+  // ========================================================================
+
+  // Client frames are masked (RFC 6455)
+  bool sendFrame(uint8_t op, const uint8_t* data, size_t len) {
+    if (!up) {
+      return false;
+    }
+    uint8_t* frame = (uint8_t*)malloc(len + 14);
+    if (!frame) {
+      return false;
+    }
+    size_t n = 0;
+    frame[n++] = 0x80 | op;
+    if (len < 126) {
+      frame[n++] = 0x80 | len;
+    } else if (len < 65536) {
+      frame[n++] = 0x80 | 126;
+      frame[n++] = len >> 8;
+      frame[n++] = len & 0xff;
+    } else {
+      frame[n++] = 0x80 | 127;
+      for (int i = 7; i >= 0; --i) {
+        frame[n++] = i < 4 ? (len >> (8 * i)) & 0xff : 0;
+      }
+    }
+    uint32_t r = esp_random();
+    uint8_t* mask = &frame[n];
+    memcpy(mask, &r, 4);
+    n += 4;
+    for (size_t i = 0; i < len; ++i) {
+      frame[n + i] = data[i] ^ mask[i & 3];
+    }
+    n += len;
+    bool ok = client.write(frame, n) == n;
+    free(frame);
+    if (!ok) {
+      drop();
+      return false;
+    }
+    lastSent = millis();
+    return true;
+  }
+
+  bool sendText(const String& msg) { return sendFrame(OP_TEXT, (const uint8_t*)msg.c_str(), msg.length()); }
+
+  // A complete text or control frame
+  void handleFrame() {
+    text[textLen] = '\0';
+    if (opcode == OP_PING) {
+      sendFrame(OP_PONG, (const uint8_t*)text, textLen);
+    } else if (opcode == OP_PONG) {
+      if (pingSent) {
+        stats.lastRttMs = millis() - pingSent;
+        pingSent = 0;
+      }
+    } else if (opcode == OP_CLOSE) {
+      drop();
+    } else if (opcode == OP_TEXT && strncmp(text, "CMD ", 4) == 0) {
+      char* rest;
+      uint32_t id = strtoul(text + 4, &rest, 10);
+      while (*rest == ' ') {
+        ++rest;
+      }
+      if (!*rest) {
+        return;
+      }
+      if (commandCount == MAILBOX_COMMANDS) {
+        // pushed faster than the link lets them run; say so rather than
+        // leave the dashboard waiting for its timeout
+        stats.refused++;
+        sendResult(Mailbox<Client>::resultJson(id, true, "device busy"));
+        return;
+      }
+      MailboxCommand& cmd = commands[(commandHead + commandCount) % MAILBOX_COMMANDS];
+      cmd.id = id;
+      strncpy(cmd.text, rest, MAILBOX_COMMAND_LEN - 1);
+      cmd.text[MAILBOX_COMMAND_LEN - 1] = '\0';
+      commandCount++;
+      stats.commands++;
+    }
+  }
+
+  // Binary payload bytes: the response head, its ETag, then the body
+  void responseBytes(const uint8_t* data, size_t n) {
+    while (n > 0) {
+      if (respHeadLen < sizeof(respHead)) {
+        size_t k = min(n, sizeof(respHead) - respHeadLen);
+        memcpy(&respHead[respHeadLen], data, k);
+        respHeadLen += k;
+        data += k;
+        n -= k;
+        if (respHeadLen == sizeof(respHead)) {
+          respId = le32(respHead);
+          respEtagLeft = respHead[10];
+          if (respId == awaitedId) {
+            respStatus = (respHead[4] | (respHead[5] << 8)) & 0x3fff;
+            respGzip = respHead[5] & 0x80;
+            respMore = respHead[5] & 0x40;
+            respStreamed = respStreamed || respMore;
+            respLength = le32(&respHead[6]);
+            respEtag = String();
+          }
+        }
+        continue;
+      }
+      if (respEtagLeft > 0) {
+        size_t k = min(n, (size_t)respEtagLeft);
+        if (respId == awaitedId) {
+          for (size_t i = 0; i < k; ++i) {
+            respEtag += (char)data[i];
+          }
+        }
+        respEtagLeft -= k;
+        data += k;
+        n -= k;
+        continue;
+      }
+      if (respId == awaitedId && bodySink) {
+        size_t k = bodySink->write(data, n);
+        if (k != n) {
+          bodyOverflow = true;
+          bodySink = NULL;
+        }
+        bodyRead += n;
+      }
+      n = 0;
+    }
+  }
+
+  // Reads whatever has arrived. Stops at the head of the awaited response
+  // until the caller hands over a sink for its body.
+  void pump() {
+    uint8_t buf[HTTP_READ_CHUNK_LEN];
+    while (up) {
+      if (!client.connected() && client.available() <= 0) {
+        drop();
+        return;
+      }
+      if (part == HEAD) {
+        size_t need = 2;
+        if (headLen >= 2) {
+          uint8_t len7 = head[1] & 0x7f;
+          need += len7 == 126 ? 2 : len7 == 127 ? 8 : 0;
+        }
+        if (headLen < need) {
+          if (client.available() <= 0) {
+            return;
+          }
+          head[headLen++] = client.read();
+          continue;
+        }
+        if (head[1] & 0x80) {
+          drop();  // servers never mask
+          return;
+        }
+        opcode = head[0] & 0x0f;
+        uint8_t len7 = head[1] & 0x7f;
+        left = len7;
+        if (len7 == 126) {
+          left = (head[2] << 8) | head[3];
+        } else if (len7 == 127) {
+          left = 0;
+          for (int i = 2; i < 10; ++i) {
+            left = (left << 8) | head[i];
+          }
+        }
+        headLen = 0;
+        textLen = 0;
+        respHeadLen = 0;
+        part = PAYLOAD;
+        lastHeard = millis();
+      }
+
+      if (opcode == OP_BINARY && respHeadLen == sizeof(respHead) && respEtagLeft == 0 && respId == awaitedId) {
+        if (response == WAITING) {
+          response = HEAD_READY;
+        }
+        if (!bodySink && !bodyOverflow) {
+          return;  // the caller decides where the body goes
+        }
+      }
+      if (left > 0) {
+        int avail = client.available();
+        if (avail <= 0) {
+          return;
+        }
+        size_t want = min((size_t)avail, (size_t)min(left, (uint64_t)sizeof(buf)));
+        if (opcode == OP_BINARY && respHeadLen < sizeof(respHead)) {
+          want = min(want, sizeof(respHead) - respHeadLen);  // stop after the head and
+        } else if (opcode == OP_BINARY && respEtagLeft > 0) {
+          want = min(want, (size_t)respEtagLeft);             // the ETag to look for a sink
+        }
+        int got = client.read(buf, want);
+        if (got <= 0) {
+          return;
+        }
+        left -= got;
+        lastHeard = millis();
+        if (opcode == OP_BINARY) {
+          responseBytes(buf, got);
+        } else {
+          size_t k = min((size_t)got, CHANNEL_TEXT_LEN - textLen);
+          memcpy(&text[textLen], buf, k);
+          textLen += k;
+        }
+        continue;
+      }
+
+      // frame complete
+      part = HEAD;
+      if (opcode == OP_BINARY) {
+        if (respHeadLen == sizeof(respHead) && respId == awaitedId && !respMore) {
+          response = DONE;
+        }
+      } else {
+        handleFrame();
+      }
+    }
+  }
+
+  // Sends a request frame and waits for the head of its response
+  int request(uint32_t id, uint8_t op, const uint8_t* data, size_t len) {
+    awaitedId = id;
+    response = WAITING;
+    bodySink = NULL;
+    bodyRead = 0;
+    bodyOverflow = false;
+    respStreamed = false;
+    stats.requests++;
+    if (!sendFrame(op, data, len)) {
+      response = NONE;
+      return HTTPC_ERROR_SEND_HEADER_FAILED;
+    }
+    unsigned long start = millis();
+    while (up && response == WAITING) {
+      pump();
+      if (response != WAITING) {
+        break;
+      }
+      if (millis() - start > HTTP_RESPONSE_TIMEOUT_MS) {
+        drop();
+        return HTTPC_ERROR_READ_TIMEOUT;
+      }
+      delay(1);
+    }
+    return up || response == DONE ? respStatus : HTTPC_ERROR_CONNECTION_LOST;
+  }
+
+public:
+  void setAuthorization(const char* user, const char* password) {
+    auth = base64::encode(String(user) + ":" + password);
+  }
+
+  bool isUp() { return up; }
+  bool isCompact() { return up && compact; }
+
+  // Connects when due, reads what has arrived, and keeps the connection
+  // alive. serverUrl is the current server (it may change).
+  void step(const char* serverUrl) {
+    if (server != serverUrl && !setServer(serverUrl)) {
+      return;
+    }
+    if (host.length() == 0) {
+      return;
+    }
+    if (!up) {
+      if ((long)(millis() - nextAttempt) >= 0) {
+        connect();
+      }
+      return;
+    }
+    pump();
+    if (!up) {
+      return;
+    }
+    if (millis() - lastHeard > CHANNEL_DEAD_MS) {
+      drop();
+      return;
+    }
+    if (millis() - lastSent > CHANNEL_PING_MS) {
+      pingSent = millis();
+      stats.pings++;
+      sendFrame(OP_PING, NULL, 0);
+    }
+  }
+
+  // ========================================================================
+  // Requests
+  // ========================================================================
+
+  // Sends a GET for path (relative to the server), conditional when etag is
+  // given and accepting gzip when asked, and waits for the response head.
+  // Returns the HTTP status or an HTTPC_ERROR; the body then comes from
+  // readBody() (still compressed when gzipped()), or is skipped by end().
+  int get(const String& path, const char* etag = NULL, bool gzip = false) {
+    if (!up) {
+      return HTTPC_ERROR_NOT_CONNECTED;
+    }
+    uint32_t id = ++requestSeq;
+    String msg = "GET " + String(id) + " " + (etag && *etag ? String(etag) : String("-")) + " " + path;
+    if (gzip) {
+      msg += " gzip";
+    }
+    return request(id, OP_TEXT, (const uint8_t*)msg.c_str(), msg.length());
+  }
+
+  // get() for a compact request; only while isCompact()
+  int call(const WireRequest& req, const char* etag = NULL, bool gzip = false) {
+    if (!isCompact()) {
+      return HTTPC_ERROR_NOT_CONNECTED;
+    }
+    uint32_t id = ++requestSeq;
+    uint8_t* buf = (uint8_t*)malloc(req.size(etag ? strlen(etag) : 0));
+    if (!buf) {
+      return HTTPC_ERROR_TOO_LESS_RAM;
+    }
+    size_t len = req.encode(buf, id, etag, gzip);
+    int status = request(id, OP_BINARY, buf, len);
+    free(buf);
+    return status;
+  }
+
+  const String& etag() { return respEtag; }
+  bool gzipped() { return respGzip; }
+  // -1 for a streamed body, whose length is not known up front
+  int length() { return respStreamed ? -1 : (int)respLength; }
+
+  // Streams the body of the response get() returned into sink. Returns its
+  // length or an HTTPC_ERROR, like HttpBodyReader::read().
+  int readBody(Print& sink, unsigned long timeoutMs, unsigned long stallMs = HTTP_STALL_TIMEOUT_MS) {
+    bodySink = &sink;
+    unsigned long start = millis();
+    unsigned long lastData = start;
+    size_t seen = bodyRead;
+    int error = 0;
+    while (response != DONE && !error) {
+      pump();
+      if (!up) {
+        error = HTTPC_ERROR_CONNECTION_LOST;
+      } else if (bodyRead != seen) {
+        seen = bodyRead;
+        lastData = millis();
+      } else if (response != DONE) {
+        if (millis() - lastData > stallMs || millis() - start > timeoutMs) {
+          // the rest of the frame would still arrive: start over
+          drop();
+          error = HTTPC_ERROR_READ_TIMEOUT;
+        } else {
+          delay(1);
+        }
+      }
+    }
+    bodySink = NULL;
+    awaitedId = 0;
+    if (error) {
+      return error;
+    }
+    return bodyOverflow ? HTTPC_ERROR_TOO_LESS_RAM : (int)bodyRead;
+  }
+
+  // Moves what has arrived of the body into sink without waiting, for a body
+  // consumed as it streams. Returns the bytes moved; bodyDone() once it has
+  // all arrived, and the channel drops if it fails.
+  size_t pollBody(Print& sink) {
+    size_t before = bodyRead;
+    bodySink = &sink;
+    pump();
+    bodySink = NULL;
+    return bodyRead - before;
+  }
+
+  bool bodyDone() { return response == DONE; }
+
+  // Done with the response; a body not read is skipped as it arrives
+  void end() {
+    awaitedId = 0;
+    bodySink = NULL;
+    response = NONE;
+  }
+
+  // ========================================================================
+  // Dashboard
+  // ========================================================================
+
+  // The oldest pushed command not run yet
+  bool next(MailboxCommand* out) {
+    if (commandCount == 0) {
+      return false;
+    }
+    *out = commands[commandHead];
+    commandHead = (commandHead + 1) % MAILBOX_COMMANDS;
+    commandCount--;
+    return true;
+  }
+
+  bool sendResult(const String& json) {
+    if (!sendText("RESULT " + json)) {
+      return false;
+    }
+    stats.results++;
+    return true;
+  }
+
+  void log(const String& line) {
+    if (up) {
+      sendText("LOG " + line);
+    }
+  }
+
+  const ChannelStats& getStats() { return stats; }
+};
+
+#endif // CHANNEL_H
@@ -41,7 +41,179 @@
 #define WIFI_SCAN_TIMEOUT    10000  // 10 seconds for WiFi scan
 #define WIFI_CONNECT_TIMEOUT 20000  // 20 seconds to connect
 #define WIFI_RECONNECT_DELAY 5000   // 5 seconds between reconnect attempts
-#define POLL_INTERVAL_MS     5000   // 5 seconds between polling attempts
+#define POLL_INTERVAL_MS     5000   // longest gap between mailbox polls (server not holding them, or down)
+
+// ============================================================================
+// Program Downloads
+// ============================================================================
+
+#define MAX_PROGRAM_VAR_SIZE      24576  // roughly the free RAM of a TI-84 Plus
+#define PROGRAM_CHUNK_LEN         256    // socket -> link staging buffer
+#define PROGRAM_STREAM_TIMEOUT_MS 5000   // give up when the body stalls this long
+#define PROGRAM_FRAME_HEADER_LEN  10     // /programs/bundle: name[8] + size
+#define ASSET_NAME_LEN            16     // /programs/fetch, /image/fetch: longest name kept
+#define LINK_SESSION_MAX_VARS     16     // variables queued (and tracked) per session
+#define LINK_PACKET_RETRIES       3      // resends of one packet the calc rejected (ERR)
+#define LINK_VARIABLE_RETRIES     2      // restarts of a variable from its RTS
+#define LINK_REPLAY_LEN           MAX_PROGRAM_VAR_SIZE  // largest streamed variable recorded for resends (PSRAM)
+#define LINK_REPLAY_DRAM_LEN      2048   // ... on a board without PSRAM
+
+// ============================================================================
+// HTTP Pool
+// ============================================================================
+
+#define HTTP_POOL_SIZE            2      // commands + a program stream held by the link
+#define HTTP_POOL_IDLE_MS         60000  // under the server's 65 s keepAliveTimeout
+#define HTTP_RESPONSE_TIMEOUT_MS  30000  // wait for the headers (GPT answers are slow)
+#define HTTP_BODY_TIMEOUT_MS      20000  // whole body of a buffered response
+#define HTTP_STALL_TIMEOUT_MS     5000   // give up when a body stalls this long
+#define HTTP_READ_CHUNK_LEN       256    // socket -> sink staging buffer
+#define HTTP_UPLOAD_SLICE_LEN     4096   // bytes per socket write of a posted body (none copied)
+#define HTTP_HEAD_LINE_LEN        128    // status line and headers of a post's response
+
+// ============================================================================
+// Response Cache
+// ============================================================================
+
+#define CACHE_PSRAM_BYTES         (2 * 1024 * 1024)  // half of the AI Thinker's PSRAM
+#define CACHE_HEAP_BYTES          (32 * 1024)        // boards without PSRAM
+#define CACHE_MAX_ENTRIES         64
+#define CACHE_ENTRY_MAX_LEN       MAX_PROGRAM_VAR_SIZE
+#define CACHE_LIST_FRESH_MS       15000   // list pages served without asking
+#define CACHE_ITEM_FRESH_MS       300000  // images, programs and their names
+#define CACHE_FILL_STEP           1024    // first allocation for a body of unknown length
+
+// ============================================================================
+// Gzip (compressed response bodies)
+// ============================================================================
+
+#define GZIP_ENABLED              1      // 0: never ask for gzip
+#define GZIP_PATHS                { "/gpt/", "/chats/", "/programs/", "/image/list", "/batch" }
+#define GZIP_WINDOW_LEN           32768  // TINFL_LZ_DICT_SIZE; a power of two
+
+// ============================================================================
+// Prefetch (next list page and its first items, while the calculator is idle)
+// ============================================================================
+
+#define PREFETCH_QUEUE_LEN        8
+#define PREFETCH_ITEMS            2      // listed items prefetched per page
+#define PREFETCH_QUIET_MS         300    // link idle this long before prefetching
+#define PREFETCH_BACKOFF_MS       500    // pause after finding the link or network busy
+
+// ============================================================================
+// Batch (several cacheable GETs in one round trip)
+// ============================================================================
+
+#define BATCH_ENABLED             1      // 0: every GET goes out by itself
+#define BATCH_PATH                "/batch"
+#define BATCH_MAX_REQUESTS        6      // GETs per batch
+
+// ============================================================================
+// Mailbox (dashboard commands by long-polling /esp32/poll)
+// ============================================================================
+
+#define MAILBOX_PATH              "/esp32/poll"
+#define MAILBOX_HOLD_MS           20000  // how long the server may hold an empty poll
+#define MAILBOX_SLACK_MS          10000  // beyond the hold before a poll is given up
+#define MAILBOX_MIN_GAP_MS        250    // first backoff after a poll the server did not hold
+#define MAILBOX_COMMANDS          4      // commands taken per poll
+#define MAILBOX_COMMAND_LEN       128    // "NAME ARG ..." as queued on the dashboard
+#define MAILBOX_REPLY_LEN         (MAILBOX_COMMANDS * (MAILBOX_COMMAND_LEN + 12))
+#define MAILBOX_RESULTS_LEN       8192   // results held for the next poll
+#define MAILBOX_LINE_LEN          128    // status line and headers of the reply
+
+// ============================================================================
+// Channel (persistent WebSocket to the server, carrying requests and commands)
+// ============================================================================
+
+#define CHANNEL_ENABLED            1      // 0: plain HTTP requests and mailbox polling only
+#define CHANNEL_PATH               "/esp32/channel"
+#define CHANNEL_CONNECT_TIMEOUT_MS 5000   // connect + upgrade
+#define CHANNEL_PING_MS            15000  // heartbeat when nothing else was sent
+#define CHANNEL_DEAD_MS            40000  // nothing heard this long: reconnect
+#define CHANNEL_RETRY_MS           1000   // first reconnect delay, doubling
+#define CHANNEL_RETRY_MAX_MS       60000  // also the delay when the server has no channel
+#define CHANNEL_TEXT_LEN           512    // longest text message (commands, results)
+
+// ============================================================================
+// Link Scheduler
+// ============================================================================
+
+#define LINK_QUEUE_LEN            8      // pending silent transfers
+#define LINK_IDLE_QUIET_MS        100    // TIP/RING idle and no CBL2 traffic this long
+#define LINK_RETRY_MS             50     // between RTS attempts while the calc is busy
+#define LINK_TRANSFER_TIMEOUT_MS  30000  // drop a transfer the calc never accepts
+
+// ============================================================================
+// Tasks (link I/O and networking run on separate cores)
+// ============================================================================
+
+#define LINK_TASK_CORE        1      // CBL2 bit-banging and the onReceived/onRequest callbacks
+#define LINK_TASK_PRIORITY    20     // above everything on its core, below the WiFi driver
+#define LINK_TASK_STACK       6144
+#define NET_TASK_CORE         0      // commands and HTTP, next to the WiFi stack
+#define NET_TASK_PRIORITY     1
+#define NET_TASK_STACK        16384  // TLS handshakes need the room
+#define COMMAND_QUEUE_LEN     4      // jobs in flight (power of two)
+#define JOB_SLOTS             6      // jobs whose results are kept for S/E/Str1
+#define PROGRAM_RING_LEN      4096   // program body read ahead of the link (power of two)
+
+// ============================================================================
+// Variable Registry (results the calculator can Get( after a command)
+// ============================================================================
+
+// characters per string slot, in link order: Str1..Str9, then Str0
+// (Str2 carries list pages: up to 32 rows of 20 characters)
+#define VAR_STR_CAPACITY     { 256, 640, 128, 128, 128, 128, 128, 128, 128, 512 }
+#define VAR_STR_POOL_LEN     (256 + 640 + 7 * 128 + 512 + 10)
+// entries per list slot, L1..L6
+#define VAR_LIST_CAPACITY    { 64, 64, 32, 32, 32, 32 }
+#define VAR_LIST_POOL_LEN    (2 * 64 + 4 * 32)
+
+// ============================================================================
+// Paged Lists (program_list, image_list, fetch_chats, scan_networks)
+// ============================================================================
+
+#define LIST_PAGE_LEN          4    // entries per /programs/list and /image/list page
+#define LIST_PAGE_ENTRY_WIDTH  16   // characters per server list entry
+#define LIST_VALUES_LEN        64   // ids / RSSIs published in L1
+
+// ============================================================================
+// Streamed Answers (gpt, get_gpt_chunk)
+// ============================================================================
+
+#define ANSWER_PAGE_LEN        255    // characters per page: one command result (Str1)
+#define ANSWER_PAGES           16     // pages kept; the rest of a longer answer is dropped
+#define ANSWER_STALL_MS        15000  // give up on a stream that is silent this long
+
+// ============================================================================
+// Camera Profiles (pic for snap, vision for uploads to the model)
+// ============================================================================
+
+#define CAMERA_PIC_FORMAT          PIXFORMAT_GRAYSCALE  // or PIXFORMAT_YUV422, or PIXFORMAT_JPEG (decoded)
+#define CAMERA_PIC_FRAMESIZE       FRAMESIZE_QQVGA      // 160x120, enough to average down to 96x63
+#define CAMERA_PIC_JPEG_QUALITY    12
+#define CAMERA_VISION_FRAMESIZE    FRAMESIZE_VGA
+#define CAMERA_VISION_JPEG_QUALITY 10
+#define CAMERA_SETTLE_FRAMES       2    // dropped after a start while the exposure settles
+#define CAMERA_SESSION_FBS         2    // PSRAM frame buffers the sensor keeps filling in a session
+#define CAMERA_SESSION_IDLE_MS     30000  // no grab this long ends the session and idles the sensor
+
+// ============================================================================
+// Snapshots (snap)
+// ============================================================================
+
+#define SNAP_JPEG_SCALE            4    // a JPEG pic profile is decoded at 1/1, 1/2, 1/4 or 1/8 size
+#define PIC_STRETCH_CLIP_PERMILLE  10   // darkest and brightest pixels ignored by the contrast stretch
+#define PIC_STRETCH_MIN_RANGE      48   // levels a flat picture is stretched from, at least
+#define PIC_DITHER                 ErrorDiffusionDither  // or BayerDither, ThresholdDither (pic_dither.h)
+
+// ============================================================================
+// Vision (solve: a frame and a question to the model)
+// ============================================================================
+
+#define VISION_PATH                "/gpt/vision"
+#define VISION_BOUNDARY            "ti32-vision-frame-7c1f0a93e5d2b846"  // multipart boundary
 
 // ============================================================================
 // OTA Web Server Configuration
@@ -50,6 +222,7 @@
 #define OTA_SERVER_PORT      80
 #define OTA_UPDATE_PATH      "/update"
 #define OTA_STATUS_PATH      "/status"
+#define OTA_STATUS_SECTIONS  11 // extra objects in the /status JSON
 
 // ============================================================================
 // Default Values (Fallback from secrets.h)
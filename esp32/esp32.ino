@@ -13,12 +13,29 @@
 // ==========================================
 #include <Arduino.h>
 #include "esp_camera.h" // This library is built-in to the ESP32 Board package
+#include "img_converters.h"
 #include "./secrets.h"
 #include "./launcher.h"
 #include "./config.h"
 #include "./config_manager.h"
 #include "./wifi_manager.h"
 #include "./ota_manager.h"
+#include "./camera_manager.h"
+#include "./link_session.h"
+#include "./link_scheduler.h"
+#include "./var_registry.h"
+#include "./spsc_queue.h"
+#include "./http_body.h"
+#include "./http_pool.h"
+#include "./response_cache.h"
+#include "./prefetcher.h"
+#include "./mailbox.h"
+#include "./channel.h"
+#include "./inflate.h"
+#include "./answer_pages.h"
+#include "./batch.h"
+#include "./asset_frame.h"
+#include "./pic_pipeline.h"
 #include <TICL.h>
 #include <CBL2.h>
 #include <TIVar.h>
@@ -70,12 +87,33 @@ constexpr auto PICVARSIZE = PICSIZE + 2;
 constexpr auto PASSWORD = 42069;
 
 CBL2 cbl;
+LinkScheduler linkScheduler(TIP, RING);
 Preferences prefs;
 
 // Manager instances
 ConfigManager configMgr;
 WiFiManager wifiMgr(&configMgr);
 OTAManager otaMgr(&wifiMgr, &configMgr);
+CameraManager cameraMgr;
+LinkSession linkSession(&cbl);
+VarRegistry varRegistry;
+#ifdef SECURE
+typedef HttpPool<WiFiClientSecure> ServerPool;
+typedef Mailbox<WiFiClientSecure> ServerMailbox;
+typedef Channel<WiFiClientSecure> ServerChannel;
+#else
+typedef HttpPool<WiFiClient> ServerPool;
+typedef Mailbox<WiFiClient> ServerMailbox;
+typedef Channel<WiFiClient> ServerChannel;
+#endif
+ServerPool httpPool;
+ResponseCache responseCache;
+Prefetcher prefetcher;
+ServerMailbox mailbox;
+ServerChannel channel;
+GzipInflater inflater;
+AnswerPages answerPages;
+RequestBatch batch(responseCache);
 
 // Current SERVER URL (loaded from NVS or defaults to secrets.h)
 char currentServer[MAX_NGROK_URL_LEN] = {0};
@@ -90,28 +128,110 @@ int bootCount = 0;
 bool wifiConnected = false;
 char lastIP[16] = {0};
 
-// Arguments
-int currentArg = 0;
-char strArgs[MAXARGS][MAXSTRARGLEN];
-double realArgs[MAXARGS];
+// CBL2 and the onReceived/onRequest callbacks run on the link task, commands
+// and everything that touches the network on the network task, and the OTA
+// server on loopTask. A command travels to the network task as a
+// CommandRequest and comes back as a CommandResult; the two tasks share
+// nothing else while it runs.
+//
+// Each command is a job. Send(ID,C) starts one and makes its number readable
+// as J; Send(J) selects an earlier job, and S, E and Str1 always describe the
+// selected one. The calculator can start a job while others are still in
+// flight and collect each result when it is ready. The network task runs
+// them in order, since commands share the response buffers.
+TaskHandle_t linkTask = NULL;
+TaskHandle_t netTask = NULL;
+
+struct CommandRequest {
+  uint32_t seq;  // job number
+  int id;
+  int numArgs;
+  char strArgs[MAXARGS][MAXSTRARGLEN];
+  double realArgs[MAXARGS];
+};
+
+struct CommandResult {
+  uint32_t seq;
+  bool error;
+  char message[MAXSTRARGLEN];
+};
+
+SpscQueue<CommandRequest, COMMAND_QUEUE_LEN> commandQueue;  // link -> network
+SpscQueue<CommandResult, COMMAND_QUEUE_LEN> resultQueue;    // network -> link
+
+enum JobState : uint8_t { JOB_FREE, JOB_COLLECTING, JOB_QUEUED, JOB_DONE };
+
+struct Job {
+  uint32_t id;
+  JobState state;
+  bool error;                  // E
+  char message[MAXSTRARGLEN];  // Str1
+};
 
-// the command to execute
+// ---- link task ----
+// the command being collected, with its arguments
+CommandRequest incoming;
+// the command whose arguments are being collected, -1 when none
 int command = -1;
-// whether or not the operation has completed
-bool status = 0;
-// whether or not the operation failed
-bool error = 0;
-// error or success message
+Job jobs[JOB_SLOTS];
+uint32_t jobSeq = 0;
+uint32_t selectedJob = 0;  // 0 = none yet
+int commandsInFlight = 0;
+// a dashboard command is running on the network task (set there, read here)
+std::atomic<bool> dashboardRunning{false};
+// Str1 before the first job
+char resultMessage[MAXSTRARGLEN];
+
+// ---- network task ----
+// arguments of the running command
+char strArgs[MAXARGS][MAXSTRARGLEN];
+double realArgs[MAXARGS];
+// scratch for building a result message
 char message[MAXSTRARGLEN];
+CommandResult commandResult;
+bool commandFinished = false;
 // list data
 constexpr auto LISTLEN = 256;
 constexpr auto LISTENTRYLEN = 20;
 char list[LISTLEN][LISTENTRYLEN];
+int listCount = 0;
+// the calculator's Pic 1 and the list rows its Str2 serves (640 chars),
+// kept while a dashboard command borrows frame and list
+uint8_t dashboardFrame[PICVARSIZE];
+char dashboardList[32][LISTENTRYLEN];
+int dashboardListCount = 0;
 // http response
 constexpr auto MAXHTTPRESPONSELEN = 4096;
 char response[MAXHTTPRESPONSELEN];
 // image variable (96x63)
 uint8_t frame[PICVARSIZE] = { PICSIZE & 0xff, PICSIZE >> 8 };
+static_assert(PIC_BYTES == PICSIZE, "the pipeline renders a whole Pic");
+
+// snapshots: the frame as luma (a decoded JPEG is converted in place), and
+// what became of the last ones
+PicPipeline picPipeline;
+uint8_t* snapLuma = NULL;
+size_t snapLumaLen = 0;
+struct SnapStats {
+  uint32_t snaps = 0;
+  uint32_t failed = 0;
+  unsigned long captureMs = 0;  // the last snap's stages
+  unsigned long decodeMs = 0;
+  unsigned long renderUs = 0;
+  int width = 0;                // the luma it rendered from
+  int height = 0;
+} snapStats;
+
+// vision uploads (solve): the frame goes from the camera's buffer to the
+// socket as it is
+struct VisionStats {
+  uint32_t solves = 0;
+  uint32_t failed = 0;
+  size_t frameBytes = 0;        // the last upload's JPEG
+  unsigned long captureMs = 0;  // the last solve's stages
+  unsigned long uploadMs = 0;
+  unsigned long answerMs = 0;   // upload written .. response head
+} visionStats;
 
 // Context management for multi-modal interactions
 char contextBuffer[MAXHTTPRESPONSELEN];
@@ -137,6 +257,8 @@ void get_ngrok();
 void set_ngrok();
 void get_ip_address();
 void get_power_status();
+void get_gpt_chunk();
+void install_programs();
 
 struct Command {
   int id;
@@ -166,11 +288,14 @@ struct Command commands[] = {
   { 18, "get_ngrok", 0, get_ngrok, false },
   { 19, "set_ngrok", 1, set_ngrok, false },
   { 20, "get_ip_address", 0, get_ip_address, false },
-  { 21, "get_power_status", 0, get_power_status, false }
+  { 21, "get_power_status", 0, get_power_status, false },
+  { 23, "get_gpt_chunk", 1, get_gpt_chunk, false },
+  { 24, "install_programs", 0, install_programs, true }
 };
 
 constexpr int NUMCOMMANDS = sizeof(commands) / sizeof(struct Command);
-constexpr int MAXCOMMAND = 21;
+constexpr int MAXCOMMAND = 24;
+constexpr int GET_GPT_CHUNK = 23;  // runs while an answer is still streaming in
 
 uint8_t header[MAXHDRLEN];
 uint8_t data[MAXDATALEN];
@@ -191,37 +316,289 @@ int onReceived(uint8_t type, enum Endpoint model, int datalen);
 int onRequest(uint8_t type, enum Endpoint model, int* headerlen,
               int* datalen, data_callback* data_callback);
 
+// link task
+Job* findJob(uint32_t id) {
+  for (int i = 0; i < JOB_SLOTS; ++i) {
+    if (jobs[i].state != JOB_FREE && jobs[i].id == id) {
+      return &jobs[i];
+    }
+  }
+  return NULL;
+}
+
+// link task: what S, E and Str1 report for the job from now on
+void finishJob(Job* job, bool failed, const char* text) {
+  job->state = JOB_DONE;
+  job->error = failed;
+  snprintf(job->message, sizeof(job->message), "%s", text);
+}
+
+// link task: a free slot, else the oldest finished job's. There is always
+// one, since at most COMMAND_QUEUE_LEN jobs are in flight.
+Job* _allocJob() {
+  Job* oldest = NULL;
+  for (int i = 0; i < JOB_SLOTS; ++i) {
+    if (jobs[i].state == JOB_FREE) {
+      return &jobs[i];
+    }
+    if (jobs[i].state == JOB_DONE && (!oldest || jobs[i].id < oldest->id)) {
+      oldest = &jobs[i];
+    }
+  }
+  return oldest;
+}
+
+// link task
 void startCommand(int cmd) {
+  // a job still waiting for its arguments is dropped
+  if (command >= 0) {
+    Job* abandoned = findJob(incoming.seq);
+    if (abandoned) {
+      abandoned->state = JOB_FREE;
+    }
+  }
+  memset(&incoming, 0, sizeof(incoming));
+  incoming.id = cmd;
+  incoming.seq = ++jobSeq;
+  selectedJob = incoming.seq;
+
+  Job* job = _allocJob();
+  job->id = incoming.seq;
+  job->state = JOB_COLLECTING;
+  job->error = false;
+  strncpy(job->message, "no command", MAXSTRARGLEN);
   command = cmd;
-  status = 0;
-  error = 0;
-  currentArg = 0;
-  for (int i = 0; i < MAXARGS; ++i) {
-    memset(&strArgs[i], 0, MAXSTRARGLEN);
-    realArgs[i] = 0;
+  if (commandsInFlight >= COMMAND_QUEUE_LEN) {
+    finishJob(job, true, "too many jobs");
+    command = -1;
   }
-  strncpy(message, "no command", MAXSTRARGLEN);
+}
+
+// network task: the result is handed to the link task once the command returns
+void _setResult(bool failed, const char* text) {
+  commandResult.error = failed;
+  strncpy(commandResult.message, text, MAXSTRARGLEN - 1);
+  commandResult.message[MAXSTRARGLEN - 1] = '\0';
+  commandFinished = true;
 }
 
 void setError(const char* err) {
   Serial.print("ERROR: ");
   Serial.println(err);
-  error = 1;
-  status = 1;
-  command = -1;
-  strncpy(message, err, MAXSTRARGLEN);
+  _setResult(true, err);
 }
 
 void setSuccess(const char* success) {
   Serial.print("SUCCESS: ");
   Serial.println(success);
-  error = 0;
-  status = 1;
-  command = -1;
-  strncpy(message, success, MAXSTRARGLEN);
+  _setResult(false, success);
+}
+
+int sendProgramVariable(const char* name, uint8_t* program, size_t variableSize, data_callback callback = NULL);
+void _serviceProgramStream();
+bool _programQueued();
+bool _pumpAnswer();
+bool _runDashboardCommand();
+void _sendBatch();
+int fetchInto(String url, Print& sink, size_t* len, long cacheFreshMs = -1);
+void startTasks();
+
+// Connection reuse and timings for /status
+String httpStatusJson() {
+  const HttpPoolStats& h = httpPool.getStats();
+  String json = "{";
+  json += "\"requests\":" + String(h.requests) + ",";
+  json += "\"connects\":" + String(h.connects) + ",";
+  json += "\"reused\":" + String(h.reused) + ",";
+  json += "\"reconnects\":" + String(h.reconnects) + ",";
+  json += "\"failures\":" + String(h.failures) + ",";
+  json += "\"uploads\":" + String(h.uploads) + ",";
+  json += "\"lastConnectMs\":" + String(h.lastConnectMs) + ",";
+  json += "\"lastTtfbMs\":" + String(h.lastTtfbMs) + ",";
+  json += "\"lastUploadMs\":" + String(h.lastUploadMs);
+  json += "}";
+  return json;
+}
+
+// Link retry counters for /status
+String linkStatusJson() {
+  const LinkCounters& c = linkSession.getCounters();
+  String json = "{";
+  json += "\"sessions\":" + String((uint32_t)c.sessions) + ",";
+  json += "\"variables\":" + String((uint32_t)c.variables) + ",";
+  json += "\"bytes\":" + String((uint32_t)c.bytes) + ",";
+  json += "\"checksumErrors\":" + String((uint32_t)c.checksumErrors) + ",";
+  json += "\"packetRetries\":" + String((uint32_t)c.packetRetries) + ",";
+  json += "\"variableRestarts\":" + String((uint32_t)c.variableRestarts) + ",";
+  json += "\"failures\":" + String((uint32_t)c.failures) + ",";
+  json += "\"queued\":" + String(linkScheduler.pending());
+  json += "}";
+  return json;
+}
+
+// Response cache hits and memory for /status
+String cacheStatusJson() {
+  const ResponseCacheStats& c = responseCache.getStats();
+  String json = "{";
+  json += "\"hits\":" + String(c.hits) + ",";
+  json += "\"revalidated\":" + String(c.revalidated) + ",";
+  json += "\"misses\":" + String(c.misses) + ",";
+  json += "\"stored\":" + String(c.stored) + ",";
+  json += "\"evicted\":" + String(c.evicted) + ",";
+  json += "\"entries\":" + String(c.entries) + ",";
+  json += "\"bytes\":" + String(c.bytes) + ",";
+  json += "\"budget\":" + String(c.budget);
+  json += "}";
+  return json;
+}
+
+// Prefetch predictions and how many paid off, for /status
+String prefetchStatusJson() {
+  const PrefetchStats& p = prefetcher.getStats();
+  const ResponseCacheStats& c = responseCache.getStats();
+  String json = "{";
+  json += "\"queued\":" + String(p.queued) + ",";
+  json += "\"fetched\":" + String(p.fetched) + ",";
+  json += "\"fresh\":" + String(p.fresh) + ",";
+  json += "\"failed\":" + String(p.failed) + ",";
+  json += "\"dropped\":" + String(p.dropped) + ",";
+  json += "\"backoffs\":" + String(p.backoffs) + ",";
+  json += "\"hits\":" + String(c.prefetchHits) + ",";
+  json += "\"wasted\":" + String(c.prefetchWasted) + ",";
+  json += "\"hitRate\":" + String(p.fetched ? 100 * c.prefetchHits / p.fetched : 0);
+  json += "}";
+  return json;
+}
+
+// Dashboard polls and how quickly they come back, for /status
+String mailboxStatusJson() {
+  const MailboxStats& m = mailbox.getStats();
+  String json = "{";
+  json += "\"polls\":" + String(m.polls) + ",";
+  json += "\"held\":" + String(m.held) + ",";
+  json += "\"commands\":" + String(m.commands) + ",";
+  json += "\"results\":" + String(m.results) + ",";
+  json += "\"droppedResults\":" + String(m.droppedResults) + ",";
+  json += "\"batches\":" + String(m.batches) + ",";
+  json += "\"failures\":" + String(m.failures) + ",";
+  json += "\"gapMs\":" + String(m.gapMs) + ",";
+  json += "\"lastPollMs\":" + String(m.lastPollMs);
+  json += "}";
+  return json;
+}
+
+// The persistent server connection, for /status
+String channelStatusJson() {
+  const ChannelStats& c = channel.getStats();
+  String json = "{";
+  json += "\"up\":" + String(channel.isUp() ? "true" : "false") + ",";
+  json += "\"connects\":" + String(c.connects) + ",";
+  json += "\"drops\":" + String(c.drops) + ",";
+  json += "\"requests\":" + String(c.requests) + ",";
+  json += "\"commands\":" + String(c.commands) + ",";
+  json += "\"refused\":" + String(c.refused) + ",";
+  json += "\"results\":" + String(c.results) + ",";
+  json += "\"pings\":" + String(c.pings) + ",";
+  json += "\"lastRttMs\":" + String(c.lastRttMs);
+  json += "}";
+  return json;
+}
+
+// Capture profiles, for /status
+String cameraStatusJson() {
+  const CameraStats& c = cameraMgr.getStats();
+  String json = "{";
+  json += "\"profile\":\"" + String(cameraProfiles[cameraMgr.current()].name) + "\",";
+  json += "\"active\":" + String(cameraMgr.active() ? "true" : "false") + ",";
+  json += "\"sessions\":" + String(c.sessions) + ",";
+  json += "\"grabs\":" + String(c.grabs) + ",";
+  json += "\"failed\":" + String(c.failed) + ",";
+  json += "\"switches\":" + String(c.switches) + ",";
+  json += "\"switchFailures\":" + String(c.switchFailures) + ",";
+  json += "\"switchMs\":" + String(c.switchMs) + ",";
+  json += "\"frameAgeMs\":" + String(c.frameAgeMs);
+  json += "}";
+  return json;
+}
+
+// Snapshots, for /status
+String snapStatusJson() {
+  const PicStats& p = picPipeline.getStats();
+  String json = "{";
+  json += "\"snaps\":" + String(snapStats.snaps) + ",";
+  json += "\"failed\":" + String(snapStats.failed) + ",";
+  json += "\"captureMs\":" + String(snapStats.captureMs) + ",";
+  json += "\"decodeMs\":" + String(snapStats.decodeMs) + ",";
+  json += "\"renderUs\":" + String(snapStats.renderUs) + ",";
+  json += "\"source\":\"" + String(snapStats.width) + "x" + String(snapStats.height) + "\",";
+  json += "\"stretch\":[" + String(p.low) + "," + String(p.high) + "],";
+  json += "\"dark\":" + String(p.dark);
+  json += "}";
+  return json;
+}
+
+// Vision uploads, for /status
+String visionStatusJson() {
+  String json = "{";
+  json += "\"solves\":" + String(visionStats.solves) + ",";
+  json += "\"failed\":" + String(visionStats.failed) + ",";
+  json += "\"frameBytes\":" + String((unsigned long)visionStats.frameBytes) + ",";
+  json += "\"captureMs\":" + String(visionStats.captureMs) + ",";
+  json += "\"uploadMs\":" + String(visionStats.uploadMs) + ",";
+  json += "\"answerMs\":" + String(visionStats.answerMs);
+  json += "}";
+  return json;
+}
+
+// Compressed responses, for /status
+String gzipStatusJson() {
+  const GzipStats& g = inflater.getStats();
+  String json = "{";
+  json += "\"responses\":" + String(g.responses) + ",";
+  json += "\"failures\":" + String(g.failures) + ",";
+  json += "\"compressedBytes\":" + String(g.compressedBytes) + ",";
+  json += "\"decodedBytes\":" + String(g.decodedBytes) + ",";
+  json += "\"savedBytes\":" + String((long)g.decodedBytes - (long)g.compressedBytes) + ",";
+  json += "\"inflateMs\":" + String(g.inflateUs / 1000);
+  json += "}";
+  return json;
+}
+
+// GETs that shared a round trip, for /status
+String batchStatusJson() {
+  const BatchStats& b = batch.getStats();
+  String json = "{";
+  json += "\"batches\":" + String(b.batches) + ",";
+  json += "\"requests\":" + String(b.requests) + ",";
+  json += "\"filed\":" + String(b.filed) + ",";
+  json += "\"revalidated\":" + String(b.revalidated) + ",";
+  json += "\"failed\":" + String(b.failed) + ",";
+  json += "\"unsupported\":" + String(b.unsupported) + ",";
+  json += "\"roundTripsSaved\":" + String(b.requests - b.batches);
+  json += "}";
+  return json;
 }
 
-int sendProgramVariable(const char* name, uint8_t* program, size_t variableSize);
+// What the dashboard's status panel shows (GET_STATUS)
+String dashboardStatusJson() {
+  unsigned long s = millis() / 1000;
+  char uptime[32];
+  snprintf(uptime, sizeof(uptime), "%lud %02lu:%02lu:%02lu", s / 86400, s / 3600 % 24, s / 60 % 60, s % 60);
+  String json = "{\"device\":{";
+  json += "\"uptime_formatted\":\"" + String(uptime) + "\",";
+  json += "\"free_heap\":" + String(ESP.getFreeHeap()) + ",";
+  json += "\"boot_count\":" + String(bootCount);
+  json += "},\"wifi\":{";
+  json += "\"ssid\":\"" + WiFi.SSID() + "\",";
+  json += "\"ip\":\"" + WiFi.localIP().toString() + "\",";
+  json += "\"rssi\":" + String(WiFi.RSSI());
+  json += "},\"server\":{";
+  json += "\"ngrok_url\":\"" + String(currentServer) + "\",";
+  json += "\"poll_interval_ms\":" + String(mailbox.getStats().gapMs) + ",";
+  json += "\"long_poll_ms\":" + String(MAILBOX_HOLD_MS);
+  json += "}}";
+  return json;
+}
 
 bool camera_sign = false;
 
@@ -262,6 +639,10 @@ void setup() {
   }
   Serial.print("[Setup] Current SERVER: ");
   Serial.println(currentServer);
+  httpPool.setAuthorization(HTTP_USERNAME, HTTP_PASSWORD);
+  mailbox.setAuthorization(HTTP_USERNAME, HTTP_PASSWORD);
+  channel.setAuthorization(HTTP_USERNAME, HTTP_PASSWORD);
+  responseCache.begin();
 
   // ========================================================================
   // Connect to WiFi (with NVS credentials or fallback to secrets.h)
@@ -299,6 +680,17 @@ void setup() {
   // ========================================================================
   Serial.println("[Setup] Starting OTA Web Server...");
   otaMgr.begin();
+  otaMgr.addStatusSection("link", linkStatusJson);
+  otaMgr.addStatusSection("http", httpStatusJson);
+  otaMgr.addStatusSection("cache", cacheStatusJson);
+  otaMgr.addStatusSection("prefetch", prefetchStatusJson);
+  otaMgr.addStatusSection("mailbox", mailboxStatusJson);
+  otaMgr.addStatusSection("channel", channelStatusJson);
+  otaMgr.addStatusSection("gzip", gzipStatusJson);
+  otaMgr.addStatusSection("batch", batchStatusJson);
+  otaMgr.addStatusSection("snap", snapStatusJson);
+  otaMgr.addStatusSection("camera", cameraStatusJson);
+  otaMgr.addStatusSection("vision", visionStatusJson);
   otaMgr.printInfo();
 
   // ========================================================================
@@ -326,64 +718,371 @@ void setup() {
   config.pin_pwdn = PWDN_GPIO_NUM;
   config.pin_reset = RESET_GPIO_NUM;
   config.xclk_freq_hz = 20000000;
-  config.pixel_format = PIXFORMAT_JPEG;
-  config.frame_size = FRAMESIZE_VGA;
-  config.jpeg_quality = 10;
-  config.fb_count = 1;
-
-  esp_err_t err = esp_camera_init(&config);
-  if (err != ESP_OK) {
-    Serial.printf("Camera init failed with error 0x%x", err);
+
+  // format, frame size and buffers come from the profile and the session;
+  // the sensor idles until the first snap
+  if (!cameraMgr.begin(config, CAMERA_PROFILE_PIC)) {
+    Serial.println("Camera init failed");
     return;
   }
   Serial.println("[Setup] Camera initialized successfully");
   #endif
 
-  strncpy(message, "default message", MAXSTRARGLEN);
+  strncpy(resultMessage, "default message", MAXSTRARGLEN);
   delay(100);
   memset(data, 0, MAXDATALEN);
   memset(header, 0, 16);
+  startTasks();
   Serial.println("[ready]");
 }
 
-void (*queued_action)() = NULL;
+// ============================================================================
+// Link and Network Tasks
+// ============================================================================
 
-void loop() {
-  // Handle OTA web server requests (non-blocking)
-  otaMgr.handleClient();
+// Hands the collected command to the network task once all of its
+// arguments have arrived
+void _dispatchCommand() {
+  if (command < 0) {
+    return;
+  }
+  for (int i = 0; i < NUMCOMMANDS; ++i) {
+    if (commands[i].id == command && commands[i].num_args == incoming.numArgs) {
+      // cannot fail: startCommand refuses jobs beyond COMMAND_QUEUE_LEN
+      commandQueue.push(incoming);
+      ++commandsInFlight;
+      findJob(incoming.seq)->state = JOB_QUEUED;
+      command = -1;
+      return;
+    }
+  }
+}
 
-  // Polling logic
-  // The original working code did not have polling. 
-  // We'll leave it out for now to isolate the issue.
-
-  if (queued_action) {
-    // dont ask me why you need this, but it fails otherwise.
-    // probably relates to a CBL2 timeout thing?
-    delay(1000);
-    Serial.println("executing queued actions");
-    // dont ask me
-    void (*tmp)() = queued_action;
-    queued_action = NULL;
-    tmp();
-  }
-  if (command >= 0 && command <= MAXCOMMAND) {
-    for (int i = 0; i < NUMCOMMANDS; ++i) {
-      if (commands[i].id == command && commands[i].num_args == currentArg) {
-        if (commands[i].wifi && !WiFi.isConnected()) {
-          setError("wifi not connected");
-        } else {
-          Serial.print("processing command: ");
-          Serial.println(commands[i].name);
-          commands[i].command_fp();
-        }
+// Everything that drives TIP/RING. Never waits on the network.
+void linkStep() {
+  cbl.eventLoopTick();
+  _dispatchCommand();
+
+  CommandResult done;
+  while (resultQueue.pop(&done)) {
+    --commandsInFlight;
+    finishJob(findJob(done.seq), done.error, done.message);
+  }
+
+  // start queued transfers once the calculator has let go of the link
+  linkScheduler.tick();
+}
+
+// Warms the response cache with one prediction while the calculator is busy
+// displaying and nothing else needs the network or the link
+void _prefetchStep() {
+  if (!prefetcher.pending()) {
+    return;
+  }
+  bool busy = !commandQueue.empty() || _programQueued() || linkScheduler.pending() > 0 ||
+              linkScheduler.quietMs() < PREFETCH_QUIET_MS || !WiFi.isConnected();
+  if (busy) {
+    prefetcher.backOff();
+    return;
+  }
+  // the predictions of a page go out together when the server takes batches
+  int take = BATCH_ENABLED && batch.usable(currentServer) ? BATCH_MAX_REQUESTS : 1;
+  String url;
+  unsigned long freshMs;
+  unsigned long urlFreshMs = 0;
+  batch.clear();
+  while (batch.size() < take && prefetcher.next(&url, &freshMs)) {
+    if (batch.add(url, freshMs)) {
+      urlFreshMs = freshMs;
+    } else {
+      prefetcher.noteFresh();
+    }
+  }
+  if (batch.size() == 0) {
+    return;
+  }
+  Serial.print("[Prefetch] ");
+  responseCache.setPrefetching(true);
+  if (batch.size() > 1) {
+    _sendBatch();
+    for (int i = 0; i < batch.size(); ++i) {
+      prefetcher.noteFetched(batch.served(i));
+    }
+  } else {
+    NullPrint sink;
+    size_t len = 0;
+    int code = fetchInto(batch.url(0), sink, &len, urlFreshMs);
+    prefetcher.noteFetched(code == 0);
+  }
+  responseCache.setPrefetching(false);
+}
+
+// The cacheable GETs a queued command is going to make, built exactly as
+// the command builds them
+void _planRequests(const CommandRequest* req) {
+  String id = urlEncode(String((int)req->realArgs[0]));
+  String server = currentServer;
+  switch (req->id) {
+    case 9:  // image_list
+      batch.add(server + "/image/list?p=" + id, CACHE_LIST_FRESH_MS);
+      break;
+    case 10:  // fetch_image
+      batch.add(server + "/image/fetch?id=" + id, CACHE_ITEM_FRESH_MS);
+      break;
+    case 13:  // program_list
+      batch.add(server + "/programs/list?p=" + id, CACHE_LIST_FRESH_MS);
+      break;
+    case 14:  // fetch_program
+      batch.add(server + "/programs/fetch?id=" + id, CACHE_ITEM_FRESH_MS);
+      break;
+  }
+}
+
+// Sends the GETs collected in the batch as one request into the response
+// cache. A single GET is left to go out by itself.
+void _sendBatch() {
+  if (batch.size() < 2) {
+    return;
+  }
+  Serial.print("[Batch] ");
+  Serial.print(batch.size());
+  Serial.print(" GETs: ");
+  batch.begin();
+  size_t len = 0;
+  int code = fetchInto(batch.request(currentServer), batch, &len);
+  batch.finish(code, currentServer);
+}
+
+// Before the next command runs: what it and the commands queued behind it
+// will GET, in one round trip
+void _batchQueued() {
+  if (!BATCH_ENABLED || !batch.usable(currentServer) || !WiFi.isConnected()) {
+    return;
+  }
+  batch.clear();
+  for (size_t i = 0; CommandRequest* req = commandQueue.peek(i); ++i) {
+    _planRequests(req);
+  }
+  _sendBatch();
+}
+
+// Runs one entry of commands[] with strArgs/realArgs already set; the
+// outcome is left in commandResult. A dashboard command leaves the
+// calculator's variable slots as they were: its results only go back to
+// the dashboard.
+void _runCommand(int id, int numArgs, bool dashboard = false) {
+  commandFinished = false;
+  if (dashboard) {
+    // not one of the calculator's jobs
+    commandResult.seq = 0;
+    varRegistry.mute(true);
+  } else {
+    varRegistry.beginCommand();
+  }
+  for (int i = 0; i < NUMCOMMANDS; ++i) {
+    if (commands[i].id == id && commands[i].num_args == numArgs) {
+      if (commands[i].wifi && !WiFi.isConnected()) {
+        setError("wifi not connected");
+      } else {
+        Serial.print("processing command: ");
+        Serial.println(commands[i].name);
+        commands[i].command_fp();
       }
     }
   }
-  cbl.eventLoopTick();
+  if (!commandFinished) {
+    setError("command did not finish");
+  }
+  varRegistry.mute(false);
+  channel.log(String(commandResult.error ? "failed: " : "done: ") + commandResult.message);
+}
+
+// A dashboard result goes back the way its command came. One the channel
+// cannot send any more waits for the next mailbox poll.
+void _dashboardResult(bool pushed, uint32_t id, bool error, const char* text, const char* data = NULL) {
+  String json = ServerMailbox::resultJson(id, error, text, data);
+  if (!pushed || !channel.sendResult(json)) {
+    mailbox.addResultJson(json);
+  }
+}
+
+// Marks a dashboard command in flight, as long as the calculator has left
+// the link alone for LINK_IDLE_QUIET_MS. onRequest notes activity before it
+// reads the flag, and both are sequentially consistent, so either it sees
+// the command and holds back the buffers the command writes, or the command
+// sees it and waits.
+bool _claimDashboard() {
+  dashboardRunning = true;
+  if (linkScheduler.quietMs() < LINK_IDLE_QUIET_MS) {
+    dashboardRunning = false;
+    return false;
+  }
+  return true;
+}
+
+// Runs one command the dashboard queued, pushed over the channel or taken
+// by a mailbox poll, when the calculator leaves the network task and the
+// link free. It runs in flight like a calculator command, and whatever it
+// puts in frame and list is undone afterwards.
+bool _runMailboxCommand() {
+  if (_programQueued() || !_claimDashboard()) {
+    return false;
+  }
+  memcpy(dashboardFrame, frame, sizeof(frame));
+  memcpy(dashboardList, list, sizeof(dashboardList));
+  dashboardListCount = listCount;
+  bool ran = _runDashboardCommand();
+  memcpy(frame, dashboardFrame, sizeof(frame));
+  memcpy(list, dashboardList, sizeof(dashboardList));
+  listCount = dashboardListCount;
+  dashboardRunning = false;
+  return ran;
+}
+
+// "SCAN_NETWORKS" or "SET_NGROK https://..." name an entry of commands[];
+// each argument is passed both as a string and as a number. GET_STATUS
+// answers with the dashboard's status panel.
+bool _runDashboardCommand() {
+  MailboxCommand cmd;
+  bool pushed = channel.next(&cmd);
+  if (!pushed && !mailbox.next(&cmd)) {
+    return false;
+  }
+  Serial.print("[Mailbox] ");
+  Serial.println(cmd.text);
+  char* save = NULL;
+  const char* name = strtok_r(cmd.text, " ", &save);
+  int numArgs = 0;
+  memset(strArgs, 0, sizeof(strArgs));
+  memset(realArgs, 0, sizeof(realArgs));
+  for (char* arg = strtok_r(NULL, " ", &save); arg; arg = strtok_r(NULL, " ", &save)) {
+    if (numArgs == MAXARGS) {
+      _dashboardResult(pushed, cmd.id, true, "too many arguments");
+      return true;
+    }
+    strncpy(strArgs[numArgs], arg, MAXSTRARGLEN - 1);
+    realArgs[numArgs] = atof(arg);
+    ++numArgs;
+  }
+  if (!name) {
+    _dashboardResult(pushed, cmd.id, true, "no command");
+    return true;
+  }
+  if (strcasecmp(name, "GET_STATUS") == 0) {
+    _dashboardResult(pushed, cmd.id, false, "status", dashboardStatusJson().c_str());
+    return true;
+  }
+  for (int i = 0; i < NUMCOMMANDS; ++i) {
+    if (strcasecmp(commands[i].name, name) != 0) {
+      continue;
+    }
+    if (commands[i].num_args != numArgs) {
+      snprintf(message, MAXSTRARGLEN, "%s takes %d arguments", commands[i].name, commands[i].num_args);
+      _dashboardResult(pushed, cmd.id, true, message);
+      return true;
+    }
+    _runCommand(commands[i].id, numArgs, true);
+    _dashboardResult(pushed, cmd.id, commandResult.error, commandResult.message);
+    return true;
+  }
+  _dashboardResult(pushed, cmd.id, true, "unknown command");
+  return true;
+}
+
+// Commands, the program stream, the dashboard and prefetching. Calculator
+// commands go first, after one batch of the GETs the queued ones will make.
+// The mailbox is only polled while the channel is down.
+// While a gpt answer is still streaming in, only requests for its pages run.
+void netStep() {
+  cameraMgr.step();
+  _serviceProgramStream();
+  bool answering = _pumpAnswer();
+  if (WiFi.isConnected()) {
+    if (CHANNEL_ENABLED) {
+      channel.step(currentServer);
+    }
+    if (!channel.isUp()) {
+      mailbox.step(currentServer);
+    }
+  }
+
+  CommandRequest* req = commandQueue.peek();
+  if (answering && (!req || req->id != GET_GPT_CHUNK)) {
+    return;
+  }
+  if (!req) {
+    if (!_runMailboxCommand()) {
+      _prefetchStep();
+    }
+    return;
+  }
+  if (!answering) {
+    _batchQueued();
+  }
+  memcpy(strArgs, req->strArgs, sizeof(strArgs));
+  memcpy(realArgs, req->realArgs, sizeof(realArgs));
+  int id = req->id;
+  int numArgs = req->numArgs;
+  commandResult.seq = req->seq;
+  commandQueue.pop();
+
+  _runCommand(id, numArgs);
+  // cannot fail: the link task keeps at most COMMAND_QUEUE_LEN in flight
+  resultQueue.push(commandResult);
+  // the calculator is about to collect the result
+  prefetcher.backOff();
+}
+
+void linkTaskMain(void*) {
+  for (;;) {
+    linkStep();
+    vTaskDelay(1);
+  }
+}
+
+void netTaskMain(void*) {
+  for (;;) {
+    netStep();
+    vTaskDelay(1);
+  }
+}
+
+// Both tasks or neither: without them loop() runs the two halves in turn
+void startTasks() {
+  if (xTaskCreatePinnedToCore(linkTaskMain, "link", LINK_TASK_STACK, NULL, LINK_TASK_PRIORITY, &linkTask,
+                              LINK_TASK_CORE) != pdPASS) {
+    linkTask = NULL;
+    Serial.println("[Tasks] No link task, running link and network from loop()");
+    return;
+  }
+  if (xTaskCreatePinnedToCore(netTaskMain, "net", NET_TASK_STACK, NULL, NET_TASK_PRIORITY, &netTask,
+                              NET_TASK_CORE) != pdPASS) {
+    vTaskDelete(linkTask);
+    linkTask = NULL;
+    netTask = NULL;
+    Serial.println("[Tasks] No network task, running link and network from loop()");
+    return;
+  }
+  Serial.print("[Tasks] Link on core ");
+  Serial.print(LINK_TASK_CORE);
+  Serial.print(", network on core ");
+  Serial.println(NET_TASK_CORE);
+}
+
+void loop() {
+  // never behind a command: those run on the network task
+  otaMgr.handleClient();
+  if (!netTask) {
+    netStep();
+    linkStep();
+    return;
+  }
+  delay(1);
 }
 
 int onReceived(uint8_t type, enum Endpoint model, int datalen) {
   char varName = header[3];
+  linkScheduler.noteActivity();
 
   Serial.print("unlocked: ");
   Serial.println(unlocked);
@@ -404,6 +1103,15 @@ int onReceived(uint8_t type, enum Endpoint model, int datalen) {
     return -1;
   }
 
+  // select the job that S, E and Str1 report
+  if (varName == 'J') {
+    if (type != VarTypes82::VarReal) {
+      return -1;
+    }
+    selectedJob = TIVar::realToLong8x(data, model);
+    return 0;
+  }
+
   // check for command
   if (varName == 'C') {
     if (type != VarTypes82::VarReal) {
@@ -422,37 +1130,44 @@ int onReceived(uint8_t type, enum Endpoint model, int datalen) {
     }
   }
 
+  int currentArg = incoming.numArgs;
   if (currentArg >= MAXARGS) {
     Serial.println("argument overflow");
-    setError("argument overflow");
+    if (command >= 0) {
+      finishJob(findJob(incoming.seq), true, "argument overflow");
+      command = -1;
+    }
     return -1;
   }
 
   switch (type) {
     case VarTypes82::VarString:
       Serial.print("len: ");
-      strncpy(strArgs[currentArg++], TIVar::strVarToString8x(data, model).c_str(), MAXSTRARGLEN);
-      fixStrVar(strArgs[currentArg - 1]);
+      strncpy(incoming.strArgs[currentArg], TIVar::strVarToString8x(data, model).c_str(), MAXSTRARGLEN - 1);
+      fixStrVar(incoming.strArgs[currentArg]);
       Serial.print("Str");
-      Serial.print(currentArg - 1);
+      Serial.print(currentArg);
       Serial.print(" ");
-      Serial.println(strArgs[currentArg - 1]);
+      Serial.println(incoming.strArgs[currentArg]);
       break;
     case VarTypes82::VarReal:
-      realArgs[currentArg++] = TIVar::realToFloat8x(data, model);
+      incoming.realArgs[currentArg] = TIVar::realToFloat8x(data, model);
       Serial.print("Real");
-      Serial.print(currentArg - 1);
+      Serial.print(currentArg);
       Serial.print(" ");
-      Serial.println(realArgs[currentArg - 1]);
+      Serial.println(incoming.realArgs[currentArg]);
       break;
     default:
       // maybe set error here?
       return -1;
   }
+  incoming.numArgs = currentArg + 1;
   return 0;
 }
 
 uint8_t frameCallback(int idx) {
+  // a Pic still going out keeps dashboard commands off frame
+  linkScheduler.noteActivity();
   return frame[idx];
 }
 
@@ -462,16 +1177,31 @@ char varIndex(int idx) {
 
 int onRequest(uint8_t type, enum Endpoint model, int* headerlen, int* datalen, data_callback* data_callback) {
   char varName = header[3];
+  linkScheduler.noteActivity();
   char strIndex = header[4];
   char strname[5] = { 'S', 't', 'r', varIndex(strIndex), 0x00 };
   char picname[5] = { 'P', 'i', 'c', varIndex(strIndex), 0x00 };
   Serial.print("request for ");
   Serial.println(varName == 0xaa ? strname : varName == 0x60 ? picname
                                                              : (const char*)&header[3]);
+  // results published by the last command take precedence over the defaults
+  // below. The network task writes them (and frame) while a command runs,
+  // the calculator's or the dashboard's, so until it is done only S, E, J
+  // and Str1 are served.
+  bool commandRunning = command >= 0 || commandsInFlight > 0 || dashboardRunning;
+  // before the first job: S = 0, E = 0, the default message
+  const Job* job = findJob(selectedJob);
+  const Job noJob = { selectedJob, JOB_DONE, true, "no such job" };
+  if (!job && selectedJob != 0) {
+    job = &noJob;
+  }
+  if (!commandRunning && varRegistry.serve(type, model, header, data, MAXDATALEN, headerlen, datalen)) {
+    return 0;
+  }
   memset(header, 0, sizeof(header));
   switch (varName) {
     case 0x60:
-      if (type != VarTypes82::VarPic) {
+      if (type != VarTypes82::VarPic || commandRunning) {
         return -1;
       }
       *datalen = PICVARSIZE;
@@ -485,8 +1215,9 @@ int onRequest(uint8_t type, enum Endpoint model, int* headerlen, int* datalen, d
       if (type != VarTypes82::VarString) {
         return -1;
       }
-      // TODO right now, the only string variable will be the message, but ill need to allow for other vars later
-      *datalen = TIVar::stringToStrVar8x(String(message), data, model);
+      // strings a command published were served from varRegistry above;
+      // any other Str gets the selected job's message
+      *datalen = TIVar::stringToStrVar8x(String(!job ? resultMessage : job->state == JOB_DONE ? job->message : "no command"), data, model);
       TIVar::intToSizeWord(*datalen, header);
       header[2] = VarTypes82::VarString;
       header[3] = 0xAA;
@@ -498,18 +1229,29 @@ int onRequest(uint8_t type, enum Endpoint model, int* headerlen, int* datalen, d
       if (type != VarTypes82::VarReal) {
         return -1;
       }
-      *datalen = TIVar::longToReal8x(error, data, model);
+      *datalen = TIVar::longToReal8x(job && job->state == JOB_DONE && job->error, data, model);
       TIVar::intToSizeWord(*datalen, header);
       header[2] = VarTypes82::VarReal;
       header[3] = 'E';
       header[4] = '\0';
       *headerlen = 13;
       break;
+    case 'J':
+      if (type != VarTypes82::VarReal) {
+        return -1;
+      }
+      *datalen = TIVar::longToReal8x(selectedJob, data, model);
+      TIVar::intToSizeWord(*datalen, header);
+      header[2] = VarTypes82::VarReal;
+      header[3] = 'J';
+      header[4] = '\0';
+      *headerlen = 13;
+      break;
     case 'S':
       if (type != VarTypes82::VarReal) {
         return -1;
       }
-      *datalen = TIVar::longToReal8x(status, data, model);
+      *datalen = TIVar::longToReal8x(job && job->state == JOB_DONE, data, model);
       TIVar::intToSizeWord(*datalen, header);
       header[2] = VarTypes82::VarReal;
       header[3] = 'S';
@@ -522,52 +1264,149 @@ int onRequest(uint8_t type, enum Endpoint model, int* headerlen, int* datalen, d
   return 0;
 }
 
-int makeRequest(String url, char* result, int resultLen, size_t* len) {
-  memset(result, 0, resultLen);
+// The decoded length of a gzip body the reader returned read for. A sink
+// that overflowed or corrupt data fail the read as TOO_LESS_RAM; the
+// inflater tells them apart.
+int _finishGzip(int read) {
+  int decoded = inflater.finish();
+  return read >= 0 || read == HTTPC_ERROR_TOO_LESS_RAM ? decoded : read;
+}
 
-#ifdef SECURE
-  WiFiClientSecure client;
-  client.setInsecure();
-#else
-  WiFiClient client;
-#endif
-  HTTPClient http;
-  http.setAuthorization(HTTP_USERNAME, HTTP_PASSWORD);
+// Done with a response from httpPool (conn) or the channel (NULL)
+void _releaseResponse(ServerPool::Conn* conn) {
+  if (conn) {
+    httpPool.release(conn);
+  } else {
+    channel.end();
+  }
+}
 
-  Serial.println(url);
-  http.begin(client, url.c_str());
+// GETs url and streams the body into sink. Returns 0 with *len set to the
+// body length, the HTTP status when it is not 200, or an HTTPC_ERROR.
+// With cacheFreshMs >= 0 the response goes through responseCache: a copy
+// younger than that is served without a request, an older one is
+// revalidated.
+int fetchInto(String url, Print& sink, size_t* len, long cacheFreshMs) {
+  ResponseCache::Entry* cached = cacheFreshMs >= 0 ? responseCache.find(url) : NULL;
+  if (cached && responseCache.fresh(cached, cacheFreshMs)) {
+    Serial.print(url);
+    Serial.println(" (cached)");
+    responseCache.hit(cached);
+    *len = cached->len;
+    return responseCache.serve(cached, sink) ? 0 : HTTPC_ERROR_TOO_LESS_RAM;
+  }
 
-  // Send HTTP GET request
-  int httpResponseCode = http.GET();
+  Serial.println(url);
+  // over the channel while it is up; it only reaches the current server
+  bool ours = url.startsWith(currentServer);
+  bool viaChannel = channel.isUp() && ours;
+  bool acceptGzip = ours && gzipWanted(url.c_str() + strlen(currentServer)) && inflater.ready();
+  const char* etag = cached ? cached->etag.c_str() : NULL;
+  ServerPool::Conn* conn = NULL;
+  int httpResponseCode;
+  if (viaChannel) {
+    httpResponseCode = channel.get(url.substring(strlen(currentServer)), etag, acceptGzip);
+  } else {
+    httpResponseCode = httpPool.get(url, &conn, etag, acceptGzip);
+  }
   Serial.print(url);
-  Serial.print(" ");
+  Serial.print(viaChannel ? " (channel) " : " ");
   Serial.println(httpResponseCode);
+  if (httpResponseCode < 0) {
+    return httpResponseCode;
+  }
+  if (httpResponseCode == 304 && cached) {
+    _releaseResponse(conn);
+    responseCache.revalidated(cached);
+    *len = cached->len;
+    return responseCache.serve(cached, sink) ? 0 : HTTPC_ERROR_TOO_LESS_RAM;
+  }
+  if (httpResponseCode != 200) {
+    _releaseResponse(conn);
+    return httpResponseCode;
+  }
 
-  int responseSize = http.getSize();
-  WiFiClient* httpStream = http.getStreamPtr();
-
+  int size = conn ? conn->http.getSize() : channel.length();
+  bool gzip = conn ? conn->gzip : channel.gzipped();
   Serial.print("response size: ");
-  Serial.println(responseSize);
+  Serial.print(size);
+  Serial.println(gzip ? " (gzip)" : "");
 
+  CacheFill fill;
+  if (cacheFreshMs >= 0) {
+    // the cache keeps the decoded body, whose length is not known yet
+    responseCache.beginFill(fill, url, conn ? conn->http.header("ETag") : channel.etag(), gzip ? -1 : size);
+  }
+  TeePrint tee(sink, fill);
+  if (gzip) {
+    inflater.begin(tee);
+  }
+  Print& body = gzip ? (Print&)inflater : (Print&)tee;
+  int read = conn ? conn->body.read(body, HTTP_BODY_TIMEOUT_MS) : channel.readBody(body, HTTP_BODY_TIMEOUT_MS);
+  // a body not read to its end closes the connection rather than being
+  // read by the next request
+  _releaseResponse(conn);
+  if (gzip) {
+    read = _finishGzip(read);
+  }
+  if (read < 0) {
+    responseCache.abort(fill);
+    Serial.print("response failed: ");
+    Serial.println(read == HTTPC_ERROR_TOO_LESS_RAM ? "too big" : HTTPClient::errorToString(read).c_str());
+    return read;
+  }
+  responseCache.commit(fill);
+  *len = read;
+  return 0;
+}
+
+// Sends an uncached request to the current server: compact over the channel
+// when it negotiated that, as a GET of its URL otherwise
+int requestInto(const WireRequest& req, Print& sink, size_t* len) {
+  if (!channel.isCompact()) {
+    return fetchInto(req.url(currentServer), sink, len);
+  }
+  bool acceptGzip = gzipWanted(wireRoutes[req.getRoute()].path) && inflater.ready();
+  int httpResponseCode = channel.call(req, NULL, acceptGzip);
+  Serial.print(wireRoutes[req.getRoute()].path);
+  Serial.print(" (compact) ");
+  Serial.println(httpResponseCode);
+  if (httpResponseCode < 0) {
+    return httpResponseCode;
+  }
   if (httpResponseCode != 200) {
+    channel.end();
     return httpResponseCode;
   }
-
-  if (httpStream->available() > resultLen) {
-    Serial.print("response size: ");
-    Serial.print(httpStream->available());
-    Serial.println(" is too big");
-    return -1;
+  bool gzip = channel.gzipped();
+  if (gzip) {
+    inflater.begin(sink);
   }
-
-  while (httpStream->available()) {
-    *(result++) = httpStream->read();
+  int read = channel.readBody(gzip ? (Print&)inflater : sink, HTTP_BODY_TIMEOUT_MS);
+  channel.end();
+  if (gzip) {
+    read = _finishGzip(read);
+  }
+  if (read < 0) {
+    Serial.print("response failed: ");
+    Serial.println(read == HTTPC_ERROR_TOO_LESS_RAM ? "too big" : HTTPClient::errorToString(read).c_str());
+    return read;
   }
-  *len = responseSize;
+  *len = read;
+  return 0;
+}
 
-  http.end();
+// fetchInto a NUL-terminated text buffer
+int makeRequest(String url, char* result, int resultLen, size_t* len, long cacheFreshMs = -1) {
+  memset(result, 0, resultLen);
+  BufferPrint sink((uint8_t*)result, resultLen - 1);
+  return fetchInto(url, sink, len, cacheFreshMs);
+}
 
-  return 0;
+int makeRequest(const WireRequest& req, char* result, int resultLen, size_t* len) {
+  memset(result, 0, resultLen);
+  BufferPrint sink((uint8_t*)result, resultLen - 1);
+  return requestInto(req, sink, len);
 }
 
 void connect() {
@@ -605,6 +1444,105 @@ void manageContext(const char* input, bool isImage) {
   }
 }
 
+// ---- network task: the answer gpt is streaming ----
+ServerPool::Conn* answerConn = NULL;  // over HTTP; NULL over the channel
+bool answerOpen = false;
+unsigned long answerHeardAt = 0;
+
+// The answer's response has opened with httpResponseCode: streams it from
+// here on when that is 200, lets it go otherwise
+int _keepAnswer(int httpResponseCode) {
+  if (httpResponseCode != 200) {
+    _releaseResponse(answerConn);
+    answerConn = NULL;
+    answerPages.end();
+    return httpResponseCode;
+  }
+  answerOpen = true;
+  answerHeardAt = millis();
+  return httpResponseCode;
+}
+
+// Starts streaming an answer into answerPages: over the channel while it is
+// up, over HTTP otherwise. Returns the HTTP status or an HTTPC_ERROR.
+int _openAnswer(const WireRequest& req) {
+  answerPages.begin();
+  int httpResponseCode;
+  if (channel.isCompact()) {
+    httpResponseCode = channel.call(req);
+  } else if (channel.isUp()) {
+    httpResponseCode = channel.get(req.url(""));
+  } else {
+    httpResponseCode = httpPool.get(req.url(currentServer), &answerConn);
+  }
+  Serial.print(wireRoutes[req.getRoute()].path);
+  Serial.print(answerConn ? " " : " (channel) ");
+  Serial.println(httpResponseCode);
+  return _keepAnswer(httpResponseCode);
+}
+
+// Moves what has arrived of the answer into answerPages. Returns true while
+// more of it may arrive.
+bool _pumpAnswer() {
+  if (!answerOpen) {
+    return false;
+  }
+  size_t got;
+  bool ended, failed;
+  if (answerConn) {
+    got = answerConn->body.poll(answerPages, SIZE_MAX);
+    ended = answerConn->body.done();
+    failed = answerConn->body.failed();
+  } else {
+    got = channel.pollBody(answerPages);
+    ended = channel.bodyDone();
+    failed = !channel.isUp();
+  }
+  if (got > 0) {
+    answerHeardAt = millis();
+  } else if (!ended && millis() - answerHeardAt > ANSWER_STALL_MS) {
+    failed = true;
+  }
+  if (!ended && !failed) {
+    return true;
+  }
+  // a body not read to its end closes the connection
+  _releaseResponse(answerConn);
+  answerConn = NULL;
+  answerOpen = false;
+  answerPages.end();
+  Serial.print("[Answer] ");
+  Serial.print(answerPages.length());
+  Serial.print(" chars");
+  if (answerPages.droppedBytes()) {
+    Serial.print(", dropped ");
+    Serial.print(answerPages.droppedBytes());
+  }
+  Serial.println(failed ? ", cut off" : "");
+  return false;
+}
+
+// Until page n of the answer is full or the answer has ended
+void _waitForPage(int n) {
+  while (!answerPages.complete(n) && _pumpAnswer()) {
+    delay(1);
+  }
+}
+
+// The result of a page request: Str1 is the page (as far as it has arrived),
+// G its number, N the pages so far and M 1 while more of the answer may come
+void _publishAnswerPage(int n) {
+  char text[ANSWER_PAGE_LEN + 1];
+  if (answerPages.page(n, text) == 0) {
+    setError(n == 1 ? "no response" : "no such page");
+    return;
+  }
+  varRegistry.publishReal('G', n);
+  varRegistry.publishReal('N', answerPages.pages());
+  varRegistry.publishReal('M', answerPages.more());
+  setSuccess(text);
+}
+
 void gpt() {
   const char* prompt = strArgs[0];
   Serial.print("prompt: ");
@@ -613,18 +1551,30 @@ void gpt() {
   // Manage context for text input
   manageContext(prompt, false);
 
-  auto url = String(currentServer) + String("/gpt/ask?question=") + urlEncode(String(prompt));
-
-  size_t realsize = 0;
-  if (makeRequest(url, response, MAXHTTPRESPONSELEN, &realsize)) {
+  if (!answerPages.ready()) {
+    setError("out of memory");
+    return;
+  }
+  WireRequest req(ROUTE_GPT_STREAM);
+  req.arg(prompt);
+  if (_openAnswer(req) != 200) {
     setError("error making request");
     return;
   }
 
-  Serial.print("response: ");
-  Serial.println(response);
+  // the first page is shown while the rest streams in
+  _waitForPage(1);
+  // Str0 still holds the long form for older programs, as far as it got
+  varRegistry.publishStringRef(0, answerPages.data(), answerPages.length());
+  _publishAnswerPage(1);
+}
 
-  setSuccess(response);
+// Page realArgs[0] (from 1) of the last answer, or the page after the one
+// read last for 0. Waits until that page is full or the answer has ended.
+void get_gpt_chunk() {
+  int n = realArgs[0] >= 1 ? (int)realArgs[0] : answerPages.next();
+  _waitForPage(n);
+  _publishAnswerPage(n);
 }
 
 void send() {
@@ -638,14 +1588,17 @@ void send() {
   setSuccess("OK: sent");
 }
 
-void _sendLauncher() {
-  sendProgramVariable("TI32", (uint8_t*)__launcher_var, __launcher_var_len);
+int _sendLauncher() {
+  return sendProgramVariable("TI32", (uint8_t*)__launcher_var, __launcher_var_len);
 }
 
 void launcher() {
   // we have to queue this action, since otherwise the transfer fails
   // due to the CBL2 library still using the lines
-  queued_action = _sendLauncher;
+  if (!linkScheduler.enqueue("launcher", _sendLauncher)) {
+    setError("link queue full");
+    return;
+  }
   setSuccess("queued transfer");
 }
 
@@ -682,58 +1635,248 @@ void provideCaptureFeedback() {
   #endif
 }
 
+#ifdef CAMERA
+// A luma buffer of at least len bytes, kept for the next snap
+uint8_t* _snapBuffer(size_t len) {
+  if (len > snapLumaLen) {
+    free(snapLuma);
+    snapLuma = (uint8_t*)(psramFound() ? ps_malloc(len) : malloc(len));
+    snapLumaLen = snapLuma ? len : 0;
+  }
+  return snapLuma;
+}
+
+// Renders fb into the Pic variable's body
+bool _frameToPic(camera_fb_t* fb) {
+  const uint8_t* luma = fb->buf;
+  int width = fb->width;
+  int height = fb->height;
+  if (fb->format == PIXFORMAT_JPEG) {
+    // the decoder scales by whole powers of two, which also spares it most
+    // of the IDCT work; the area average does the rest
+    static const jpg_scale_t scales[] = { JPG_SCALE_NONE, JPG_SCALE_2X, JPG_SCALE_4X, JPG_SCALE_8X };
+    int shift = SNAP_JPEG_SCALE >= 8 ? 3 : SNAP_JPEG_SCALE >= 4 ? 2 : SNAP_JPEG_SCALE >= 2 ? 1 : 0;
+    width = fb->width >> shift;
+    height = fb->height >> shift;
+    uint8_t* rgb = _snapBuffer((size_t)width * height * 2);
+    unsigned long start = millis();
+    if (!rgb || !jpg2rgb565(fb->buf, fb->len, rgb, scales[shift])) {
+      Serial.println("[Snap] JPEG decode failed");
+      return false;
+    }
+    PicPipeline::rgb565ToLuma(rgb, (size_t)width * height);
+    snapStats.decodeMs = millis() - start;
+    luma = rgb;
+  } else if (fb->format == PIXFORMAT_GRAYSCALE) {
+    snapStats.decodeMs = 0;
+  } else if (fb->format == PIXFORMAT_YUV422) {
+    // YUYV: the luma is every other byte, gathered at the front of the
+    // frame (which is ours until it is released)
+    size_t pixels = (size_t)width * height;
+    for (size_t i = 0; i < pixels; ++i) {
+      fb->buf[i] = fb->buf[2 * i];
+    }
+    snapStats.decodeMs = 0;
+  } else {
+    Serial.println("[Snap] unsupported pixel format");
+    return false;
+  }
+  unsigned long start = micros();
+  bool ok = picPipeline.render(luma, width, height, width, frame + 2);
+  snapStats.renderUs = micros() - start;
+  snapStats.width = width;
+  snapStats.height = height;
+  return ok;
+}
+#endif
+
 void snap() {
   #ifdef CAMERA
   // Provide real-time feedback before capture
   provideCaptureFeedback();
   
   // Capture image from camera
-  camera_fb_t *fb = esp_camera_fb_get();
+  unsigned long start = millis();
+  camera_fb_t *fb = cameraMgr.grab(CAMERA_PROFILE_PIC);
   if (!fb) {
+    snapStats.failed++;
     setError("Camera capture failed");
     return;
   }
+  snapStats.captureMs = millis() - start;
   
   // Manage context for image input
   manageContext("Image captured", true);
   
-  // Compress and send image
-  // Placeholder for image compression and transmission logic
-  setSuccess("Image captured successfully");
-  
-  // Return the frame buffer
-  esp_camera_fb_return(fb);
+  // Render it into Pic 1, which the calculator reads with no network
+  // round trip
+  bool ok = _frameToPic(fb);
+  cameraMgr.release(fb);
+  if (!ok) {
+    snapStats.failed++;
+    memset(frame + 2, 0, PICSIZE);
+    setError("could not convert image");
+    return;
+  }
+  frame[0] = PICSIZE & 0xff;
+  frame[1] = PICSIZE >> 8;
+  snapStats.snaps++;
+  Serial.printf("[Snap] %dx%d in %lu ms + %lu ms decode + %lu us render\n", snapStats.width, snapStats.height,
+                snapStats.captureMs, snapStats.decodeMs, snapStats.renderUs);
+  setSuccess("image captured");
   #else
   setError("Camera not supported on this board");
   #endif
 }
 
-
+// Asks the model the question in Str1 about what the camera sees, and pages
+// its answer like gpt's
 void solve() {
   #ifdef CAMERA
-  // Capture and solve image (e.g., QR code, object recognition)
-  camera_fb_t *fb = esp_camera_fb_get();
+  const char* prompt = strArgs[0];
+  Serial.print("vision prompt: ");
+  Serial.println(prompt);
+  if (!answerPages.ready()) {
+    setError("out of memory");
+    return;
+  }
+  unsigned long start = millis();
+  camera_fb_t *fb = cameraMgr.grab(CAMERA_PROFILE_VISION);
   if (!fb) {
+    visionStats.failed++;
     setError("Camera capture failed");
     return;
   }
-  
-  // Placeholder for image solving logic
-  setSuccess("Image solved successfully");
-  
-  // Return the frame buffer
-  esp_camera_fb_return(fb);
+  visionStats.captureMs = millis() - start;
+  manageContext(prompt, true);
+
+  // The JPEG is the file part of a multipart POST with the prompt as its
+  // other field. Only the text around it is built here; the frame goes to
+  // the socket from the camera's buffer, which goes back to the driver once
+  // its last byte is written.
+  String head = "--" VISION_BOUNDARY "\r\nContent-Disposition: form-data; name=\"question\"\r\n\r\n";
+  head += prompt;
+  head += "\r\n--" VISION_BOUNDARY "\r\nContent-Disposition: form-data; name=\"image\"; filename=\"frame.jpg\"\r\n"
+          "Content-Type: image/jpeg\r\n\r\n";
+  static const char tail[] = "\r\n--" VISION_BOUNDARY "--\r\n";
+  HttpBodyPart parts[] = {
+    { (const uint8_t*)head.c_str(), head.length() },
+    { fb->buf, fb->len },
+    { (const uint8_t*)tail, sizeof(tail) - 1 },
+  };
+  answerPages.begin();
+  int httpResponseCode = httpPool.post(String(currentServer) + VISION_PATH,
+                                       "multipart/form-data; boundary=" VISION_BOUNDARY, parts, 3, &answerConn);
+  visionStats.frameBytes = fb->len;
+  cameraMgr.release(fb);
+  const HttpPoolStats& h = httpPool.getStats();
+  visionStats.uploadMs = h.lastUploadMs;
+  visionStats.answerMs = h.lastTtfbMs;
+  Serial.printf("[Vision] %u bytes, capture %lu ms, upload %lu ms, answer after %lu ms: %d\n",
+                (unsigned)visionStats.frameBytes, visionStats.captureMs, visionStats.uploadMs, visionStats.answerMs,
+                httpResponseCode);
+  if (!answerConn) {
+    answerPages.end();
+  }
+  if (!answerConn || _keepAnswer(httpResponseCode) != 200) {
+    visionStats.failed++;
+    setError("error making request");
+    return;
+  }
+  visionStats.solves++;
+
+  // paged like gpt's answers: the first page now, get_gpt_chunk for more
+  _waitForPage(1);
+  varRegistry.publishStringRef(0, answerPages.data(), answerPages.length());
+  _publishAnswerPage(1);
   #else
   setError("Camera not supported on this board");
   #endif
 }
 
+// ============================================================================
+// Paged list results
+// ============================================================================
+// List commands split their page into list[] rows. Each row is LISTENTRYLEN
+// characters, space padded and not terminated, so the rows read as one string.
+// They publish Str2 = every row, N = row count and L1 = one number per row
+// (the id to pass to the matching fetch command, or the RSSI of a network).
+// A menu can render the whole page after a single Get( per variable, and
+// sub(Str2,20I+1,20) is row I. Str1 still carries the raw page for older
+// programs.
+
+void _clearList() {
+  listCount = 0;
+}
+
+void _addListEntry(const char* text, size_t len) {
+  if (listCount >= LISTLEN) {
+    return;
+  }
+  memset(list[listCount], ' ', LISTENTRYLEN);
+  memcpy(list[listCount], text, min(len, (size_t)LISTENTRYLEN));
+  ++listCount;
+}
+
+// server pages are fixed-width entries; all-blank entries are padding
+void _splitListPage(const char* page, size_t width) {
+  _clearList();
+  size_t total = strlen(page);
+  for (size_t at = 0; at < total; at += width) {
+    size_t len = min(width, total - at);
+    bool blank = true;
+    for (size_t i = 0; i < len; ++i) {
+      blank = blank && page[at + i] == ' ';
+    }
+    if (!blank) {
+      _addListEntry(&page[at], len);
+    }
+  }
+}
+
+void _publishList(const double* values, int count) {
+  varRegistry.publishReal('N', listCount);
+  if (listCount == 0) {
+    return;
+  }
+  varRegistry.publishStringRef(2, list[0], listCount * LISTENTRYLEN);
+  if (values) {
+    varRegistry.publishList(1, values, count);
+  }
+}
+
+// ids of a page of `perPage` entries, as the fetch commands expect them
+void _publishListPage(int page, int perPage) {
+  double ids[LIST_VALUES_LEN];
+  int count = min(listCount, LIST_VALUES_LEN);
+  for (int i = 0; i < count; ++i) {
+    ids[i] = page * perPage + i;
+  }
+  _publishList(ids, count);
+}
+
+// Predicts the calculator's next request after a list page: the next page
+// if this one was full, and the first PREFETCH_ITEMS entries under every
+// path in itemPaths
+void _prefetchAfterPage(const char* listPath, int page, const char* itemPaths[], int paths) {
+  prefetcher.clear();
+  if (listCount >= LIST_PAGE_LEN) {
+    prefetcher.add(String(currentServer) + listPath + "?p=" + String(page + 1), CACHE_LIST_FRESH_MS);
+  }
+  for (int i = 0; i < min(listCount, PREFETCH_ITEMS); ++i) {
+    for (int p = 0; p < paths; ++p) {
+      prefetcher.add(String(currentServer) + itemPaths[p] + "?id=" + String(page * LIST_PAGE_LEN + i),
+                     CACHE_ITEM_FRESH_MS);
+    }
+  }
+}
+
 void image_list() {
   int page = realArgs[0];
   auto url = String(currentServer) + String("/image/list?p=") + urlEncode(String(page));
 
   size_t realsize = 0;
-  if (makeRequest(url, response, MAXSTRARGLEN, &realsize)) {
+  if (makeRequest(url, response, MAXHTTPRESPONSELEN, &realsize, CACHE_LIST_FRESH_MS)) {
     setError("error making request");
     return;
   }
@@ -741,6 +1884,10 @@ void image_list() {
   Serial.print("response: ");
   Serial.println(response);
 
+  _splitListPage(response, LIST_PAGE_ENTRY_WIDTH);
+  _publishListPage(page, LIST_PAGE_LEN);
+  const char* items[] = { "/image/fetch" };
+  _prefetchAfterPage("/image/list", page, items, 1);
   setSuccess(response);
 }
 
@@ -751,36 +1898,44 @@ void fetch_image() {
   Serial.print("id: ");
   Serial.println(id);
 
-  auto url = String(currentServer) + String("/image/get?id=") + urlEncode(String(id));
+  auto url = String(currentServer) + String("/image/fetch?id=") + urlEncode(String(id));
 
+  // the body goes straight into the Pic variable; a longer one overflows
+  BufferPrint sink(&frame[2], PICSIZE);
+  AssetReader image;
+  image.begin(sink);
   size_t realsize = 0;
-  if (makeRequest(url, response, MAXHTTPRESPONSELEN, &realsize)) {
-    setError("error making request");
+  int code = fetchInto(url, image, &realsize, CACHE_ITEM_FRESH_MS);
+  const AssetHeader& asset = image.header();
+  if (code || !image.complete() || asset.type != ASSET_PICTURE || asset.size != PICSIZE) {
+    memset(frame + 2, 0, PICSIZE);
+    Serial.print("response size:");
+    Serial.println(sink.length());
+    setError(code && code != HTTPC_ERROR_TOO_LESS_RAM ? "error making request" : "bad image size");
     return;
   }
-
-  if (realsize != PICSIZE) {
-    Serial.print("response size:");
-    Serial.println(realsize);
-    setError("bad image size");
+  if (!image.verified()) {
+    memset(frame + 2, 0, PICSIZE);
+    setError("image checksum mismatch");
     return;
   }
+  realsize = asset.size;
 
   // load the image
   frame[0] = realsize & 0xff;
   frame[1] = (realsize >> 8) & 0xff;
-  memcpy(&frame[2], response, 756);
 
-  setSuccess(response);
+  setSuccess("image loaded");
 }
 
 void fetch_chats() {
   int room = realArgs[0];
   int page = realArgs[1];
-  auto url = String(currentServer) + String("/chats/messages?p=") + urlEncode(String(page)) + String("&c=") + urlEncode(String(room));
+  WireRequest req(ROUTE_CHATS_MESSAGES);
+  req.arg((long)page).arg((long)room);
 
   size_t realsize = 0;
-  if (makeRequest(url, response, MAXSTRARGLEN, &realsize)) {
+  if (makeRequest(req, response, MAXHTTPRESPONSELEN, &realsize)) {
     setError("error making request");
     return;
   }
@@ -788,6 +1943,9 @@ void fetch_chats() {
   Serial.print("response: ");
   Serial.println(response);
 
+  // chat lines are not fetchable on their own, so no ids
+  _splitListPage(response, LIST_PAGE_ENTRY_WIDTH);
+  _publishList(NULL, 0);
   setSuccess(response);
 }
 
@@ -795,10 +1953,11 @@ void send_chat() {
   int room = realArgs[0];
   const char* msg = strArgs[1];
 
-  auto url = String(currentServer) + String("/chats/send?c=") + urlEncode(String(room)) + String("&m=") + urlEncode(String(msg)) + String("&id=") + urlEncode(String(CHAT_NAME));
+  WireRequest req(ROUTE_CHATS_SEND);
+  req.arg((long)room).arg(msg).arg(CHAT_NAME);
 
   size_t realsize = 0;
-  if (makeRequest(url, response, MAXSTRARGLEN, &realsize)) {
+  if (makeRequest(req, response, MAXSTRARGLEN, &realsize)) {
     setError("error making request");
     return;
   }
@@ -814,7 +1973,7 @@ void program_list() {
   auto url = String(currentServer) + String("/programs/list?p=") + urlEncode(String(page));
 
   size_t realsize = 0;
-  if (makeRequest(url, response, MAXSTRARGLEN, &realsize)) {
+  if (makeRequest(url, response, MAXHTTPRESPONSELEN, &realsize, CACHE_LIST_FRESH_MS)) {
     setError("error making request");
     return;
   }
@@ -822,29 +1981,291 @@ void program_list() {
   Serial.print("response: ");
   Serial.println(response);
 
+  _splitListPage(response, LIST_PAGE_ENTRY_WIDTH);
+  _publishListPage(page, LIST_PAGE_LEN);
+  const char* items[] = { "/programs/fetch" };
+  _prefetchAfterPage("/programs/list", page, items, 1);
   setSuccess(response);
 }
 
 
 char programName[256];
-char programData[4096];
 size_t programLength;
 
+// The program body is never buffered whole: fetch_program opens the request
+// and reads the headers, then the network task pumps the body into
+// programRing while the DATA packet of the silent transfer drains it on the
+// link task. A program costs PROGRAM_RING_LEN + PROGRAM_CHUNK_LEN bytes of
+// RAM whatever its size, and the link never waits on a socket. A program
+// still in responseCache skips all that: its pinned copy goes to the link.
+ServerPool::Conn* programConn = NULL;            // its body reader frames the stream
+ResponseCache::Entry* programCached = NULL;
+size_t programBodyOffset = 0;                    // past the frame header of programCached
+CacheFill programFill;
+AssetReader programAsset;                        // parses a fetch_program stream
+bool programFramed = false;                      // the stream is one /programs/fetch frame
+uint8_t programChunk[PROGRAM_CHUNK_LEN];
+size_t programChunkPos = 0;
+size_t programChunkLen = 0;
+size_t programStreamed = 0;
+// the stream stalled, or its checksum failed (set by either task)
+std::atomic<bool> programStreamFailed{false};
+std::atomic<bool> programChecksumFailed{false};
+uint32_t programJob = 0;                         // the fetch_program job the transfer reports to
+const char programChecksumMismatch[] = "program checksum mismatch";
+// network task -> link task
+SpscQueue<uint8_t, PROGRAM_RING_LEN> programRing;
+std::atomic<bool> programPumpDone{false};        // nothing more will reach the ring
+std::atomic<bool> programTransferFinished{false}; // set by the link task's done()
+int bundleLeft = 0;                              // -1 until the count byte is read
+
+// network task: a download or install is waiting for or using the link
+bool _programQueued() {
+  return programConn || programCached;
+}
+
+// network task
 void _resetProgram() {
+  if (programConn) {
+    // only a fully read body leaves the connection reusable
+    httpPool.release(programConn);
+    programConn = NULL;
+  }
+  if (programCached) {
+    responseCache.unpin(programCached);
+    programCached = NULL;
+  }
+  programBodyOffset = 0;
+  programFramed = false;
+  responseCache.abort(programFill);
   memset(programName, 0, 256);
-  memset(programData, 0, 4096);
   programLength = 0;
+  programChunkPos = 0;
+  programChunkLen = 0;
+  programStreamed = 0;
+  programStreamFailed = false;
+  programChecksumFailed = false;
+  programJob = 0;
+  programRing.reset();
+  programPumpDone = false;
+  bundleLeft = 0;
 }
 
-void _sendDownloadedProgram() {
-  if (sendProgramVariable(programName, (uint8_t*)programData, programLength)) {
+// the program body's sink
+class ProgramRingPrint : public Print {
+public:
+  size_t write(uint8_t b) override { return programRing.push(b) ? 1 : 0; }
+  size_t write(const uint8_t* buf, size_t len) override { return programRing.push(buf, len); }
+} programRingSink;
+TeePrint programSink(programRingSink, programFill);
+TeePrint programFrameSink(programAsset, programFill);  // the cache keeps the whole frame
+
+// network task: moves whatever the socket has into programRing
+void _pumpProgramStream() {
+  if (!programConn || programPumpDone) {
+    return;
+  }
+  HttpBodyReader& body = programConn->body;
+  body.poll(programFramed ? programFrameSink : programSink, programRing.space());
+  if (body.done() && programFramed && !programAsset.verified()) {
+    // too late to keep it off the link, which has most of it; the transfer
+    // is reported failed and the body is not kept
+    Serial.println("program checksum mismatch");
+    programChecksumFailed = true;
+    programStreamFailed = true;
+    responseCache.abort(programFill);
+  } else if (body.done()) {
+    responseCache.commit(programFill);
+  }
+  if (body.done() || body.failed()) {
+    programPumpDone = true;
+  }
+}
+
+// network task: ends the request once the link is done with it
+void _serviceProgramStream() {
+  if (programTransferFinished.exchange(false)) {
+    _resetProgram();
+  }
+  _pumpProgramStream();
+}
+
+// Link task: refills programChunk without crossing into the next variable of
+// a bundle. Returns false once the body stalls for PROGRAM_STREAM_TIMEOUT_MS.
+bool _fillProgramChunk(size_t limit) {
+  programChunkPos = 0;
+  programChunkLen = 0;
+  unsigned long deadline = millis() + PROGRAM_STREAM_TIMEOUT_MS;
+  while (!programStreamFailed) {
+    if (!netTask) {
+      _pumpProgramStream();  // no network task to do it
+    }
+    // read before popping: once the pump is done, the ring holds all there is
+    bool ended = programPumpDone;
+    programChunkLen = programRing.pop(programChunk, min(sizeof(programChunk), limit));
+    if (programChunkLen > 0) {
+      return true;
+    }
+    if (ended || (long)(millis() - deadline) >= 0) {
+      Serial.print("program stream stalled at ");
+      Serial.println(programStreamed);
+      programStreamFailed = true;
+      break;
+    }
+    delay(1);
+  }
+  return false;
+}
+
+bool _readProgramStream(uint8_t* buf, size_t len) {
+  while (len > 0) {
+    if (programChunkPos >= programChunkLen && !_fillProgramChunk(len)) {
+      return false;
+    }
+    size_t n = min(len, programChunkLen - programChunkPos);
+    memcpy(buf, &programChunk[programChunkPos], n);
+    programChunkPos += n;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+uint8_t programStreamCallback(int idx) {
+  if (programChunkPos >= programChunkLen) {
+    // the DATA packet is already on the wire and has to be completed;
+    // pad it and let the caller report the failure
+    if (!_fillProgramChunk(programLength - programStreamed)) {
+      return 0;
+    }
+  }
+  ++programStreamed;
+  return programChunk[programChunkPos++];
+}
+
+// Opens a GET whose body is pulled later by programStreamCallback, and
+// returns the HTTP status. programConn is only kept for a 200. *length is
+// the Content-Length, or -1 when the body is chunked or ends at close.
+int _openProgramStream(String url, int* length, const char* etag = NULL) {
+  Serial.println(url);
+  int httpResponseCode = httpPool.get(url, &programConn, etag);
+  *length = programConn ? programConn->http.getSize() : -1;
+  Serial.print(url);
+  Serial.print(" ");
+  Serial.println(httpResponseCode);
+  Serial.print("response size: ");
+  Serial.println(*length);
+
+  if (httpResponseCode != 200) {
+    httpPool.release(programConn);
+    programConn = NULL;
+  }
+  return httpResponseCode;
+}
+
+// network task: reads the frame header of a fetch_program stream. The body
+// after it stays in programRing for the link. Returns false if the stream
+// ends or stalls first.
+bool _programHeaderFromStream() {
+  programFramed = true;
+  programAsset.begin(programRingSink);
+  unsigned long deadline = millis() + PROGRAM_STREAM_TIMEOUT_MS;
+  while (!programAsset.started()) {
+    _pumpProgramStream();
+    if (programAsset.started()) {
+      break;
+    }
+    if (programPumpDone || (long)(millis() - deadline) >= 0) {
+      return false;
+    }
+    delay(1);
+  }
+  return true;
+}
+
+int _sendDownloadedProgram() {
+  if (programCached) {
+    return sendProgramVariable(programName, programCached->body + programBodyOffset, programLength);
+  }
+  if (programStreamFailed) {
+    // a body that fit in programRing was checked before its RTS
+    return ERR_BAD_CHECKSUM;
+  }
+  return sendProgramVariable(programName, NULL, programLength, programStreamCallback);
+}
+
+// Link task. fetch_program's job already said "queued download"; a
+// transfer that failed turns it into an error, so E and Str1 tell.
+void _programTransferDone(int result) {
+  if (result || programStreamFailed) {
     Serial.println("failed to transfer requested download");
     Serial.print(programName);
     Serial.print("(");
+    Serial.print(programStreamed);
+    Serial.print("/");
     Serial.print(programLength);
     Serial.println(")");
+    Job* job = findJob(programJob);
+    if (job && job->state == JOB_DONE) {
+      finishJob(job, true, programChecksumFailed ? programChecksumMismatch : "program transfer failed");
+    }
   }
-  _resetProgram();
+  programTransferFinished = true;
+}
+
+// Network task: the fetch_program frame at url, either whole in the cache
+// (programCached, checked and pinned) or as a stream whose header has been
+// read. Returns NULL, or what to report.
+const char* _openProgram(const String& url) {
+  ResponseCache::Entry* cached = NULL;
+  if (channel.isUp()) {
+    // A frame streamed at the link's pace would hold up everything else on
+    // the channel. The body comes whole into the cache instead and goes out
+    // from there; the stream below is for when that fails.
+    NullPrint discard;
+    size_t len;
+    int code = fetchInto(url, discard, &len, CACHE_ITEM_FRESH_MS);
+    if (code > 0) {
+      return "error making request for program";
+    }
+    cached = code == 0 ? responseCache.find(url) : NULL;
+  }
+  if (cached) {
+    // fetched over the channel
+  } else if ((cached = responseCache.find(url)) && responseCache.fresh(cached, CACHE_ITEM_FRESH_MS)) {
+    Serial.print(url);
+    Serial.println(" (cached)");
+    responseCache.hit(cached);
+  } else {
+    int responseSize = -1;
+    int code = _openProgramStream(url, &responseSize, cached ? cached->etag.c_str() : NULL);
+    if (code == 304 && cached) {
+      responseCache.revalidated(cached);
+    } else if (code != 200) {
+      return "error making request for program";
+    } else {
+      // the frame is copied into the cache as it streams
+      responseCache.beginFill(programFill, url, programConn->http.header("ETag"), responseSize);
+      if (!_programHeaderFromStream()) {
+        _resetProgram();
+        return "error reading program";
+      }
+      return NULL;
+    }
+  }
+  // the cached frame is checked whole before any of it goes out
+  NullPrint discard;
+  programAsset.begin(discard);
+  programAsset.write(cached->body, cached->len);
+  if (!programAsset.verified()) {
+    // or every retry would be served the same bad copy
+    responseCache.invalidate(url);
+    return programChecksumMismatch;
+  }
+  responseCache.pin(cached);
+  programCached = cached;
+  programBodyOffset = programAsset.headerLength();
+  return NULL;
 }
 
 void fetch_program() {
@@ -852,106 +2273,163 @@ void fetch_program() {
   Serial.print("id: ");
   Serial.println(id);
 
+  // one program stream at a time: it is only read while it goes out on the link
+  if (_programQueued()) {
+    setError("download already queued");
+    return;
+  }
   _resetProgram();
 
-  auto url = String(currentServer) + String("/programs/get?id=") + urlEncode(String(id));
-
-  if (makeRequest(url, programData, 4096, &programLength)) {
-    setError("error making request for program data");
+  // name, size and checksum come in the same frame as the body
+  auto url = String(currentServer) + String("/programs/fetch?id=") + urlEncode(String(id));
+  const char* failure = _openProgram(url);
+  if (failure == programChecksumMismatch) {
+    // a bad copy in the cache is dropped by now; the server gets one more go
+    Serial.println("fetching the program again");
+    failure = _openProgram(url);
+  }
+  if (failure) {
+    setError(failure);
     return;
   }
-
-  size_t realsize = 0;
-  auto nameUrl = String(currentServer) + String("/programs/get_name?id=") + urlEncode(String(id));
-  if (makeRequest(nameUrl, programName, 256, &realsize)) {
-    setError("error making request for program name");
+  const AssetHeader& asset = programAsset.header();
+  // the RTS announces the size up front, so the length has to be known
+  if (asset.type != ASSET_PROGRAM && asset.type != ASSET_PROTECTED_PROGRAM) {
+    _resetProgram();
+    setError("not a program");
+    return;
+  }
+  if (asset.size == 0 || asset.size > MAX_PROGRAM_VAR_SIZE) {
+    _resetProgram();
+    setError("program too big");
     return;
   }
 
-  queued_action = _sendDownloadedProgram;
+  strncpy(programName, asset.name, sizeof(programName) - 1);
+  programLength = asset.size;
+  programJob = commandResult.seq;
+  if (!linkScheduler.enqueue("download", _sendDownloadedProgram, _programTransferDone)) {
+    _resetProgram();
+    setError("link queue full");
+    return;
+  }
 
   setSuccess("queued download");
 }
 
-/// OTHER FUNCTIONS
-
-int sendProgramVariable(const char* name, uint8_t* program, size_t variableSize) {
-  Serial.print("transferring: ");
-  Serial.print(name);
-  Serial.print("(");
-  Serial.print(variableSize);
-  Serial.println(")");
+// /programs/bundle is one response with every program, each framed as
+// name[8], size (little endian u16), variable. The session reads the frame
+// header right before the RTS, so the whole suite goes over the link behind
+// a single EOT without buffering more than the ring.
+bool _nextBundledProgram(LinkVariable* var) {
+  if (bundleLeft < 0) {
+    uint8_t count = 0;
+    if (!_readProgramStream(&count, 1)) {
+      return false;
+    }
+    bundleLeft = count;
+  }
+  if (programLength > 0 && programStreamed == 0) {
+    // the calculator refused the RTS; offer the same variable again
+    *var = LinkVariable::program(programName, NULL, programLength);
+    var->callback = programStreamCallback;
+    return true;
+  }
+  if (programStreamed != programLength) {
+    return false;  // previous body was not fully consumed
+  }
+  while (bundleLeft > 0) {
+    --bundleLeft;
+    uint8_t frameHeader[PROGRAM_FRAME_HEADER_LEN];
+    if (!_readProgramStream(frameHeader, sizeof(frameHeader))) {
+      return false;
+    }
+    size_t size = frameHeader[8] | (frameHeader[9] << 8);
+    memcpy(programName, frameHeader, 8);
+    programName[8] = '\0';
+
+    if (size == 0 || size > MAX_PROGRAM_VAR_SIZE) {
+      Serial.print("skipping ");
+      Serial.println(programName);
+      uint8_t discard[32];
+      for (size_t left = size; left > 0;) {
+        size_t n = min(left, sizeof(discard));
+        if (!_readProgramStream(discard, n)) {
+          return false;
+        }
+        left -= n;
+      }
+      continue;
+    }
 
-  int dataLength = 0;
+    programLength = size;
+    programStreamed = 0;
+    *var = LinkVariable::program(programName, NULL, size);
+    var->callback = programStreamCallback;
+    return true;
+  }
+  return false;
+}
 
-  // IF THIS ISNT SET TO COMP83P, THIS DOESNT WORK
-  // seems like ti-84s cant silent transfer to each other
-  uint8_t msg_header[4] = { COMP83P, RTS, 13, 0 };
+int _sendProgramBundle() {
+  linkSession.clear();
+  linkSession.setSource(_nextBundledProgram);
+  return linkSession.send();
+}
 
-  uint8_t rtsdata[13] = { variableSize & 0xff, variableSize >> 8, VarTypes82::VarProgram, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
-  int nameSize = strlen(name);
-  if (nameSize == 0) {
-    return 1;
+void _programBundleDone(int result) {
+  if (result || programStreamFailed) {
+    Serial.println("failed to install programs");
   }
-  memcpy(&rtsdata[3], name, min(nameSize, 8));
+  programTransferFinished = true;
+}
 
-  auto rtsVal = cbl.send(msg_header, rtsdata, 13);
-  if (rtsVal) {
-    Serial.print("rts return: ");
-    Serial.println(rtsVal);
-    return rtsVal;
+void install_programs() {
+  if (_programQueued()) {
+    setError("download already queued");
+    return;
   }
+  _resetProgram();
 
-  cbl.resetLines();
-  auto ackVal = cbl.get(msg_header, NULL, &dataLength, 0);
-  if (ackVal || msg_header[1] != ACK) {
-    Serial.print("ack return: ");
-    Serial.println(ackVal);
-    return ackVal;
+  auto url = String(currentServer) + String("/programs/bundle");
+  int responseSize;
+  if (_openProgramStream(url, &responseSize) != 200 || responseSize == 0) {
+    _resetProgram();
+    setError("error making request for programs");
+    return;
   }
+  // the link task reads the count byte when the session starts
+  bundleLeft = -1;
 
-  auto ctsRet = cbl.get(msg_header, NULL, &dataLength, 0);
-  if (ctsRet || msg_header[1] != CTS) {
-    Serial.print("cts return: ");
-    Serial.println(ctsRet);
-    return ctsRet;
+  if (!linkScheduler.enqueue("install", _sendProgramBundle, _programBundleDone)) {
+    _resetProgram();
+    setError("link queue full");
+    return;
   }
 
-  msg_header[1] = ACK;
-  msg_header[2] = 0x00;
-  msg_header[3] = 0x00;
-  ackVal = cbl.send(msg_header, NULL, 0);
-  if (ackVal || msg_header[1] != ACK) {
-    Serial.print("ack cts return: ");
-    Serial.println(ackVal);
-    return ackVal;
-  }
+  setSuccess("queued install");
+}
 
-  msg_header[1] = DATA;
-  msg_header[2] = variableSize & 0xff;
-  msg_header[3] = (variableSize >> 8) & 0xff;
-  auto dataRet = cbl.send(msg_header, program, variableSize);
-  if (dataRet) {
-    Serial.print("data return: ");
-    Serial.println(dataRet);
-    return dataRet;
-  }
+/// OTHER FUNCTIONS
+
+int sendProgramVariable(const char* name, uint8_t* program, size_t variableSize, data_callback callback) {
+  Serial.print("transferring: ");
+  Serial.print(name);
+  Serial.print("(");
+  Serial.print(variableSize);
+  Serial.println(")");
 
-  ackVal = cbl.get(msg_header, NULL, &dataLength, 0);
-  if (ackVal || msg_header[1] != ACK) {
-    Serial.print("ack data: ");
-    Serial.println(ackVal);
-    return ackVal;
+  if (strlen(name) == 0) {
+    return 1;
   }
 
-  msg_header[1] = EOT;
-  msg_header[2] = 0x00;
-  msg_header[3] = 0x00;
-  auto eotVal = cbl.send(msg_header, NULL, 0);
-  if (eotVal) {
-    Serial.print("eot return: ");
-    Serial.println(eotVal);
-    return eotVal;
+  LinkVariable var = LinkVariable::program(name, program, variableSize);
+  var.callback = callback;
+  linkSession.clear();
+  linkSession.add(var);
+  int ret = linkSession.send();
+  if (ret) {
+    return ret;
   }
 
   Serial.print("transferred: ");
@@ -973,6 +2451,18 @@ void scan_networks() {
    return;
  }
  
+ // Str2/N/L1 hold every network with its RSSI; Str1 is truncated
+ _clearList();
+ double rssi[LIST_VALUES_LEN];
+ for (int i = 0; i < wifiMgr.getScannedCount(); ++i) {
+   String ssid = wifiMgr.getScannedSSID(i);
+   if (listCount < LIST_VALUES_LEN) {
+     rssi[listCount] = wifiMgr.getScannedRSSI(i);
+   }
+   _addListEntry(ssid.c_str(), ssid.length());
+ }
+ _publishList(rssi, min(listCount, LIST_VALUES_LEN));
+
  // Truncate to MAXSTRARGLEN if necessary
  if (networkList.length() >= MAXSTRARGLEN) {
    networkList = networkList.substring(0, MAXSTRARGLEN - 1);
@@ -992,6 +2482,8 @@ void connect_wifi() {
  Serial.print(" with password: ");
  Serial.println("<hidden>");
  
+ // pooled connections belong to the old network
+ httpPool.closeIdle();
  if (wifiMgr.connectToNetwork(ssid, password) != 0) {
    setError("WiFi connection failed");
    return;
@@ -1094,5 +2586,8 @@ void get_power_status() {
   statusJson += "}";
   
   strncpy(message, statusJson.c_str(), MAXSTRARGLEN - 1);
+  varRegistry.publishReal('B', bootCount);
+  varRegistry.publishReal('W', wifiConnected);
+  varRegistry.publishReal('P', isPowered);
   setSuccess(message);
 }
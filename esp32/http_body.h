@@ -0,0 +1,224 @@
+#ifndef HTTP_BODY_H
+#define HTTP_BODY_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <HTTPClient.h>
+#include "config.h"
+
+// ============================================================================
+// HTTP Body - Framed, bounded reads of a response body into a sink
+// ============================================================================
+//
+// The body is delimited by Content-Length, by chunked encoding, or (with
+// neither) by the server closing the connection. Bytes go straight from the
+// socket into a Print sink, which can be a fixed buffer such as the Pic frame
+// or the ring the link drains. A sink that accepts fewer bytes than offered
+// has overflowed, and the read fails rather than truncating quietly.
+
+// Fixed-size memory sink
+class BufferPrint : public Print {
+private:
+  uint8_t* buf;
+  size_t capacity;
+  size_t len = 0;
+
+public:
+  BufferPrint(uint8_t* dst, size_t cap) : buf(dst), capacity(cap) {}
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  size_t write(const uint8_t* src, size_t n) override {
+    n = min(n, capacity - len);
+    memcpy(&buf[len], src, n);
+    len += n;
+    return n;
+  }
+
+  size_t length() { return len; }
+};
+
+// Discards the body (the response cache keeps its copy)
+class NullPrint : public Print {
+public:
+  size_t write(uint8_t b) override { return 1; }
+  size_t write(const uint8_t* src, size_t n) override { return n; }
+};
+
+// Passes writes to a sink and copies what it accepted to a second Print
+class TeePrint : public Print {
+private:
+  Print& sink;
+  Print& copy;
+
+public:
+  TeePrint(Print& primary, Print& secondary) : sink(primary), copy(secondary) {}
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  size_t write(const uint8_t* src, size_t n) override {
+    n = sink.write(src, n);
+    copy.write(src, n);
+    return n;
+  }
+};
+
+class HttpBodyReader {
+private:
+  enum State { BODY, CHUNK_SIZE, CHUNK_DATA, CHUNK_END, TRAILER, DONE, FAILED };
+
+  WiFiClient* stream = NULL;
+  State state = DONE;
+  long left = 0;  // bytes left in the body or the current chunk; -1 = until close
+  size_t total = 0;
+  int error = 0;
+  char line[16];
+  size_t lineLen = 0;
+
+  void fail(int err) {
+    state = FAILED;
+    error = err;
+  }
+
+  // Consumes a CRLF-terminated line (kept up to sizeof(line) - 1 chars);
+  // false until the whole line has arrived
+  bool readLine(size_t* length) {
+    while (stream->available() > 0) {
+      int c = stream->read();
+      if (c < 0) {
+        return false;
+      }
+      if (c == '\n') {
+        line[min(lineLen, sizeof(line) - 1)] = '\0';
+        *length = lineLen;
+        lineLen = 0;
+        return true;
+      }
+      if (c != '\r') {
+        if (lineLen < sizeof(line) - 1) {
+          line[lineLen] = c;
+        }
+        ++lineLen;
+      }
+    }
+    return false;
+  }
+
+public:
+  // contentLength < 0 when the response has none
+  void begin(WiFiClient* client, int contentLength, bool chunked) {
+    stream = client;
+    total = 0;
+    error = 0;
+    lineLen = 0;
+    left = chunked ? 0 : contentLength;
+    state = chunked ? CHUNK_SIZE : (left == 0 ? DONE : BODY);
+    if (!stream) {
+      fail(HTTPC_ERROR_NO_STREAM);
+    }
+  }
+
+  bool done() { return state == DONE; }
+  bool failed() { return state == FAILED; }
+  int getError() { return error; }
+  size_t getTotal() { return total; }
+
+  // ========================================================================
+  // Reading
+  // ========================================================================
+
+  // Moves what has already arrived into sink, at most max body bytes.
+  // Never waits; returns the number of body bytes moved.
+  size_t poll(Print& sink, size_t max) {
+    uint8_t buf[HTTP_READ_CHUNK_LEN];
+    size_t moved = 0;
+    while (state != DONE && state != FAILED) {
+      if (state == BODY || state == CHUNK_DATA) {
+        if (left == 0) {
+          state = state == BODY ? DONE : CHUNK_END;
+          continue;
+        }
+        if (moved >= max) {
+          break;
+        }
+        int avail = stream->available();
+        if (avail <= 0) {
+          if (!stream->connected()) {
+            if (left < 0) {
+              state = DONE;  // no length: the close ends the body
+            } else {
+              fail(HTTPC_ERROR_CONNECTION_LOST);
+            }
+          }
+          break;
+        }
+        size_t want = min(min((size_t)avail, sizeof(buf)), max - moved);
+        if (left > 0) {
+          want = min(want, (size_t)left);
+        }
+        int got = stream->read(buf, want);
+        if (got <= 0) {
+          break;
+        }
+        if (sink.write(buf, got) != (size_t)got) {
+          fail(HTTPC_ERROR_TOO_LESS_RAM);
+          break;
+        }
+        moved += got;
+        total += got;
+        if (left > 0) {
+          left -= got;
+        }
+        continue;
+      }
+
+      size_t length;
+      if (!readLine(&length)) {
+        if (stream->available() <= 0 && !stream->connected()) {
+          fail(HTTPC_ERROR_CONNECTION_LOST);
+        }
+        break;
+      }
+      if (state == CHUNK_SIZE) {
+        char* end;
+        left = strtol(line, &end, 16);
+        if (end == line || left < 0) {
+          fail(HTTPC_ERROR_ENCODING);
+        } else {
+          state = left > 0 ? CHUNK_DATA : TRAILER;
+        }
+      } else if (state == CHUNK_END) {
+        state = CHUNK_SIZE;
+      } else if (length == 0) {
+        state = DONE;  // blank line after the trailers
+      }
+    }
+    return moved;
+  }
+
+  // Reads the rest of the body into sink. Returns its length, or an
+  // HTTPC_ERROR: the sink overflowed (TOO_LESS_RAM), nothing arrived for
+  // stallMs or the body took longer than timeoutMs (READ_TIMEOUT), or the
+  // server closed early (CONNECTION_LOST).
+  int read(Print& sink, unsigned long timeoutMs, unsigned long stallMs = HTTP_STALL_TIMEOUT_MS) {
+    unsigned long start = millis();
+    unsigned long lastData = start;
+    while (state != DONE && state != FAILED) {
+      if (poll(sink, SIZE_MAX) > 0) {
+        lastData = millis();
+        continue;
+      }
+      if (state == DONE || state == FAILED) {
+        break;
+      }
+      if (millis() - lastData > stallMs || millis() - start > timeoutMs) {
+        fail(HTTPC_ERROR_READ_TIMEOUT);
+        break;
+      }
+      delay(1);
+    }
+    return state == DONE ? (int)total : error;
+  }
+};
+
+#endif // HTTP_BODY_H
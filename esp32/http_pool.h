@@ -0,0 +1,438 @@
+#ifndef HTTP_POOL_H
+#define HTTP_POOL_H
+
+#include <WiFi.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include <base64.h>
+#include "config.h"
+#include "http_body.h"
+
+// ============================================================================
+// HTTP Pool - Keep-alive connections to the server
+// ============================================================================
+//
+// Every request used to open its own socket, and under SECURE that meant a
+// full TLS handshake per request. The pool keeps HTTP_POOL_SIZE connections
+// open between requests. It reconnects when the server has closed one, and
+// logs what each request spent on connect/TLS and on time to first byte.
+//
+// WiFiClientSecure cannot save and restore a TLS session, so a handshake is
+// avoided by keeping the connection itself alive. Connections idle for
+// HTTP_POOL_IDLE_MS are closed before use; that is shorter than the
+// server's keepAliveTimeout, so a request never races the server's close.
+//
+// Each connection carries the reader for its response body, so release()
+// knows whether the body was read to its end and the socket can be reused.
+//
+// post() uploads a body given as parts that stay where they are (a camera
+// frame, the text around it). HTTPClient would copy a Stream body through a
+// buffer of its own, so post() writes the request on the socket itself,
+// each part straight from its memory in slices of HTTP_UPLOAD_SLICE_LEN,
+// and reads the status line and headers itself. The parts are not touched
+// once post() returns.
+//
+// Only the network task uses the pool.
+
+struct HttpPoolStats {
+  uint32_t requests = 0;
+  uint32_t connects = 0;     // new connections (each one a TLS handshake under SECURE)
+  uint32_t reused = 0;       // requests on an open connection
+  uint32_t reconnects = 0;   // reused connection found closed, request sent again
+  uint32_t failures = 0;
+  uint32_t uploads = 0;      // posts whose body was written in full
+  unsigned long lastConnectMs = 0;
+  unsigned long lastTtfbMs = 0;
+  unsigned long lastUploadMs = 0;  // writing the last post's request
+};
+
+// A piece of a request body, sent from where it lies
+struct HttpBodyPart {
+  const uint8_t* data;
+  size_t len;
+};
+
+template <typename Client>
+class HttpPool {
+public:
+  struct Conn {
+    Client client;
+    HTTPClient http;
+    HttpBodyReader body;
+    bool gzip = false;  // the body is gzip (asked for and sent)
+    bool raw = false;   // post() read the response head, not http
+    bool closeAfter = false;  // raw: the server closes the connection after it
+    bool busy = false;
+    String host;
+    uint16_t port = 0;
+    unsigned long lastUsed = 0;
+  };
+
+private:
+  Conn conns[HTTP_POOL_SIZE];
+  const char* user = NULL;
+  const char* password = NULL;
+  String auth;  // base64 of user:password, for requests written by hand
+  HttpPoolStats stats;
+
+  static void prepare(WiFiClientSecure& client) { client.setInsecure(); }
+  static void prepare(WiFiClient& client) { (void)client; }
+
+  static bool parseUrl(const String& url, String* host, uint16_t* port) {
+    int scheme = url.indexOf("://");
+    if (scheme < 0) {
+      return false;
+    }
+    *port = url.startsWith("https") ? 443 : 80;
+    int start = scheme + 3;
+    int end = url.indexOf('/', start);
+    String authority = end < 0 ? url.substring(start) : url.substring(start, end);
+    int colon = authority.indexOf(':');
+    if (colon >= 0) {
+      *port = authority.substring(colon + 1).toInt();
+      authority = authority.substring(0, colon);
+    }
+    *host = authority;
+    return host->length() > 0;
+  }
+
+  // An idle connection to the same server, open if possible
+  Conn* pick(const String& host, uint16_t port) {
+    Conn* fallback = NULL;
+    for (int i = 0; i < HTTP_POOL_SIZE; ++i) {
+      Conn& c = conns[i];
+      if (c.busy) continue;
+      bool expired = millis() - c.lastUsed > HTTP_POOL_IDLE_MS;
+      if (c.client.connected() && (c.host != host || c.port != port || expired)) {
+        c.client.stop();
+      }
+      if (c.client.connected()) return &c;
+      if (!fallback) fallback = &c;
+    }
+    return fallback;
+  }
+
+  int send(Conn* c, const String& url, const char* etag, bool gzip, bool* reused) {
+    *reused = c->client.connected();
+    if (!*reused) {
+      prepare(c->client);
+      unsigned long start = millis();
+      if (!c->client.connect(c->host.c_str(), c->port)) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+      }
+      stats.lastConnectMs = millis() - start;
+      stats.connects++;
+    }
+    static const char* headers[] = {"Transfer-Encoding", "ETag", "Content-Encoding"};
+    c->http.setReuse(true);
+    c->http.setTimeout(HTTP_RESPONSE_TIMEOUT_MS);
+    c->http.collectHeaders(headers, 3);
+    if (user) {
+      c->http.setAuthorization(user, password);
+    }
+    c->http.begin(c->client, url);
+    if (etag) {
+      c->http.addHeader("If-None-Match", etag);
+    }
+    if (gzip) {
+      c->http.addHeader("Accept-Encoding", "gzip");
+    }
+    unsigned long start = millis();
+    int code = c->http.GET();
+    stats.lastTtfbMs = millis() - start;
+    return code;
+  }
+
+  // Writes len bytes from data a slice at a time; false when the socket
+  // closes or takes nothing for HTTP_STALL_TIMEOUT_MS
+  static bool writeAll(Client& client, const uint8_t* data, size_t len) {
+    unsigned long heard = millis();
+    while (len > 0) {
+      size_t n = client.write(data, min(len, (size_t)HTTP_UPLOAD_SLICE_LEN));
+      if (n > 0) {
+        data += n;
+        len -= n;
+        heard = millis();
+      } else if (!client.connected() || millis() - heard > HTTP_STALL_TIMEOUT_MS) {
+        return false;
+      } else {
+        delay(1);
+      }
+    }
+    return true;
+  }
+
+  // The status line and headers of a response to a request written by
+  // hand: the status, or an HTTPC_ERROR. *answered says whether any byte
+  // of a response arrived.
+  int readHead(Conn* c, long* contentLength, bool* chunked, bool* answered) {
+    char line[HTTP_HEAD_LINE_LEN];
+    size_t lineLen = 0;
+    int status = 0;
+    *contentLength = -1;
+    *chunked = false;
+    *answered = false;
+    c->closeAfter = false;
+    unsigned long start = millis();
+    while (millis() - start < HTTP_RESPONSE_TIMEOUT_MS) {
+      int ch = c->client.read();
+      if (ch < 0) {
+        if (!c->client.connected()) {
+          return HTTPC_ERROR_CONNECTION_LOST;
+        }
+        delay(1);
+        continue;
+      }
+      *answered = true;
+      if (ch == '\r') {
+        continue;
+      }
+      if (ch != '\n') {
+        if (lineLen < sizeof(line) - 1) {
+          line[lineLen++] = ch;
+        }
+        continue;
+      }
+      line[lineLen] = '\0';
+      size_t length = lineLen;
+      lineLen = 0;
+      if (length == 0) {
+        if (status != 0) {
+          return status;
+        }
+        continue;
+      }
+      if (status == 0) {
+        // "HTTP/1.1 200 OK"
+        const char* space = strchr(line, ' ');
+        status = space ? atoi(space + 1) : 0;
+        if (status <= 0) {
+          return HTTPC_ERROR_NO_HTTP_SERVER;
+        }
+        continue;
+      }
+      char* colon = strchr(line, ':');
+      if (!colon) {
+        continue;
+      }
+      *colon = '\0';
+      const char* value = colon + 1;
+      while (*value == ' ') {
+        ++value;
+      }
+      if (strcasecmp(line, "Content-Length") == 0) {
+        *contentLength = atol(value);
+      } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+        *chunked = strcasecmp(value, "chunked") == 0;
+      } else if (strcasecmp(line, "Connection") == 0) {
+        c->closeAfter = strcasecmp(value, "close") == 0;
+      }
+    }
+    return HTTPC_ERROR_READ_TIMEOUT;
+  }
+
+  // A POST of parts written by hand, then its response head. *stale says
+  // the server had closed the connection before it saw the request: a write
+  // failed, or it closed without a byte of response.
+  int sendParts(Conn* c, const String& url, const char* contentType, const HttpBodyPart* parts, int count,
+                bool* reused, bool* stale) {
+    *stale = false;
+    *reused = c->client.connected();
+    if (!*reused) {
+      prepare(c->client);
+      unsigned long start = millis();
+      if (!c->client.connect(c->host.c_str(), c->port)) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+      }
+      stats.lastConnectMs = millis() - start;
+      stats.connects++;
+    }
+    size_t total = 0;
+    for (int i = 0; i < count; ++i) {
+      total += parts[i].len;
+    }
+    int slash = url.indexOf('/', url.indexOf("://") + 3);
+    String head = "POST " + (slash < 0 ? String("/") : url.substring(slash)) + " HTTP/1.1\r\nHost: " + c->host +
+                  "\r\nConnection: keep-alive\r\nContent-Type: " + contentType +
+                  "\r\nContent-Length: " + String((unsigned long)total) + "\r\n";
+    if (auth.length()) {
+      head += "Authorization: Basic " + auth + "\r\n";
+    }
+    head += "\r\n";
+    unsigned long start = millis();
+    bool written = writeAll(c->client, (const uint8_t*)head.c_str(), head.length());
+    for (int i = 0; written && i < count; ++i) {
+      written = writeAll(c->client, parts[i].data, parts[i].len);
+    }
+    if (!written) {
+      *stale = true;
+      return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+    }
+    stats.lastUploadMs = millis() - start;
+    stats.uploads++;
+    long contentLength;
+    bool chunked;
+    bool answered;
+    start = millis();
+    int code = readHead(c, &contentLength, &chunked, &answered);
+    stats.lastTtfbMs = millis() - start;
+    *stale = code == HTTPC_ERROR_CONNECTION_LOST && !answered;
+    if (code > 0) {
+      bool bodyless = code == 204 || code == 304;
+      c->body.begin(&c->client, bodyless ? 0 : chunked ? -1 : contentLength, chunked && !bodyless);
+    }
+    return code;
+  }
+
+  // An idle connection for url's server, or NULL
+  Conn* take(const String& url) {
+    String host;
+    uint16_t port;
+    if (!parseUrl(url, &host, &port)) {
+      Serial.print("[HttpPool] Bad URL: ");
+      Serial.println(url);
+      return NULL;
+    }
+    Conn* c = pick(host, port);
+    if (!c) {
+      Serial.println("[HttpPool] All connections busy");
+      stats.failures++;
+      return NULL;
+    }
+    c->host = host;
+    c->port = port;
+    stats.requests++;
+    return c;
+  }
+
+  void logRequest(const char* method, int code, bool reused) {
+    Serial.print("[HttpPool] ");
+    Serial.print(method);
+    Serial.print(code);
+    Serial.print(reused ? " reused" : " connect+tls ");
+    if (!reused) {
+      Serial.print(stats.lastConnectMs);
+      Serial.print(" ms");
+    }
+    Serial.print(", ttfb ");
+    Serial.print(stats.lastTtfbMs);
+    Serial.println(" ms");
+  }
+
+public:
+  void setAuthorization(const char* httpUser, const char* httpPassword) {
+    user = httpUser;
+    password = httpPassword;
+    auth = user ? base64::encode(String(user) + ":" + password) : String();
+  }
+
+  // ========================================================================
+  // Requests
+  // ========================================================================
+
+  // Sends a GET on a pooled connection, conditional when etag is given and
+  // accepting gzip when asked. On success (any HTTP status) *out holds the
+  // connection, with the headers read and conn->body ready to read (still
+  // compressed when conn->gzip), until release().
+  int get(const String& url, Conn** out, const char* etag = NULL, bool gzip = false) {
+    *out = NULL;
+    Conn* c = take(url);
+    if (!c) {
+      return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+
+    bool reused;
+    int code = send(c, url, etag, gzip, &reused);
+    if (code < 0 && reused) {
+      // the server closed it while it sat in the pool
+      stats.reconnects++;
+      c->client.stop();
+      code = send(c, url, etag, gzip, &reused);
+    }
+    if (reused) {
+      stats.reused++;
+    }
+
+    logRequest("", code, reused);
+
+    if (code < 0) {
+      stats.failures++;
+      c->client.stop();
+      return code;
+    }
+    c->raw = false;
+    bool chunked = c->http.header("Transfer-Encoding").equalsIgnoreCase("chunked");
+    // 204 and 304 never have a body, whatever the headers say
+    bool bodyless = code == 204 || code == 304;
+    c->gzip = gzip && !bodyless && c->http.header("Content-Encoding").equalsIgnoreCase("gzip");
+    c->body.begin(c->http.getStreamPtr(), bodyless ? 0 : chunked ? -1 : c->http.getSize(), chunked && !bodyless);
+    c->busy = true;
+    *out = c;
+    return code;
+  }
+
+  // Sends a POST of the parts, in order, on a pooled connection. The parts
+  // are written from where they lie and may be freed or reused once this
+  // returns. On success (any HTTP status) *out holds the connection with
+  // conn->body ready to read, until release(); conn->http is not used.
+  int post(const String& url, const char* contentType, const HttpBodyPart* parts, int count, Conn** out) {
+    *out = NULL;
+    Conn* c = take(url);
+    if (!c) {
+      return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+
+    bool reused;
+    bool stale;
+    int code = sendParts(c, url, contentType, parts, count, &reused, &stale);
+    if (stale && reused) {
+      // the server closed it while it sat in the pool; the parts are still
+      // there to send again. Anything else (a timeout after the upload, a
+      // garbled answer) may have reached the server, and is not repeated.
+      stats.reconnects++;
+      c->client.stop();
+      code = sendParts(c, url, contentType, parts, count, &reused, &stale);
+    }
+    if (reused) {
+      stats.reused++;
+    }
+    logRequest("POST ", code, reused);
+
+    if (code < 0) {
+      stats.failures++;
+      c->client.stop();
+      return code;
+    }
+    c->raw = true;
+    c->gzip = false;
+    c->busy = true;
+    *out = c;
+    return code;
+  }
+
+  // Hands the connection back. It stays open only when the server allows
+  // keep-alive and the whole body was read.
+  void release(Conn* c) {
+    if (!c) return;
+    if (!c->body.done() || (c->raw && c->closeAfter)) {
+      c->client.stop();
+    }
+    if (!c->raw) {
+      c->http.end();
+    }
+    c->lastUsed = millis();
+    c->busy = false;
+  }
+
+  // Closes every idle connection (WiFi changed)
+  void closeIdle() {
+    for (int i = 0; i < HTTP_POOL_SIZE; ++i) {
+      if (!conns[i].busy) conns[i].client.stop();
+    }
+  }
+
+  const HttpPoolStats& getStats() { return stats; }
+};
+
+#endif // HTTP_POOL_H
@@ -0,0 +1,239 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include "esp32/rom/miniz.h"
+#include "config.h"
+
+// ============================================================================
+// Inflate - Streaming gzip decoding of response bodies
+// ============================================================================
+//
+// Lists, chat pages, GPT answers and programs are text or tokens that
+// compress to a fraction of their size. For the paths in GZIP_PATHS the
+// device asks for gzip (Accept-Encoding over HTTP, a flag on the channel).
+// A compressed body is decoded as it arrives: the inflater is the Print the
+// body reader writes to, and it writes the decoded bytes on to the real
+// sink. A sink that overflows fails the read exactly as without gzip.
+//
+// Decoding uses the ROM's tinfl with one 32 KB window, allocated on first
+// use (in PSRAM when the board has it) and kept, so memory stays bounded
+// whatever the size of the body. If the window cannot be allocated, nothing
+// asks for gzip. The gzip trailer's length is checked; its CRC is not, as
+// TCP and TLS already protect the bytes.
+//
+// Only the network task uses the inflater.
+
+struct GzipStats {
+  uint32_t responses = 0;       // compressed bodies decoded
+  uint32_t failures = 0;
+  uint32_t compressedBytes = 0; // on the wire
+  uint32_t decodedBytes = 0;
+  uint32_t inflateUs = 0;       // CPU time spent decoding
+};
+
+// The paths (relative to the server) that may answer compressed
+inline bool gzipWanted(const char* path) {
+  static const char* const paths[] = GZIP_PATHS;
+  if (!GZIP_ENABLED) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i) {
+    if (strncmp(path, paths[i], strlen(paths[i])) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+class GzipInflater : public Print {
+private:
+  enum State { HEADER, EXTRA_LEN, EXTRA, NAME, COMMENT, HCRC, DATA, TRAILER, DONE, FAILED };
+  enum Flags : uint8_t { FHCRC = 0x02, FEXTRA = 0x04, FNAME = 0x08, FCOMMENT = 0x10 };
+
+  tinfl_decompressor* decomp = NULL;
+  uint8_t* window = NULL;
+  size_t windowPos = 0;
+  Print* sink = NULL;
+  State state = DONE;
+  uint8_t header[10];
+  size_t have = 0;   // bytes of the current header field or trailer
+  size_t skip = 0;   // FEXTRA bytes left
+  uint8_t trailer[8];
+  uint32_t decoded = 0;
+  bool overflow = false;
+  GzipStats stats;
+
+  void fail() {
+    if (state != FAILED) {
+      stats.failures++;
+    }
+    state = FAILED;
+  }
+
+  // The header field after the one just finished
+  State after(State field) {
+    uint8_t flags = header[3];
+    if (field < EXTRA_LEN && (flags & FEXTRA)) return EXTRA_LEN;
+    if (field < NAME && (flags & FNAME)) return NAME;
+    if (field < COMMENT && (flags & FCOMMENT)) return COMMENT;
+    if (field < HCRC && (flags & FHCRC)) return HCRC;
+    return DATA;
+  }
+
+  // Header bytes; returns how many of src it used
+  size_t parseHeader(const uint8_t* src, size_t n) {
+    size_t used = 0;
+    while (used < n && state < DATA) {
+      uint8_t c = src[used++];
+      switch (state) {
+        case HEADER:
+          header[have++] = c;
+          if (have == sizeof(header)) {
+            have = 0;
+            // magic, and deflate as the method
+            if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8) {
+              fail();
+              return used;
+            }
+            state = after(HEADER);
+          }
+          break;
+        case EXTRA_LEN:
+          skip |= (size_t)c << (8 * have++);
+          if (have == 2) {
+            have = 0;
+            state = skip ? EXTRA : after(EXTRA);
+          }
+          break;
+        case EXTRA:
+          if (--skip == 0) {
+            state = after(EXTRA);
+          }
+          break;
+        case NAME:
+        case COMMENT:
+          if (c == 0) {
+            state = after(state);
+          }
+          break;
+        case HCRC:
+          if (++have == 2) {
+            have = 0;
+            state = DATA;
+          }
+          break;
+        default:
+          break;
+      }
+    }
+    return used;
+  }
+
+  // Deflate data; returns how many of src it used
+  size_t inflate(const uint8_t* src, size_t n) {
+    size_t used = 0;
+    unsigned long start = micros();
+    while (state == DATA) {
+      size_t inSize = n - used;
+      size_t outSize = GZIP_WINDOW_LEN - windowPos;
+      tinfl_status status = tinfl_decompress(decomp, src + used, &inSize, window, window + windowPos, &outSize,
+                                             TINFL_FLAG_HAS_MORE_INPUT);
+      used += inSize;
+      if (outSize > 0) {
+        if (sink->write(window + windowPos, outSize) != outSize) {
+          overflow = true;
+          fail();
+          break;
+        }
+        decoded += outSize;
+        windowPos = (windowPos + outSize) & (GZIP_WINDOW_LEN - 1);
+      }
+      if (status == TINFL_STATUS_DONE) {
+        state = TRAILER;
+      } else if (status < 0) {
+        fail();
+      } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && used == n) {
+        break;
+      }
+    }
+    stats.inflateUs += micros() - start;
+    return used;
+  }
+
+public:
+  // Allocates the window; false if there is no room for it
+  bool ready() {
+    if (decomp && window) {
+      return true;
+    }
+    bool psram = psramFound();
+    if (!decomp) {
+      decomp = (tinfl_decompressor*)(psram ? ps_malloc(sizeof(tinfl_decompressor)) : malloc(sizeof(tinfl_decompressor)));
+    }
+    if (!window) {
+      window = (uint8_t*)(psram ? ps_malloc(GZIP_WINDOW_LEN) : malloc(GZIP_WINDOW_LEN));
+    }
+    return decomp && window;
+  }
+
+  // Starts a compressed body that decodes into out
+  void begin(Print& out) {
+    sink = &out;
+    state = HEADER;
+    have = 0;
+    skip = 0;
+    windowPos = 0;
+    decoded = 0;
+    overflow = false;
+    tinfl_init(decomp);
+  }
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  // Compressed bytes; fewer than n are taken when the sink overflows or the
+  // data is corrupt
+  size_t write(const uint8_t* src, size_t n) override {
+    stats.compressedBytes += n;
+    size_t used = 0;
+    while (used < n && state != DONE && state != FAILED) {
+      if (state < DATA) {
+        used += parseHeader(src + used, n - used);
+      } else if (state == DATA) {
+        used += inflate(src + used, n - used);
+      } else {
+        trailer[have++] = src[used++];
+        if (have == sizeof(trailer)) {
+          // ISIZE: the decoded length, mod 2^32
+          uint32_t size = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | ((uint32_t)trailer[7] << 24);
+          if (size != decoded) {
+            fail();
+          } else {
+            state = DONE;
+          }
+        }
+      }
+    }
+    if (state == DONE && used < n) {
+      fail();  // bytes after the trailer
+    }
+    return state == FAILED ? 0 : n;
+  }
+
+  // After the body was read to its end: the decoded length, or an
+  // HTTPC_ERROR (TOO_LESS_RAM when the sink overflowed, ENCODING otherwise)
+  int finish() {
+    stats.decodedBytes += decoded;
+    if (state == DONE) {
+      stats.responses++;
+      return (int)decoded;
+    }
+    fail();
+    return overflow ? HTTPC_ERROR_TOO_LESS_RAM : HTTPC_ERROR_ENCODING;
+  }
+
+  const GzipStats& getStats() { return stats; }
+};
+
+#endif // INFLATE_H
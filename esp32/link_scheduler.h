@@ -0,0 +1,141 @@
+#ifndef LINK_SCHEDULER_H
+#define LINK_SCHEDULER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "link_session.h"
+#include "spsc_queue.h"
+#include <atomic>
+
+// ============================================================================
+// Link Scheduler - Starts queued silent transfers once the link is free
+// ============================================================================
+//
+// Transfers cannot start while CBL2 is still answering the calculator, or
+// while the calculator is still running the BASIC program that asked for
+// them. The scheduler therefore waits until TIP/RING have been idle and
+// CBL2 has been silent for LINK_IDLE_QUIET_MS. It then tries the transfer
+// at the head of the FIFO. A transfer that returns LINK_NOT_READY stays
+// queued and is retried every LINK_RETRY_MS until its timeout expires.
+//
+// Commands run on the network task and enqueue(); tick() runs on the link
+// task. The FIFO is a lock-free SPSC queue, so those are the only two
+// callers allowed: one producer and one consumer.
+
+struct LinkJob {
+  const char* name;
+  int (*transfer)();             // ArTICL error code, 0, or LINK_NOT_READY
+  void (*done)(int result);      // cleanup, called exactly once (may be NULL)
+  unsigned long deadline;
+};
+
+class LinkScheduler {
+private:
+  int tip;
+  int ring;
+  SpscQueue<LinkJob, LINK_QUEUE_LEN> jobs;
+  std::atomic<unsigned long> lastActivity{0};
+  unsigned long nextAttempt = 0;
+
+  void finish(int result) {
+    LinkJob job;
+    if (!jobs.pop(&job)) {
+      return;
+    }
+    if (job.done) {
+      job.done(result);
+    }
+  }
+
+public:
+  LinkScheduler(int tipPin, int ringPin) : tip(tipPin), ring(ringPin) {}
+
+  // ========================================================================
+  // Queue
+  // ========================================================================
+
+  // Returns false (without calling done) when the queue is full
+  bool enqueue(const char* name, int (*transfer)(), void (*done)(int result) = NULL,
+               unsigned long timeoutMs = LINK_TRANSFER_TIMEOUT_MS) {
+    LinkJob job = { name, transfer, done, millis() + timeoutMs };
+    if (!jobs.push(job)) {
+      Serial.print("[LinkScheduler] Queue full, dropping ");
+      Serial.println(name);
+      return false;
+    }
+    Serial.print("[LinkScheduler] Queued ");
+    Serial.print(name);
+    Serial.print(" (");
+    Serial.print(pending());
+    Serial.println(" pending)");
+    return true;
+  }
+
+  int pending() { return jobs.size(); }
+
+  // ========================================================================
+  // Bus State
+  // ========================================================================
+
+  // Call from the CBL2 callbacks: the calculator is mid-transaction
+  void noteActivity() {
+    lastActivity = millis();
+  }
+
+  // How long the calculator has left the link alone (any task)
+  unsigned long quietMs() {
+    return millis() - lastActivity;
+  }
+
+  // Both lines are pulled high when nobody drives them
+  bool linesIdle() {
+    return digitalRead(tip) == HIGH && digitalRead(ring) == HIGH;
+  }
+
+  // ========================================================================
+  // Dispatch (call from the link task)
+  // ========================================================================
+
+  void tick() {
+    LinkJob* next = jobs.peek();
+    if (!next) {
+      return;
+    }
+    unsigned long now = millis();
+
+    LinkJob& job = *next;
+    if ((long)(now - job.deadline) >= 0) {
+      Serial.print("[LinkScheduler] Timed out: ");
+      Serial.println(job.name);
+      finish(ERR_WRITE_TIMEOUT);
+      return;
+    }
+
+    if (!linesIdle()) {
+      lastActivity = now;
+      return;
+    }
+    if (now - lastActivity < LINK_IDLE_QUIET_MS || (long)(now - nextAttempt) < 0) {
+      return;
+    }
+
+    Serial.print("[LinkScheduler] Starting ");
+    Serial.println(job.name);
+    int result = job.transfer();
+    if (result == LINK_NOT_READY) {
+      // calculator did not answer the RTS yet (program still running)
+      nextAttempt = millis() + LINK_RETRY_MS;
+      return;
+    }
+    if (result) {
+      Serial.print("[LinkScheduler] Failed ");
+      Serial.print(job.name);
+      Serial.print(": ");
+      Serial.println(result);
+    }
+    lastActivity = millis();
+    finish(result);
+  }
+};
+
+#endif // LINK_SCHEDULER_H
@@ -0,0 +1,425 @@
+#ifndef LINK_SESSION_H
+#define LINK_SESSION_H
+
+#include <TICL.h>
+#include <TIVar.h>
+#include "config.h"
+#include <atomic>
+
+// ============================================================================
+// Link Session - Silent transfer of several variables behind a single EOT
+// ============================================================================
+//
+// A session is RTS/ACK/CTS/ACK/DATA/ACK once per variable and a single EOT at
+// the end. Variables are either queued up front with add() or produced while
+// the session runs by a source function. A source can pull the next variable
+// out of a network stream right before its RTS.
+//
+// The calculator answers a packet whose checksum failed with ERR instead of
+// ACK. That packet is sent again, up to LINK_PACKET_RETRIES times. A
+// variable that still fails after its RTS was accepted is restarted from
+// its RTS, up to LINK_VARIABLE_RETRIES times. Variables the calculator has
+// already ACKed are never sent again. Streamed variables are recorded while
+// they go out, so a resend replays the recording and the network is read
+// only once. The recording is freed once its variable is ACKed or given up.
+
+// send() result when the calculator did not answer the first RTS (it is
+// still running a program, or off). Nothing was sent, so it is safe to retry.
+#define LINK_NOT_READY -1
+
+struct LinkVariable {
+  uint8_t type = VarTypes82::VarProgram;
+  uint8_t name[8] = { 0 };
+  size_t size = 0;
+  const uint8_t* data = NULL;      // either the variable in memory...
+  uint8_t (*callback)(int) = NULL; // ...or a pull for each byte
+
+  static LinkVariable program(const char* name, const uint8_t* data, size_t size) {
+    LinkVariable v;
+    v.type = VarTypes82::VarProgram;
+    memcpy(v.name, name, min(strlen(name), sizeof(v.name)));
+    v.data = data;
+    v.size = size;
+    return v;
+  }
+
+  // Pic1..Pic9 are 0..8, Pic0 is 9 (same for strings and L1..L6 -> 0..5)
+  static LinkVariable picture(uint8_t index, const uint8_t* data, size_t size) {
+    return token(VarTypes82::VarPic, 0x60, index, data, size);
+  }
+
+  static LinkVariable string(uint8_t index, const uint8_t* data, size_t size) {
+    return token(VarTypes82::VarString, 0xAA, index, data, size);
+  }
+
+  static LinkVariable list(uint8_t index, const uint8_t* data, size_t size) {
+    return token(VarTypes82::VarRList, 0x5D, index, data, size);
+  }
+
+  static LinkVariable token(uint8_t type, uint8_t prefix, uint8_t index, const uint8_t* data, size_t size) {
+    LinkVariable v;
+    v.type = type;
+    v.name[0] = prefix;
+    v.name[1] = index;
+    v.data = data;
+    v.size = size;
+    return v;
+  }
+};
+
+struct LinkTransferStats {
+  uint8_t type = 0;
+  char name[9] = { 0 };
+  size_t bytes = 0;
+  unsigned long ms = 0;
+  int result = 0;
+
+  unsigned long bytesPerSecond() const { return ms ? bytes * 1000UL / ms : 0; }
+};
+
+// Totals since boot. The link task writes them and the status page reads
+// them from the network task.
+struct LinkCounters {
+  std::atomic<uint32_t> sessions{0};
+  std::atomic<uint32_t> variables{0};        // variables ACKed
+  std::atomic<uint32_t> bytes{0};
+  std::atomic<uint32_t> packetRetries{0};    // packets sent again
+  std::atomic<uint32_t> checksumErrors{0};   // ERR answers from the calculator
+  std::atomic<uint32_t> variableRestarts{0}; // variables restarted from their RTS
+  std::atomic<uint32_t> failures{0};         // sessions that gave up
+};
+
+class LinkSession {
+private:
+  TICL* link;
+  LinkVariable queued[LINK_SESSION_MAX_VARS];
+  int queuedCount = 0;
+  bool (*source)(LinkVariable* var) = NULL;
+
+  LinkTransferStats transfers[LINK_SESSION_MAX_VARS];
+  int transferCount = 0;
+  int sentCount = 0;
+  bool accepted = false;
+  size_t totalBytes = 0;
+  unsigned long totalMs = 0;
+  LinkCounters counters;
+
+  // Bytes of the streamed variable in flight, recorded as they are pulled
+  uint8_t* replay = NULL;
+  size_t replayLen = 0;
+  uint8_t (*pull)(int) = NULL;
+
+  // data_callback has no context pointer; only one session sends at a time
+  static LinkSession*& active() {
+    static LinkSession* session = NULL;
+    return session;
+  }
+
+  static uint8_t replayCallback(int idx) {
+    LinkSession* s = active();
+    if ((size_t)idx < s->replayLen) {
+      return s->replay[idx];
+    }
+    uint8_t b = s->pull(idx);
+    if (s->replay && (size_t)idx == s->replayLen) {
+      s->replay[s->replayLen++] = b;
+    }
+    return b;
+  }
+
+  // A resend needs the same bytes again: in memory, or recorded on the way
+  // out. The recording is as large as the variable and lives in PSRAM; a
+  // board without it only records variables up to LINK_REPLAY_DRAM_LEN, and
+  // sends larger ones once.
+  bool prepareReplay(const LinkVariable& var) {
+    replayLen = 0;
+    pull = var.callback;
+    if (!var.callback) {
+      return true;
+    }
+    bool psram = psramFound();
+    if (var.size > (psram ? LINK_REPLAY_LEN : LINK_REPLAY_DRAM_LEN)) {
+      return false;
+    }
+    replay = (uint8_t*)(psram ? ps_malloc(var.size) : malloc(var.size));
+    return replay != NULL;
+  }
+
+  void releaseReplay() {
+    free(replay);
+    replay = NULL;
+    replayLen = 0;
+  }
+
+  int expect(uint8_t* msg_header, uint8_t cmd, const char* what) {
+    int dataLength = 0;
+    int ret = link->get(msg_header, NULL, &dataLength, 0);
+    if (ret || msg_header[1] != cmd) {
+      Serial.print("[LinkSession] ");
+      Serial.print(what);
+      Serial.print(" return: ");
+      Serial.print(ret);
+      Serial.print(" cmd: ");
+      Serial.println(msg_header[1]);
+      return ret ? ret : ERR_INVALID;
+    }
+    return 0;
+  }
+
+  // Sends a packet and waits for its ACK. An ERR answer or a failed send
+  // is retried; an RTS the calculator never answered is returned at once,
+  // since it is not listening at all.
+  int sendAcked(uint8_t cmd, uint8_t* data, int len, data_callback cb, bool resendable, const char* what) {
+    int ret = 0;
+    for (int attempt = 0; attempt <= LINK_PACKET_RETRIES; ++attempt) {
+      if (attempt > 0) {
+        if (!resendable) {
+          break;
+        }
+        counters.packetRetries++;
+        Serial.print("[LinkSession] Resending ");
+        Serial.println(what);
+      }
+      // IF THIS ISNT SET TO COMP83P, THIS DOESNT WORK
+      // seems like ti-84s cant silent transfer to each other
+      uint8_t msg_header[4] = { COMP83P, cmd, (uint8_t)(len & 0xff), (uint8_t)((len >> 8) & 0xff) };
+      ret = link->send(msg_header, data, len, cb);
+      if (ret) {
+        Serial.print("[LinkSession] ");
+        Serial.print(what);
+        Serial.print(" return: ");
+        Serial.println(ret);
+        if (cmd == RTS && ret == ERR_WRITE_TIMEOUT) {
+          return ret;
+        }
+        continue;
+      }
+      if (cmd == RTS) {
+        link->resetLines();
+      }
+
+      int dataLength = 0;
+      ret = link->get(msg_header, NULL, &dataLength, 0);
+      if (ret == 0 && msg_header[1] == ACK) {
+        return 0;
+      }
+      if (ret == 0 && msg_header[1] == ERR) {
+        counters.checksumErrors++;
+        ret = ERR_BAD_CHECKSUM;
+        continue;
+      }
+      Serial.print("[LinkSession] ack ");
+      Serial.print(what);
+      Serial.print(" return: ");
+      Serial.print(ret);
+      Serial.print(" cmd: ");
+      Serial.println(msg_header[1]);
+      return ret ? ret : ERR_INVALID;
+    }
+    return ret;
+  }
+
+  int sendVariable(const LinkVariable& var, bool replayable) {
+    uint8_t rtsdata[13] = { 0 };
+    rtsdata[0] = var.size & 0xff;
+    rtsdata[1] = (var.size >> 8) & 0xff;
+    rtsdata[2] = var.type;
+    memcpy(&rtsdata[3], var.name, sizeof(var.name));
+
+    int ret = sendAcked(RTS, rtsdata, 13, NULL, true, "rts");
+    if (ret) return ret;
+    accepted = true;
+    uint8_t msg_header[4];
+    if ((ret = expect(msg_header, CTS, "cts"))) return ret;
+
+    msg_header[0] = COMP83P;
+    msg_header[1] = ACK;
+    msg_header[2] = 0x00;
+    msg_header[3] = 0x00;
+    ret = link->send(msg_header, NULL, 0);
+    if (ret) {
+      Serial.print("[LinkSession] ack cts return: ");
+      Serial.println(ret);
+      return ret;
+    }
+
+    return sendAcked(DATA, (uint8_t*)var.data, var.size, var.callback ? replayCallback : NULL, replayable,
+                     "data");
+  }
+
+  // Restarts the variable from its RTS while it keeps failing after the
+  // calculator took it on
+  int sendWithRestarts(const LinkVariable& var) {
+    bool replayable = prepareReplay(var);
+    int ret = 0;
+    for (int attempt = 0; attempt <= LINK_VARIABLE_RETRIES; ++attempt) {
+      if (attempt > 0) {
+        counters.variableRestarts++;
+        Serial.println("[LinkSession] Restarting variable from its RTS");
+        delay(LINK_RETRY_MS);
+      }
+      ret = sendVariable(var, replayable);
+      // nothing has been accepted yet: the caller retries the whole session
+      if (ret == 0 || !replayable || (ret == ERR_WRITE_TIMEOUT && !accepted)) {
+        break;
+      }
+    }
+    releaseReplay();
+    return ret;
+  }
+
+  void record(const LinkVariable& var, unsigned long ms, int result) {
+    if (result == 0) {
+      ++sentCount;
+      totalBytes += var.size;
+    }
+    if (transferCount >= LINK_SESSION_MAX_VARS) {
+      return;
+    }
+    LinkTransferStats& t = transfers[transferCount++];
+    t.type = var.type;
+    memcpy(t.name, var.name, sizeof(var.name));
+    t.name[8] = '\0';
+    t.bytes = var.size;
+    t.ms = ms;
+    t.result = result;
+  }
+
+  bool nextVariable(int index, LinkVariable* var) {
+    if (index < queuedCount) {
+      *var = queued[index];
+      return true;
+    }
+    return source && source(var);
+  }
+
+public:
+  LinkSession(TICL* ticl) : link(ticl) {}
+
+  // ========================================================================
+  // Building a Session
+  // ========================================================================
+
+  // Queue a variable; returns false when the session is full
+  bool add(const LinkVariable& var) {
+    if (queuedCount >= LINK_SESSION_MAX_VARS) {
+      Serial.println("[LinkSession] Session full");
+      return false;
+    }
+    queued[queuedCount++] = var;
+    return true;
+  }
+
+  // Called after the queued variables until it returns false
+  void setSource(bool (*next)(LinkVariable* var)) {
+    source = next;
+  }
+
+  void clear() {
+    queuedCount = 0;
+    source = NULL;
+  }
+
+  // ========================================================================
+  // Transfer
+  // ========================================================================
+
+  // Sends every variable, then a single EOT. Stops at the first failure and
+  // returns its ArTICL error code, or LINK_NOT_READY. A session that was
+  // not ready is recorded, but does not count as a session or a failure.
+  int send() {
+    transferCount = 0;
+    sentCount = 0;
+    accepted = false;
+    totalBytes = 0;
+
+    unsigned long sessionStart = millis();
+    active() = this;
+    int ret = 0;
+    LinkVariable var;
+    for (int i = 0; ret == 0 && nextVariable(i, &var); ++i) {
+      unsigned long start = millis();
+      ret = sendWithRestarts(var);
+      if (ret == ERR_WRITE_TIMEOUT && !accepted) {
+        ret = LINK_NOT_READY;
+      }
+      record(var, millis() - start, ret);
+    }
+
+    if (ret == 0 && sentCount > 0) {
+      uint8_t msg_header[4] = { COMP83P, EOT, 0x00, 0x00 };
+      ret = link->send(msg_header, NULL, 0);
+      if (ret) {
+        Serial.print("[LinkSession] eot return: ");
+        Serial.println(ret);
+      }
+    }
+    totalMs = millis() - sessionStart;
+    active() = NULL;
+    if (ret == LINK_NOT_READY) {
+      return ret;
+    }
+    counters.sessions++;
+    counters.variables += sentCount;
+    counters.bytes += totalBytes;
+    if (ret) {
+      counters.failures++;
+    }
+    printStats();
+    return ret;
+  }
+
+  // ========================================================================
+  // Throughput
+  // ========================================================================
+
+  int getSentCount() { return sentCount; }
+  size_t getTotalBytes() { return totalBytes; }
+  unsigned long getTotalMs() { return totalMs; }
+  unsigned long getBytesPerSecond() { return totalMs ? totalBytes * 1000UL / totalMs : 0; }
+  int getTransferCount() { return transferCount; }
+  const LinkTransferStats& getTransfer(int i) { return transfers[i]; }
+  const LinkCounters& getCounters() { return counters; }
+
+  void printStats() {
+    for (int i = 0; i < transferCount; ++i) {
+      const LinkTransferStats& t = transfers[i];
+      Serial.print("[LinkSession] ");
+      Serial.print(t.type == VarTypes82::VarProgram ? t.name : "<token>");
+      Serial.print(": ");
+      Serial.print(t.bytes);
+      Serial.print(" bytes in ");
+      Serial.print(t.ms);
+      Serial.print(" ms (");
+      Serial.print(t.bytesPerSecond());
+      Serial.print(" B/s)");
+      if (t.result) {
+        Serial.print(" FAILED ");
+        Serial.print(t.result);
+      }
+      Serial.println();
+    }
+    Serial.print("[LinkSession] Session: ");
+    Serial.print(sentCount);
+    Serial.print(" variables, ");
+    Serial.print(totalBytes);
+    Serial.print(" bytes in ");
+    Serial.print(totalMs);
+    Serial.print(" ms (");
+    Serial.print(getBytesPerSecond());
+    Serial.println(" B/s)");
+    if (counters.packetRetries || counters.variableRestarts) {
+      Serial.print("[LinkSession] Since boot: ");
+      Serial.print((uint32_t)counters.checksumErrors);
+      Serial.print(" checksum errors, ");
+      Serial.print((uint32_t)counters.packetRetries);
+      Serial.print(" packets resent, ");
+      Serial.print((uint32_t)counters.variableRestarts);
+      Serial.print(" variables restarted, ");
+      Serial.print((uint32_t)counters.failures);
+      Serial.println(" sessions failed");
+    }
+  }
+};
+
+#endif // LINK_SESSION_H
@@ -0,0 +1,408 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <base64.h>
+#include "config.h"
+#include "http_body.h"
+
+// ============================================================================
+// Mailbox - Dashboard commands by HTTP long-polling
+// ============================================================================
+//
+// The dashboard queues commands on the server (server/routes/esp32.mjs). The
+// device keeps one request to MAILBOX_PATH open, and the server answers it as
+// soon as a command is queued, or with a 204 once MAILBOX_HOLD_MS has passed.
+// A queued command therefore reaches the device after half a round trip. When
+// nothing happens, polling costs one request per MAILBOX_HOLD_MS.
+//
+// The results of a poll's commands go back with the next poll. That poll is a
+// POST carrying them as one JSON batch, so results need no request of their
+// own. Polling pauses until every command the last poll delivered has run.
+//
+// Only opening the connection blocks. step() writes the request and then
+// picks up the response as it arrives, so calculator commands run while a
+// poll is held. A server that answers without holding (an older one, or a
+// proxy in between) or that fails is polled less often. The gap doubles from
+// MAILBOX_MIN_GAP_MS up to POLL_INTERVAL_MS and drops back to zero once
+// commands arrive.
+//
+// Only the network task uses the mailbox.
+
+struct MailboxStats {
+  uint32_t polls = 0;
+  uint32_t held = 0;       // empty polls the server held for the full wait
+  uint32_t commands = 0;
+  uint32_t results = 0;
+  uint32_t droppedResults = 0;  // beyond MAILBOX_RESULTS_LEN while polls failed
+  uint32_t batches = 0;    // polls that carried results
+  uint32_t failures = 0;
+  unsigned long gapMs = 0; // current pause between polls
+  unsigned long lastPollMs = 0;
+};
+
+struct MailboxCommand {
+  uint32_t id;
+  char text[MAILBOX_COMMAND_LEN];  // "NAME ARG ..."
+};
+
+template <typename Client>
+class Mailbox {
+private:
+  enum State { IDLE, HEADERS, BODY };
+
+  Client client;
+  HttpBodyReader body;
+  State state = IDLE;
+
+  String server;  // as given, to notice a new ngrok URL
+  String host;
+  uint16_t port = 0;
+  String basePath;
+  String auth;
+
+  // the poll in flight
+  unsigned long sentAt = 0;
+  unsigned long nextPoll = 0;
+  int status = 0;
+  long contentLength = -1;
+  bool chunked = false;
+  bool closeAfter = false;
+  bool carriedResults = false;
+  int carriedCount = 0;      // results the poll carries; more may be added meanwhile
+  size_t carriedLen = 0;
+  char line[MAILBOX_LINE_LEN];
+  size_t lineLen = 0;
+  char reply[MAILBOX_REPLY_LEN];
+  BufferPrint replySink{ (uint8_t*)reply, 0 };
+
+  // delivered commands not run yet, and the results waiting for the next poll
+  MailboxCommand commands[MAILBOX_COMMANDS];
+  int commandHead = 0;
+  int commandCount = 0;
+  String results;
+  int resultCount = 0;
+
+  MailboxStats stats;
+
+  static void prepare(WiFiClientSecure& c) { c.setInsecure(); }
+  static void prepare(WiFiClient& c) { (void)c; }
+
+  bool setServer(const char* url) {
+    server = url;
+    client.stop();
+    state = IDLE;
+    String u = server;
+    int scheme = u.indexOf("://");
+    if (scheme < 0) {
+      host = String();
+      return false;
+    }
+    port = u.startsWith("https") ? 443 : 80;
+    int start = scheme + 3;
+    int slash = u.indexOf('/', start);
+    String authority = slash < 0 ? u.substring(start) : u.substring(start, slash);
+    basePath = slash < 0 ? String() : u.substring(slash);
+    while (basePath.endsWith("/")) {
+      basePath.remove(basePath.length() - 1);
+    }
+    int colon = authority.indexOf(':');
+    if (colon >= 0) {
+      port = authority.substring(colon + 1).toInt();
+      authority = authority.substring(0, colon);
+    }
+    host = authority;
+    return host.length() > 0;
+  }
+
+  // The next poll: a POST when results are waiting
+  bool send() {
+    if (!client.connected()) {
+      prepare(client);
+      if (!client.connect(host.c_str(), port)) {
+        return false;
+      }
+    }
+    carriedResults = resultCount > 0;
+    carriedCount = resultCount;
+    carriedLen = results.length();
+    String payload;
+    if (carriedResults) {
+      payload = "{\"results\":[" + results + "]}";
+    }
+    // the server hands out no more commands than fit, and keeps the rest
+    String req = String(carriedResults ? "POST " : "GET ") + basePath + MAILBOX_PATH + "?wait=" + String(MAILBOX_HOLD_MS) +
+                 "&max=" + String(MAILBOX_COMMANDS - commandCount) + "&bytes=" + String(MAILBOX_REPLY_LEN - 1) +
+                 " HTTP/1.1\r\nHost: " + host + "\r\nConnection: keep-alive\r\n";
+    if (auth.length()) {
+      req += "Authorization: Basic " + auth + "\r\n";
+    }
+    if (carriedResults) {
+      req += "Content-Type: application/json\r\nContent-Length: " + String(payload.length()) + "\r\n";
+    }
+    req += "\r\n";
+    req += payload;
+    if (client.write((const uint8_t*)req.c_str(), req.length()) != req.length()) {
+      return false;
+    }
+    sentAt = millis();
+    status = 0;
+    contentLength = -1;
+    chunked = false;
+    closeAfter = false;
+    lineLen = 0;
+    state = HEADERS;
+    stats.polls++;
+    return true;
+  }
+
+  // Status line and headers; false until the blank line has arrived
+  bool readHeaders() {
+    while (client.available() > 0) {
+      int c = client.read();
+      if (c < 0) {
+        break;
+      }
+      if (c == '\r') {
+        continue;
+      }
+      if (c != '\n') {
+        if (lineLen < sizeof(line) - 1) {
+          line[lineLen++] = c;
+        }
+        continue;
+      }
+      line[lineLen] = '\0';
+      size_t length = lineLen;
+      lineLen = 0;
+      if (length == 0) {
+        return status != 0;
+      }
+      if (status == 0) {
+        // "HTTP/1.1 200 OK"
+        const char* space = strchr(line, ' ');
+        status = space ? atoi(space + 1) : -1;
+        continue;
+      }
+      char* colon = strchr(line, ':');
+      if (!colon) {
+        continue;
+      }
+      *colon = '\0';
+      const char* value = colon + 1;
+      while (*value == ' ') {
+        ++value;
+      }
+      if (strcasecmp(line, "Content-Length") == 0) {
+        contentLength = atol(value);
+      } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+        chunked = strcasecmp(value, "chunked") == 0;
+      } else if (strcasecmp(line, "Connection") == 0) {
+        closeAfter = strcasecmp(value, "close") == 0;
+      }
+    }
+    return false;
+  }
+
+  // One "ID NAME ARG ..." line per command. A server that ignores max may
+  // send more than fit; those are answered busy rather than lost.
+  void takeCommands(size_t len) {
+    reply[len] = '\0';
+    char* save = NULL;
+    for (char* l = strtok_r(reply, "\r\n", &save); l; l = strtok_r(NULL, "\r\n", &save)) {
+      char* text;
+      uint32_t id = strtoul(l, &text, 10);
+      while (*text == ' ') {
+        ++text;
+      }
+      if (text == l || !*text) {
+        continue;
+      }
+      if (commandCount >= MAILBOX_COMMANDS) {
+        addResult(id, true, "device busy");
+        continue;
+      }
+      MailboxCommand& cmd = commands[(commandHead + commandCount) % MAILBOX_COMMANDS];
+      cmd.id = id;
+      strncpy(cmd.text, text, MAILBOX_COMMAND_LEN - 1);
+      cmd.text[MAILBOX_COMMAND_LEN - 1] = '\0';
+      commandCount++;
+      stats.commands++;
+    }
+  }
+
+  void finish(bool ok) {
+    unsigned long took = millis() - sentAt;
+    stats.lastPollMs = took;
+    if (!ok || closeAfter) {
+      client.stop();
+    }
+    state = IDLE;
+    if (!ok) {
+      stats.failures++;
+      Serial.println("[Mailbox] Poll failed");
+      backOff();
+      return;
+    }
+    if (carriedResults) {
+      // keep what was added while the poll was out, without its comma
+      results = carriedLen < results.length() ? results.substring(carriedLen + 1) : String();
+      resultCount -= carriedCount;
+      stats.batches++;
+    }
+    if (commandCount > 0) {
+      stats.gapMs = 0;
+    } else if (took >= MAILBOX_HOLD_MS / 2) {
+      // held as asked: poll again straight away
+      stats.held++;
+      stats.gapMs = 0;
+    } else if (!carriedResults) {
+      backOff();
+    }
+    nextPoll = millis() + stats.gapMs;
+  }
+
+  void backOff() {
+    stats.gapMs = stats.gapMs ? min(stats.gapMs * 2, (unsigned long)POLL_INTERVAL_MS) : MAILBOX_MIN_GAP_MS;
+    nextPoll = millis() + stats.gapMs;
+  }
+
+  static void appendJsonString(String& out, const char* s) {
+    out += '"';
+    for (; *s; ++s) {
+      char c = *s;
+      if (c == '"' || c == '\\') {
+        out += '\\';
+        out += c;
+      } else if ((uint8_t)c < 0x20) {
+        char esc[8];
+        snprintf(esc, sizeof(esc), "\\u%04x", c);
+        out += esc;
+      } else {
+        out += c;
+      }
+    }
+    out += '"';
+  }
+
+public:
+  void setAuthorization(const char* user, const char* password) {
+    auth = base64::encode(String(user) + ":" + password);
+  }
+
+  // ========================================================================
+  // Polling
+  // ========================================================================
+
+  // Sends the next poll when it is due, and reads whatever of the current
+  // one has arrived. serverUrl is the current server (it may change).
+  void step(const char* serverUrl) {
+    if (server != serverUrl && !setServer(serverUrl)) {
+      return;
+    }
+    if (host.length() == 0) {
+      return;
+    }
+
+    if (state == IDLE) {
+      // the results of the last batch go back together
+      if (commandCount > 0 || (long)(millis() - nextPoll) < 0) {
+        return;
+      }
+      if (!send()) {
+        client.stop();
+        stats.failures++;
+        backOff();
+      }
+      return;
+    }
+
+    if (millis() - sentAt > MAILBOX_HOLD_MS + MAILBOX_SLACK_MS) {
+      finish(false);
+      return;
+    }
+    if (state == HEADERS) {
+      if (!readHeaders()) {
+        if (client.available() <= 0 && !client.connected()) {
+          finish(false);
+        }
+        return;
+      }
+      if (status < 200 || status >= 300) {
+        // whatever the body says, the connection is not worth keeping
+        closeAfter = true;
+        finish(false);
+        return;
+      }
+      bool bodyless = status == 204;
+      replySink = BufferPrint((uint8_t*)reply, sizeof(reply) - 1);
+      body.begin(&client, bodyless ? 0 : chunked ? -1 : contentLength, chunked && !bodyless);
+      state = BODY;
+    }
+    body.poll(replySink, SIZE_MAX);
+    if (body.done()) {
+      takeCommands(replySink.length());
+      finish(true);
+    } else if (body.failed()) {
+      finish(false);
+    }
+  }
+
+  // ========================================================================
+  // Commands and Results
+  // ========================================================================
+
+  // The oldest delivered command not run yet
+  bool next(MailboxCommand* out) {
+    if (commandCount == 0) {
+      return false;
+    }
+    *out = commands[commandHead];
+    commandHead = (commandHead + 1) % MAILBOX_COMMANDS;
+    commandCount--;
+    return true;
+  }
+
+  // {"id":..,"success":..,"message":..} as the dashboard expects a result;
+  // data, when given, is a JSON value
+  static String resultJson(uint32_t id, bool error, const char* message, const char* data = NULL) {
+    String json = "{\"id\":" + String(id) + ",\"success\":" + String(error ? "false" : "true") + ",\"message\":";
+    appendJsonString(json, message);
+    if (error) {
+      json += ",\"error\":";
+      appendJsonString(json, message);
+    }
+    if (data) {
+      json += ",\"data\":";
+      json += data;
+    }
+    json += "}";
+    return json;
+  }
+
+  // Queued for the next poll
+  void addResult(uint32_t id, bool error, const char* message, const char* data = NULL) {
+    addResultJson(resultJson(id, error, message, data));
+  }
+
+  // Results pile up while polls fail; past MAILBOX_RESULTS_LEN the newest
+  // are dropped and the dashboard times out waiting for them
+  void addResultJson(const String& json) {
+    if (results.length() + json.length() + 1 > MAILBOX_RESULTS_LEN) {
+      stats.droppedResults++;
+      return;
+    }
+    if (resultCount > 0) {
+      results += ",";
+    }
+    results += json;
+    resultCount++;
+    stats.results++;
+  }
+
+  const MailboxStats& getStats() { return stats; }
+};
+
+#endif // MAILBOX_H
@@ -19,6 +19,14 @@ private:
   WiFiManager* wifiMgr;
   ConfigManager* configMgr;
 
+  // Extra objects in /status, filled in by the rest of the firmware
+  struct StatusSection {
+    const char* name;
+    String (*json)();
+  };
+  StatusSection statusSections[OTA_STATUS_SECTIONS];
+  int statusSectionCount = 0;
+
 public:
   OTAManager(WiFiManager* wm, ConfigManager* cm) : server(OTA_SERVER_PORT), wifiMgr(wm), configMgr(cm) {}
 
@@ -66,6 +74,15 @@ public:
     server.handleClient();
   }
 
+  // json() returns a JSON object; it is served as "name": {...} in /status
+  bool addStatusSection(const char* name, String (*json)()) {
+    if (statusSectionCount >= OTA_STATUS_SECTIONS) {
+      return false;
+    }
+    statusSections[statusSectionCount++] = { name, json };
+    return true;
+  }
+
   void stop() {
     server.stop();
     Serial.println("[OTAManager] Web server stopped");
@@ -344,6 +361,12 @@ public:
     json += "\"progress\":" + String(updateProgress) + ",";
     json += "\"sketchSize\":" + String(ESP.getSketchSize()) + ",";
     json += "\"freeSpace\":" + String(ESP.getFreeSketchSpace());
+    for (int i = 0; i < statusSectionCount; ++i) {
+      json += ",\"";
+      json += statusSections[i].name;
+      json += "\":";
+      json += statusSections[i].json();
+    }
     json += "}";
     server.send(200, "application/json", json);
   }
@@ -0,0 +1,190 @@
+#ifndef PIC_DITHER_H
+#define PIC_DITHER_H
+
+#include <stdint.h>
+#include <string.h>
+
+// ============================================================================
+// Pic Dither - Kernels that turn 96x63 levels into the Pic's bits
+// ============================================================================
+//
+// Each kernel renders PIC_WIDTH x PIC_HEIGHT levels (0 black, 255 white,
+// one byte each, 4-byte aligned) into a Pic: 12 bytes per row, the leftmost
+// pixel in the high bit, a set bit for a dark pixel. The pipeline takes
+// one as a template argument (PIC_DITHER in config.h):
+//
+//   ThresholdDither       dark below 128; flat areas stay flat
+//   BayerDither           an 8x8 ordered pattern; fast, with a visible grid
+//   ErrorDiffusionDither  Floyd-Steinberg, alternating direction; the best
+//                         tones, and serial by nature
+//
+// Threshold and Bayer compare four pixels per 32-bit word. Their levels are
+// halved to 7 bits so that (level | 0x80) - threshold cannot borrow from
+// the next byte; each byte's top bit is then set where the level is not
+// below the threshold. A multiply gathers the four bits into a nibble in
+// pixel order. The words are read little-endian, as both the ESP32 and the
+// host are.
+//
+// Error diffusion carries the error for the next pixel and the row below
+// in registers, writes each row of errors once instead of adding into it
+// three times per pixel, and assembles each byte in a register before it
+// is stored. Its output is bit for bit that of the plain per-pixel loop.
+//
+// host/picbench.cpp compares the kernels on test-images/ against per-pixel
+// versions of themselves, for speed and for how close they stay to the
+// levels.
+
+#define PIC_WIDTH      96
+#define PIC_HEIGHT     63
+#define PIC_ROW_BYTES  (PIC_WIDTH / 8)
+#define PIC_BYTES      (PIC_ROW_BYTES * PIC_HEIGHT)
+
+// ============================================================================
+// Word-parallel Helpers
+// ============================================================================
+
+namespace pic_words {
+
+static inline uint32_t load(const uint8_t* p) {
+  uint32_t w;
+  memcpy(&w, p, 4);
+  return w;
+}
+
+// Four 7-bit thresholds as one word, the first in the low byte
+static inline uint32_t thresholds(uint8_t t0, uint8_t t1, uint8_t t2, uint8_t t3) {
+  return t0 | (t1 << 8) | (t2 << 16) | ((uint32_t)t3 << 24);
+}
+
+// The four pixels of levels below their thresholds, as a nibble with the
+// first pixel in its high bit
+static inline uint32_t darkNibble(uint32_t levels, uint32_t thresholds7) {
+  uint32_t halved = (levels >> 1) & 0x7f7f7f7f;
+  uint32_t dark = ~((halved | 0x80808080) - thresholds7) & 0x80808080;
+  return ((dark >> 7) * 0x08040201) >> 24;
+}
+
+// A row of levels against a repeating pair of threshold words (8 pixels)
+static inline void packRow(const uint8_t* levels, const uint32_t* pair, uint8_t* out) {
+  for (int b = 0; b < PIC_ROW_BYTES; ++b) {
+    uint32_t hi = darkNibble(load(levels + 8 * b), pair[0]);
+    uint32_t lo = darkNibble(load(levels + 8 * b + 4), pair[1]);
+    out[b] = (hi << 4) | lo;
+  }
+}
+
+}  // namespace pic_words
+
+// ============================================================================
+// Kernels
+// ============================================================================
+
+class ThresholdDither {
+public:
+  static const char* name() { return "threshold"; }
+
+  void render(const uint8_t* levels, uint8_t* pic) {
+    static const uint32_t pair[2] = { 0x40404040, 0x40404040 };  // 128, halved
+    for (int y = 0; y < PIC_HEIGHT; ++y) {
+      pic_words::packRow(levels + y * PIC_WIDTH, pair, pic + y * PIC_ROW_BYTES);
+    }
+  }
+};
+
+class BayerDither {
+private:
+  uint32_t pairs[8][2];  // each row of the matrix, as 7-bit threshold words
+
+public:
+  // The 8x8 Bayer matrix; a level is dark below (2m + 1) / 128
+  static uint8_t matrix(int x, int y) {
+    static const uint8_t m[8][8] = {
+      { 0, 32, 8, 40, 2, 34, 10, 42 },   { 48, 16, 56, 24, 50, 18, 58, 26 },
+      { 12, 44, 4, 36, 14, 46, 6, 38 },  { 60, 28, 52, 20, 62, 30, 54, 22 },
+      { 3, 35, 11, 43, 1, 33, 9, 41 },   { 51, 19, 59, 27, 49, 17, 57, 25 },
+      { 15, 47, 7, 39, 13, 45, 5, 37 },  { 63, 31, 55, 23, 61, 29, 53, 21 },
+    };
+    return m[y & 7][x & 7];
+  }
+
+  static const char* name() { return "bayer"; }
+
+  BayerDither() {
+    for (int y = 0; y < 8; ++y) {
+      for (int w = 0; w < 2; ++w) {
+        int x = 4 * w;
+        pairs[y][w] = pic_words::thresholds(2 * matrix(x, y) + 1, 2 * matrix(x + 1, y) + 1,
+                                            2 * matrix(x + 2, y) + 1, 2 * matrix(x + 3, y) + 1);
+      }
+    }
+  }
+
+  void render(const uint8_t* levels, uint8_t* pic) {
+    for (int y = 0; y < PIC_HEIGHT; ++y) {
+      pic_words::packRow(levels + y * PIC_WIDTH, pairs[y & 7], pic + y * PIC_ROW_BYTES);
+    }
+  }
+};
+
+class ErrorDiffusionDither {
+private:
+  // errors for the row being rendered and the next, in 16ths, padded by a
+  // pixel on each side
+  int16_t errs[2][PIC_WIDTH + 2];
+
+public:
+  static const char* name() { return "error-diffusion"; }
+
+  void render(const uint8_t* levels, uint8_t* pic) {
+    memset(errs[0], 0, sizeof(errs[0]));
+    for (int y = 0; y < PIC_HEIGHT; ++y) {
+      const int16_t* above = &errs[y & 1][1];  // what the row above left
+      int16_t* below = &errs[(y + 1) & 1][1];
+      const uint8_t* row = levels + y * PIC_WIDTH;
+      uint8_t* out = pic + y * PIC_ROW_BYTES;
+      // 7/16 of the error goes ahead; 3/16 behind, 5/16 under and 1/16
+      // ahead in the row below, which is final once the pixel after has
+      // added to it
+      int ahead = 0;
+      int behindBelow = 0;
+      int underBelow = 0;
+      if ((y & 1) == 0) {
+        for (int b = 0; b < PIC_ROW_BYTES; ++b) {
+          uint32_t bits = 0;
+          for (int x = 8 * b; x < 8 * b + 8; ++x) {
+            int v = row[x] + (above[x] + ahead) / 16;
+            int dark = v < 128;
+            int e = dark ? v : v - 255;
+            bits = (bits << 1) | dark;
+            ahead = 7 * e;
+            below[x - 1] = behindBelow + 3 * e;
+            behindBelow = underBelow + 5 * e;
+            underBelow = e;
+          }
+          out[b] = bits;
+        }
+        below[PIC_WIDTH - 1] = behindBelow;
+        below[PIC_WIDTH] = underBelow;
+      } else {
+        for (int b = PIC_ROW_BYTES - 1; b >= 0; --b) {
+          uint32_t bits = 0;
+          for (int x = 8 * b + 7; x >= 8 * b; --x) {
+            int v = row[x] + (above[x] + ahead) / 16;
+            int dark = v < 128;
+            int e = dark ? v : v - 255;
+            bits = (bits >> 1) | (dark << 7);
+            ahead = 7 * e;
+            below[x + 1] = behindBelow + 3 * e;
+            behindBelow = underBelow + 5 * e;
+            underBelow = e;
+          }
+          out[b] = bits;
+        }
+        below[0] = behindBelow;
+        below[-1] = underBelow;
+      }
+    }
+  }
+};
+
+#endif // PIC_DITHER_H
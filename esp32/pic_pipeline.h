@@ -0,0 +1,218 @@
+#ifndef PIC_PIPELINE_H
+#define PIC_PIPELINE_H
+
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+#include "pic_dither.h"
+
+// ============================================================================
+// Pic Pipeline - A camera frame as a 96x63 calculator picture
+// ============================================================================
+//
+// snap turns its frame into the Pic variable the calculator reads, with no
+// server in between. The input is 8-bit luma (the sensor's grayscale frame,
+// or its JPEG decoded at reduced scale and converted). It goes through:
+//
+//   1. a center crop to the Pic's 96:63 aspect
+//   2. an area-average downscale to 96x63: every source pixel counts by how
+//      much of it each output pixel covers, in integers, so no row or
+//      column is skipped as with point sampling
+//   3. a contrast stretch between the darkest and brightest few pixels
+//      (PIC_STRETCH_CLIP_PERMILLE at each end)
+//   4. dithering, by the kernel the pipeline is built with (pic_dither.h;
+//      PicPipeline uses PIC_DITHER)
+//
+// The result is the Pic's 756 bytes: 63 rows of 12, the top row first, the
+// leftmost pixel in each byte's high bit and a set bit for a dark pixel -
+// what build/prepareimage.mjs makes of a picture for /image/fetch.
+//
+// The pipeline does not allocate and does not touch Arduino APIs, so
+// host/picbench.cpp runs the same code on the pictures in test-images/.
+
+#define PIC_MAX_CROP_AREA  (0xffffffffu / 255)
+
+// A region of an 8-bit luma image
+struct PicCrop {
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+struct PicStats {
+  PicCrop crop = { 0, 0, 0, 0 };
+  uint8_t low = 0;    // levels mapped to black and white by the stretch
+  uint8_t high = 255;
+  uint16_t dark = 0;  // pixels set in the Pic
+};
+
+template <class Dither>
+class BasicPicPipeline {
+private:
+  alignas(4) uint8_t gray[PIC_WIDTH * PIC_HEIGHT];
+  uint32_t rowSums[PIC_WIDTH];
+  uint32_t acc[PIC_WIDTH];
+  Dither ditherer;
+  PicStats stats;
+
+  // Sums the crop's part of one source row into rowSums, each output column
+  // weighted in units of 1/PIC_WIDTH of a source pixel
+  void sumRow(const uint8_t* row, int cropWidth) {
+    memset(rowSums, 0, sizeof(rowSums));
+    int out = 0;
+    uint32_t boundary = cropWidth;  // where output column out ends
+    for (int x = 0; x < cropWidth; ++x) {
+      uint32_t start = (uint32_t)x * PIC_WIDTH;
+      uint32_t end = start + PIC_WIDTH;
+      while (start < end) {
+        uint32_t stop = end < boundary ? end : boundary;
+        rowSums[out] += row[x] * (stop - start);
+        start = stop;
+        if (start == boundary) {
+          out++;
+          boundary += cropWidth;
+        }
+      }
+    }
+  }
+
+public:
+  // The largest centered region of a width x height image with the Pic's
+  // aspect
+  static PicCrop centerCrop(int width, int height) {
+    PicCrop c;
+    if ((long)width * PIC_HEIGHT > (long)height * PIC_WIDTH) {
+      c.height = height;
+      c.width = ((long)height * PIC_WIDTH + PIC_HEIGHT / 2) / PIC_HEIGHT;
+    } else {
+      c.width = width;
+      c.height = ((long)width * PIC_HEIGHT + PIC_WIDTH / 2) / PIC_WIDTH;
+    }
+    c.x = (width - c.width) / 2;
+    c.y = (height - c.height) / 2;
+    return c;
+  }
+
+  // Converts big-endian RGB565 pixels (what the camera's JPEG decoder
+  // writes) to luma in place; the luma takes the first half of the buffer
+  static void rgb565ToLuma(uint8_t* buf, size_t pixels) {
+    for (size_t i = 0; i < pixels; ++i) {
+      uint16_t p = (buf[2 * i] << 8) | buf[2 * i + 1];
+      uint32_t r = ((p >> 11) * 527 + 23) >> 6;  // 5 and 6 bits to 8
+      uint32_t g = (((p >> 5) & 0x3f) * 259 + 33) >> 6;
+      uint32_t b = ((p & 0x1f) * 527 + 23) >> 6;
+      buf[i] = (77 * r + 150 * g + 29 * b) >> 8;
+    }
+  }
+
+  // Step 2: averages crop of the image (stride bytes per row) down to
+  // PIC_WIDTH x PIC_HEIGHT levels
+  void downscale(const uint8_t* luma, int stride, const PicCrop& crop) {
+    int out = 0;
+    uint32_t boundary = crop.height;  // where output row out ends
+    uint32_t area = (uint32_t)crop.width * crop.height;
+    memset(acc, 0, sizeof(acc));
+    for (int y = 0; y < crop.height; ++y) {
+      sumRow(luma + (size_t)(crop.y + y) * stride + crop.x, crop.width);
+      uint32_t start = (uint32_t)y * PIC_HEIGHT;
+      uint32_t end = start + PIC_HEIGHT;
+      while (start < end) {
+        uint32_t stop = end < boundary ? end : boundary;
+        for (int x = 0; x < PIC_WIDTH; ++x) {
+          acc[x] += rowSums[x] * (stop - start);
+        }
+        start = stop;
+        if (start == boundary) {
+          uint8_t* dst = &gray[out * PIC_WIDTH];
+          for (int x = 0; x < PIC_WIDTH; ++x) {
+            dst[x] = (acc[x] + area / 2) / area;
+          }
+          memset(acc, 0, sizeof(acc));
+          out++;
+          boundary += crop.height;
+        }
+      }
+    }
+  }
+
+  // Step 3: spreads the levels between the clipped extremes over 0-255. A
+  // nearly flat picture is stretched by at most 255 / PIC_STRETCH_MIN_RANGE
+  // so its noise does not become the picture.
+  void stretch() {
+    uint16_t hist[256];
+    memset(hist, 0, sizeof(hist));
+    for (int i = 0; i < PIC_WIDTH * PIC_HEIGHT; ++i) {
+      hist[gray[i]]++;
+    }
+    const int clip = PIC_WIDTH * PIC_HEIGHT * PIC_STRETCH_CLIP_PERMILLE / 1000;
+    int low = 0;
+    int seen = hist[0];
+    while (low < 255 && seen <= clip) {
+      seen += hist[++low];
+    }
+    int high = 255;
+    seen = hist[255];
+    while (high > 0 && seen <= clip) {
+      seen += hist[--high];
+    }
+    if (high - low < PIC_STRETCH_MIN_RANGE) {
+      int mid = (low + high) / 2;
+      low = mid - PIC_STRETCH_MIN_RANGE / 2;
+      high = low + PIC_STRETCH_MIN_RANGE;
+      if (low < 0) {
+        low = 0;
+        high = PIC_STRETCH_MIN_RANGE;
+      } else if (high > 255) {
+        high = 255;
+        low = 255 - PIC_STRETCH_MIN_RANGE;
+      }
+    }
+    uint8_t map[256];
+    for (int v = 0; v < 256; ++v) {
+      int s = v <= low ? 0 : v >= high ? 255 : ((v - low) * 255 + (high - low) / 2) / (high - low);
+      map[v] = s;
+    }
+    for (int i = 0; i < PIC_WIDTH * PIC_HEIGHT; ++i) {
+      gray[i] = map[gray[i]];
+    }
+    stats.low = low;
+    stats.high = high;
+  }
+
+  // Step 4: dithers the levels into pic (PIC_BYTES)
+  void dither(uint8_t* pic) {
+    ditherer.render(gray, pic);
+    stats.dark = 0;
+    for (int i = 0; i < PIC_BYTES; ++i) {
+      stats.dark += __builtin_popcount(pic[i]);
+    }
+  }
+
+  // The whole pipeline: width x height luma with stride bytes per row into
+  // pic (PIC_BYTES). False for an empty image, or a crop of more than
+  // PIC_MAX_CROP_AREA pixels, whose sums would not fit 32 bits.
+  bool render(const uint8_t* luma, int width, int height, int stride, uint8_t* pic) {
+    if (width <= 0 || height <= 0 || stride < width) {
+      return false;
+    }
+    stats.crop = centerCrop(width, height);
+    uint32_t area = (uint32_t)stats.crop.width * stats.crop.height;
+    if (area == 0 || area > PIC_MAX_CROP_AREA) {
+      return false;
+    }
+    downscale(luma, stride, stats.crop);
+    stretch();
+    dither(pic);
+    return true;
+  }
+
+  // The levels before dithering, PIC_WIDTH per row
+  const uint8_t* levels() { return gray; }
+
+  const PicStats& getStats() { return stats; }
+};
+
+typedef BasicPicPipeline<PIC_DITHER> PicPipeline;
+
+#endif // PIC_PIPELINE_H
@@ -0,0 +1,105 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// Prefetcher - Predicted requests that warm the response cache
+// ============================================================================
+//
+// After a page of image_list or program_list, the calculator almost always
+// asks for the next page or for one of the listed items. The list commands
+// queue those URLs here. While the calculator is busy displaying, the network
+// task fetches them one at a time into the response cache. Each time the
+// link, a transfer or a command needs the network, it backs off for
+// PREFETCH_BACKOFF_MS.
+//
+// A new list page replaces the predictions of the previous one. Whether a
+// prediction paid off is counted by the cache (prefetchHits/prefetchWasted).
+//
+// Only the network task uses the prefetcher.
+
+struct PrefetchStats {
+  uint32_t queued = 0;
+  uint32_t fetched = 0;    // requests sent
+  uint32_t fresh = 0;      // already cached, nothing to do
+  uint32_t failed = 0;
+  uint32_t dropped = 0;    // replaced by a newer page before their turn
+  uint32_t backoffs = 0;
+};
+
+class Prefetcher {
+private:
+  String urls[PREFETCH_QUEUE_LEN];
+  unsigned long freshMs[PREFETCH_QUEUE_LEN];
+  int head = 0;
+  int count = 0;
+  unsigned long nextAttempt = 0;
+  PrefetchStats stats;
+
+public:
+  // Forgets predictions not fetched yet
+  void clear() {
+    stats.dropped += count;
+    for (int i = 0; i < count; ++i) {
+      urls[(head + i) % PREFETCH_QUEUE_LEN] = String();
+    }
+    head = 0;
+    count = 0;
+  }
+
+  // A URL the calculator will probably want next, cached for freshMs
+  void add(const String& url, unsigned long fresh) {
+    if (count >= PREFETCH_QUEUE_LEN) {
+      stats.dropped++;
+      return;
+    }
+    int slot = (head + count) % PREFETCH_QUEUE_LEN;
+    urls[slot] = url;
+    freshMs[slot] = fresh;
+    count++;
+    stats.queued++;
+  }
+
+  // ========================================================================
+  // Fetching
+  // ========================================================================
+
+  // The next prediction, if there is one and the prefetcher is not backing off
+  bool next(String* url, unsigned long* fresh) {
+    if (count == 0 || (long)(millis() - nextAttempt) < 0) {
+      return false;
+    }
+    *url = urls[head];
+    *fresh = freshMs[head];
+    urls[head] = String();
+    head = (head + 1) % PREFETCH_QUEUE_LEN;
+    count--;
+    return true;
+  }
+
+  bool pending() { return count > 0; }
+
+  // Something else needs the network or the link
+  void backOff() {
+    if ((long)(millis() - nextAttempt) >= 0) {
+      stats.backoffs++;
+    }
+    nextAttempt = millis() + PREFETCH_BACKOFF_MS;
+  }
+
+  void noteFetched(bool ok) {
+    if (ok) {
+      stats.fetched++;
+    } else {
+      stats.failed++;
+    }
+  }
+
+  void noteFresh() { stats.fresh++; }
+
+  const PrefetchStats& getStats() { return stats; }
+};
+
+#endif // PREFETCHER_H
@@ -0,0 +1,315 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// Response Cache - URL-keyed LRU of server responses in PSRAM
+// ============================================================================
+//
+// Paging through image_list/program_list and fetching the same image or
+// program again used to download the same bytes over ngrok every time. Bodies
+// that came with an ETag are kept here, in PSRAM when the board has it. A copy
+// younger than the caller's freshness window is served without asking the
+// server. An older copy is revalidated with If-None-Match, and a 304 serves
+// it without the body being sent again.
+//
+// A body with a Content-Length is allocated whole up front. One without it
+// (chunked, or decoded from gzip) grows from CACHE_FILL_STEP and is kept if
+// it ends within CACHE_ENTRY_MAX_LEN. When the budget is exhausted, the least
+// recently used entries are dropped. An entry being sent to the calculator is
+// pinned and is never dropped.
+//
+// Only the network task uses the cache.
+
+struct ResponseCacheStats {
+  uint32_t hits = 0;          // served without a request
+  uint32_t revalidated = 0;   // served after a 304
+  uint32_t misses = 0;        // fetched in full
+  uint32_t stored = 0;
+  uint32_t evicted = 0;
+  uint32_t prefetchHits = 0;    // prefetched entries the calculator then asked for
+  uint32_t prefetchWasted = 0;  // prefetched entries dropped unused
+  uint32_t entries = 0;
+  uint32_t bytes = 0;         // bodies, URLs and ETags
+  uint32_t budget = 0;
+};
+
+// Copies a response body into a new entry while it streams to its real sink
+class CacheFill : public Print {
+private:
+  uint8_t* buf = NULL;
+  size_t capacity = 0;
+  size_t limit = 0;    // what capacity may grow to when the length is unknown
+  size_t len = 0;
+  bool sized = false;  // capacity is the announced length
+  bool psram = false;
+  bool prefetch = false;
+
+  friend class ResponseCache;
+
+public:
+  String url;
+  String etag;
+
+  bool active() { return buf != NULL; }
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  size_t write(const uint8_t* src, size_t n) override {
+    if (!buf) return n;
+    if (len + n > capacity && len + n <= limit) {
+      size_t grown = min(max(capacity * 2, len + n), limit);
+      uint8_t* bigger = (uint8_t*)(psram ? ps_realloc(buf, grown) : realloc(buf, grown));
+      if (bigger) {
+        buf = bigger;
+        capacity = grown;
+      }
+    }
+    if (len + n > capacity) {
+      // longer than announced or allowed: not worth keeping
+      free(buf);
+      buf = NULL;
+      return n;
+    }
+    memcpy(&buf[len], src, n);
+    len += n;
+    return n;
+  }
+};
+
+class ResponseCache {
+public:
+  struct Entry {
+    String url;
+    String etag;
+    uint8_t* body = NULL;
+    size_t len = 0;
+    unsigned long validatedAt = 0;  // millis() of the last 200 or 304
+    uint32_t lastUse = 0;
+    uint8_t pins = 0;
+    bool prefetched = false;  // warmed by the prefetcher, not used yet
+  };
+
+private:
+  Entry entries[CACHE_MAX_ENTRIES];
+  uint32_t useClock = 0;
+  bool psram = false;
+  bool prefetching = false;
+  ResponseCacheStats stats;
+
+  static size_t cost(const Entry& e) { return e.len + e.url.length() + e.etag.length(); }
+
+  void* alloc(size_t size) { return psram ? ps_malloc(size) : malloc(size); }
+
+  void drop(Entry& e) {
+    if (e.prefetched) {
+      stats.prefetchWasted++;
+    }
+    stats.bytes -= cost(e);
+    stats.entries--;
+    free(e.body);
+    e.body = NULL;
+    e.url = String();
+    e.etag = String();
+    e.len = 0;
+    e.prefetched = false;
+  }
+
+  void used(Entry* e) {
+    e->lastUse = ++useClock;
+    if (e->prefetched) {
+      e->prefetched = false;
+      stats.prefetchHits++;
+    }
+  }
+
+  // Drops least recently used entries until size more bytes fit; false if
+  // pinned entries leave too little room. keep (the copy a fill will
+  // replace) goes last.
+  bool makeRoom(size_t size, const Entry* keep = NULL) {
+    while (stats.bytes + size > stats.budget) {
+      Entry* victim = NULL;
+      for (int i = 0; i < CACHE_MAX_ENTRIES; ++i) {
+        Entry& e = entries[i];
+        if (e.body && !e.pins && &e != keep && (!victim || e.lastUse < victim->lastUse)) {
+          victim = &e;
+        }
+      }
+      if (!victim && keep && keep->body && !keep->pins) {
+        victim = (Entry*)keep;
+      }
+      if (!victim) {
+        return false;
+      }
+      drop(*victim);
+      stats.evicted++;
+    }
+    return true;
+  }
+
+  Entry* freeSlot() {
+    for (int i = 0; i < CACHE_MAX_ENTRIES; ++i) {
+      if (!entries[i].body) return &entries[i];
+    }
+    return NULL;
+  }
+
+public:
+  void begin() {
+    psram = psramFound();
+    stats.budget = psram ? CACHE_PSRAM_BYTES : CACHE_HEAP_BYTES;
+    Serial.print("[ResponseCache] ");
+    Serial.print(stats.budget / 1024);
+    Serial.println(psram ? " KB in PSRAM" : " KB in internal RAM (no PSRAM)");
+  }
+
+  // ========================================================================
+  // Lookup
+  // ========================================================================
+
+  Entry* find(const String& url) {
+    for (int i = 0; i < CACHE_MAX_ENTRIES; ++i) {
+      if (entries[i].body && entries[i].url == url) return &entries[i];
+    }
+    return NULL;
+  }
+
+  bool fresh(Entry* e, unsigned long freshMs) { return millis() - e->validatedAt < freshMs; }
+
+  // A fresh entry served without a request
+  void hit(Entry* e) {
+    used(e);
+    stats.hits++;
+  }
+
+  // The server answered 304 to the entry's ETag
+  void revalidated(Entry* e) {
+    e->validatedAt = millis();
+    if (prefetching) {
+      e->prefetched = true;
+      return;
+    }
+    used(e);
+    stats.revalidated++;
+  }
+
+  // While set, requests are the prefetcher's: they do not count as use
+  void setPrefetching(bool on) { prefetching = on; }
+
+  // Writes the body into sink. False if the sink overflowed.
+  bool serve(Entry* e, Print& sink) { return sink.write(e->body, e->len) == e->len; }
+
+  // Forgets the URL's copy, unless the link is reading it
+  void invalidate(const String& url) {
+    Entry* e = find(url);
+    if (e && !e->pins) {
+      drop(*e);
+    }
+  }
+
+  // Keeps the body in place while the link reads it
+  void pin(Entry* e) { e->pins++; }
+  void unpin(Entry* e) { e->pins--; }
+
+  // ========================================================================
+  // Filling
+  // ========================================================================
+
+  // Starts copying a 200 response; contentLength < 0 when it is not known.
+  // The fill stays inactive (and the response uncached) without an ETag.
+  // An older copy of the URL stays until commit() replaces it, so a body
+  // that never arrives whole leaves it in place.
+  void beginFill(CacheFill& fill, const String& url, const String& etag, int contentLength) {
+    if (!prefetching) {
+      stats.misses++;
+    }
+    abort(fill);
+    if (!stats.budget || etag.length() == 0 || contentLength > CACHE_ENTRY_MAX_LEN) {
+      return;
+    }
+    fill.sized = contentLength >= 0;
+    if (fill.sized) {
+      if (!makeRoom(contentLength + url.length() + etag.length(), find(url))) {
+        return;
+      }
+      fill.capacity = contentLength;
+    } else {
+      // room is made at commit(), once the length is known
+      fill.capacity = CACHE_FILL_STEP;
+    }
+    fill.buf = (uint8_t*)alloc(max(fill.capacity, (size_t)1));
+    fill.limit = fill.sized ? fill.capacity : CACHE_ENTRY_MAX_LEN;
+    fill.psram = psram;
+    fill.len = 0;
+    fill.url = url;
+    fill.etag = etag;
+    fill.prefetch = prefetching;
+  }
+
+  // Stores a fill whose body arrived complete; returns the entry or NULL
+  Entry* commit(CacheFill& fill) {
+    if (!fill.buf || (fill.sized && fill.len != fill.capacity)) {
+      abort(fill);
+      return NULL;
+    }
+    if (!fill.sized) {
+      if (!makeRoom(fill.len + fill.url.length() + fill.etag.length(), find(fill.url))) {
+        abort(fill);
+        return NULL;
+      }
+      // give back what the last doubling did not use
+      uint8_t* fitted = (uint8_t*)(psram ? ps_realloc(fill.buf, max(fill.len, (size_t)1)) : realloc(fill.buf, max(fill.len, (size_t)1)));
+      if (fitted) {
+        fill.buf = fitted;
+      }
+    }
+    Entry* old = find(fill.url);
+    if (old && !old->pins) {
+      drop(*old);
+      old = NULL;
+    }
+    Entry* e = old ? NULL : freeSlot();
+    if (!e) {
+      // all slots taken (or the old copy is still pinned): drop the LRU
+      Entry* victim = NULL;
+      for (int i = 0; i < CACHE_MAX_ENTRIES; ++i) {
+        if (entries[i].body && !entries[i].pins && (!victim || entries[i].lastUse < victim->lastUse)) {
+          victim = &entries[i];
+        }
+      }
+      if (old || !victim) {
+        abort(fill);
+        return NULL;
+      }
+      drop(*victim);
+      stats.evicted++;
+      e = victim;
+    }
+    e->url = fill.url;
+    e->etag = fill.etag;
+    e->body = fill.buf;
+    e->len = fill.len;
+    e->validatedAt = millis();
+    e->lastUse = ++useClock;
+    e->pins = 0;
+    e->prefetched = fill.prefetch;
+    fill.buf = NULL;
+    stats.bytes += cost(*e);
+    stats.entries++;
+    stats.stored++;
+    return e;
+  }
+
+  // Discards a fill; the copy it would have replaced is kept
+  void abort(CacheFill& fill) {
+    free(fill.buf);
+    fill.buf = NULL;
+    fill.len = 0;
+  }
+
+  const ResponseCacheStats& getStats() { return stats; }
+};
+
+#endif // RESPONSE_CACHE_H
@@ -0,0 +1,111 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// ============================================================================
+// SPSC Queue - Lock-free ring between exactly one producer and one consumer
+// ============================================================================
+//
+// The link task and the network task hand work to each other through these.
+// Only the producer writes `tail` and only the consumer writes `head`, so a
+// release store on one side paired with an acquire load on the other is all
+// the synchronisation needed: no locks, and neither side ever blocks. The
+// counters run freely and are masked on access, so N must be a power of two
+// and all N slots are usable.
+
+template <typename T, size_t N>
+class SpscQueue {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+private:
+  T items[N];
+  std::atomic<size_t> head{0};  // next slot to read (consumer)
+  std::atomic<size_t> tail{0};  // next slot to write (producer)
+
+public:
+  // ========================================================================
+  // Producer
+  // ========================================================================
+
+  bool push(const T& item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) >= N) {
+      return false;
+    }
+    items[t & (N - 1)] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Copies as many items as fit; returns how many
+  size_t push(const T* src, size_t count) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t n = min(count, N - (t - head.load(std::memory_order_acquire)));
+    for (size_t i = 0; i < n; ++i) {
+      items[(t + i) & (N - 1)] = src[i];
+    }
+    tail.store(t + n, std::memory_order_release);
+    return n;
+  }
+
+  size_t space() const {
+    return N - (tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire));
+  }
+
+  // ========================================================================
+  // Consumer
+  // ========================================================================
+
+  // The oldest item (or the i-th after it), left in place until pop();
+  // NULL when there are not that many
+  T* peek(size_t i = 0) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (tail.load(std::memory_order_acquire) - h <= i) {
+      return NULL;
+    }
+    return &items[(h + i) & (N - 1)];
+  }
+
+  bool pop(T* out = NULL) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    if (out) {
+      *out = items[h & (N - 1)];
+    }
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Moves up to count items into dst; returns how many
+  size_t pop(T* dst, size_t count) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t n = min(count, tail.load(std::memory_order_acquire) - h);
+    for (size_t i = 0; i < n; ++i) {
+      dst[i] = items[(h + i) & (N - 1)];
+    }
+    head.store(h + n, std::memory_order_release);
+    return n;
+  }
+
+  // ========================================================================
+  // Either Side
+  // ========================================================================
+
+  size_t size() const {
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+  }
+
+  bool empty() const { return size() == 0; }
+
+  // Only while neither side is using the queue
+  void reset() {
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+  }
+};
+
+#endif // SPSC_QUEUE_H
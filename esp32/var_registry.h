@@ -0,0 +1,252 @@
+#ifndef VAR_REGISTRY_H
+#define VAR_REGISTRY_H
+
+#include <TICL.h>
+#include <TIVar.h>
+#include "config.h"
+
+// ============================================================================
+// Variable Registry - Named results the calculator can Get( after a command
+// ============================================================================
+//
+// Commands publish into slots named after calculator variables:
+//   Str0-Str9   text, copied into the slot (or referenced, see below)
+//   Pic0-Pic9   756-byte pictures, referenced (the publisher owns the buffer)
+//   L1-L6       real lists, copied
+//   A-Z, theta  reals
+// onRequest asks serve() first, so a single command can leave several results
+// behind for the calculator to pull. Every slot has its own capacity and a
+// lifetime: kept until replaced, dropped when the next command starts, or
+// dropped after the calculator has read it once. A slot can also expire
+// after ttlMs.
+
+enum VarLifetime {
+  VAR_KEEP,     // until replaced or cleared
+  VAR_COMMAND,  // until the next command starts
+  VAR_ONCE,     // until the calculator has read it
+};
+
+// Link names: Str1..Str9 = 0..8 and Str0 = 9 (same for Pic), L1..L6 = 0..5
+#define VAR_STR_PREFIX  0xAA
+#define VAR_PIC_PREFIX  0x60
+#define VAR_LIST_PREFIX 0x5D
+#define VAR_THETA       0x5B
+
+class VarRegistry {
+private:
+  struct Slot {
+    bool published = false;
+    VarLifetime lifetime = VAR_KEEP;
+    unsigned long expiresAt = 0;  // millis(), 0 = never
+    const void* ref = NULL;       // referenced content (strings, pics)
+    size_t len = 0;               // chars, list entries or bytes
+  };
+
+  bool muted = false;  // publishing is ignored (see mute())
+
+  Slot strSlots[10];
+  Slot picSlots[10];
+  Slot listSlots[6];
+  Slot realSlots[27];
+
+  const size_t strCapacity[10] = VAR_STR_CAPACITY;
+  const size_t listCapacity[6] = VAR_LIST_CAPACITY;
+  char strPool[VAR_STR_POOL_LEN];
+  double listPool[VAR_LIST_POOL_LEN];
+  double reals[27];
+
+  static int linkIndex(int n) { return n == 0 ? 9 : n - 1; }
+
+  char* strStorage(int slot) {
+    size_t offset = 0;
+    for (int i = 0; i < slot; ++i) offset += strCapacity[i] + 1;
+    return &strPool[offset];
+  }
+
+  double* listStorage(int slot) {
+    size_t offset = 0;
+    for (int i = 0; i < slot; ++i) offset += listCapacity[i];
+    return &listPool[offset];
+  }
+
+  static int realSlot(uint8_t name) {
+    if (name >= 'A' && name <= 'Z') return name - 'A';
+    if (name == VAR_THETA) return 26;
+    return -1;
+  }
+
+  void set(Slot& slot, VarLifetime lifetime, unsigned long ttlMs, const void* ref, size_t len) {
+    slot.published = true;
+    slot.lifetime = lifetime;
+    slot.expiresAt = ttlMs ? max(millis() + ttlMs, 1UL) : 0;
+    slot.ref = ref;
+    slot.len = len;
+  }
+
+  bool live(Slot& slot) {
+    if (slot.published && slot.expiresAt && (long)(millis() - slot.expiresAt) >= 0) {
+      slot.published = false;
+    }
+    return slot.published;
+  }
+
+  static void writeHeader(uint8_t* header, int* headerlen, int datalen, uint8_t type, uint8_t name0, uint8_t name1) {
+    memset(header, 0, 16);
+    TIVar::intToSizeWord(datalen, header);
+    header[2] = type;
+    header[3] = name0;
+    header[4] = name1;
+    *headerlen = 13;
+  }
+
+public:
+  VarRegistry() {
+    size_t strTotal = 0, listTotal = 0;
+    for (int i = 0; i < 10; ++i) strTotal += strCapacity[i] + 1;
+    for (int i = 0; i < 6; ++i) listTotal += listCapacity[i];
+    if (strTotal > VAR_STR_POOL_LEN || listTotal > VAR_LIST_POOL_LEN) {
+      Serial.println("[VarRegistry] Slot capacities exceed their pools");
+    }
+  }
+
+  // ========================================================================
+  // Publishing (n is the number the calculator uses: Str1, Pic2, L3...)
+  // ========================================================================
+
+  // Copies text into Str<n>, truncated to the slot's capacity
+  bool publishString(int n, const char* text, VarLifetime lifetime = VAR_COMMAND, unsigned long ttlMs = 0) {
+    if (muted || n < 0 || n > 9) return false;
+    int slot = linkIndex(n);
+    char* dst = strStorage(slot);
+    strncpy(dst, text, strCapacity[slot]);
+    dst[strCapacity[slot]] = '\0';
+    set(strSlots[slot], lifetime, ttlMs, dst, strlen(dst));
+    return true;
+  }
+
+  // Serves up to len chars (capped by the slot) straight from text; it has
+  // to outlive the slot
+  bool publishStringRef(int n, const char* text, size_t len, VarLifetime lifetime = VAR_COMMAND,
+                        unsigned long ttlMs = 0) {
+    if (muted || n < 0 || n > 9) return false;
+    int slot = linkIndex(n);
+    set(strSlots[slot], lifetime, ttlMs, text, min(len, strCapacity[slot]));
+    return true;
+  }
+
+  // pic is a full Pic variable (size word + 756 bytes); it has to outlive the slot
+  bool publishPic(int n, const uint8_t* pic, VarLifetime lifetime = VAR_COMMAND, unsigned long ttlMs = 0) {
+    if (muted || n < 0 || n > 9) return false;
+    set(picSlots[linkIndex(n)], lifetime, ttlMs, pic, TIVar::sizeWordToInt((uint8_t*)pic) + 2);
+    return true;
+  }
+
+  // Copies up to the slot's capacity into L<n>
+  bool publishList(int n, const double* values, size_t count, VarLifetime lifetime = VAR_COMMAND,
+                   unsigned long ttlMs = 0) {
+    if (muted || n < 1 || n > 6) return false;
+    int slot = n - 1;
+    count = min(count, listCapacity[slot]);
+    memcpy(listStorage(slot), values, count * sizeof(double));
+    set(listSlots[slot], lifetime, ttlMs, NULL, count);
+    return true;
+  }
+
+  bool publishReal(uint8_t name, double value, VarLifetime lifetime = VAR_COMMAND, unsigned long ttlMs = 0) {
+    int slot = realSlot(name);
+    if (muted || slot < 0) return false;
+    reals[slot] = value;
+    set(realSlots[slot], lifetime, ttlMs, NULL, 1);
+    return true;
+  }
+
+  // ========================================================================
+  // Lifetime
+  // ========================================================================
+
+  // While muted, publishing leaves every slot and its content as it was, for
+  // commands whose results the calculator did not ask for
+  void mute(bool on) { muted = on; }
+
+  void beginCommand() {
+    Slot* groups[] = { strSlots, picSlots, listSlots, realSlots };
+    int sizes[] = { 10, 10, 6, 27 };
+    for (int g = 0; g < 4; ++g) {
+      for (int i = 0; i < sizes[g]; ++i) {
+        if (groups[g][i].lifetime == VAR_COMMAND) groups[g][i].published = false;
+      }
+    }
+  }
+
+  void clear() {
+    Slot* groups[] = { strSlots, picSlots, listSlots, realSlots };
+    int sizes[] = { 10, 10, 6, 27 };
+    for (int g = 0; g < 4; ++g) {
+      for (int i = 0; i < sizes[g]; ++i) groups[g][i].published = false;
+    }
+  }
+
+  int publishedCount() {
+    int n = 0;
+    for (int i = 0; i < 10; ++i) n += live(strSlots[i]) + live(picSlots[i]);
+    for (int i = 0; i < 6; ++i) n += live(listSlots[i]);
+    for (int i = 0; i < 27; ++i) n += live(realSlots[i]);
+    return n;
+  }
+
+  // ========================================================================
+  // CBL2 send callback
+  // ========================================================================
+
+  // Fills header/data for a Get( of a published slot. Returns false when
+  // nothing is published under that name, so onRequest can fall back.
+  bool serve(uint8_t type, enum Endpoint model, uint8_t* header, uint8_t* data, int maxlen,
+             int* headerlen, int* datalen) {
+    uint8_t name0 = header[3];
+    uint8_t name1 = header[4];
+    Slot* slot = NULL;
+
+    if (name0 == VAR_STR_PREFIX && type == VarTypes82::VarString && name1 < 10) {
+      slot = &strSlots[name1];
+      if (!live(*slot)) return false;
+      // tokens take up to two bytes per character
+      size_t len = min(slot->len, (size_t)(maxlen - 2) / 2);
+      String text;
+      text.reserve(len);
+      const char* src = (const char*)slot->ref;
+      for (size_t i = 0; i < len && src[i]; ++i) text += src[i];
+      *datalen = TIVar::stringToStrVar8x(text, data, model);
+    } else if (name0 == VAR_PIC_PREFIX && type == VarTypes82::VarPic && name1 < 10) {
+      slot = &picSlots[name1];
+      if (!live(*slot) || (int)slot->len > maxlen) return false;
+      memcpy(data, slot->ref, slot->len);
+      *datalen = slot->len;
+    } else if (name0 == VAR_LIST_PREFIX && type == VarTypes82::VarRList && name1 < 6) {
+      slot = &listSlots[name1];
+      if (!live(*slot)) return false;
+      size_t count = min(slot->len, (size_t)(maxlen - 2) / 9);
+      const double* values = listStorage(name1);
+      TIVar::intToSizeWord(count, data);
+      int offset = 2;
+      for (size_t i = 0; i < count; ++i) {
+        offset += TIVar::floatToReal8x(values[i], &data[offset], model);
+      }
+      *datalen = offset;
+    } else if (type == VarTypes82::VarReal && realSlot(name0) >= 0) {
+      slot = &realSlots[realSlot(name0)];
+      if (!live(*slot)) return false;
+      *datalen = TIVar::floatToReal8x(reals[realSlot(name0)], data, model);
+    } else {
+      return false;
+    }
+
+    writeHeader(header, headerlen, *datalen, type, name0, name0 == VAR_STR_PREFIX || name0 == VAR_PIC_PREFIX ||
+                name0 == VAR_LIST_PREFIX ? name1 : 0);
+    if (slot->lifetime == VAR_ONCE) {
+      slot->published = false;
+    }
+    return true;
+  }
+};
+
+#endif // VAR_REGISTRY_H
@@ -14,6 +14,8 @@ private:
   ConfigManager* configMgr;
   int lastScanCount = 0;
   String lastScannedNetworks[MAX_NETWORKS];
+  int lastScannedRSSI[MAX_NETWORKS];
+  int lastUniqueCount = 0;
 
 public:
   WiFiManager(ConfigManager* cfg) : configMgr(cfg) {}
@@ -37,6 +39,7 @@ public:
 
     if (lastScanCount == 0) {
       Serial.println("[WiFiManager] No networks found");
+      lastUniqueCount = 0;
       return "";
     }
 
@@ -63,6 +66,7 @@ public:
 
       if (!isDuplicate && uniqueCount < MAX_NETWORKS) {
         lastScannedNetworks[uniqueCount] = ssid;
+        lastScannedRSSI[uniqueCount] = WiFi.RSSI(i);
         
         // Append to network list
         if (networkList.length() > 0) {
@@ -86,10 +90,24 @@ public:
     Serial.print("[WiFiManager] Returning ");
     Serial.print(uniqueCount);
     Serial.println(" unique networks");
+    lastUniqueCount = uniqueCount;
     
     return networkList;
   }
 
+  // Unique networks of the last scanNetworks(), in the order it listed them
+  int getScannedCount() {
+    return lastUniqueCount;
+  }
+
+  String getScannedSSID(int i) {
+    return i < lastUniqueCount ? lastScannedNetworks[i] : String("");
+  }
+
+  int getScannedRSSI(int i) {
+    return i < lastUniqueCount ? lastScannedRSSI[i] : 0;
+  }
+
   // Scan available WiFi networks and return detailed JSON
   String scanNetworksDetailed() {
     Serial.println("[WiFiManager] Starting detailed WiFi scan...");
@@ -0,0 +1,133 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <Arduino.h>
+#include <UrlEncode.h>
+#include "config.h"
+
+// ============================================================================
+// Wire - Compact binary requests for the channel
+// ============================================================================
+//
+// A request names a route of the server by number and carries its
+// arguments as length-prefixed bytes, in the order of the route's query
+// parameters:
+//
+//   version:u8 id:u32 route:u8 flags:u8 etagLen:u8 etag argc:u8 (len:u16 bytes)*
+//
+// Integers are little-endian. Flag bit 0 accepts a gzip body. Arguments are
+// neither URL-encoded nor copied into a URL; they are written from the
+// caller's buffers straight into the frame. The answer is the channel's
+// usual binary response frame.
+//
+// The channel offers WIRE_PROTOCOL when it upgrades, and only sends compact
+// requests when the server accepts it for that connection. Otherwise, and
+// over plain HTTP, url() builds the equivalent GET. The route table must
+// match server/routes/wire.mjs; a change to either side bumps WIRE_VERSION.
+
+#define WIRE_VERSION   4
+#define WIRE_PROTOCOL  "ti32.4"
+#define WIRE_FLAG_GZIP 0x01
+#define WIRE_MAX_ARGS  4
+
+enum WireRoute : uint8_t {
+  ROUTE_GPT_ASK = 1,
+  ROUTE_CHATS_MESSAGES,
+  ROUTE_CHATS_SEND,
+  ROUTE_GPT_STREAM,
+  ROUTE_COUNT
+};
+
+struct WireRouteDef {
+  const char* path;
+  const char* params[WIRE_MAX_ARGS];
+};
+
+// indexed by WireRoute
+static const WireRouteDef wireRoutes[ROUTE_COUNT] = {
+  { NULL, { NULL } },
+  { "/gpt/ask", { "question" } },
+  { "/chats/messages", { "p", "c" } },
+  { "/chats/send", { "c", "m", "id" } },
+  { "/gpt/stream", { "question" } },
+};
+
+class WireRequest {
+private:
+  WireRoute route;
+  uint8_t argc = 0;
+  const char* args[WIRE_MAX_ARGS];
+  size_t lens[WIRE_MAX_ARGS];
+  char numbers[WIRE_MAX_ARGS][12];  // integer arguments, formatted in place
+
+public:
+  explicit WireRequest(WireRoute r) : route(r) {}
+
+  // The next argument; s must outlive the request
+  WireRequest& arg(const char* s) {
+    if (argc < WIRE_MAX_ARGS) {
+      args[argc] = s;
+      lens[argc] = strlen(s);
+      argc++;
+    }
+    return *this;
+  }
+
+  WireRequest& arg(long n) {
+    if (argc < WIRE_MAX_ARGS) {
+      snprintf(numbers[argc], sizeof(numbers[argc]), "%ld", n);
+      arg(numbers[argc]);
+    }
+    return *this;
+  }
+
+  WireRoute getRoute() const { return route; }
+
+  // Encoded length with the given ETag
+  size_t size(size_t etagLen) const {
+    size_t n = 1 + 4 + 1 + 1 + 1 + etagLen + 1;
+    for (int i = 0; i < argc; ++i) {
+      n += 2 + lens[i];
+    }
+    return n;
+  }
+
+  // Writes the request into out, which holds size(strlen(etag)) bytes
+  size_t encode(uint8_t* out, uint32_t id, const char* etag, bool gzip) const {
+    size_t etagLen = etag ? min(strlen(etag), (size_t)255) : 0;
+    size_t n = 0;
+    out[n++] = WIRE_VERSION;
+    for (int i = 0; i < 4; ++i) {
+      out[n++] = (id >> (8 * i)) & 0xff;
+    }
+    out[n++] = route;
+    out[n++] = gzip ? WIRE_FLAG_GZIP : 0;
+    out[n++] = etagLen;
+    memcpy(&out[n], etag, etagLen);
+    n += etagLen;
+    out[n++] = argc;
+    for (int i = 0; i < argc; ++i) {
+      size_t len = min(lens[i], (size_t)0xffff);
+      out[n++] = len & 0xff;
+      out[n++] = len >> 8;
+      memcpy(&out[n], args[i], len);
+      n += len;
+    }
+    return n;
+  }
+
+  // The same request as an HTTP GET of server
+  String url(const char* server) const {
+    const WireRouteDef& def = wireRoutes[route];
+    String u = String(server) + def.path;
+    for (int i = 0; i < argc && def.params[i]; ++i) {
+      u += i == 0 ? "?" : "&";
+      u += def.params[i];
+      u += "=";
+      u += urlEncode(String(args[i]));
+    }
+    return u;
+  }
+};
+
+#endif // WIRE_H
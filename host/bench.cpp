@@ -0,0 +1,859 @@
+// ============================================================================
+// TI-32 host benchmark
+//
+// Boots esp32/esp32.ino against the shims in host/shims, then drives it from
+// a virtual TI-84 the way the calculator programs do: Send( the command and
+// its arguments, poll S with Get(, then Get( E and the result variable.
+// Downloads that arrive through silent link transfers are checked byte for
+// byte against what the server model served.
+//
+// Usage: host/out/ti32-bench [options]   (see --help)
+// ============================================================================
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "sim/sim.h"
+#include "shims/TIVar.h"
+#include "../esp32/config.h"
+#include "../esp32/launcher.h"
+
+void setup();
+void loop();
+String linkStatusJson();
+
+namespace {
+
+using sim::calc;
+using sim::linkParams;
+using sim::netParams;
+
+// ============================================================================
+// Calculator side: one Send( / Get( at a time
+// ============================================================================
+
+constexpr double kTransactionTimeoutMs = 60000;
+constexpr double kTransferTimeoutMs = 60000;
+constexpr double kBrowseLookMs = 2000;  // a user reading one screen
+
+void pumpUntil(std::function<bool()> done, double timeoutMs) {
+  uint64_t deadline = sim::nowUs() + (uint64_t)(timeoutMs * 1000);
+  while (!done() && sim::nowUs() < deadline) loop();
+}
+
+// BASIC keeps running between link statements while the firmware loops
+void basicStep() {
+  uint64_t until = sim::nowUs() + (uint64_t)(linkParams().basicStepMs * 1000);
+  pumpUntil([&] { return sim::nowUs() >= until; }, linkParams().basicStepMs + 1);
+}
+
+bool transact() {
+  pumpUntil([] { return !calc().busy(); }, kTransactionTimeoutMs);
+  return !calc().busy() && !calc().failed();
+}
+
+std::vector<uint8_t> strName(int idx) { return { 0xAA, (uint8_t)(idx == 0 ? 9 : idx - 1) }; }
+std::vector<uint8_t> picName(int idx) { return { 0x60, (uint8_t)(idx == 0 ? 9 : idx - 1) }; }
+
+bool sendReal(char name, double v) {
+  std::vector<uint8_t> data(9);
+  TIVar::floatToReal8x(v, data.data(), CALC83P);
+  calc().beginSend(VarReal, { (uint8_t)name }, data);
+  return transact();
+}
+
+bool sendStr(int idx, const std::string& s) {
+  std::vector<uint8_t> data(2 * s.size() + 2);
+  data.resize(TIVar::stringToStrVar8x(String(s.c_str()), data.data(), CALC83P));
+  calc().beginSend(VarString, strName(idx), data);
+  return transact();
+}
+
+bool getReal(char name, double* out) {
+  calc().beginGet(VarReal, { (uint8_t)name });
+  if (!transact() || calc().lastGet().data.size() < 9) return false;
+  *out = TIVar::realToFloat8x(const_cast<uint8_t*>(calc().lastGet().data.data()), CALC83P);
+  return true;
+}
+
+bool getStr(int idx, std::string* out) {
+  calc().beginGet(VarString, strName(idx));
+  if (!transact()) return false;
+  auto data = calc().lastGet().data;
+  *out = TIVar::strVarToString8x(data.data(), CALC83P).c_str();
+  return true;
+}
+
+bool getList(int n, std::vector<double>* out) {
+  calc().beginGet(VarRList, { 0x5D, (uint8_t)(n - 1) });
+  if (!transact()) return false;
+  auto data = calc().lastGet().data;
+  if (data.size() < 2) return false;
+  size_t count = data[0] | (data[1] << 8);
+  if (data.size() < 2 + 9 * count) return false;
+  out->clear();
+  for (size_t i = 0; i < count; ++i) out->push_back(TIVar::realToFloat8x(&data[2 + 9 * i], CALC83P));
+  return true;
+}
+
+bool getPic(int idx, std::vector<uint8_t>* out) {
+  calc().beginGet(VarPic, picName(idx));
+  if (!transact()) return false;
+  *out = calc().lastGet().data;
+  return true;
+}
+
+struct Arg {
+  bool isString;
+  std::string s;
+  double r;
+};
+Arg str(const std::string& s) { return { true, s, 0 }; }
+Arg real(double r) { return { false, "", r }; }
+
+enum class Result { Str, Pic };
+
+struct CommandRun {
+  bool ok = false;
+  bool error = false;
+  double latencyMs = 0;
+  std::string text;
+  std::vector<uint8_t> pic;
+};
+
+// mirrors the calculator programs: Send(C), Send( args, Repeat S:Get(S), Get(E), Get( result.
+// Commands that answer with a silent transfer (launcher, fetch_program) are
+// fire-and-forget in LAUNCHER: Send(C):Send(D):Stop, so no polling there.
+CommandRun runCommand(int cmd, const std::vector<Arg>& args, Result result = Result::Str, bool poll = true) {
+  CommandRun run;
+  uint64_t t0 = sim::nowUs();
+  calc().startProgram();
+  bool ok = sendReal('C', cmd);
+  for (auto& a : args) {
+    basicStep();
+    ok = ok && (a.isString ? sendStr(1, a.s) : sendReal('D', a.r));
+  }
+  if (!poll) {
+    run.latencyMs = (sim::nowUs() - t0) / 1000.0;
+    calc().endProgram();
+    run.ok = ok;
+    return run;
+  }
+  double s = 0;
+  for (int polls = 0; ok && s == 0 && polls < 5000; ++polls) {
+    basicStep();
+    ok = getReal('S', &s);
+  }
+  double e = 0;
+  ok = ok && s != 0 && getReal('E', &e);
+  if (ok) {
+    ok = result == Result::Pic ? getPic(1, &run.pic) : getStr(1, &run.text);
+  }
+  run.latencyMs = (sim::nowUs() - t0) / 1000.0;
+  calc().endProgram();
+  run.ok = ok;
+  run.error = e != 0;
+  return run;
+}
+
+// ============================================================================
+// Scenarios
+// ============================================================================
+
+struct Scenario {
+  std::string name;
+  sim::Series latencyMs;      // command: Send(C) .. result read
+  sim::Series transferMs;     // downloads: Send(C) .. variable on the calculator
+  sim::Series linkBytesPerS;  // downloads: payload / silent-link session time
+  int runs = 0;
+  int failures = 0;
+  std::string note;
+};
+
+std::vector<Scenario> scenarios;
+
+Scenario& scenario(const std::string& name) {
+  for (auto& s : scenarios) {
+    if (s.name == name) return s;
+  }
+  scenarios.push_back(Scenario{ name });
+  return scenarios.back();
+}
+
+void command(const std::string& name, int cmd, const std::vector<Arg>& args, Result result = Result::Str) {
+  Scenario& sc = scenario(name);
+  CommandRun run = runCommand(cmd, args, result);
+  ++sc.runs;
+  if (!run.ok || run.error) {
+    ++sc.failures;
+    sc.note = run.ok ? run.text : "link error";
+  }
+  sc.latencyMs.add(run.latencyMs);
+}
+
+std::string key8(const std::string& name) { return name.substr(0, 8); }
+
+// a command whose result is a silent link transfer of `varName`
+void download(const std::string& name, int cmd, const std::vector<Arg>& args,
+              const std::string& varName, const std::vector<uint8_t>& expected) {
+  Scenario& sc = scenario(name);
+  auto& received = calc().received();
+  received.erase(key8(varName));
+  int sessions = calc().silentSessions();
+  uint64_t t0 = sim::nowUs();
+  CommandRun run = runCommand(cmd, args, Result::Str, false);
+  pumpUntil([&] { return calc().silentSessions() > sessions; }, kTransferTimeoutMs);
+  ++sc.runs;
+  sc.latencyMs.add(run.latencyMs);
+
+  auto it = received.find(key8(varName));
+  if (!run.ok || run.error) {
+    ++sc.failures;
+    sc.note = run.ok ? run.text : "link error";
+  } else if (it == received.end()) {
+    ++sc.failures;
+    sc.note = "never arrived";
+  } else if (it->second.data != expected) {
+    ++sc.failures;
+    sc.note = "corrupt (" + std::to_string(it->second.data.size()) + " of " +
+              std::to_string(expected.size()) + " bytes, content differs)";
+  } else {
+    sc.transferMs.add((sim::nowUs() - t0) / 1000.0);
+    double sessionS = calc().lastSilentSessionUs() / 1e6;
+    if (sessionS > 0) sc.linkBytesPerS.add(expected.size() / sessionS);
+  }
+}
+
+// one of the firmware's link counters from /status
+uint32_t linkCounter(const char* name) {
+  std::string json = linkStatusJson().c_str();
+  size_t at = json.find("\"" + std::string(name) + "\":");
+  return at == std::string::npos ? 0 : strtoul(json.c_str() + at + strlen(name) + 3, nullptr, 10);
+}
+
+// a download over a cable that corrupts every other RTS/DATA packet: the
+// firmware has to resend them and still deliver the variable intact
+void flakyDownload(const std::string& name, int cmd, const std::vector<Arg>& args,
+                   const std::string& varName, const std::vector<uint8_t>& expected) {
+  uint64_t errors = sim::linkStats().checksumErrors;
+  uint32_t retries = linkCounter("packetRetries");
+  int every = linkParams().errorEvery;
+  linkParams().errorEvery = 2;
+  download(name, cmd, args, varName, expected);
+  linkParams().errorEvery = every;
+  Scenario& sc = scenario(name);
+  if (sc.failures) return;
+  if (sim::linkStats().checksumErrors == errors) {
+    ++sc.failures;
+    sc.note = "no checksum errors injected";
+  } else if (linkCounter("packetRetries") == retries) {
+    ++sc.failures;
+    sc.note = "nothing resent";
+  }
+}
+
+// a program whose frame fails its checksum. Over the channel, or streamed
+// when it fits in the ring, it is checked before the link sees it; a larger
+// stream is mostly on the calculator by the time the checksum arrives.
+// Either way the job has to end in an error.
+void badChecksum(const std::string& name, size_t id) {
+  Scenario& sc = scenario(name);
+  sim::SimServer& srv = sim::server();
+  srv.corruptAssets = 1000;
+  int sessions = calc().silentSessions();
+  CommandRun run = runCommand(14, { real((double)id) });
+  pumpUntil([&] { return calc().silentSessions() > sessions; }, run.error ? 0 : kTransferTimeoutMs);
+  srv.corruptAssets = 0;
+  ++sc.runs;
+  sc.latencyMs.add(run.latencyMs);
+  double e = 0;
+  std::string text;
+  calc().startProgram();
+  bool ok = run.ok && getReal('E', &e);
+  basicStep();
+  ok = ok && getStr(1, &text);
+  calc().endProgram();
+  if (!ok) {
+    ++sc.failures;
+    sc.note = "link error";
+  } else if (e == 0 || text != "program checksum mismatch") {
+    ++sc.failures;
+    sc.note = "job says " + text;
+  }
+}
+
+// snap renders the fake sensor's frame into Pic 1 on the device; its dark
+// disc has to come out black, and the rest dithered rather than solid
+void snapshot(const std::string& name) {
+  Scenario& sc = scenario(name);
+  CommandRun run = runCommand(7, {}, Result::Pic);
+  ++sc.runs;
+  sc.latencyMs.add(run.latencyMs);
+  size_t dark = 0;
+  for (size_t i = 2; i < run.pic.size(); ++i) dark += __builtin_popcount(run.pic[i]);
+  // the disc's center, (2/5, 1/2) of the frame, after the crop
+  bool disc = run.pic.size() == 2 + 756 && (run.pic[2 + 31 * 12 + 38 / 8] & (0x80 >> (38 % 8)));
+  if (!run.ok || run.error) {
+    ++sc.failures;
+    sc.note = run.ok ? run.text : "link error";
+  } else if (run.pic.size() != 2 + 756 || (run.pic[0] | (run.pic[1] << 8)) != 756 || !disc ||
+             dark < 96 * 63 / 10 || dark > 96 * 63 * 9 / 10) {
+    ++sc.failures;
+    sc.note = "bad picture";
+  }
+}
+
+// fetch_image and send_chat started back to back, each result collected
+// through J once its job is done
+void jobs(const std::string& name) {
+  Scenario& sc = scenario(name);
+  uint64_t t0 = sim::nowUs();
+  calc().startProgram();
+  double image = 0, chat = 0, s = 0, e = 1;
+  std::string text;
+  std::vector<uint8_t> pic;
+  bool ok = sendReal('C', 10);
+  basicStep();
+  ok = ok && sendReal('D', 1);
+  basicStep();
+  ok = ok && getReal('J', &image);
+  basicStep();
+  ok = ok && sendReal('C', 12);
+  basicStep();
+  ok = ok && sendReal('D', 0) && sendStr(1, "HELLO FROM JOB TWO");
+  basicStep();
+  ok = ok && getReal('J', &chat);
+  // the chat job is selected and runs last
+  for (int polls = 0; ok && s == 0 && polls < 5000; ++polls) {
+    basicStep();
+    ok = getReal('S', &s);
+  }
+  ok = ok && getReal('E', &e) && e == 0;
+  basicStep();
+  ok = ok && sendReal('J', image);
+  basicStep();
+  ok = ok && getReal('S', &s) && s == 1 && getReal('E', &e) && e == 0;
+  basicStep();
+  ok = ok && getStr(1, &text) && getPic(1, &pic);
+  calc().endProgram();
+  ++sc.runs;
+  sc.latencyMs.add((sim::nowUs() - t0) / 1000.0);
+  if (!ok || chat != image + 1) {
+    ++sc.failures;
+    sc.note = "job results not collected";
+  } else if (text != "image loaded" || pic.size() < 756) {
+    ++sc.failures;
+    sc.note = "image job: " + text;
+  }
+}
+
+// the launcher's flow: a page of program_list, then fetch_program of an
+// entry the prefetcher did not guess. Latency is from the list command to
+// fetch_program's result, transfer to the program arriving.
+void menu(const std::string& name, int page) {
+  Scenario& sc = scenario(name);
+  sim::SimServer& srv = sim::server();
+  size_t id = std::min((size_t)page * LIST_PAGE_LEN + LIST_PAGE_LEN - 1, srv.programs().size() - 1);
+  auto& p = srv.programs()[id];
+  std::string varName = p.file.substr(0, 10);
+  for (auto& c : varName) c = toupper((unsigned char)c);
+  auto& received = calc().received();
+  received.erase(key8(varName));
+  int sessions = calc().silentSessions();
+
+  uint64_t t0 = sim::nowUs();
+  CommandRun list = runCommand(13, { real(page) });
+  basicStep();
+  CommandRun fetch = runCommand(14, { real((double)id) });
+  ++sc.runs;
+  sc.latencyMs.add((sim::nowUs() - t0) / 1000.0);
+  pumpUntil([&] { return calc().silentSessions() > sessions; }, kTransferTimeoutMs);
+  auto it = received.find(key8(varName));
+  if (!list.ok || list.error || !fetch.ok || fetch.error) {
+    ++sc.failures;
+    sc.note = !list.ok || list.error ? "program_list: " + list.text : "fetch_program: " + fetch.text;
+  } else if (it == received.end() || it->second.data != p.var) {
+    ++sc.failures;
+    sc.note = "program not received";
+  } else {
+    sc.transferMs.add((sim::nowUs() - t0) / 1000.0);
+  }
+}
+
+// a user paging through image_list and opening a picture, looking at each
+// screen for a while; the firmware prefetches in the pauses
+void browse(const std::string& name) {
+  auto look = [] {
+    uint64_t until = sim::nowUs() + (uint64_t)(kBrowseLookMs * 1000);
+    pumpUntil([&] { return sim::nowUs() >= until; }, kBrowseLookMs + 1);
+  };
+  Scenario& sc = scenario(name);
+  CommandRun runs[3];
+  runs[0] = runCommand(9, { real(0) });
+  look();
+  runs[1] = runCommand(9, { real(1) });
+  look();
+  runs[2] = runCommand(10, { real(LIST_PAGE_LEN) }, Result::Pic);
+  look();
+  for (auto& run : runs) {
+    ++sc.runs;
+    sc.latencyMs.add(run.latencyMs);
+    if (!run.ok || run.error) {
+      ++sc.failures;
+      sc.note = run.ok ? run.text : "link error";
+    }
+  }
+}
+
+// commands queued together on the dashboard while the calculator is idle,
+// timed from queueing to the last result reaching the server
+void dashboard(const std::string& name, const std::vector<std::string>& texts) {
+  Scenario& sc = scenario(name);
+  sim::SimServer& srv = sim::server();
+  // somewhere inside the poll the device is holding open
+  uint64_t until = sim::nowUs() + (uint64_t)(kBrowseLookMs * 1000);
+  pumpUntil([&] { return sim::nowUs() >= until; }, kBrowseLookMs + 1);
+
+  uint64_t t0 = sim::nowUs();
+  std::vector<int> ids;
+  for (auto& t : texts) ids.push_back(srv.queueCommand(t, t0));
+  uint64_t last = 0;
+  auto done = [&] {
+    last = 0;
+    for (int id : ids) {
+      uint64_t at;
+      if (!srv.resultAt(id, &at) || at > sim::nowUs()) return false;
+      last = std::max(last, at);
+    }
+    return true;
+  };
+  pumpUntil(done, kTransactionTimeoutMs);
+  ++sc.runs;
+  if (!done()) {
+    ++sc.failures;
+    sc.note = "no result";
+    return;
+  }
+  sc.latencyMs.add((last - t0) / 1000.0);
+  for (int id : ids) {
+    uint64_t at;
+    std::string result;
+    srv.resultAt(id, &at, &result);
+    if (result.find("\"success\":true") == std::string::npos) {
+      ++sc.failures;
+      sc.note = result;
+    }
+  }
+}
+
+// the calculator's results outlive dashboard commands that write the same
+// buffers: Pic 1 from fetch_image and the Str2/N page from program_list,
+// read again after the dashboard fetched another image and scanned networks
+void keepResults(const std::string& name) {
+  scenario(name);
+  CommandRun image = runCommand(10, { real(1) }, Result::Pic);
+  basicStep();
+  CommandRun page = runCommand(13, { real(0) });
+  auto read = [](std::vector<uint8_t>* pic, std::string* rows, double* n) {
+    calc().startProgram();
+    bool ok = getPic(1, pic);
+    basicStep();
+    ok = ok && getStr(2, rows);
+    basicStep();
+    ok = ok && getReal('N', n);
+    calc().endProgram();
+    return ok;
+  };
+  std::vector<uint8_t> picBefore, picAfter;
+  std::string rowsBefore, rowsAfter;
+  double nBefore = 0, nAfter = 0;
+  bool ok = image.ok && !image.error && page.ok && !page.error && read(&picBefore, &rowsBefore, &nBefore);
+  uint64_t t0 = sim::nowUs();
+  dashboard(name + " (dashboard)", { "FETCH_IMAGE 2", "SCAN_NETWORKS" });
+  ok = ok && read(&picAfter, &rowsAfter, &nAfter);
+  // looked up again: dashboard() may have grown scenarios
+  Scenario& sc = scenario(name);
+  ++sc.runs;
+  sc.latencyMs.add((sim::nowUs() - t0) / 1000.0);
+  if (!ok) {
+    ++sc.failures;
+    sc.note = "results not read";
+  } else if (picAfter != picBefore || rowsAfter != rowsBefore || nAfter != nBefore) {
+    ++sc.failures;
+    sc.note = "results overwritten by the dashboard";
+  }
+}
+
+// a gpt answer read the way a reader pages through it: page 1 from gpt (or
+// from solve, which asks about a camera frame), then get_gpt_chunk for the
+// next page until M says the answer is complete and N pages have been read.
+// Latency is to page 1, transfer to the last page.
+void answer(const std::string& name, const std::string& question, int cmd = 2) {
+  Scenario& sc = scenario(name);
+  uint64_t t0 = sim::nowUs();
+  CommandRun run = runCommand(cmd, { str(question) });
+  double latencyMs = run.latencyMs;
+  std::string text = run.text;
+  bool ok = run.ok && !run.error;
+  double pages = 0, more = 1;
+  for (int page = 1; ok; ++page) {
+    calc().startProgram();
+    ok = getReal('N', &pages);
+    basicStep();
+    ok = ok && getReal('M', &more);
+    calc().endProgram();
+    if (!ok || (more == 0 && page >= pages) || page >= ANSWER_PAGES) break;
+    run = runCommand(23, { real(0) });
+    ok = run.ok && !run.error;
+    text += run.text;
+  }
+  ++sc.runs;
+  sc.latencyMs.add(latencyMs);
+  std::string expected = sim::gptAnswer(question);
+  if (!ok) {
+    ++sc.failures;
+    sc.note = run.ok ? run.text : "link error";
+  } else if (text != expected) {
+    ++sc.failures;
+    sc.note = std::to_string(text.size()) + " of " + std::to_string(expected.size()) + " chars, content differs";
+  } else {
+    sc.transferMs.add((sim::nowUs() - t0) / 1000.0);
+  }
+}
+
+// a command that leaves several results in the variable registry
+void registry(const std::string& name, int cmd, const std::vector<Arg>& args, const std::vector<char>& reals) {
+  Scenario& sc = scenario(name);
+  uint64_t t0 = sim::nowUs();
+  CommandRun run = runCommand(cmd, args);
+  calc().startProgram();
+  bool ok = run.ok && !run.error;
+  for (char r : reals) {
+    double v = 0;
+    basicStep();
+    ok = ok && getReal(r, &v);
+  }
+  calc().endProgram();
+  ++sc.runs;
+  sc.latencyMs.add((sim::nowUs() - t0) / 1000.0);
+  if (!ok) {
+    ++sc.failures;
+    sc.note = run.ok ? "registry read failed" : "link error";
+  }
+}
+
+// a list command read the way a menu would: N, the rows in Str2 and the ids in L1
+void listPage(const std::string& name, int cmd, const std::vector<Arg>& args, bool values) {
+  Scenario& sc = scenario(name);
+  uint64_t t0 = sim::nowUs();
+  CommandRun run = runCommand(cmd, args);
+  calc().startProgram();
+  double n = 0;
+  std::string rows;
+  std::vector<double> ids;
+  bool ok = run.ok && !run.error;
+  basicStep();
+  ok = ok && getReal('N', &n);
+  basicStep();
+  ok = ok && n > 0 && getStr(2, &rows);
+  if (values) {
+    basicStep();
+    ok = ok && getList(1, &ids) && ids.size() == (size_t)n;
+  }
+  calc().endProgram();
+  ++sc.runs;
+  sc.latencyMs.add((sim::nowUs() - t0) / 1000.0);
+  if (!ok) {
+    ++sc.failures;
+    sc.note = run.ok ? "page read failed" : "link error";
+  } else if (rows.size() != (size_t)n * 20) {
+    ++sc.failures;
+    sc.note = std::to_string(rows.size()) + " chars for " + std::to_string((int)n) + " rows";
+  }
+}
+
+// a command whose result is one silent session carrying several variables
+void install(const std::string& name, int cmd, const std::map<std::string, std::vector<uint8_t>>& expected) {
+  Scenario& sc = scenario(name);
+  auto& received = calc().received();
+  for (auto& e : expected) received.erase(e.first);
+  int sessions = calc().silentSessions();
+  uint64_t t0 = sim::nowUs();
+  CommandRun run = runCommand(cmd, {}, Result::Str, false);
+  pumpUntil([&] { return calc().silentSessions() > sessions; }, kTransferTimeoutMs * expected.size());
+  ++sc.runs;
+  sc.latencyMs.add(run.latencyMs);
+
+  size_t bytes = 0;
+  std::string missing;
+  for (auto& e : expected) {
+    auto it = received.find(e.first);
+    if (it == received.end() || it->second.data != e.second) missing += " " + e.first;
+    bytes += e.second.size();
+  }
+  if (!run.ok || run.error) {
+    ++sc.failures;
+    sc.note = run.ok ? run.text : "link error";
+  } else if (calc().silentSessions() != sessions + 1 || !missing.empty()) {
+    ++sc.failures;
+    sc.note = "missing or corrupt:" + missing;
+  } else {
+    sc.transferMs.add((sim::nowUs() - t0) / 1000.0);
+    double sessionS = calc().lastSilentSessionUs() / 1e6;
+    if (sessionS > 0) sc.linkBytesPerS.add(bytes / sessionS);
+  }
+}
+
+// ============================================================================
+// Options + Report
+// ============================================================================
+
+struct Options {
+  int iterations = 3;
+  std::string filter;
+  std::string json;
+  bool strict = false;
+  std::vector<size_t> synthetic = { 1024, 4000, 8192, 16384, 24000 };
+};
+
+void usage() {
+  printf(
+      "usage: ti32-bench [options]\n"
+      "  --iterations N     runs per scenario (default 3)\n"
+      "  --only SUBSTR      run scenarios whose name contains SUBSTR\n"
+      "  --json FILE        also write results as JSON\n"
+      "  --strict           exit with status 1 if any scenario failed\n"
+      "  --log FILE         write the firmware's Serial output to FILE ('-' = stderr)\n"
+      "  --synthetic LIST   extra program sizes in bytes (default 1024,4000,8192,16384,24000)\n"
+      "  --bit-us X         link bit time in us (default %.0f)\n"
+      "  --turnaround-us X  calculator packet turnaround in us (default %.0f)\n"
+      "  --link-errors P    chance that an RTS/DATA packet fails its checksum (default 0)\n"
+      "  --rtt-ms X         network round trip in ms (default %.0f)\n"
+      "  --bw-kbps X        downstream bandwidth in kbit/s (default %.0f)\n"
+      "  --tls-ms X         TLS handshake CPU time in ms (default %.0f)\n"
+      "  --gpt-ms X         /gpt/ask model latency in ms (default %.0f)\n"
+      "  --gpt-first-ms X   /gpt/stream latency to the first part of the answer (default %.0f)\n"
+      "  --chunked N        send response bodies chunked, N bytes a chunk (default off)\n"
+      "  --no-channel       the server refuses the WebSocket channel (plain HTTP and polling)\n"
+      "  --no-compact       the channel carries text GETs only, not compact binary requests\n"
+      "  --no-gzip          the server never compresses bodies\n",
+      linkParams().bitUs, linkParams().turnaroundUs, netParams().rttMs, netParams().bandwidthKbps,
+      netParams().tlsCpuMs, netParams().gptMs, netParams().gptFirstMs);
+}
+
+std::vector<size_t> parseSizes(const char* s) {
+  std::vector<size_t> out;
+  while (*s) {
+    char* end;
+    size_t v = strtoul(s, &end, 10);
+    if (end == s) break;
+    out.push_back(v);
+    s = *end ? end + 1 : end;
+  }
+  return out;
+}
+
+bool parseArgs(int argc, char** argv, Options& o) {
+  for (int i = 1; i < argc; ++i) {
+    std::string a = argv[i];
+    auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : ""; };
+    if (a == "--iterations") o.iterations = atoi(next());
+    else if (a == "--only") o.filter = next();
+    else if (a == "--json") o.json = next();
+    else if (a == "--strict") o.strict = true;
+    else if (a == "--log") {
+      std::string f = next();
+      sim::setLogFile(f == "-" ? stderr : fopen(f.c_str(), "w"));
+    }
+    else if (a == "--synthetic") o.synthetic = parseSizes(next());
+    else if (a == "--bit-us") linkParams().bitUs = atof(next());
+    else if (a == "--turnaround-us") linkParams().turnaroundUs = atof(next());
+    else if (a == "--link-errors") linkParams().errorRate = atof(next());
+    else if (a == "--rtt-ms") netParams().rttMs = atof(next());
+    else if (a == "--bw-kbps") netParams().bandwidthKbps = atof(next());
+    else if (a == "--tls-ms") netParams().tlsCpuMs = atof(next());
+    else if (a == "--gpt-ms") netParams().gptMs = atof(next());
+    else if (a == "--gpt-first-ms") netParams().gptFirstMs = atof(next());
+    else if (a == "--chunked") netParams().chunkBytes = (size_t)atoi(next());
+    else if (a == "--no-channel") netParams().channel = false;
+    else if (a == "--no-compact") netParams().compact = false;
+    else if (a == "--no-gzip") netParams().gzip = false;
+    else {
+      usage();
+      return false;
+    }
+  }
+  return true;
+}
+
+void report(const Options& o) {
+  printf("\n%-28s %5s %5s %10s %10s %12s %12s\n", "scenario", "runs", "fail", "cmd p50ms", "cmd p95ms",
+         "xfer p50ms", "xfer B/s");
+  for (auto& s : scenarios) {
+    printf("%-28s %5d %5d %10.1f %10.1f", s.name.c_str(), s.runs, s.failures, s.latencyMs.percentile(50),
+           s.latencyMs.percentile(95));
+    if (s.transferMs.count()) {
+      printf(" %12.1f", s.transferMs.percentile(50));
+      if (s.linkBytesPerS.count()) {
+        printf(" %12.0f", s.linkBytesPerS.mean());
+      } else {
+        printf(" %12s", "-");
+      }
+    } else {
+      printf(" %12s %12s", "-", "-");
+    }
+    if (s.failures) printf("  [%s]", s.note.c_str());
+    printf("\n");
+  }
+
+  const sim::LinkStats& ls = sim::linkStats();
+  const sim::NetStats& ns = sim::netStats();
+  double linkBps = ls.busyUs ? ls.bytes / (ls.busyUs / 1e6) : 0;
+  printf("\nlink: %llu packets, %llu bytes, %.0f B/s on the wire, packet latency mean %.2f ms p50 %.2f p95 %.2f max %.2f\n",
+         (unsigned long long)ls.packets, (unsigned long long)ls.bytes, linkBps, ls.packetUs.mean() / 1000,
+         ls.packetUs.percentile(50) / 1000, ls.packetUs.percentile(95) / 1000, ls.packetUs.max() / 1000);
+  printf("link: %llu write timeouts, %llu read timeouts, %llu checksum errors\n", (unsigned long long)ls.writeTimeouts,
+         (unsigned long long)ls.readTimeouts, (unsigned long long)ls.checksumErrors);
+  printf("net:  %llu connects, %llu TLS handshakes, %llu requests, %llu bytes down, %llu bytes up\n",
+         (unsigned long long)ns.connects, (unsigned long long)ns.tlsHandshakes, (unsigned long long)ns.requests,
+         (unsigned long long)ns.bytesDown, (unsigned long long)ns.bytesUp);
+  printf("virtual time: %.1f s\n", sim::nowUs() / 1e6);
+
+  if (o.json.empty()) return;
+  FILE* f = fopen(o.json.c_str(), "w");
+  if (!f) return;
+  fprintf(f, "{\n  \"scenarios\": [\n");
+  for (size_t i = 0; i < scenarios.size(); ++i) {
+    auto& s = scenarios[i];
+    fprintf(f,
+            "    {\"name\": \"%s\", \"runs\": %d, \"failures\": %d, \"cmdP50Ms\": %.3f, \"cmdP95Ms\": %.3f, "
+            "\"transferP50Ms\": %.3f, \"linkBytesPerS\": %.1f}%s\n",
+            s.name.c_str(), s.runs, s.failures, s.latencyMs.percentile(50), s.latencyMs.percentile(95),
+            s.transferMs.percentile(50), s.linkBytesPerS.mean(), i + 1 < scenarios.size() ? "," : "");
+  }
+  fprintf(f,
+          "  ],\n  \"link\": {\"packets\": %llu, \"bytes\": %llu, \"wireBytesPerS\": %.1f, \"packetMeanMs\": %.3f, "
+          "\"packetP95Ms\": %.3f, \"writeTimeouts\": %llu, \"readTimeouts\": %llu, \"checksumErrors\": %llu},\n",
+          (unsigned long long)ls.packets, (unsigned long long)ls.bytes, linkBps, ls.packetUs.mean() / 1000,
+          ls.packetUs.percentile(95) / 1000, (unsigned long long)ls.writeTimeouts,
+          (unsigned long long)ls.readTimeouts, (unsigned long long)ls.checksumErrors);
+  fprintf(f, "  \"net\": {\"connects\": %llu, \"tlsHandshakes\": %llu, \"requests\": %llu, \"bytesDown\": %llu}\n}\n",
+          (unsigned long long)ns.connects, (unsigned long long)ns.tlsHandshakes, (unsigned long long)ns.requests,
+          (unsigned long long)ns.bytesDown);
+  fclose(f);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options o;
+  if (!parseArgs(argc, argv, o)) return 2;
+
+  sim::SimServer& srv = sim::server();
+  srv.loadPrograms(sim::repoRoot() + "/programs");
+  for (size_t size : o.synthetic) srv.addSyntheticProgram(size);
+
+  setup();
+  sim::linkStats().clear();
+  sim::netStats().clear();
+
+  auto want = [&](const std::string& name) { return o.filter.empty() || name.find(o.filter) != std::string::npos; };
+  std::vector<uint8_t> launcherVar(__launcher_var, __launcher_var + __launcher_var_len);
+
+  for (int it = 0; it < o.iterations; ++it) {
+    if (want("get_ip_address")) command("get_ip_address", 20, {});
+    if (want("gpt")) command("gpt", 2, { str("WHAT IS SIX TIMES SEVEN") });
+    if (want("gpt_pages")) answer("gpt_pages", "HOW DO I MULTIPLY 23 BY 45");
+    if (want("program_list")) command("program_list", 13, { real(0) });
+    if (want("image_list")) command("image_list", 9, { real(0) });
+    if (want("fetch_image")) command("fetch_image", 10, { real(1) }, Result::Pic);
+    // the same image again, from the firmware's response cache
+    if (want("fetch_image")) command("fetch_image again", 10, { real(1) }, Result::Pic);
+    if (want("snap")) {
+      // the sensor idles between sessions; the first snap starts one
+      uint64_t until = sim::nowUs() + (uint64_t)(CAMERA_SESSION_IDLE_MS + 1000) * 1000;
+      pumpUntil([&] { return sim::nowUs() >= until; }, CAMERA_SESSION_IDLE_MS + 1001);
+      snapshot("snap cold");
+      snapshot("snap");
+      // a JPEG for the vision profile, uploaded with the question, then back
+      // to the pic profile
+      answer("solve", "WHAT IS ON THE BOARD", 8);
+      snapshot("snap after solve");
+    }
+    if (want("send_chat")) command("send_chat", 12, { real(0), str("HELLO FROM THE SIM") });
+    if (want("fetch_chats")) command("fetch_chats", 11, { real(0), real(0) });
+    if (want("scan_networks")) command("scan_networks", 15, {});
+    if (want("jobs")) jobs("jobs");
+    if (want("browse")) browse("browse");
+    // a page not listed before, so nothing is cached yet
+    if (want("menu")) menu("menu", 1 + it);
+    if (want("mailbox")) dashboard("mailbox", { "GET_STATUS" });
+    if (want("mailbox")) dashboard("mailbox burst", { "GET_IP_ADDRESS", "SCAN_NETWORKS", "GET_STATUS" });
+    if (want("mailbox")) {
+      std::vector<std::string> flood(MAILBOX_COMMANDS + 2, "GET_STATUS");
+      dashboard("mailbox flood", flood);
+    }
+    if (want("mailbox")) keepResults("mailbox keeps results");
+    if (want("power_status")) registry("power_status", 21, {}, { 'B', 'W', 'P' });
+    if (want("program_list_page")) listPage("program_list_page", 13, { real(1) }, true);
+    if (want("fetch_chats_page")) listPage("fetch_chats_page", 11, { real(0), real(0) }, false);
+    if (want("scan_networks_page")) listPage("scan_networks_page", 15, {}, true);
+    if (want("launcher")) download("launcher", 5, {}, "TI32", launcherVar);
+    for (size_t id = 0; id < srv.programs().size(); ++id) {
+      auto& p = srv.programs()[id];
+      std::string name = "fetch_program " + p.file;
+      std::string varName = p.file.substr(0, 10);
+      for (auto& c : varName) c = toupper((unsigned char)c);
+      if (want(name)) download(name, 14, { real((double)id) }, varName, p.var);
+    }
+    if (want("flaky_link")) {
+      // the largest program over a cable that corrupts every other packet
+      size_t id = 0;
+      for (size_t i = 1; i < srv.programs().size(); ++i) {
+        if (srv.programs()[i].var.size() > srv.programs()[id].var.size()) id = i;
+      }
+      auto& p = srv.programs()[id];
+      std::string varName = p.file.substr(0, 10);
+      for (auto& c : varName) c = toupper((unsigned char)c);
+      flakyDownload("flaky_link " + p.file, 14, { real((double)id) }, varName, p.var);
+    }
+    if (want("bad_checksum")) {
+      // programs of their own, so no other scenario's cached copy stands in
+      size_t first = srv.programs().size();
+      srv.addSyntheticProgram(4000);
+      srv.addSyntheticProgram(12000);
+      srv.addSyntheticProgram(3000);
+      badChecksum("bad_checksum small", first);
+      badChecksum("bad_checksum large", first + 1);
+      if (netParams().channel) {
+        // only the first copy is corrupt, and over the channel it lands in
+        // the cache; fetch_program has to drop it and ask the server again
+        srv.corruptAssets = 1;
+        download("bad_checksum refetched", 14, { real((double)(first + 2)) }, "SYN3000", srv.programs()[first + 2].var);
+        srv.corruptAssets = 0;
+      }
+      srv.programs().resize(first);
+    }
+    if (want("install_programs")) {
+      // one session with every program; a later variable with the same
+      // 8-character name replaces the earlier one, like on the calculator
+      std::map<std::string, std::vector<uint8_t>> expected;
+      for (auto& p : srv.programs()) {
+        std::string varName = p.file.substr(0, 8);
+        for (auto& c : varName) c = toupper((unsigned char)c);
+        expected[varName] = p.var;
+      }
+      install("install_programs", 24, expected);
+    }
+  }
+
+  report(o);
+  int failures = 0;
+  for (auto& s : scenarios) failures += s.failures;
+  return o.strict && failures ? 1 : 0;
+}
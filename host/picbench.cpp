@@ -0,0 +1,471 @@
+// Runs snap's picture pipeline (esp32/pic_pipeline.h) on the pictures in
+// test-images/: how long each stage takes, and what the calculator would
+// show, written as PBM files next to the binary. Then compares the dither
+// kernels (esp32/pic_dither.h) on the same levels: their speed against
+// per-pixel versions of themselves, and how close each stays to the levels.
+//
+//   bash build/picbench.sh                       # every picture in test-images/
+//   bash build/picbench.sh --iterations 50 car.jpg
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+// jpeglib.h needs size_t and FILE declared first
+#include <jpeglib.h>
+#include <png.h>
+
+#include "pic_pipeline.h"
+
+namespace {
+
+struct Options {
+  std::string dir = std::string(SIM_REPO_ROOT) + "/test-images";
+  std::string out = std::string(SIM_REPO_ROOT) + "/host/out/pics";
+  int iterations = 200;
+  std::vector<std::string> files;
+};
+
+struct Image {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> luma;
+};
+
+uint8_t luma(int r, int g, int b) { return (uint8_t)((77 * r + 150 * g + 29 * b) >> 8); }
+
+std::string lower(std::string s) {
+  for (auto& c : s) c = tolower((unsigned char)c);
+  return s;
+}
+
+std::string extension(const std::string& name) {
+  size_t dot = name.rfind('.');
+  return dot == std::string::npos ? "" : lower(name.substr(dot + 1));
+}
+
+// ============================================================================
+// Decoders
+// ============================================================================
+
+struct JpegError {
+  jpeg_error_mgr mgr;
+  jmp_buf jump;
+};
+
+void jpegFail(j_common_ptr info) { longjmp(((JpegError*)info->err)->jump, 1); }
+
+bool readJpeg(FILE* f, Image* img) {
+  jpeg_decompress_struct info;
+  JpegError err;
+  info.err = jpeg_std_error(&err.mgr);
+  err.mgr.error_exit = jpegFail;
+  if (setjmp(err.jump)) {
+    jpeg_destroy_decompress(&info);
+    return false;
+  }
+  jpeg_create_decompress(&info);
+  jpeg_stdio_src(&info, f);
+  jpeg_read_header(&info, TRUE);
+  info.out_color_space = JCS_GRAYSCALE;
+  jpeg_start_decompress(&info);
+  img->width = info.output_width;
+  img->height = info.output_height;
+  img->luma.resize((size_t)img->width * img->height);
+  while (info.output_scanline < info.output_height) {
+    JSAMPROW row = &img->luma[(size_t)info.output_scanline * img->width];
+    jpeg_read_scanlines(&info, &row, 1);
+  }
+  jpeg_finish_decompress(&info);
+  jpeg_destroy_decompress(&info);
+  return true;
+}
+
+bool readPng(const std::string& path, Image* img) {
+  png_image png;
+  memset(&png, 0, sizeof(png));
+  png.version = PNG_IMAGE_VERSION;
+  if (!png_image_begin_read_from_file(&png, path.c_str())) return false;
+  // transparent pixels over white, like a browser shows them
+  png.format = PNG_FORMAT_GRAY;
+  png_color white = { 255, 255, 255 };
+  img->width = png.width;
+  img->height = png.height;
+  img->luma.resize(PNG_IMAGE_SIZE(png));
+  return png_image_finish_read(&png, &white, img->luma.data(), 0, nullptr) != 0;
+}
+
+// Uncompressed BMPs of 1, 4, 8, 24 or 32 bits per pixel
+bool readBmp(FILE* f, Image* img) {
+  std::vector<uint8_t> b;
+  uint8_t buf[4096];
+  for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) b.insert(b.end(), buf, buf + n);
+  auto u16 = [&](size_t i) { return (uint32_t)(b[i] | (b[i + 1] << 8)); };
+  auto u32 = [&](size_t i) { return u16(i) | (u16(i + 2) << 16); };
+  if (b.size() < 54 || b[0] != 'B' || b[1] != 'M') return false;
+  uint32_t offset = u32(10), headerLen = u32(14), bpp = u16(28), compression = u32(30);
+  int32_t width = (int32_t)u32(18), height = (int32_t)u32(22);
+  bool topDown = height < 0;
+  height = std::abs(height);
+  if (width <= 0 || height == 0 || (compression != 0 && compression != 3) ||
+      (bpp != 1 && bpp != 4 && bpp != 8 && bpp != 24 && bpp != 32)) {
+    return false;
+  }
+  uint8_t palette[256];
+  uint32_t colors = u32(46) ? u32(46) : (bpp <= 8 ? 1u << bpp : 0);
+  for (uint32_t i = 0; i < colors && i < 256; ++i) {
+    size_t p = 14 + headerLen + 4 * i;
+    palette[i] = p + 2 < b.size() ? luma(b[p + 2], b[p + 1], b[p]) : 0;
+  }
+  size_t stride = ((size_t)width * bpp + 31) / 32 * 4;
+  if (offset + stride * height > b.size()) return false;
+  img->width = width;
+  img->height = height;
+  img->luma.resize((size_t)width * height);
+  for (int y = 0; y < height; ++y) {
+    const uint8_t* row = &b[offset + stride * (topDown ? y : height - 1 - y)];
+    uint8_t* dst = &img->luma[(size_t)y * width];
+    for (int x = 0; x < width; ++x) {
+      switch (bpp) {
+        case 1: dst[x] = palette[(row[x / 8] >> (7 - x % 8)) & 1]; break;
+        case 4: dst[x] = palette[(row[x / 2] >> (x % 2 ? 0 : 4)) & 15]; break;
+        case 8: dst[x] = palette[row[x]]; break;
+        default: {
+          const uint8_t* p = &row[x * bpp / 8];
+          dst[x] = luma(p[2], p[1], p[0]);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// Empty note: decoded; otherwise why not
+std::string decode(const std::string& path, Image* img) {
+  std::string ext = extension(path);
+  if (ext == "png") return readPng(path, img) ? "" : "bad PNG";
+  if (ext == "webp") return "no WebP decoder";
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return "cannot open";
+  bool ok = false;
+  if (ext == "jpg" || ext == "jpeg") {
+    ok = readJpeg(f, img);
+  } else if (ext == "bmp") {
+    ok = readBmp(f, img);
+  } else {
+    fclose(f);
+    return "not a picture";
+  }
+  fclose(f);
+  return ok ? "" : "bad " + ext;
+}
+
+// ============================================================================
+// Timing
+// ============================================================================
+
+double nowUs() {
+  using namespace std::chrono;
+  return duration<double, std::micro>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct Timing {
+  double downscale = 0;
+  double stretch = 0;
+  double dither = 0;
+  double total() const { return downscale + stretch + dither; }
+};
+
+// Mean time of each stage over n runs
+Timing time(PicPipeline& pipe, const Image& img, int n, uint8_t* pic) {
+  Timing t;
+  PicCrop crop = PicPipeline::centerCrop(img.width, img.height);
+  for (int i = 0; i < n; ++i) {
+    double t0 = nowUs();
+    pipe.downscale(img.luma.data(), img.width, crop);
+    double t1 = nowUs();
+    pipe.stretch();
+    double t2 = nowUs();
+    pipe.dither(pic);
+    double t3 = nowUs();
+    t.downscale += t1 - t0;
+    t.stretch += t2 - t1;
+    t.dither += t3 - t2;
+  }
+  t.downscale /= n;
+  t.stretch /= n;
+  t.dither /= n;
+  return t;
+}
+
+// What snap renders from: the picture at the size the camera's decoder
+// hands over for a VGA frame at 1/SNAP_JPEG_SCALE (point-sampled; only the
+// timing is taken from it)
+Image deviceSized(const Image& img) {
+  Image d;
+  d.width = 640 / SNAP_JPEG_SCALE;
+  d.height = 480 / SNAP_JPEG_SCALE;
+  d.luma.resize((size_t)d.width * d.height);
+  for (int y = 0; y < d.height; ++y) {
+    for (int x = 0; x < d.width; ++x) {
+      d.luma[(size_t)y * d.width + x] = img.luma[(size_t)(y * img.height / d.height) * img.width + x * img.width / d.width];
+    }
+  }
+  return d;
+}
+
+bool writePbm(const std::string& path, const uint8_t* pic) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) return false;
+  // P4 rows are the Pic's rows: MSB leftmost, 1 is black
+  fprintf(f, "P4\n%d %d\n", PIC_WIDTH, PIC_HEIGHT);
+  bool ok = fwrite(pic, 1, PIC_BYTES, f) == PIC_BYTES;
+  return fclose(f) == 0 && ok;
+}
+
+// ============================================================================
+// Dither Kernels
+// ============================================================================
+
+// One pixel at a time, each bit ORed into place: what the kernels must
+// match bit for bit
+void setDark(uint8_t* pic, int x, int y) { pic[y * PIC_ROW_BYTES + x / 8] |= 0x80 >> (x & 7); }
+
+void perPixelThreshold(const uint8_t* levels, uint8_t* pic) {
+  memset(pic, 0, PIC_BYTES);
+  for (int y = 0; y < PIC_HEIGHT; ++y) {
+    for (int x = 0; x < PIC_WIDTH; ++x) {
+      if (levels[y * PIC_WIDTH + x] < 128) setDark(pic, x, y);
+    }
+  }
+}
+
+void perPixelBayer(const uint8_t* levels, uint8_t* pic) {
+  memset(pic, 0, PIC_BYTES);
+  for (int y = 0; y < PIC_HEIGHT; ++y) {
+    for (int x = 0; x < PIC_WIDTH; ++x) {
+      if ((levels[y * PIC_WIDTH + x] >> 1) < 2 * BayerDither::matrix(x, y) + 1) setDark(pic, x, y);
+    }
+  }
+}
+
+void perPixelErrorDiffusion(const uint8_t* levels, uint8_t* pic) {
+  static int16_t errs[2][PIC_WIDTH + 2];
+  memset(pic, 0, PIC_BYTES);
+  memset(errs, 0, sizeof(errs));
+  for (int y = 0; y < PIC_HEIGHT; ++y) {
+    int16_t* cur = &errs[y & 1][1];
+    int16_t* next = &errs[(y + 1) & 1][1];
+    memset(next - 1, 0, sizeof(errs[0]));
+    int dir = (y & 1) == 0 ? 1 : -1;
+    for (int i = 0; i < PIC_WIDTH; ++i) {
+      int x = dir > 0 ? i : PIC_WIDTH - 1 - i;
+      int v = levels[y * PIC_WIDTH + x] + cur[x] / 16;
+      int e = v;
+      if (v < 128) {
+        setDark(pic, x, y);
+      } else {
+        e = v - 255;
+      }
+      cur[x + dir] += e * 7;
+      next[x - dir] += e * 3;
+      next[x] += e * 5;
+      next[x + dir] += e;
+    }
+  }
+}
+
+// The 5x5 binomial blur of a 96x63 image, edges repeated: roughly what
+// the eye makes of the calculator's pixels from reading distance
+std::vector<double> blur(const std::vector<double>& img) {
+  static const double k[5] = { 1 / 16.0, 4 / 16.0, 6 / 16.0, 4 / 16.0, 1 / 16.0 };
+  std::vector<double> tmp(img.size()), out(img.size());
+  auto at = [](int v, int n) { return std::min(std::max(v, 0), n - 1); };
+  for (int y = 0; y < PIC_HEIGHT; ++y) {
+    for (int x = 0; x < PIC_WIDTH; ++x) {
+      double s = 0;
+      for (int i = -2; i <= 2; ++i) s += k[i + 2] * img[y * PIC_WIDTH + at(x + i, PIC_WIDTH)];
+      tmp[y * PIC_WIDTH + x] = s;
+    }
+  }
+  for (int y = 0; y < PIC_HEIGHT; ++y) {
+    for (int x = 0; x < PIC_WIDTH; ++x) {
+      double s = 0;
+      for (int i = -2; i <= 2; ++i) s += k[i + 2] * tmp[at(y + i, PIC_HEIGHT) * PIC_WIDTH + x];
+      out[y * PIC_WIDTH + x] = s;
+    }
+  }
+  return out;
+}
+
+// PSNR in dB between the blurred levels and the blurred picture
+double quality(const uint8_t* levels, const uint8_t* pic) {
+  std::vector<double> a(PIC_WIDTH * PIC_HEIGHT), b(PIC_WIDTH * PIC_HEIGHT);
+  for (int y = 0; y < PIC_HEIGHT; ++y) {
+    for (int x = 0; x < PIC_WIDTH; ++x) {
+      a[y * PIC_WIDTH + x] = levels[y * PIC_WIDTH + x];
+      b[y * PIC_WIDTH + x] = (pic[y * PIC_ROW_BYTES + x / 8] & (0x80 >> (x & 7))) ? 0 : 255;
+    }
+  }
+  a = blur(a);
+  b = blur(b);
+  double mse = 0;
+  for (size_t i = 0; i < a.size(); ++i) mse += (a[i] - b[i]) * (a[i] - b[i]);
+  mse /= a.size();
+  return mse > 0 ? 10 * log10(255.0 * 255.0 / mse) : 99;
+}
+
+struct Levels {
+  std::string name;
+  std::vector<uint8_t> levels;
+};
+
+// Times kernel K and its per-pixel version on every picture's levels,
+// checks that they agree, and writes K's pictures to out/<kernel>/
+template <class K>
+bool compareKernel(const std::vector<Levels>& all, void (*perPixel)(const uint8_t*, uint8_t*), int n,
+                   const std::string& out) {
+  K kernel;
+  double kernelUs = 0, perPixelUs = 0, psnr = 0, worst = 99;
+  int mismatches = 0;
+  std::string dir = out + "/" + K::name();
+  mkdir(dir.c_str(), 0755);
+  for (auto& l : all) {
+    alignas(4) uint8_t levels[PIC_WIDTH * PIC_HEIGHT];
+    memcpy(levels, l.levels.data(), sizeof(levels));
+    uint8_t a[PIC_BYTES], b[PIC_BYTES];
+    double t0 = nowUs();
+    for (int i = 0; i < n; ++i) kernel.render(levels, a);
+    double t1 = nowUs();
+    for (int i = 0; i < n; ++i) perPixel(levels, b);
+    double t2 = nowUs();
+    kernelUs += (t1 - t0) / n;
+    perPixelUs += (t2 - t1) / n;
+    if (memcmp(a, b, PIC_BYTES) != 0) ++mismatches;
+    double q = quality(levels, a);
+    psnr += q;
+    worst = std::min(worst, q);
+    writePbm(dir + "/" + l.name + ".pbm", a);
+  }
+  size_t count = all.size();
+  printf("%-16s %9.2f %12.2f %7.1fx %8.2f %8.2f %10s\n", K::name(), kernelUs / count, perPixelUs / count,
+         perPixelUs / kernelUs, psnr / count, worst, mismatches ? (std::to_string(mismatches) + " differ").c_str() : "yes");
+  return mismatches == 0;
+}
+
+bool parseArgs(int argc, char** argv, Options& o) {
+  for (int i = 1; i < argc; ++i) {
+    std::string a = argv[i];
+    auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+    const char* v = nullptr;
+    if (a == "--dir" && (v = next())) {
+      o.dir = v;
+    } else if (a == "--out" && (v = next())) {
+      o.out = v;
+    } else if (a == "--iterations" && (v = next())) {
+      o.iterations = std::max(1, atoi(v));
+    } else if (a == "--help" || a == "-h" || a[0] == '-') {
+      fprintf(stderr,
+              "usage: picbench [--dir DIR] [--out DIR] [--iterations N] [FILE...]\n"
+              "  --dir DIR         pictures to convert (default test-images/)\n"
+              "  --out DIR         where the PBMs go (default host/out/pics/)\n"
+              "  --iterations N    runs timed per picture (default 200)\n"
+              "  FILE...           only these pictures of DIR\n");
+      return false;
+    } else {
+      o.files.push_back(a);
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options o;
+  if (!parseArgs(argc, argv, o)) return 2;
+  if (o.files.empty()) {
+    DIR* d = opendir(o.dir.c_str());
+    if (!d) {
+      fprintf(stderr, "cannot read %s\n", o.dir.c_str());
+      return 1;
+    }
+    while (dirent* e = readdir(d)) {
+      if (e->d_name[0] != '.') o.files.push_back(e->d_name);
+    }
+    closedir(d);
+    std::sort(o.files.begin(), o.files.end());
+  }
+  mkdir(o.out.c_str(), 0755);
+
+  PicPipeline pipe;
+  uint8_t pic[PIC_BYTES];
+  int converted = 0, failed = 0;
+  Timing sum, deviceSum;
+  std::vector<Levels> levels;
+  printf("%-26s %11s %11s %9s %9s %8s %8s %9s %7s %6s\n", "picture", "size", "crop", "scale us", "stretch",
+         "dither", "total", "device us", "levels", "dark");
+  for (auto& file : o.files) {
+    Image img;
+    std::string why = decode(o.dir + "/" + file, &img);
+    if (!why.empty()) {
+      printf("%-26s %s, skipped\n", file.c_str(), why.c_str());
+      if (why != "no WebP decoder" && why != "not a picture") ++failed;
+      continue;
+    }
+    std::string size = std::to_string(img.width) + "x" + std::to_string(img.height);
+    if (!pipe.render(img.luma.data(), img.width, img.height, img.width, pic)) {
+      printf("%-26s %11s too large, skipped\n", file.c_str(), size.c_str());
+      ++failed;
+      continue;
+    }
+    PicStats stats = pipe.getStats();
+    std::string name = file.substr(0, file.rfind('.'));
+    levels.push_back({ name, std::vector<uint8_t>(pipe.levels(), pipe.levels() + PIC_WIDTH * PIC_HEIGHT) });
+    if (!writePbm(o.out + "/" + name + ".pbm", pic)) {
+      fprintf(stderr, "cannot write %s/%s.pbm\n", o.out.c_str(), name.c_str());
+      ++failed;
+    }
+
+    uint8_t scratch[PIC_BYTES];
+    Timing t = time(pipe, img, o.iterations, scratch);
+    Timing device = time(pipe, deviceSized(img), o.iterations, scratch);
+    sum.downscale += t.downscale;
+    sum.stretch += t.stretch;
+    sum.dither += t.dither;
+    deviceSum.downscale += device.downscale;
+    deviceSum.stretch += device.stretch;
+    deviceSum.dither += device.dither;
+    ++converted;
+
+    std::string crop = std::to_string(stats.crop.width) + "x" + std::to_string(stats.crop.height);
+    std::string levels = std::to_string(stats.low) + "-" + std::to_string(stats.high);
+    printf("%-26s %11s %11s %9.1f %9.1f %8.1f %8.1f %9.1f %7s %5.1f%%\n", file.c_str(), size.c_str(), crop.c_str(),
+           t.downscale, t.stretch, t.dither, t.total(), device.total(), levels.c_str(),
+           100.0 * stats.dark / (PIC_WIDTH * PIC_HEIGHT));
+  }
+  if (converted) {
+    printf("\n%d pictures, mean %.1f us (scale %.1f, stretch %.1f, dither %.1f); from %dx%d luma %.1f us\n", converted,
+           sum.total() / converted, sum.downscale / converted, sum.stretch / converted, sum.dither / converted,
+           640 / SNAP_JPEG_SCALE, 480 / SNAP_JPEG_SCALE, deviceSum.total() / converted);
+    printf("PBMs in %s\n", o.out.c_str());
+
+    printf("\n%-16s %9s %12s %8s %8s %8s %10s\n", "kernel", "word us", "per-pixel us", "speedup", "PSNR dB",
+           "worst", "identical");
+    bool same = compareKernel<ThresholdDither>(levels, perPixelThreshold, o.iterations, o.out);
+    same = compareKernel<BayerDither>(levels, perPixelBayer, o.iterations, o.out) && same;
+    same = compareKernel<ErrorDiffusionDither>(levels, perPixelErrorDiffusion, o.iterations, o.out) && same;
+    printf("PSNR of the pictures against their levels, both blurred 5x5; each kernel's PBMs in %s/<kernel>\n",
+           o.out.c_str());
+    if (!same) ++failed;
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// ============================================================================
+// Arduino core shim for the host simulator (see docs/HOST_SIMULATOR.md)
+// ============================================================================
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "WString.h"
+#include "Print.h"
+#include "HardwareSerial.h"
+#include "IPAddress.h"
+#include "Esp.h"
+#include "FreeRTOS.h"
+
+using std::max;
+using std::min;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+// the simulated board is an AI Thinker ESP32-CAM with 4 MB of PSRAM
+inline bool psramFound() { return true; }
+inline void* ps_malloc(size_t size) { return malloc(size); }
+inline void* ps_realloc(void* ptr, size_t size) { return realloc(ptr, size); }
+
+// hardware RNG; deterministic here so runs repeat
+inline uint32_t esp_random() { return (uint32_t)rand(); }
+
+inline bool isLowerCase(int c) { return islower(c); }
+inline bool isUpperCase(int c) { return isupper(c); }
+inline bool isDigit(int c) { return isdigit(c); }
+
+#endif  // HOST_ARDUINO_H
@@ -0,0 +1,27 @@
+#ifndef HOST_CBL2_H
+#define HOST_CBL2_H
+
+#include "TICL.h"
+
+// ArTICL CBL2 shim: answers the calculator's Send( and Get( like a CBL2
+class CBL2 : public TICL {
+public:
+  void setupCallbacks(uint8_t* header, uint8_t* data, int maxlength,
+                      int (*get_callback)(uint8_t, enum Endpoint, int),
+                      int (*send_callback)(uint8_t, enum Endpoint, int*, int*, data_callback*));
+  int eventLoopTick(bool quick = false);
+
+private:
+  int onGetAsCBL2(Endpoint model);
+  int onSendAsCBL2(Endpoint model);
+  int sendCommand(uint8_t cmd);
+  int expect(uint8_t cmd);
+
+  uint8_t* header_ = nullptr;
+  uint8_t* data_ = nullptr;
+  int maxlength_ = 0;
+  int (*get_callback_)(uint8_t, enum Endpoint, int) = nullptr;
+  int (*send_callback_)(uint8_t, enum Endpoint, int*, int*, data_callback*) = nullptr;
+};
+
+#endif  // HOST_CBL2_H
@@ -0,0 +1,20 @@
+#ifndef HOST_ESP_H
+#define HOST_ESP_H
+
+#include <cstdint>
+
+class EspClass {
+public:
+  uint32_t getSketchSize() { return 1187840; }
+  uint32_t getFreeSketchSpace() { return 1966080; }
+  uint32_t getFreeHeap() { return 180000; }
+  uint32_t getHeapSize() { return 320000; }
+  uint32_t getPsramSize() { return 4194252; }
+  uint32_t getFreePsram() { return 4194252; }
+  const char* getChipModel() { return "ESP32-D0WDQ6 (host sim)"; }
+  void restart();
+};
+
+extern EspClass ESP;
+
+#endif  // HOST_ESP_H
@@ -0,0 +1,31 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// ============================================================================
+// FreeRTOS task shim for the host simulator
+// ============================================================================
+//
+// The simulator is single threaded, so task creation always fails and the
+// firmware runs its link and network work cooperatively from loop().
+
+#include <cstdint>
+
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define configMAX_PRIORITIES 25
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stackDepth, void* param,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+
+#endif  // HOST_FREERTOS_H
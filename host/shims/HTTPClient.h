@@ -0,0 +1,94 @@
+#ifndef HOST_HTTPCLIENT_H
+#define HOST_HTTPCLIENT_H
+
+// ============================================================================
+// Subset of the arduino-esp32 HTTPClient, speaking real HTTP/1.1 bytes to the
+// simulated server so header parsing, keep-alive and body reads behave the
+// way they do on the device.
+// ============================================================================
+
+#include <utility>
+#include <vector>
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+#define HTTPCLIENT_DEFAULT_TCP_TIMEOUT (5000)
+
+typedef enum {
+  HTTP_CODE_OK = 200,
+  HTTP_CODE_NOT_MODIFIED = 304,
+  HTTP_CODE_BAD_REQUEST = 400,
+  HTTP_CODE_NOT_FOUND = 404,
+  HTTP_CODE_INTERNAL_SERVER_ERROR = 500
+} t_http_codes;
+
+typedef enum { HTTPC_TE_IDENTITY, HTTPC_TE_CHUNKED } transferEncoding_t;
+
+class HTTPClient {
+public:
+  HTTPClient() {}
+  ~HTTPClient() { end(); }
+
+  bool begin(WiFiClient& client, String url);
+  void end();
+  bool connected();
+
+  void setReuse(bool reuse) { reuse_ = reuse; }
+  void setUserAgent(const String& ua) { userAgent_ = ua; }
+  void setAuthorization(const char* user, const char* password);
+  void setTimeout(uint16_t ms) { tcpTimeout_ = ms; }
+  void setConnectTimeout(int32_t ms) { (void)ms; }
+  void addHeader(const String& name, const String& value, bool first = false, bool replace = true);
+  void collectHeaders(const char* headerKeys[], const size_t headerKeysCount);
+  String header(const char* name);
+  bool hasHeader(const char* name);
+
+  int GET();
+  int POST(uint8_t* payload, size_t size);
+  int POST(const String& payload);
+  int sendRequest(const char* type, const String& payload);
+  int sendRequest(const char* type, uint8_t* payload = nullptr, size_t size = 0);
+
+  int getSize() { return size_; }
+  transferEncoding_t getTransferEncoding() { return te_; }
+  WiFiClient& getStream() { return *client_; }
+  WiFiClient* getStreamPtr() { return connected() ? client_ : nullptr; }
+  int writeToStream(Stream* stream);
+  String getString();
+
+  static String errorToString(int error);
+
+private:
+  bool connect();
+  int handleHeaderResponse();
+  void disconnect(bool preserveClient = false);
+
+  WiFiClient* client_ = nullptr;
+  String host_;
+  uint16_t port_ = 80;
+  String uri_;
+  String base64Auth_;
+  String userAgent_ = "ESP32HTTPClient";
+  String headers_;
+  bool reuse_ = true;
+  bool canReuse_ = false;
+  uint16_t tcpTimeout_ = HTTPCLIENT_DEFAULT_TCP_TIMEOUT;
+  int returnCode_ = 0;
+  int size_ = -1;
+  transferEncoding_t te_ = HTTPC_TE_IDENTITY;
+  std::vector<std::pair<String, String>> collected_;
+};
+
+#endif  // HOST_HTTPCLIENT_H
@@ -0,0 +1,22 @@
+#ifndef HOST_HARDWARESERIAL_H
+#define HOST_HARDWARESERIAL_H
+
+#include "Print.h"
+
+// Serial output is forwarded to the simulator log (sim::setLogFile)
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  void end() {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buf, size_t n) override;
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif  // HOST_HARDWARESERIAL_H
@@ -0,0 +1,23 @@
+#ifndef HOST_IPADDRESS_H
+#define HOST_IPADDRESS_H
+
+#include <cstdio>
+#include "Print.h"
+
+class IPAddress : public Printable {
+public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : b_{a, b, c, d} {}
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", b_[0], b_[1], b_[2], b_[3]);
+    return String(buf);
+  }
+  size_t printTo(Print& p) const override { return p.print(toString()); }
+  uint8_t operator[](int i) const { return b_[i]; }
+
+private:
+  uint8_t b_[4] = {0, 0, 0, 0};
+};
+
+#endif  // HOST_IPADDRESS_H
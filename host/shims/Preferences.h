@@ -0,0 +1,28 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <cstdint>
+#include "WString.h"
+
+// NVS stand-in: process-wide, in-memory key/value store per namespace
+class Preferences {
+public:
+  bool begin(const char* name, bool readOnly = false);
+  void end();
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+
+  size_t putUInt(const char* key, uint32_t v);
+  uint32_t getUInt(const char* key, uint32_t def = 0);
+  size_t putUChar(const char* key, uint8_t v);
+  uint8_t getUChar(const char* key, uint8_t def = 0);
+  size_t putString(const char* key, const char* v);
+  size_t putString(const char* key, const String& v) { return putString(key, v.c_str()); }
+  String getString(const char* key, const String& def = String());
+
+private:
+  String ns_;
+};
+
+#endif  // HOST_PREFERENCES_H
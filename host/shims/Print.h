@@ -0,0 +1,76 @@
+#ifndef HOST_PRINT_H
+#define HOST_PRINT_H
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print;
+
+class Printable {
+public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t n) {
+    size_t k = 0;
+    while (n--) k += write(*buf++);
+    return k;
+  }
+  size_t write(const char* s) { return s ? write((const uint8_t*)s, strlen(s)) : 0; }
+  size_t write(const char* s, size_t n) { return write((const uint8_t*)s, n); }
+  virtual void flush() {}
+
+  size_t print(const char* s) { return write(s); }
+  size_t print(const String& s) { return write(s.c_str(), s.length()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char v, int base = DEC) { return print(String(v, base)); }
+  size_t print(int v, int base = DEC) { return print(String(v, base)); }
+  size_t print(unsigned int v, int base = DEC) { return print(String(v, base)); }
+  size_t print(long v, int base = DEC) { return print(String(v, base)); }
+  size_t print(unsigned long v, int base = DEC) { return print(String(v, base)); }
+  size_t print(long long v, int base = DEC) { return print(String(v, base)); }
+  size_t print(unsigned long long v, int base = DEC) { return print(String(v, base)); }
+  size_t print(double v, int digits = 2) { return print(String(v, digits)); }
+  size_t print(const Printable& p) { return p.printTo(*this); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T& v) { size_t n = print(v); return n + println(); }
+  template <typename T>
+  size_t println(const T& v, int arg) { size_t n = print(v, arg); return n + println(); }
+
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long ms) { timeout_ = ms; }
+  unsigned long getTimeout() const { return timeout_; }
+  size_t readBytes(uint8_t* buf, size_t len);
+  size_t readBytes(char* buf, size_t len) { return readBytes((uint8_t*)buf, len); }
+  String readStringUntil(char terminator);
+  String readString();
+
+protected:
+  int timedRead();
+  unsigned long timeout_ = 1000;
+};
+
+#endif  // HOST_PRINT_H
@@ -0,0 +1,77 @@
+#ifndef HOST_TICL_H
+#define HOST_TICL_H
+
+// ============================================================================
+// ArTICL TICL shim: packet-level send/get over the simulated TIP/RING bus
+// ============================================================================
+
+#include <cstdint>
+#include "Arduino.h"
+
+#define ERR_READ_TIMEOUT 1000
+#define ERR_WRITE_TIMEOUT 2000
+#define ERR_BAD_CHECKSUM 3000
+#define ERR_BUFFER_OVERFLOW 4000
+#define ERR_INVALID 5000
+
+#define TIMEOUT 1000
+#define GET_ENTER_TIMEOUT 30000
+
+enum Endpoint {
+  COMP82 = 0x02,
+  COMP83 = 0x03,
+  COMP85 = 0x05,
+  COMP86 = 0x06,
+  COMP89 = 0x08,
+  CBL82 = 0x12,
+  CBL85 = 0x15,
+  CBL89 = 0x19,
+  COMP83P = 0x23,
+  CALC83P = 0x73,
+  CALC82 = 0x82,
+  CALC83 = 0x83,
+  CALC85a = 0x85,
+  CALC86 = 0x86,
+  CALC89 = 0x89,
+  CALC85b = 0x95,
+};
+
+enum CommandID {
+  VAR = 0x06,
+  CTS = 0x09,
+  DATA = 0x15,
+  VER = 0x2D,
+  SKIP = 0x36,
+  ACK = 0x56,
+  ERR = 0x5A,
+  RDY = 0x68,
+  SCR = 0x6D,
+  RID = 0x74,
+  CONT = 0x78,
+  KEY = 0x87,
+  DEL = 0x88,
+  EOT = 0x92,
+  REQ = 0xA2,
+  RTS = 0xC9,
+};
+
+typedef uint8_t (*data_callback)(int);
+
+class TICL {
+public:
+  TICL() {}
+  void setLines(int tip, int ring) { tip_ = tip; ring_ = ring; }
+  void resetLines() {}
+  void setVerbosity(bool verbose, HardwareSerial* serial = nullptr) {
+    (void)verbose;
+    (void)serial;
+  }
+  int send(uint8_t* header, uint8_t* data, int datalength, data_callback cb = nullptr);
+  int get(uint8_t* header, uint8_t* data, int* datalength, int maxlength);
+
+protected:
+  int tip_ = -1;
+  int ring_ = -1;
+};
+
+#endif  // HOST_TICL_H
@@ -0,0 +1,35 @@
+#ifndef HOST_TIVAR_H
+#define HOST_TIVAR_H
+
+#include "Arduino.h"
+#include "TICL.h"
+
+enum VarTypes82 {
+  VarReal = 0x00,
+  VarRList = 0x01,
+  VarMatrix = 0x02,
+  VarEqu = 0x03,
+  VarString = 0x04,
+  VarProgram = 0x05,
+  VarProtProg = 0x06,
+  VarPic = 0x07,
+  VarGDB = 0x08,
+  VarWindow = 0x0B,
+  VarComplex = 0x0C,
+  VarCList = 0x0D,
+  VarAppVar = 0x15,
+};
+
+class TIVar {
+public:
+  static long realToLong8x(uint8_t* real, enum Endpoint model);
+  static double realToFloat8x(uint8_t* real, enum Endpoint model);
+  static int longToReal8x(long num, uint8_t* real, enum Endpoint model);
+  static int floatToReal8x(double num, uint8_t* real, enum Endpoint model);
+  static String strVarToString8x(uint8_t* strVar, enum Endpoint model);
+  static int stringToStrVar8x(String s, uint8_t* strVar, enum Endpoint model);
+  static int sizeWordToInt(uint8_t* sizeWord);
+  static void intToSizeWord(int size, uint8_t* sizeWord);
+};
+
+#endif  // HOST_TIVAR_H
@@ -0,0 +1,22 @@
+#ifndef HOST_UPDATE_H
+#define HOST_UPDATE_H
+
+#include "Arduino.h"
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+#define U_FLASH 0
+#define U_SPIFFS 100
+
+class UpdateClass {
+public:
+  bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH) { (void)size; (void)command; return true; }
+  size_t write(uint8_t* data, size_t len) { (void)data; return len; }
+  bool end(bool evenIfRemaining = false) { (void)evenIfRemaining; return true; }
+  bool hasError() { return false; }
+  uint8_t getError() { return 0; }
+  void printError(Print& out) { out.println("no error"); }
+};
+
+extern UpdateClass Update;
+
+#endif  // HOST_UPDATE_H
@@ -0,0 +1,8 @@
+#ifndef HOST_URLENCODE_H
+#define HOST_URLENCODE_H
+
+#include "WString.h"
+
+String urlEncode(String str);
+
+#endif  // HOST_URLENCODE_H
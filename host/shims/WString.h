@@ -0,0 +1,101 @@
+#ifndef HOST_WSTRING_H
+#define HOST_WSTRING_H
+
+// ============================================================================
+// Arduino String, backed by std::string
+// ============================================================================
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+class String {
+public:
+  String() {}
+  String(const char* s) : s_(s ? s : "") {}
+  String(const std::string& s) : s_(s) {}
+  explicit String(char c) : s_(1, c) {}
+  explicit String(unsigned char v, unsigned char base = 10) { fromUnsigned(v, base); }
+  explicit String(int v, unsigned char base = 10) { fromSigned(v, base); }
+  explicit String(unsigned int v, unsigned char base = 10) { fromUnsigned(v, base); }
+  explicit String(long v, unsigned char base = 10) { fromSigned(v, base); }
+  explicit String(unsigned long v, unsigned char base = 10) { fromUnsigned(v, base); }
+  explicit String(long long v, unsigned char base = 10) { fromSigned(v, base); }
+  explicit String(unsigned long long v, unsigned char base = 10) { fromUnsigned(v, base); }
+  explicit String(float v, unsigned int decimals = 2) { fromDouble(v, decimals); }
+  explicit String(double v, unsigned int decimals = 2) { fromDouble(v, decimals); }
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.size(); }
+  bool isEmpty() const { return s_.empty(); }
+  bool reserve(unsigned int n) { s_.reserve(n); return true; }
+  const std::string& str() const { return s_; }
+
+  bool concat(const String& o) { s_ += o.s_; return true; }
+  bool concat(const char* o) { if (o) s_ += o; return true; }
+  bool concat(const char* o, unsigned int n) { s_.append(o, n); return true; }
+  bool concat(char c) { s_ += c; return true; }
+
+  String& operator+=(const String& o) { s_ += o.s_; return *this; }
+  String& operator+=(const char* o) { if (o) s_ += o; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+  String& operator+=(int v) { s_ += String(v).s_; return *this; }
+  String& operator+=(unsigned int v) { s_ += String(v).s_; return *this; }
+  String& operator+=(long v) { s_ += String(v).s_; return *this; }
+  String& operator+=(unsigned long v) { s_ += String(v).s_; return *this; }
+
+  friend String operator+(const String& a, const String& b) { return String(a.s_ + b.s_); }
+  friend String operator+(const String& a, const char* b) { return String(a.s_ + (b ? b : "")); }
+  friend String operator+(const char* a, const String& b) { return String(std::string(a ? a : "") + b.s_); }
+  friend String operator+(const String& a, char b) { return String(a.s_ + b); }
+
+  bool operator==(const String& o) const { return s_ == o.s_; }
+  bool operator==(const char* o) const { return s_ == (o ? o : ""); }
+  bool operator!=(const String& o) const { return s_ != o.s_; }
+  bool operator!=(const char* o) const { return !(*this == o); }
+  bool operator<(const String& o) const { return s_ < o.s_; }
+  bool equals(const String& o) const { return s_ == o.s_; }
+  bool equalsIgnoreCase(const String& o) const { return strcasecmp(c_str(), o.c_str()) == 0; }
+
+  char charAt(unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char operator[](unsigned int i) const { return charAt(i); }
+  char& operator[](unsigned int i) { return s_[i]; }
+  void setCharAt(unsigned int i, char c) { if (i < s_.size()) s_[i] = c; }
+
+  int indexOf(char c, unsigned int from = 0) const { return pos(s_.find(c, from)); }
+  int indexOf(const String& o, unsigned int from = 0) const { return pos(s_.find(o.s_, from)); }
+  int lastIndexOf(char c) const { return pos(s_.rfind(c)); }
+  bool startsWith(const String& o) const { return s_.compare(0, o.s_.size(), o.s_) == 0; }
+  bool endsWith(const String& o) const {
+    return s_.size() >= o.s_.size() && s_.compare(s_.size() - o.s_.size(), o.s_.size(), o.s_) == 0;
+  }
+  String substring(unsigned int from) const { return from >= s_.size() ? String() : String(s_.substr(from)); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    if (from >= s_.size()) return String();
+    return String(s_.substr(from, to - from));
+  }
+
+  long toInt() const { return strtol(c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(c_str(), nullptr); }
+  double toDouble() const { return strtod(c_str(), nullptr); }
+  void trim();
+  void toUpperCase() { for (auto& c : s_) c = toupper((unsigned char)c); }
+  void toLowerCase() { for (auto& c : s_) c = tolower((unsigned char)c); }
+  void replace(const String& from, const String& to);
+  void remove(unsigned int index) { if (index < s_.size()) s_.erase(index); }
+  void remove(unsigned int index, unsigned int count) { if (index < s_.size()) s_.erase(index, count); }
+  void getBytes(unsigned char* buf, unsigned int n, unsigned int index = 0) const;
+  void toCharArray(char* buf, unsigned int n, unsigned int index = 0) const {
+    getBytes((unsigned char*)buf, n, index);
+  }
+
+private:
+  static int pos(size_t p) { return p == std::string::npos ? -1 : (int)p; }
+  void fromSigned(long long v, unsigned char base);
+  void fromUnsigned(unsigned long long v, unsigned char base);
+  void fromDouble(double v, unsigned int decimals);
+  std::string s_;
+};
+
+#endif  // HOST_WSTRING_H
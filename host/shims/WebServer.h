@@ -0,0 +1,58 @@
+#ifndef HOST_WEBSERVER_H
+#define HOST_WEBSERVER_H
+
+#include <functional>
+#include <map>
+#include <vector>
+#include "Arduino.h"
+
+typedef enum { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS } HTTPMethod;
+typedef enum { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END, UPLOAD_FILE_ABORTED } HTTPUploadStatus;
+
+#define HTTP_UPLOAD_BUFLEN 1436
+
+typedef struct {
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  uint8_t buf[HTTP_UPLOAD_BUFLEN];
+} HTTPUpload;
+
+// Routes are registered like on the device; the bench drives them through
+// simRequest() instead of a socket.
+class WebServer {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  explicit WebServer(int port = 80) : port_(port) {}
+  void begin() {}
+  void stop() {}
+  void handleClient() {}
+  void on(const String& uri, HTTPMethod method, THandlerFunction fn);
+  void on(const String& uri, HTTPMethod method, THandlerFunction fn, THandlerFunction upload);
+
+  void send(int code, const char* contentType = nullptr, const String& content = String());
+  void send(int code, const String& contentType, const String& content) { send(code, contentType.c_str(), content); }
+  void sendHeader(const String& name, const String& value, bool first = false);
+  bool hasArg(const String& name);
+  String arg(const String& name);
+  HTTPUpload& upload() { return upload_; }
+
+  // ---- simulator entry point ----
+  struct Reply { int code = 0; String type; String body; };
+  Reply simRequest(HTTPMethod method, const String& uri,
+                   const std::map<String, String>& args = {});
+
+private:
+  struct Route { String uri; HTTPMethod method; THandlerFunction fn; };
+  int port_;
+  std::vector<Route> routes_;
+  std::map<String, String> args_;
+  HTTPUpload upload_ = {};
+  Reply reply_;
+};
+
+#endif  // HOST_WEBSERVER_H
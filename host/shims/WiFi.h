@@ -0,0 +1,56 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+typedef enum {
+  WL_NO_SHIELD = 255,
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+  WIFI_AUTH_OPEN = 0,
+  WIFI_AUTH_WEP,
+  WIFI_AUTH_WPA_PSK,
+  WIFI_AUTH_WPA2_PSK,
+  WIFI_AUTH_WPA_WPA2_PSK,
+  WIFI_AUTH_WPA2_ENTERPRISE,
+  WIFI_AUTH_WPA3_PSK,
+  WIFI_AUTH_WPA2_WPA3_PSK,
+  WIFI_AUTH_MAX
+} wifi_auth_mode_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA, WIFI_AP, WIFI_AP_STA } wifi_mode_t;
+
+class WiFiClass {
+public:
+  wl_status_t begin(const char* ssid, const char* pass = nullptr);
+  bool disconnect(bool wifiOff = false, bool eraseAp = false);
+  wl_status_t status();
+  bool isConnected() { return status() == WL_CONNECTED; }
+  bool mode(wifi_mode_t m) { (void)m; return true; }
+  IPAddress localIP();
+
+  int16_t scanNetworks();
+  String SSID(uint8_t i);
+  String SSID();
+  int32_t RSSI(uint8_t i);
+  int32_t RSSI();
+  int32_t channel(uint8_t i);
+  wifi_auth_mode_t encryptionType(uint8_t i);
+
+private:
+  bool connected_ = false;
+  String ssid_;
+};
+
+extern WiFiClass WiFi;
+
+#endif  // HOST_WIFI_H
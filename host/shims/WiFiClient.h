@@ -0,0 +1,40 @@
+#ifndef HOST_WIFICLIENT_H
+#define HOST_WIFICLIENT_H
+
+#include <memory>
+#include "Arduino.h"
+
+namespace sim {
+class Connection;
+}
+
+// TCP client backed by a simulated connection to the in-process server model
+class WiFiClient : public Stream {
+public:
+  WiFiClient() {}
+  virtual ~WiFiClient() {}
+
+  virtual int connect(const char* host, uint16_t port);
+  virtual int connect(const char* host, uint16_t port, int32_t timeoutMs) {
+    (void)timeoutMs;
+    return connect(host, port);
+  }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t n) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t n);
+  int peek() override;
+  void flush() override {}
+  void stop();
+  uint8_t connected();
+  operator bool() { return connected(); }
+  void setNoDelay(bool) {}
+
+protected:
+  virtual bool isSecure() const { return false; }
+  std::shared_ptr<sim::Connection> conn_;
+};
+
+#endif  // HOST_WIFICLIENT_H
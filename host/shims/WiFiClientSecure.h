@@ -0,0 +1,16 @@
+#ifndef HOST_WIFICLIENTSECURE_H
+#define HOST_WIFICLIENTSECURE_H
+
+#include "WiFiClient.h"
+
+// TLS client: connecting costs the handshake modelled by sim::NetParams
+class WiFiClientSecure : public WiFiClient {
+public:
+  void setInsecure() {}
+  void setCACert(const char*) {}
+
+protected:
+  bool isSecure() const override { return true; }
+};
+
+#endif  // HOST_WIFICLIENTSECURE_H
@@ -0,0 +1,210 @@
+// Arduino core shim implementation: String, Print/Stream, Serial, timing,
+// GPIO (TIP/RING come from the simulated link bus), NVS and UrlEncode.
+
+#include "Arduino.h"
+#include <map>
+#include <stdexcept>
+#include "Preferences.h"
+#include "UrlEncode.h"
+#include "../sim/sim.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+// ============================================================================
+// String
+// ============================================================================
+
+void String::fromSigned(long long v, unsigned char base) {
+  if (v < 0 && base == 10) {
+    fromUnsigned((unsigned long long)(-v), base);
+    s_.insert(s_.begin(), '-');
+  } else {
+    fromUnsigned((unsigned long long)v, base);
+  }
+}
+
+void String::fromUnsigned(unsigned long long v, unsigned char base) {
+  const char* digits = "0123456789abcdefghijklmnopqrstuvwxyz";
+  if (base < 2) base = 10;
+  std::string out;
+  do {
+    out.insert(out.begin(), digits[v % base]);
+    v /= base;
+  } while (v);
+  s_ = out;
+}
+
+void String::fromDouble(double v, unsigned int decimals) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+  s_ = buf;
+}
+
+void String::trim() {
+  size_t b = s_.find_first_not_of(" \t\r\n");
+  size_t e = s_.find_last_not_of(" \t\r\n");
+  s_ = b == std::string::npos ? std::string() : s_.substr(b, e - b + 1);
+}
+
+void String::replace(const String& from, const String& to) {
+  if (from.s_.empty()) return;
+  size_t p = 0;
+  while ((p = s_.find(from.s_, p)) != std::string::npos) {
+    s_.replace(p, from.s_.size(), to.s_);
+    p += to.s_.size();
+  }
+}
+
+void String::getBytes(unsigned char* buf, unsigned int n, unsigned int index) const {
+  if (!n || !buf) return;
+  unsigned int k = 0;
+  for (; k + 1 < n && index + k < s_.size(); ++k) buf[k] = s_[index + k];
+  buf[k] = 0;
+}
+
+// ============================================================================
+// Print / Stream / Serial
+// ============================================================================
+
+size_t Print::printf(const char* fmt, ...) {
+  char buf[512];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n < 0) return 0;
+  return write((const uint8_t*)buf, std::min((size_t)n, sizeof(buf) - 1));
+}
+
+int Stream::timedRead() {
+  unsigned long start = millis();
+  do {
+    int c = read();
+    if (c >= 0) return c;
+  } while (millis() - start < timeout_);
+  return -1;
+}
+
+size_t Stream::readBytes(uint8_t* buf, size_t len) {
+  size_t n = 0;
+  while (n < len) {
+    int c = timedRead();
+    if (c < 0) break;
+    buf[n++] = (uint8_t)c;
+  }
+  return n;
+}
+
+String Stream::readStringUntil(char terminator) {
+  std::string out;
+  int c;
+  while ((c = timedRead()) >= 0 && c != terminator) out += (char)c;
+  return String(out);
+}
+
+String Stream::readString() {
+  std::string out;
+  int c;
+  while ((c = timedRead()) >= 0) out += (char)c;
+  return String(out);
+}
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t n) {
+  if (FILE* f = sim::logFile()) fwrite(buf, 1, n, f);
+  return n;
+}
+
+// ============================================================================
+// Timing + GPIO
+// ============================================================================
+
+unsigned long millis() { return (unsigned long)(sim::nowUs() / 1000); }
+unsigned long micros() { return (unsigned long)sim::nowUs(); }
+void delay(uint32_t ms) { sim::advanceUs((uint64_t)ms * 1000); }
+void delayMicroseconds(uint32_t us) { sim::advanceUs(us); }
+void yield() {}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t* handle,
+                                   BaseType_t) {
+  if (handle) *handle = nullptr;
+  return pdFAIL;
+}
+void vTaskDelete(TaskHandle_t) {}
+void vTaskDelay(TickType_t ticks) { delay(ticks * portTICK_PERIOD_MS); }
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return sim::bus().linesIdle() ? HIGH : LOW; }
+
+void EspClass::restart() { throw std::runtime_error("ESP.restart()"); }
+
+// ============================================================================
+// UrlEncode
+// ============================================================================
+
+String urlEncode(String str) {
+  static const char* hex = "0123456789ABCDEF";
+  std::string out;
+  for (unsigned char c : str.str()) {
+    if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+      out += (char)c;
+    } else {
+      out += '%';
+      out += hex[c >> 4];
+      out += hex[c & 15];
+    }
+  }
+  return String(out);
+}
+
+// ============================================================================
+// Preferences
+// ============================================================================
+
+static std::map<std::string, std::string>& nvs() {
+  static std::map<std::string, std::string> store;
+  return store;
+}
+
+static std::string nvsKey(const String& ns, const char* key) { return ns.str() + "/" + key; }
+
+bool Preferences::begin(const char* name, bool) { ns_ = name; return true; }
+void Preferences::end() {}
+
+bool Preferences::clear() {
+  auto& s = nvs();
+  std::string prefix = ns_.str() + "/";
+  for (auto it = s.begin(); it != s.end();) {
+    it = it->first.compare(0, prefix.size(), prefix) == 0 ? s.erase(it) : std::next(it);
+  }
+  return true;
+}
+
+bool Preferences::remove(const char* key) { return nvs().erase(nvsKey(ns_, key)) > 0; }
+bool Preferences::isKey(const char* key) { return nvs().count(nvsKey(ns_, key)) > 0; }
+
+size_t Preferences::putUInt(const char* key, uint32_t v) {
+  nvs()[nvsKey(ns_, key)] = std::to_string(v);
+  return 4;
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t def) {
+  auto it = nvs().find(nvsKey(ns_, key));
+  return it == nvs().end() ? def : (uint32_t)std::stoul(it->second);
+}
+
+size_t Preferences::putUChar(const char* key, uint8_t v) { return putUInt(key, v) ? 1 : 0; }
+uint8_t Preferences::getUChar(const char* key, uint8_t def) { return (uint8_t)getUInt(key, def); }
+
+size_t Preferences::putString(const char* key, const char* v) {
+  nvs()[nvsKey(ns_, key)] = v ? v : "";
+  return strlen(v ? v : "");
+}
+
+String Preferences::getString(const char* key, const String& def) {
+  auto it = nvs().find(nvsKey(ns_, key));
+  return it == nvs().end() ? def : String(it->second);
+}
@@ -0,0 +1,13 @@
+#ifndef HOST_BASE64_H
+#define HOST_BASE64_H
+
+#include "WString.h"
+
+// arduino-esp32's base64 helper (cores/esp32/base64.h)
+class base64 {
+public:
+  static String encode(const uint8_t* data, size_t length);
+  static String encode(const String& text);
+};
+
+#endif  // HOST_BASE64_H
@@ -0,0 +1,147 @@
+// esp32-camera shim: a fake OV2640 that needs one frame time per grab.
+
+#include "esp_camera.h"
+#include "img_converters.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "../sim/sim.h"
+
+namespace {
+
+bool initialized = false;
+camera_config_t config;
+sensor_t sensor;
+camera_fb_t fb;
+std::vector<uint8_t> pixels;
+bool fbOut = false;
+uint64_t startedUs = 0;  // the sensor's first frame starts here
+uint64_t delivered = 0;  // the last frame handed out, counted from the start
+
+int setPixformat(sensor_t*, pixformat_t f) { config.pixel_format = f; return 0; }
+int setFramesize(sensor_t*, framesize_t f) { config.frame_size = f; return 0; }
+int setLevel(sensor_t*, int) { return 0; }
+
+void frameSize(framesize_t f, size_t* w, size_t* h) {
+  static const size_t dims[][2] = {
+    { 96, 96 }, { 160, 120 }, { 176, 144 }, { 240, 176 }, { 240, 240 }, { 320, 240 }, { 400, 296 },
+    { 480, 320 }, { 640, 480 }, { 800, 600 }, { 1024, 768 }, { 1280, 720 }, { 1280, 1024 }, { 1600, 1200 },
+  };
+  *w = dims[f < FRAMESIZE_INVALID ? f : FRAMESIZE_VGA][0];
+  *h = dims[f < FRAMESIZE_INVALID ? f : FRAMESIZE_VGA][1];
+}
+
+// a scene with something to dither: a gradient with a dark disc off center
+uint8_t scene(size_t x, size_t y, size_t w, size_t h) {
+  long dx = (long)x - (long)(w * 2 / 5);
+  long dy = (long)y - (long)(h / 2);
+  long r = (long)(h / 4);
+  if (dx * dx + dy * dy < r * r) return 30;
+  return (uint8_t)(60 + (x * 150 / w + y * 40 / h));
+}
+
+}  // namespace
+
+esp_err_t esp_camera_init(const camera_config_t* c) {
+  if (initialized) return ESP_ERR_INVALID_STATE;
+  config = *c;
+  sensor.set_pixformat = setPixformat;
+  sensor.set_framesize = setFramesize;
+  sensor.set_contrast = setLevel;
+  sensor.set_brightness = setLevel;
+  // sensor probe + register upload
+  sim::advanceUs(250 * 1000);
+  initialized = true;
+  startedUs = sim::nowUs();
+  delivered = 0;
+  return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit() {
+  if (!initialized) return ESP_FAIL;
+  // the real driver frees the buffers regardless; a frame still out would
+  // be read after the free
+  if (fbOut) {
+    fprintf(stderr, "[camera] deinit with a frame buffer still out\n");
+    abort();
+  }
+  initialized = false;
+  return ESP_OK;
+}
+
+camera_fb_t* esp_camera_fb_get() {
+  if (!initialized || fbOut) return nullptr;
+  size_t w, h;
+  frameSize(config.frame_size, &w, &h);
+  // the OV2640 runs CIF and smaller at twice the rate of SVGA
+  uint64_t frameUs = w * h <= 400 * 296 ? 1000000 / 50 : 1000000 / 25;
+  uint64_t takenUs;
+  if (config.grab_mode == CAMERA_GRAB_LATEST && config.fb_count >= 2) {
+    // the sensor never stops: the newest complete frame, or the next one
+    // if that was handed out already
+    uint64_t latest = (sim::nowUs() - startedUs) / frameUs;
+    if (latest <= delivered) {
+      latest = delivered + 1;
+      sim::advanceUs(startedUs + latest * frameUs - sim::nowUs());
+    }
+    delivered = latest;
+    takenUs = startedUs + latest * frameUs;
+  } else {
+    // a single buffer means waiting out the frame in flight plus a fresh one
+    sim::advanceUs(2 * frameUs);
+    takenUs = sim::nowUs();
+  }
+
+  if (config.pixel_format == PIXFORMAT_GRAYSCALE) {
+    pixels.assign(w * h, 0);
+    for (size_t y = 0; y < h; ++y) {
+      for (size_t x = 0; x < w; ++x) pixels[y * w + x] = scene(x, y, w, h);
+    }
+  } else if (config.pixel_format == PIXFORMAT_YUV422) {
+    // YUYV, with flat chroma
+    pixels.assign(w * h * 2, 128);
+    for (size_t y = 0; y < h; ++y) {
+      for (size_t x = 0; x < w; ++x) pixels[2 * (y * w + x)] = scene(x, y, w, h);
+    }
+  } else {
+    // JPEG-sized blob with SOI/EOI markers
+    pixels.assign(w * h / 12, 0x5A);
+    pixels[0] = 0xFF;
+    pixels[1] = 0xD8;
+    pixels[pixels.size() - 2] = 0xFF;
+    pixels[pixels.size() - 1] = 0xD9;
+  }
+  fb.buf = pixels.data();
+  fb.len = pixels.size();
+  fb.width = w;
+  fb.height = h;
+  fb.format = config.pixel_format;
+  fb.timestamp.tv_sec = takenUs / 1000000;
+  fb.timestamp.tv_usec = takenUs % 1000000;
+  fbOut = true;
+  return &fb;
+}
+
+void esp_camera_fb_return(camera_fb_t*) { fbOut = false; }
+
+sensor_t* esp_camera_sensor_get() { return initialized ? &sensor : nullptr; }
+
+bool jpg2rgb565(const uint8_t* src, size_t len, uint8_t* out, jpg_scale_t scale) {
+  if (len < 4 || src[0] != 0xFF || src[1] != 0xD8 || src != fb.buf) return false;
+  size_t w = fb.width >> scale;
+  size_t h = fb.height >> scale;
+  // the entropy decode touches every block whatever the scale, so scaling
+  // saves less than it seems (TJpgDec on a 240 MHz core, per source pixel)
+  static const uint64_t nsPerPixel[] = { 300, 200, 150, 120 };
+  sim::advanceUs(fb.width * fb.height * nsPerPixel[scale] / 1000);
+  for (size_t y = 0; y < h; ++y) {
+    for (size_t x = 0; x < w; ++x) {
+      uint8_t v = scene(x, y, w, h);
+      uint16_t p = ((v >> 3) << 11) | ((v >> 2) << 5) | (v >> 3);
+      out[2 * (y * w + x)] = p >> 8;
+      out[2 * (y * w + x) + 1] = p & 0xff;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,22 @@
+#ifndef HOST_IMG_CONVERTERS_H
+#define HOST_IMG_CONVERTERS_H
+
+// ============================================================================
+// esp32-camera img_converters shim: decodes the fake sensor's JPEG frames
+// ============================================================================
+
+#include <cstddef>
+#include <cstdint>
+
+typedef enum {
+  JPG_SCALE_NONE,
+  JPG_SCALE_2X,
+  JPG_SCALE_4X,
+  JPG_SCALE_8X,
+  JPG_SCALE_MAX = JPG_SCALE_8X
+} jpg_scale_t;
+
+// Writes the frame at 1/2^scale size as big-endian RGB565 to out
+bool jpg2rgb565(const uint8_t* src, size_t src_len, uint8_t* out, jpg_scale_t scale);
+
+#endif  // HOST_IMG_CONVERTERS_H
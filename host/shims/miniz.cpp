@@ -0,0 +1,38 @@
+// tinfl on zlib: raw deflate, output into the caller's window
+#include "esp32/rom/miniz.h"
+
+static const uint32_t kOpen = 0x7a6c6962;
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* pIn_buf_next, size_t* pIn_buf_size,
+                              mz_uint8* pOut_buf_start, mz_uint8* pOut_buf_next, size_t* pOut_buf_size,
+                              const mz_uint32 decomp_flags) {
+  (void)pOut_buf_start;
+  (void)decomp_flags;
+  if (r->m_state == 0) {
+    if (r->magic == kOpen) {
+      inflateReset(&r->z);
+    } else {
+      r->z = z_stream();
+      if (inflateInit2(&r->z, -15) != Z_OK) return TINFL_STATUS_FAILED;
+      r->magic = kOpen;
+    }
+    r->m_state = 1;
+  } else if (r->m_state == 2) {
+    *pIn_buf_size = 0;
+    *pOut_buf_size = 0;
+    return TINFL_STATUS_DONE;
+  }
+  r->z.next_in = (Bytef*)pIn_buf_next;
+  r->z.avail_in = (uInt)*pIn_buf_size;
+  r->z.next_out = pOut_buf_next;
+  r->z.avail_out = (uInt)*pOut_buf_size;
+  int rc = inflate(&r->z, Z_NO_FLUSH);
+  *pIn_buf_size -= r->z.avail_in;
+  *pOut_buf_size -= r->z.avail_out;
+  if (rc == Z_STREAM_END) {
+    r->m_state = 2;
+    return TINFL_STATUS_DONE;
+  }
+  if (rc != Z_OK && rc != Z_BUF_ERROR) return TINFL_STATUS_FAILED;
+  return r->z.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
@@ -0,0 +1,9 @@
+// Stand-in secrets.h for the host simulator. The real file lives next to
+// esp32.ino and is git-ignored; an existing esp32/secrets.h takes precedence.
+#define SECURE
+#define SERVER "https://ti32.sim"
+#define WIFI_SSID "SIMNET"
+#define WIFI_PASS "simpass"
+#define HTTP_USERNAME "sim"
+#define HTTP_PASSWORD "sim"
+#define CHAT_NAME "SIM"
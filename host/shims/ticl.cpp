@@ -0,0 +1,218 @@
+// ArTICL shims: TICL/CBL2 move packets over sim::LinkBus, TIVar converts TI
+// reals and strings the same way the calculator stores them.
+
+#include "CBL2.h"
+#include "TIVar.h"
+#include "../sim/sim.h"
+
+// ============================================================================
+// TICL
+// ============================================================================
+
+int TICL::send(uint8_t* header, uint8_t* data, int datalength, data_callback cb) {
+  return sim::bus().deviceSend(header, data, datalength, cb);
+}
+
+int TICL::get(uint8_t* header, uint8_t* data, int* datalength, int maxlength) {
+  return sim::bus().deviceGet(header, data, datalength, maxlength,
+                              sim::linkParams().readTimeoutUs);
+}
+
+// ============================================================================
+// CBL2
+// ============================================================================
+
+static constexpr int kMaxVarHeader = 16;
+
+void CBL2::setupCallbacks(uint8_t* header, uint8_t* data, int maxlength,
+                          int (*get_callback)(uint8_t, enum Endpoint, int),
+                          int (*send_callback)(uint8_t, enum Endpoint, int*, int*, data_callback*)) {
+  header_ = header;
+  data_ = data;
+  maxlength_ = maxlength;
+  get_callback_ = get_callback;
+  send_callback_ = send_callback;
+}
+
+int CBL2::sendCommand(uint8_t cmd) {
+  uint8_t hdr[4] = { CBL82, cmd, 0, 0 };
+  return send(hdr, nullptr, 0);
+}
+
+int CBL2::expect(uint8_t cmd) {
+  uint8_t hdr[4];
+  int len = 0;
+  int rval = get(hdr, nullptr, &len, 0);
+  if (rval) return rval;
+  return hdr[1] == cmd ? 0 : ERR_INVALID;
+}
+
+int CBL2::eventLoopTick(bool quick) {
+  (void)quick;
+  if (!sim::bus().incomingStarted()) {
+    sim::advanceUs((uint64_t)sim::linkParams().pollUs);
+    return 0;
+  }
+  uint8_t hdr[4];
+  int len = 0;
+  int rval = get(hdr, header_, &len, kMaxVarHeader);
+  if (rval) return rval;
+  switch (hdr[1]) {
+    case VAR:
+      return onGetAsCBL2((Endpoint)hdr[0]);
+    case REQ:
+      return onSendAsCBL2((Endpoint)hdr[0]);
+    default:
+      return ERR_INVALID;
+  }
+}
+
+// calculator Send( -> we receive a variable
+int CBL2::onGetAsCBL2(Endpoint model) {
+  int rval;
+  if ((rval = sendCommand(ACK)) || (rval = sendCommand(CTS)) || (rval = expect(ACK))) return rval;
+
+  uint8_t hdr[4];
+  int datalen = 0;
+  if ((rval = get(hdr, data_, &datalen, maxlength_))) return rval;
+  if (hdr[1] != DATA) return ERR_INVALID;
+  if ((rval = sendCommand(ACK))) return rval;
+
+  return get_callback_ ? get_callback_(header_[2], model, datalen) : 0;
+}
+
+// calculator Get( -> we send a variable
+int CBL2::onSendAsCBL2(Endpoint model) {
+  int rval;
+  uint8_t type = header_[2];
+  if ((rval = sendCommand(ACK))) return rval;
+
+  int headerlen = 11;
+  int datalen = 0;
+  data_callback cb = nullptr;
+  if (!send_callback_ || send_callback_(type, model, &headerlen, &datalen, &cb)) {
+    sendCommand(SKIP);
+    return ERR_INVALID;
+  }
+
+  uint8_t hdr[4] = { CBL82, VAR, (uint8_t)(headerlen & 0xff), (uint8_t)(headerlen >> 8) };
+  if ((rval = send(hdr, header_, headerlen)) || (rval = expect(ACK)) || (rval = expect(CTS))) return rval;
+  if ((rval = sendCommand(ACK))) return rval;
+
+  hdr[1] = DATA;
+  hdr[2] = datalen & 0xff;
+  hdr[3] = (datalen >> 8) & 0xff;
+  if ((rval = send(hdr, data_, datalen, cb))) return rval;
+  return expect(ACK);
+}
+
+// ============================================================================
+// TIVar
+// ============================================================================
+
+// TI 8x real: flags, biased exponent, 14 BCD digits
+double TIVar::realToFloat8x(uint8_t* real, enum Endpoint) {
+  int exp = (int)real[1] - 0x80;
+  double mant = 0;
+  for (int i = 0; i < 7; ++i) {
+    mant = mant * 100 + (real[2 + i] >> 4) * 10 + (real[2 + i] & 0xf);
+  }
+  // dividing by an exact power of ten keeps integers exact; multiplying by
+  // 10^-n (not representable) lands some of them just below
+  double v = exp >= 13 ? mant * pow(10.0, exp - 13) : mant / pow(10.0, 13 - exp);
+  return real[0] & 0x80 ? -v : v;
+}
+
+// The integer part, from the BCD digits directly
+long TIVar::realToLong8x(uint8_t* real, enum Endpoint) {
+  int exp = (int)real[1] - 0x80;
+  if (exp < 0) return 0;
+  long long v = 0;
+  for (int i = 0; i < 14; ++i) {
+    int digit = i % 2 ? real[2 + i / 2] & 0xf : real[2 + i / 2] >> 4;
+    if (i <= exp) v = v * 10 + digit;
+  }
+  for (int i = 13; i < exp; ++i) v *= 10;
+  return (long)(real[0] & 0x80 ? -v : v);
+}
+
+int TIVar::floatToReal8x(double num, uint8_t* real, enum Endpoint) {
+  memset(real, 0, 9);
+  real[1] = 0x80;
+  if (num == 0) return 9;
+  if (num < 0) {
+    real[0] = 0x80;
+    num = -num;
+  }
+  int exp = (int)floor(log10(num));
+  double mant = num / pow(10.0, exp - 13);
+  long long digits = llround(mant);
+  if (digits >= 100000000000000LL) {
+    digits /= 10;
+    ++exp;
+  }
+  real[1] = (uint8_t)(0x80 + exp);
+  for (int i = 6; i >= 0; --i) {
+    int pair = digits % 100;
+    digits /= 100;
+    real[2 + i] = (uint8_t)(((pair / 10) << 4) | (pair % 10));
+  }
+  return 9;
+}
+
+int TIVar::longToReal8x(long num, uint8_t* real, enum Endpoint model) {
+  return floatToReal8x((double)num, real, model);
+}
+
+int TIVar::sizeWordToInt(uint8_t* sizeWord) { return sizeWord[0] | (sizeWord[1] << 8); }
+
+void TIVar::intToSizeWord(int size, uint8_t* sizeWord) {
+  sizeWord[0] = size & 0xff;
+  sizeWord[1] = (size >> 8) & 0xff;
+}
+
+// single-byte tokens for the printable characters the programs use
+static const struct { char c; uint8_t tok; } kTokens[] = {
+  { ' ', 0x29 }, { '.', 0x3A }, { ',', 0x2B }, { ':', 0x3E }, { '"', 0x2A }, { '?', 0xAF },
+  { '(', 0x10 }, { ')', 0x11 }, { '{', 0x08 }, { '}', 0x09 }, { '[', 0x06 }, { ']', 0x07 },
+  { '+', 0x70 }, { '-', 0x71 }, { '*', 0x82 }, { '/', 0x83 }, { '=', 0x6A }, { '<', 0x6B },
+  { '>', 0x6C }, { '!', 0x2D }, { '^', 0xF0 }, { '\'', 0xAE }, { '|', 0xBC },
+};
+
+String TIVar::strVarToString8x(uint8_t* strVar, enum Endpoint) {
+  int len = sizeWordToInt(strVar);
+  std::string out;
+  for (int i = 0; i < len; ++i) {
+    uint8_t t = strVar[2 + i];
+    if (t == 0xBB && i + 1 < len) {
+      uint8_t l = strVar[2 + ++i];
+      out += (char)(l < 0xBB ? 'a' + (l - 0xB0) : 'l' + (l - 0xBC));
+      continue;
+    }
+    char c = (char)t;
+    for (auto& k : kTokens) {
+      if (k.tok == t) c = k.c;
+    }
+    out += c;
+  }
+  return String(out);
+}
+
+int TIVar::stringToStrVar8x(String s, uint8_t* strVar, enum Endpoint) {
+  int n = 0;
+  for (unsigned i = 0; i < s.length(); ++i) {
+    char c = s[i];
+    if (c >= 'a' && c <= 'z') {
+      strVar[2 + n++] = 0xBB;
+      strVar[2 + n++] = c < 'l' ? 0xB0 + (c - 'a') : 0xBC + (c - 'l');
+      continue;
+    }
+    uint8_t t = (uint8_t)c;
+    for (auto& k : kTokens) {
+      if (k.c == c) t = k.tok;
+    }
+    strVar[2 + n++] = t;
+  }
+  intToSizeWord(n, strVar);
+  return n + 2;
+}
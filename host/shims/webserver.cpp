@@ -0,0 +1,44 @@
+// WebServer / Update shims. Routes are dispatched synchronously by
+// WebServer::simRequest() so the bench can read /status and friends.
+
+#include "WebServer.h"
+#include "Update.h"
+
+UpdateClass Update;
+
+void WebServer::on(const String& uri, HTTPMethod method, THandlerFunction fn) {
+  routes_.push_back({ uri, method, fn });
+}
+
+void WebServer::on(const String& uri, HTTPMethod method, THandlerFunction fn, THandlerFunction) {
+  on(uri, method, fn);
+}
+
+void WebServer::send(int code, const char* contentType, const String& content) {
+  reply_.code = code;
+  reply_.type = contentType ? contentType : "";
+  reply_.body = content;
+}
+
+void WebServer::sendHeader(const String&, const String&, bool) {}
+
+bool WebServer::hasArg(const String& name) { return args_.count(name) > 0; }
+
+String WebServer::arg(const String& name) {
+  auto it = args_.find(name);
+  return it == args_.end() ? String() : it->second;
+}
+
+WebServer::Reply WebServer::simRequest(HTTPMethod method, const String& uri,
+                                       const std::map<String, String>& args) {
+  reply_ = Reply();
+  args_ = args;
+  for (auto& r : routes_) {
+    if (r.uri == uri && (r.method == method || r.method == HTTP_ANY)) {
+      r.fn();
+      return reply_;
+    }
+  }
+  reply_.code = 404;
+  return reply_;
+}
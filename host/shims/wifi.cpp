@@ -0,0 +1,315 @@
+// WiFi, WiFiClient, HTTPClient and base64 shims. Sockets are sim::Connection objects
+// to the in-process server model; HTTPClient speaks real HTTP/1.1 over them.
+
+#include "WiFi.h"
+#include "HTTPClient.h"
+#include "base64.h"
+#include "../sim/sim.h"
+
+WiFiClass WiFi;
+
+// ============================================================================
+// WiFi
+// ============================================================================
+
+static const char* kNetworks[] = {
+  "SIMNET", "CLASSROOM-5G", "EDUROAM", "LIBRARY-GUEST", "DIRECT-7F-HP-LASERJET",
+  "XFINITYWIFI", "ATT-HOMEBASE-2G", "NETGEAR58", "PRETTY FLY FOR A WIFI",
+  "TELLMYWIFILOVEHER", "CAFE-PUBLIC", "SCIENCE-LAB-AP", "GYM-WIFI", "BUS-23",
+  "HALLWAY-EXT", "STAFF-ONLY", "PRINTROOM", "NOT-THE-FBI-VAN", "ROOM-214", "MATHDEPT",
+};
+static const int kNumNetworks = sizeof(kNetworks) / sizeof(kNetworks[0]);
+
+wl_status_t WiFiClass::begin(const char* ssid, const char*) {
+  // association + DHCP
+  sim::advanceUs(1200 * 1000);
+  ssid_ = ssid;
+  connected_ = true;
+  return WL_CONNECTED;
+}
+
+bool WiFiClass::disconnect(bool, bool) {
+  connected_ = false;
+  return true;
+}
+
+wl_status_t WiFiClass::status() { return connected_ ? WL_CONNECTED : WL_DISCONNECTED; }
+IPAddress WiFiClass::localIP() { return connected_ ? IPAddress(192, 168, 4, 32) : IPAddress(); }
+
+int16_t WiFiClass::scanNetworks() {
+  // a blocking active scan over all channels
+  sim::advanceUs(2200 * 1000);
+  return kNumNetworks;
+}
+
+String WiFiClass::SSID(uint8_t i) { return i < kNumNetworks ? String(kNetworks[i]) : String(); }
+String WiFiClass::SSID() { return connected_ ? ssid_ : String(); }
+int32_t WiFiClass::RSSI(uint8_t i) { return -40 - 3 * i; }
+int32_t WiFiClass::RSSI() { return connected_ ? -52 : 0; }
+int32_t WiFiClass::channel(uint8_t i) { return 1 + (i * 5) % 11; }
+wifi_auth_mode_t WiFiClass::encryptionType(uint8_t i) { return i % 4 ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN; }
+
+// ============================================================================
+// WiFiClient
+// ============================================================================
+
+int WiFiClient::connect(const char*, uint16_t) {
+  if (!WiFi.isConnected()) return 0;
+  conn_ = std::make_shared<sim::Connection>(isSecure());
+  return conn_->open() ? 1 : 0;
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t n) { return conn_ ? conn_->write(buf, n) : 0; }
+int WiFiClient::available() { return conn_ ? conn_->available() : 0; }
+int WiFiClient::read() { return conn_ ? conn_->read() : -1; }
+int WiFiClient::peek() { return conn_ ? conn_->peek() : -1; }
+
+int WiFiClient::read(uint8_t* buf, size_t n) {
+  size_t k = 0;
+  while (k < n && available() > 0) buf[k++] = (uint8_t)read();
+  return (int)k;
+}
+
+void WiFiClient::stop() {
+  if (conn_) conn_->close();
+  conn_.reset();
+}
+
+uint8_t WiFiClient::connected() { return conn_ && conn_->isOpen(); }
+
+// ============================================================================
+// HTTPClient
+// ============================================================================
+
+String base64::encode(const uint8_t* data, size_t length) {
+  static const char* t = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t v = data[i] << 16;
+    if (i + 1 < length) v |= data[i + 1] << 8;
+    if (i + 2 < length) v |= data[i + 2];
+    out += t[(v >> 18) & 63];
+    out += t[(v >> 12) & 63];
+    out += i + 1 < length ? t[(v >> 6) & 63] : '=';
+    out += i + 2 < length ? t[v & 63] : '=';
+  }
+  return String(out);
+}
+
+String base64::encode(const String& text) { return encode((const uint8_t*)text.c_str(), text.length()); }
+
+bool HTTPClient::begin(WiFiClient& client, String url) {
+  if (client_ && client_ != &client) end();
+  client_ = &client;
+
+  int idx = url.indexOf("://");
+  String protocol = idx < 0 ? String("http") : url.substring(0, idx);
+  url = idx < 0 ? url : url.substring(idx + 3);
+  port_ = protocol == "https" ? 443 : 80;
+
+  idx = url.indexOf('/');
+  String host = idx < 0 ? url : url.substring(0, idx);
+  uri_ = idx < 0 ? String("/") : url.substring(idx);
+  idx = host.indexOf(':');
+  if (idx >= 0) {
+    port_ = (uint16_t)host.substring(idx + 1).toInt();
+    host = host.substring(0, idx);
+  }
+  if (host_ != host) canReuse_ = false;
+  host_ = host;
+  headers_ = String();
+  return true;
+}
+
+void HTTPClient::end() {
+  disconnect(false);
+  headers_ = String();
+}
+
+void HTTPClient::disconnect(bool preserveClient) {
+  if (connected()) {
+    while (client_->available() > 0) client_->read();
+    if (reuse_ && canReuse_) return;
+    client_->stop();
+    if (!preserveClient) client_ = nullptr;
+  }
+}
+
+bool HTTPClient::connected() { return client_ && client_->connected(); }
+
+void HTTPClient::setAuthorization(const char* user, const char* password) {
+  base64Auth_ = base64::encode(String(user) + ":" + password);
+}
+
+void HTTPClient::addHeader(const String& name, const String& value, bool first, bool) {
+  String line = name + ": " + value + "\r\n";
+  if (first) {
+    headers_ = line + headers_;
+  } else {
+    headers_ += line;
+  }
+}
+
+void HTTPClient::collectHeaders(const char* headerKeys[], const size_t count) {
+  collected_.clear();
+  for (size_t i = 0; i < count; ++i) collected_.push_back({String(headerKeys[i]), String()});
+}
+
+String HTTPClient::header(const char* name) {
+  for (auto& h : collected_) {
+    if (h.first.equalsIgnoreCase(name)) return h.second;
+  }
+  return String();
+}
+
+bool HTTPClient::hasHeader(const char* name) { return header(name).length() > 0; }
+
+bool HTTPClient::connect() {
+  if (connected()) {
+    while (client_->available() > 0) client_->read();
+    return true;
+  }
+  if (!client_) return false;
+  return client_->connect(host_.c_str(), port_) != 0;
+}
+
+int HTTPClient::GET() { return sendRequest("GET"); }
+int HTTPClient::POST(uint8_t* payload, size_t size) { return sendRequest("POST", payload, size); }
+int HTTPClient::POST(const String& payload) { return sendRequest("POST", payload); }
+
+int HTTPClient::sendRequest(const char* type, const String& payload) {
+  return sendRequest(type, (uint8_t*)payload.c_str(), payload.length());
+}
+
+int HTTPClient::sendRequest(const char* type, uint8_t* payload, size_t size) {
+  if (!connect()) return HTTPC_ERROR_CONNECTION_REFUSED;
+  for (auto& h : collected_) h.second = String();
+
+  String req = String(type) + " " + uri_ + " HTTP/1.1\r\nHost: " + host_;
+  if (port_ != 80 && port_ != 443) req += String(":") + String(port_);
+  req += String("\r\nUser-Agent: ") + userAgent_ + "\r\nConnection: ";
+  req += reuse_ ? "keep-alive" : "close";
+  req += "\r\nAccept-Encoding: identity;q=1,chunked;q=0.1,*;q=0\r\n";
+  if (base64Auth_.length()) req += String("Authorization: Basic ") + base64Auth_ + "\r\n";
+  if (payload && size) req += String("Content-Length: ") + String((unsigned)size) + "\r\n";
+  req += headers_ + "\r\n";
+
+  if (client_->write((const uint8_t*)req.c_str(), req.length()) != req.length()) {
+    return HTTPC_ERROR_SEND_HEADER_FAILED;
+  }
+  if (payload && size && client_->write(payload, size) != size) {
+    return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  }
+  returnCode_ = handleHeaderResponse();
+  return returnCode_;
+}
+
+int HTTPClient::handleHeaderResponse() {
+  if (!connected()) return HTTPC_ERROR_NOT_CONNECTED;
+  returnCode_ = 0;
+  size_ = -1;
+  te_ = HTTPC_TE_IDENTITY;
+  canReuse_ = reuse_;
+  unsigned long lastDataTime = millis();
+
+  while (connected()) {
+    if (client_->available() > 0) {
+      String line = client_->readStringUntil('\n');
+      line.trim();
+      lastDataTime = millis();
+      if (line.startsWith("HTTP/1.")) {
+        returnCode_ = line.substring(9, line.indexOf(' ', 9)).toInt();
+        canReuse_ = canReuse_ && line[7] != '0';
+      } else if (line.indexOf(':') > 0) {
+        String key = line.substring(0, line.indexOf(':'));
+        String value = line.substring(line.indexOf(':') + 1);
+        value.trim();
+        if (key.equalsIgnoreCase("Content-Length")) size_ = value.toInt();
+        if (key.equalsIgnoreCase("Connection") && value.equalsIgnoreCase("close")) canReuse_ = false;
+        if (key.equalsIgnoreCase("Transfer-Encoding") && value.equalsIgnoreCase("chunked")) te_ = HTTPC_TE_CHUNKED;
+        for (auto& h : collected_) {
+          if (h.first.equalsIgnoreCase(key)) h.second = value;
+        }
+      } else if (line.length() == 0) {
+        return returnCode_ ? returnCode_ : HTTPC_ERROR_NO_HTTP_SERVER;
+      }
+    } else {
+      if (millis() - lastDataTime > tcpTimeout_) return HTTPC_ERROR_READ_TIMEOUT;
+      delay(10);
+    }
+  }
+  return HTTPC_ERROR_CONNECTION_LOST;
+}
+
+int HTTPClient::writeToStream(Stream* stream) {
+  if (!connected()) return HTTPC_ERROR_NOT_CONNECTED;
+  int total = 0;
+  unsigned long last = millis();
+  auto copy = [&](int len) -> int {
+    int n = 0;
+    while ((len < 0 || n < len) && connected()) {
+      if (client_->available() > 0) {
+        stream->write((uint8_t)client_->read());
+        ++n;
+        last = millis();
+      } else if (millis() - last > tcpTimeout_) {
+        return HTTPC_ERROR_READ_TIMEOUT;
+      } else {
+        delay(1);
+      }
+    }
+    return n;
+  };
+
+  if (te_ == HTTPC_TE_IDENTITY) {
+    total = copy(size_);
+  } else {
+    while (true) {
+      String chunkHeader = client_->readStringUntil('\n');
+      int len = (int)strtol(chunkHeader.c_str(), nullptr, 16);
+      if (len <= 0) {
+        client_->readStringUntil('\n');
+        break;
+      }
+      int n = copy(len);
+      if (n < 0) return n;
+      total += n;
+      client_->readStringUntil('\n');
+    }
+  }
+  return total;
+}
+
+namespace {
+class StringSink : public Stream {
+public:
+  std::string out;
+  size_t write(uint8_t c) override { out += (char)c; return 1; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+};
+}  // namespace
+
+String HTTPClient::getString() {
+  StringSink sink;
+  writeToStream(&sink);
+  return String(sink.out);
+}
+
+String HTTPClient::errorToString(int error) {
+  switch (error) {
+    case HTTPC_ERROR_CONNECTION_REFUSED: return "connection refused";
+    case HTTPC_ERROR_SEND_HEADER_FAILED: return "send header failed";
+    case HTTPC_ERROR_SEND_PAYLOAD_FAILED: return "send payload failed";
+    case HTTPC_ERROR_NOT_CONNECTED: return "not connected";
+    case HTTPC_ERROR_CONNECTION_LOST: return "connection lost";
+    case HTTPC_ERROR_NO_STREAM: return "no stream";
+    case HTTPC_ERROR_NO_HTTP_SERVER: return "no HTTP server";
+    case HTTPC_ERROR_TOO_LESS_RAM: return "too less ram";
+    case HTTPC_ERROR_ENCODING: return "Transfer-Encoding not supported";
+    case HTTPC_ERROR_STREAM_WRITE: return "Stream write error";
+    case HTTPC_ERROR_READ_TIMEOUT: return "read Timeout";
+    default: return String();
+  }
+}
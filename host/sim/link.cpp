@@ -0,0 +1,279 @@
+// TIP/RING bus model and the virtual TI-84.
+//
+// The device side is blocking, like ArTICL's bit-banging: sending a packet
+// advances the clock by its wire time. The calculator answers each packet
+// after its turnaround time; its replies queue up on the bus and the device
+// picks them up with deviceGet().
+
+#include "sim.h"
+#include "../shims/TICL.h"
+
+namespace sim {
+
+static double wireUs(size_t bytes) { return bytes * 8 * linkParams().bitUs; }
+
+static size_t packetBytes(const Packet& p) { return 4 + (p.hasData ? p.data.size() + 2 : 0); }
+
+// fixed seed, so a run with --link-errors is repeatable; errorEvery fails
+// packets on a fixed pattern instead, for scenarios that need some to fail
+static bool checksumFails() {
+  static uint64_t state = 0x9E3779B97F4A7C15ULL;
+  static uint64_t packets = 0;
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  int every = linkParams().errorEvery;
+  if (every > 0 && ++packets % every == 0) return true;
+  return (state % 1000000) < linkParams().errorRate * 1000000;
+}
+
+LinkBus& bus() {
+  static LinkBus b;
+  return b;
+}
+
+VirtualCalc& calc() {
+  static VirtualCalc c;
+  return c;
+}
+
+// ============================================================================
+// LinkBus
+// ============================================================================
+
+void LinkBus::reset() {
+  toDevice_.clear();
+  lastCalcTxEndUs_ = 0;
+}
+
+int LinkBus::deviceSend(const uint8_t* header, const uint8_t* data, int len, uint8_t (*cb)(int)) {
+  VirtualCalc& c = calc();
+  if (!c.listening()) {
+    advanceUs((uint64_t)linkParams().writeTimeoutUs);
+    ++linkStats().writeTimeouts;
+    return ERR_WRITE_TIMEOUT;
+  }
+
+  Packet p;
+  p.machine = header[0];
+  p.cmd = header[1];
+  p.startUs = nowUs();
+  p.hasData = len > 0 && (data || cb);
+  double bitsUs = wireUs(4);
+  advanceUs((uint64_t)wireUs(4));
+  if (p.hasData) {
+    p.data.resize(len);
+    for (int i = 0; i < len; ++i) {
+      // a callback may block (e.g. waiting on the network); that stalls the
+      // wire just like it would on the device
+      p.data[i] = cb ? cb(i) : data[i];
+      advanceUs((uint64_t)wireUs(1));
+    }
+    advanceUs((uint64_t)wireUs(2));
+    bitsUs += wireUs(len + 2);
+  }
+  p.readyUs = nowUs();
+
+  LinkStats& s = linkStats();
+  s.bytes += packetBytes(p);
+  s.packets++;
+  s.busyUs += (uint64_t)bitsUs;
+  s.packetUs.add((double)(p.readyUs - p.startUs));
+
+  c.onPacket(p);
+  return 0;
+}
+
+int LinkBus::deviceGet(uint8_t* header, uint8_t* data, int* len, int maxlen, double timeoutUs) {
+  if (toDevice_.empty() || toDevice_.front().startUs > nowUs() + (uint64_t)timeoutUs) {
+    advanceUs((uint64_t)timeoutUs);
+    ++linkStats().readTimeouts;
+    return ERR_READ_TIMEOUT;
+  }
+  Packet p = toDevice_.front();
+  toDevice_.pop_front();
+  advanceToUs(p.readyUs);
+
+  header[0] = p.machine;
+  header[1] = p.cmd;
+  header[2] = p.hasData ? p.data.size() & 0xff : 0;
+  header[3] = p.hasData ? (p.data.size() >> 8) & 0xff : 0;
+  *len = 0;
+  if (p.hasData) {
+    if (!data || (int)p.data.size() > maxlen) return ERR_BUFFER_OVERFLOW;
+    memcpy(data, p.data.data(), p.data.size());
+    *len = (int)p.data.size();
+  }
+  return 0;
+}
+
+bool LinkBus::incomingStarted() const {
+  return !toDevice_.empty() && toDevice_.front().startUs <= nowUs();
+}
+
+void LinkBus::calcTransmit(Packet p) {
+  double turnaround = linkParams().turnaroundUs;
+  p.startUs = std::max(nowUs(), lastCalcTxEndUs_) + (uint64_t)turnaround;
+  double wire = wireUs(packetBytes(p));
+  p.readyUs = p.startUs + (uint64_t)wire;
+  lastCalcTxEndUs_ = p.readyUs;
+
+  LinkStats& s = linkStats();
+  s.bytes += packetBytes(p);
+  s.packets++;
+  s.busyUs += (uint64_t)wire;
+  s.packetUs.add(wire + turnaround);
+  toDevice_.push_back(std::move(p));
+}
+
+bool LinkBus::linesIdle() const { return nowUs() >= lastCalcTxEndUs_ && !incomingStarted(); }
+
+// ============================================================================
+// VirtualCalc
+// ============================================================================
+
+static std::vector<uint8_t> varHeader(uint8_t type, const std::vector<uint8_t>& name, size_t size) {
+  std::vector<uint8_t> h = { (uint8_t)(size & 0xff), (uint8_t)(size >> 8), type };
+  for (size_t i = 0; i < 8; ++i) h.push_back(i < name.size() ? name[i] : 0);
+  return h;
+}
+
+static std::string varKey(const std::vector<uint8_t>& name) {
+  std::string s;
+  for (uint8_t c : name) {
+    if (!c) break;
+    s += (char)c;
+  }
+  return s;
+}
+
+void VirtualCalc::reset() { *this = VirtualCalc(); }
+
+void VirtualCalc::startProgram() { running_ = true; }
+
+void VirtualCalc::endProgram() {
+  running_ = false;
+  homeAtUs_ = nowUs() + (uint64_t)(linkParams().programTailMs * 1000);
+}
+
+bool VirtualCalc::programRunning() const { return running_ || nowUs() < homeAtUs_; }
+
+bool VirtualCalc::listening() const {
+  // a running BASIC program only talks to the link inside Send( / Get(
+  return state_ != Idle || !programRunning();
+}
+
+void VirtualCalc::transmit(uint8_t cmd, const std::vector<uint8_t>* data) {
+  Packet p;
+  p.machine = CALC83P;
+  p.cmd = cmd;
+  if (data) {
+    p.hasData = true;
+    p.data = *data;
+  }
+  bus().calcTransmit(std::move(p));
+}
+
+void VirtualCalc::finish(bool ok) {
+  failed_ = !ok;
+  state_ = Idle;
+}
+
+void VirtualCalc::beginSend(uint8_t type, const std::vector<uint8_t>& name, const std::vector<uint8_t>& data) {
+  pending_.type = type;
+  pending_.name = name;
+  pending_.data = data;
+  failed_ = false;
+  state_ = SendVar;
+  auto h = varHeader(type, name, data.size());
+  transmit(VAR, &h);
+}
+
+void VirtualCalc::beginGet(uint8_t type, const std::vector<uint8_t>& name) {
+  pending_.type = type;
+  pending_.name = name;
+  pending_.data.clear();
+  lastGet_ = CalcVar();
+  failed_ = false;
+  state_ = GetVar;
+  auto h = varHeader(type, name, 0);
+  transmit(REQ, &h);
+}
+
+void VirtualCalc::onPacket(const Packet& p) {
+  // the calculator asks for a silent-transfer packet again when its checksum fails
+  if ((state_ == Idle || state_ == Silent) && p.hasData && (p.cmd == RTS || p.cmd == DATA) && checksumFails()) {
+    ++linkStats().checksumErrors;
+    transmit(ERR, nullptr);
+    return;
+  }
+  switch (state_) {
+    case Idle:
+      if (p.cmd == RTS && p.data.size() >= 3) {
+        silentVar_ = CalcVar();
+        silentVar_.type = p.data[2];
+        silentVar_.name.assign(p.data.begin() + 3, p.data.begin() + std::min<size_t>(p.data.size(), 11));
+        state_ = Silent;
+        silentStartUs_ = p.startUs;
+        transmit(ACK, nullptr);
+        transmit(CTS, nullptr);
+      }
+      break;
+
+    case SendVar:
+      if (p.cmd == CTS) {
+        transmit(ACK, nullptr);
+        transmit(DATA, &pending_.data);
+        state_ = SendData;
+      } else if (p.cmd != ACK) {
+        finish(false);
+      }
+      break;
+
+    case SendData:
+      finish(p.cmd == ACK);
+      break;
+
+    case GetVar:
+      if (p.cmd == VAR && p.data.size() >= 3) {
+        lastGet_.type = p.data[2];
+        lastGet_.name.assign(p.data.begin() + 3, p.data.end());
+        transmit(ACK, nullptr);
+        transmit(CTS, nullptr);
+        state_ = GetData;
+      } else if (p.cmd != ACK) {
+        finish(false);
+      }
+      break;
+
+    case GetData:
+      if (p.cmd == DATA) {
+        lastGet_.data = p.data;
+        transmit(ACK, nullptr);
+        finish(true);
+      } else if (p.cmd != ACK) {
+        finish(false);
+      }
+      break;
+
+    case Silent:
+      if (p.cmd == DATA) {
+        silentVar_.data = p.data;
+        received_[varKey(silentVar_.name)] = silentVar_;
+        transmit(ACK, nullptr);
+      } else if (p.cmd == RTS && p.data.size() >= 3) {
+        silentVar_ = CalcVar();
+        silentVar_.type = p.data[2];
+        silentVar_.name.assign(p.data.begin() + 3, p.data.begin() + std::min<size_t>(p.data.size(), 11));
+        transmit(ACK, nullptr);
+        transmit(CTS, nullptr);
+      } else if (p.cmd == EOT) {
+        ++silentSessions_;
+        lastSilentUs_ = p.readyUs - silentStartUs_;
+        state_ = Idle;
+      }
+      break;
+  }
+}
+
+}  // namespace sim
@@ -0,0 +1,439 @@
+// TCP/TLS connection model between the device and the server.
+//
+// Connecting costs one RTT (plus the TLS handshake for secure sockets).
+// Written bytes leave at the same bandwidth, and a write blocks while more
+// than the send buffer is still queued. Each complete HTTP request is handed
+// to the server model; the response comes back as MSS-sized segments paced
+// by the downstream bandwidth. After a 101
+// the connection carries the channel's WebSocket frames (routes/channel.mjs)
+// instead: GETs and compact requests are answered by the same server model,
+// and queued dashboard commands are pushed as soon as they are queued.
+
+#include "sim.h"
+#include <algorithm>
+#include <sstream>
+
+namespace sim {
+
+static uint64_t msToUs(double ms) { return (uint64_t)(ms * 1000); }
+
+static double transferMs(size_t bytes) { return bytes * 8.0 / netParams().bandwidthKbps; }
+
+bool Connection::open() {
+  const NetParams& np = netParams();
+  advanceUs(msToUs(np.rttMs));
+  ++netStats().connects;
+  if (secure_) {
+    // ClientHello .. Finished: two round trips plus the ESP32's crypto work
+    advanceUs(msToUs(2 * np.rttMs + np.tlsCpuMs));
+    ++netStats().tlsHandshakes;
+  }
+  open_ = true;
+  closeAtUs_ = 0;
+  return true;
+}
+
+void Connection::close() {
+  open_ = false;
+  upgraded_ = false;
+  held_.reset();
+  inbound_.clear();
+  request_.clear();
+  offset_ = 0;
+}
+
+bool Connection::isOpen() const {
+  if (!open_) return false;
+  if (closeAtUs_ && nowUs() >= closeAtUs_) {
+    // peer closed; unread bytes can still be drained
+    return const_cast<Connection*>(this)->available() > 0;
+  }
+  return true;
+}
+
+size_t Connection::write(const uint8_t* buf, size_t len) {
+  if (!isOpen()) return 0;
+  request_.append((const char*)buf, len);
+  netStats().bytesUp += len;
+  // the bytes leave at the link's rate; a write returns once what is still
+  // queued fits the send buffer
+  sentUs_ = std::max(nowUs(), sentUs_) + msToUs(transferMs(len));
+  uint64_t buffered = msToUs(transferMs(netParams().sndBufBytes));
+  if (sentUs_ > nowUs() + buffered) advanceUs(sentUs_ - buffered - nowUs());
+  if (upgraded_) {
+    dispatchFrames();
+  } else {
+    dispatch();
+  }
+  return len;
+}
+
+int Connection::available() {
+  serviceHeld();
+  serviceChannel();
+  size_t n = 0;
+  uint64_t now = nowUs();
+  for (size_t i = 0; i < inbound_.size() && inbound_[i].atUs <= now; ++i) {
+    n += inbound_[i].bytes.size() - (i == 0 ? offset_ : 0);
+  }
+  if (!n) advanceUs(5);  // a poll that finds nothing still costs a few cycles
+  return (int)n;
+}
+
+int Connection::peek() {
+  serviceHeld();
+  serviceChannel();
+  if (inbound_.empty() || inbound_.front().atUs > nowUs()) return -1;
+  return (uint8_t)inbound_.front().bytes[offset_];
+}
+
+int Connection::read() {
+  serviceHeld();
+  serviceChannel();
+  if (inbound_.empty() || inbound_.front().atUs > nowUs()) {
+    advanceUs(5);
+    return -1;
+  }
+  uint8_t c = (uint8_t)inbound_.front().bytes[offset_++];
+  if (offset_ >= inbound_.front().bytes.size()) {
+    inbound_.pop_front();
+    offset_ = 0;
+  }
+  return c;
+}
+
+static std::string lower(std::string s) {
+  for (auto& c : s) c = tolower((unsigned char)c);
+  return s;
+}
+
+static std::string urlDecode(const std::string& s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '%' && i + 2 < s.size()) {
+      out += (char)strtol(s.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+    } else {
+      out += s[i] == '+' ? ' ' : s[i];
+    }
+  }
+  return out;
+}
+
+// "/path?a=1&b=2" into path and query
+void parseTarget(const std::string& target, HttpRequest& req) {
+  size_t q = target.find('?');
+  req.path = target.substr(0, q);
+  if (q != std::string::npos) {
+    std::istringstream params(target.substr(q + 1));
+    std::string kv;
+    while (std::getline(params, kv, '&')) {
+      size_t eq = kv.find('=');
+      req.query[urlDecode(kv.substr(0, eq))] = eq == std::string::npos ? "" : urlDecode(kv.substr(eq + 1));
+    }
+  }
+}
+
+void Connection::dispatch() {
+  if (held_) return;  // one request at a time while the server holds one
+  size_t headerEnd = request_.find("\r\n\r\n");
+  if (headerEnd == std::string::npos) return;
+
+  HttpRequest req;
+  std::istringstream lines(request_.substr(0, headerEnd));
+  std::string line, target;
+  std::getline(lines, line);
+  std::istringstream first(line);
+  first >> req.method >> target;
+  while (std::getline(lines, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) continue;
+    std::string value = line.substr(colon + 1);
+    value.erase(0, value.find_first_not_of(' '));
+    req.headers[lower(line.substr(0, colon))] = value;
+  }
+  size_t bodyLen = req.headers.count("content-length") ? std::stoul(req.headers["content-length"]) : 0;
+  if (request_.size() < headerEnd + 4 + bodyLen) return;
+  req.body = request_.substr(headerEnd + 4, bodyLen);
+  request_.erase(0, headerEnd + 4 + bodyLen);
+
+  parseTarget(target, req);
+
+  const NetParams& np = netParams();
+  req.atUs = sentUs_ + msToUs(np.rttMs / 2);
+  ++netStats().requests;
+  closeAtUs_ = 0;  // the server's keep-alive timer restarts with each request
+  respond(req);
+}
+
+// a long-poll the server is still holding is answered once it decides
+void Connection::serviceHeld() {
+  if (!held_) return;
+  HttpRequest req = *held_;
+  held_.reset();
+  respond(req);
+}
+
+void Connection::respond(const HttpRequest& reqIn) {
+  HttpRequest req = reqIn;
+  const NetParams& np = netParams();
+  HttpResponse res = server().handle(req);
+  if (res.held) {
+    held_.reset(new HttpRequest(req));
+    return;
+  }
+  uint64_t respStart = req.atUs + msToUs(res.serverMs >= 0 ? res.serverMs : np.serverMs);
+
+  bool close = lower(req.headers["connection"]) == "close";
+  std::string wire = "HTTP/1.1 " + std::to_string(res.status) + (res.status == 200 ? " OK" : " ERR") + "\r\n";
+  bool hasLength = false;
+  for (auto& h : res.headers) {
+    wire += h.first + ": " + h.second + "\r\n";
+    hasLength |= lower(h.first) == "content-length" || lower(h.first) == "transfer-encoding";
+  }
+  // a 101, 204 or 304 has no body and no length
+  bool bodyless = res.status == 101 || res.status == 204 || res.status == 304;
+  bool streamed = !res.parts.empty();
+  bool chunked = streamed || (!hasLength && !bodyless && np.chunkBytes > 0);
+  if (chunked) {
+    wire += "Transfer-Encoding: chunked\r\n";
+  } else if (!hasLength && !bodyless) {
+    wire += "Content-Length: " + std::to_string(res.body.size()) + "\r\n";
+  }
+  if (res.status != 101) {
+    wire += std::string("Connection: ") + (close ? "close" : "keep-alive");
+    wire += "\r\n";
+  }
+  wire += "\r\n";
+  if (streamed) {
+    // the head goes out with the first part, each part as one chunk
+    uint64_t arrive = 0;
+    char size[16];
+    for (size_t i = 0; i < res.parts.size(); ++i) {
+      const std::string& part = res.parts[i].second;
+      snprintf(size, sizeof(size), "%zx\r\n", part.size());
+      wire += size + part + "\r\n";
+      if (i + 1 == res.parts.size()) wire += "0\r\n\r\n";
+      netStats().bytesDown += wire.size();
+      arrive = deliver(wire, req.atUs + msToUs(res.parts[i].first));
+      wire.clear();
+    }
+    closeAtUs_ = close ? arrive : arrive + msToUs(np.keepAliveMs);
+    return;
+  }
+  if (chunked) {
+    char size[16];
+    for (size_t off = 0; off < res.body.size(); off += np.chunkBytes) {
+      size_t n = std::min(res.body.size() - off, np.chunkBytes);
+      snprintf(size, sizeof(size), "%zx\r\n", n);
+      wire += size + res.body.substr(off, n) + "\r\n";
+    }
+    wire += "0\r\n\r\n";
+  } else {
+    wire += res.body;
+  }
+  netStats().bytesDown += wire.size();
+
+  uint64_t arrive = deliver(wire, respStart);
+  if (res.status == 101) {
+    // the socket now belongs to the channel: no keep-alive timer
+    upgraded_ = true;
+    closeAtUs_ = 0;
+    return;
+  }
+  closeAtUs_ = close ? arrive : arrive + msToUs(np.keepAliveMs);
+}
+
+// Queues bytes the server starts sending at startUs; returns when the last
+// of them arrives
+uint64_t Connection::deliver(const std::string& wire, uint64_t startUs) {
+  const NetParams& np = netParams();
+  uint64_t arrive = startUs + msToUs(np.rttMs / 2);
+  if (!inbound_.empty()) arrive = std::max(arrive, inbound_.back().atUs);
+  for (size_t off = 0; off < wire.size(); off += (size_t)np.mss) {
+    size_t n = std::min(wire.size() - off, (size_t)np.mss);
+    arrive += msToUs(transferMs(n));
+    inbound_.push_back({ arrive, wire.substr(off, n) });
+  }
+  return arrive;
+}
+
+// ============================================================================
+// Channel (WebSocket)
+// ============================================================================
+
+enum { WS_TEXT = 0x1, WS_BINARY = 0x2, WS_CLOSE = 0x8, WS_PING = 0x9, WS_PONG = 0xA };
+
+// Complete (masked) client frames
+void Connection::dispatchFrames() {
+  const NetParams& np = netParams();
+  while (request_.size() >= 2) {
+    uint8_t op = request_[0] & 0x0f;
+    bool masked = request_[1] & 0x80;
+    size_t len = request_[1] & 0x7f;
+    size_t pos = 2;
+    if (len == 126) {
+      if (request_.size() < 4) return;
+      len = ((uint8_t)request_[2] << 8) | (uint8_t)request_[3];
+      pos = 4;
+    } else if (len == 127) {
+      if (request_.size() < 10) return;
+      len = 0;
+      for (int i = 2; i < 10; ++i) len = (len << 8) | (uint8_t)request_[i];
+      pos = 10;
+    }
+    size_t maskAt = pos;
+    if (masked) pos += 4;
+    if (request_.size() < pos + len) return;
+    std::string payload = request_.substr(pos, len);
+    if (masked) {
+      for (size_t i = 0; i < len; ++i) payload[i] ^= request_[maskAt + (i & 3)];
+    }
+    uint64_t atUs = nowUs() + msToUs(np.rttMs / 2 + transferMs(pos + len));
+    request_.erase(0, pos + len);
+
+    if (op == WS_TEXT && payload.compare(0, 4, "GET ") == 0) {
+      channelRequest(payload, atUs);
+    } else if (op == WS_BINARY) {
+      compactRequest(payload, atUs);
+    } else if (op == WS_TEXT && payload.compare(0, 7, "RESULT ") == 0) {
+      server().addResults(payload.substr(7), atUs);
+    } else if (op == WS_PING) {
+      sendFrame(WS_PONG, payload, atUs);
+    } else if (op == WS_CLOSE) {
+      sendFrame(WS_CLOSE, std::string(), atUs);
+      closeAtUs_ = atUs + msToUs(np.rttMs / 2);
+    }
+  }
+}
+
+// "GET <id> <etag|-> <path> [gzip]"
+void Connection::channelRequest(const std::string& text, uint64_t atUs) {
+  std::istringstream in(text);
+  std::string verb, etag, target, encoding;
+  uint32_t id = 0;
+  in >> verb >> id >> etag >> target >> encoding;
+  HttpRequest req;
+  req.method = "GET";
+  parseTarget(target, req);
+  if (etag != "-") req.headers["if-none-match"] = etag;
+  if (encoding == "gzip") req.headers["accept-encoding"] = "gzip";
+  req.atUs = atUs;
+  channelAnswer(id, req);
+}
+
+// wire.h / routes/wire.mjs: the query parameters of each route, in order
+static const struct {
+  const char* path;
+  std::vector<const char*> params;
+} kWireRoutes[] = {
+  { nullptr, {} },
+  { "/gpt/ask", { "question" } },
+  { "/chats/messages", { "p", "c" } },
+  { "/chats/send", { "c", "m", "id" } },
+  { "/gpt/stream", { "question" } },
+};
+
+// version:u8 id:u32 route:u8 flags:u8 etagLen:u8 etag argc:u8 (len:u16 bytes)*
+void Connection::compactRequest(const std::string& frame, uint64_t atUs) {
+  const uint8_t* p = (const uint8_t*)frame.data();
+  size_t n = frame.size();
+  if (n < 9) return;
+  uint32_t id = p[1] | (p[2] << 8) | (p[3] << 16) | ((uint32_t)p[4] << 24);
+  uint8_t route = p[5];
+  size_t pos = 8 + p[7];
+  HttpRequest req;
+  req.method = "GET";
+  req.atUs = atUs;
+  bool ok = p[0] == 4 && route > 0 && route < sizeof(kWireRoutes) / sizeof(kWireRoutes[0]) && pos < n;
+  if (ok) {
+    req.path = kWireRoutes[route].path;
+    if (p[6] & 0x01) req.headers["accept-encoding"] = "gzip";
+    if (p[7]) req.headers["if-none-match"] = frame.substr(8, p[7]);
+    uint8_t argc = p[pos++];
+    for (uint8_t i = 0; i < argc && ok; ++i) {
+      if (pos + 2 > n) {
+        ok = false;
+        break;
+      }
+      size_t len = p[pos] | (p[pos + 1] << 8);
+      pos += 2;
+      ok = pos + len <= n && i < kWireRoutes[route].params.size();
+      if (ok) req.query[kWireRoutes[route].params[i]] = frame.substr(pos, len);
+      pos += len;
+    }
+  }
+  if (!ok) req.path = "/bad-request";  // answered 404
+  channelAnswer(id, req);
+}
+
+// One binary frame: id:u32 status:u16 length:u32 etagLen:u8 etag body,
+// little-endian; bit 15 of status marks a gzip body. A streamed body goes
+// as one frame per part with bit 14 set, then an empty last frame.
+void Connection::channelAnswer(uint32_t id, const HttpRequest& req) {
+  ++netStats().requests;
+  HttpResponse res = server().handle(req);
+  if (res.held) {
+    res.status = 503;  // long-polls belong to plain HTTP
+    res.body.clear();
+  }
+  std::string tag;
+  uint32_t status = res.status;
+  for (auto& h : res.headers) {
+    if (lower(h.first) == "etag") tag = h.second.substr(0, 255);
+    if (lower(h.first) == "content-encoding" && h.second == "gzip") status |= 0x8000;
+  }
+  auto frame = [&](uint32_t st, const std::string& body) {
+    std::string payload;
+    auto put = [&](uint32_t v, int bytes) {
+      for (int i = 0; i < bytes; ++i) payload += (char)((v >> (8 * i)) & 0xff);
+    };
+    put(id, 4);
+    put(st, 2);
+    put((uint32_t)body.size(), 4);
+    put((uint32_t)tag.size(), 1);
+    return payload + tag + body;
+  };
+  const NetParams& np = netParams();
+  if (!res.parts.empty()) {
+    for (auto& part : res.parts) {
+      sendFrame(WS_BINARY, frame(status | 0x4000, part.second), req.atUs + msToUs(part.first));
+    }
+    sendFrame(WS_BINARY, frame(status, std::string()), req.atUs + msToUs(res.parts.back().first));
+    return;
+  }
+  sendFrame(WS_BINARY, frame(status, res.body), req.atUs + msToUs(res.serverMs >= 0 ? res.serverMs : np.serverMs));
+}
+
+// dashboard commands go out as they are queued
+void Connection::serviceChannel() {
+  if (!upgraded_ || !open_) return;
+  int id;
+  std::string text;
+  uint64_t atUs;
+  while (server().takeCommand(nowUs(), &id, &text, &atUs)) {
+    sendFrame(WS_TEXT, "CMD " + std::to_string(id) + " " + text, atUs);
+  }
+}
+
+// Server frames are not masked
+void Connection::sendFrame(uint8_t op, const std::string& payload, uint64_t startUs) {
+  std::string wire(1, (char)(0x80 | op));
+  size_t len = payload.size();
+  if (len < 126) {
+    wire += (char)len;
+  } else if (len < 65536) {
+    wire += (char)126;
+    wire += (char)(len >> 8);
+    wire += (char)(len & 0xff);
+  } else {
+    wire += (char)127;
+    for (int i = 7; i >= 0; --i) wire += (char)(i < 4 ? (len >> (8 * i)) & 0xff : 0);
+  }
+  wire += payload;
+  netStats().bytesDown += wire.size();
+  deliver(wire, startUs);
+}
+
+}  // namespace sim
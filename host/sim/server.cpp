@@ -0,0 +1,448 @@
+// Server model: the routes of server/index.mjs the firmware talks to, with
+// the same paging and framing rules as the Node handlers.
+
+#include "sim.h"
+#include <algorithm>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+#include <zlib.h>
+
+namespace sim {
+
+SimServer& server() {
+  static SimServer s;
+  return s;
+}
+
+static int intParam(const HttpRequest& req, const char* key, int def) {
+  auto it = req.query.find(key);
+  if (it == req.query.end() || it->second.empty()) return def;
+  return atoi(it->second.c_str());
+}
+
+// zlib.gzipSync(): a gzip member with no name and mtime 0
+static std::string gzip(const std::string& body) {
+  z_stream z = {};
+  deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  std::string out(deflateBound(&z, body.size()), '\0');
+  z.next_in = (Bytef*)body.data();
+  z.avail_in = body.size();
+  z.next_out = (Bytef*)&out[0];
+  z.avail_out = out.size();
+  deflate(&z, Z_FINISH);
+  out.resize(z.total_out);
+  deflateEnd(&z);
+  return out;
+}
+
+static std::string padEnd(std::string s, size_t n) {
+  if (s.size() < n) s.append(n - s.size(), ' ');
+  return s;
+}
+
+// routes/programs.mjs and routes/images.mjs list pages: 4 entries of
+// `${i}:name` padded/truncated to 16 characters
+static std::string listPage(const std::vector<std::string>& names, int page) {
+  std::string out;
+  for (size_t i = page * 4; i < names.size() && i < (size_t)page * 4 + 4; ++i) {
+    out += padEnd(std::to_string(i - page * 4) + ":" + names[i], 16).substr(0, 16);
+  }
+  return out;
+}
+
+static std::string upper(std::string s) {
+  for (auto& c : s) c = toupper((unsigned char)c);
+  return s;
+}
+
+// routes/util/asset.mjs: nameLen:u8 name type:u8 size:u32 checksum:u16 body
+static std::string assetFrame(uint8_t type, const std::string& name, const std::string& body) {
+  std::string out;
+  std::string n = name.substr(0, 255);
+  out.push_back((char)n.size());
+  out += n;
+  out.push_back((char)type);
+  for (int b = 0; b < 4; ++b) out.push_back((char)((body.size() >> (8 * b)) & 0xff));
+  uint16_t sum = 0;
+  for (unsigned char c : body) sum += c;
+  out.push_back((char)(sum & 0xff));
+  out.push_back((char)(sum >> 8));
+  return out + body;
+}
+
+SimServer::SimServer() {
+  // synthetic 96x63 pictures standing in for the server's images/ folder
+  for (int n = 0; n < 8; ++n) {
+    std::vector<uint8_t> pic(756);
+    for (size_t i = 0; i < pic.size(); ++i) pic[i] = (uint8_t)(((i / 12) + n) % 2 ? 0xAA : 0x55);
+    images_.push_back(pic);
+  }
+
+  on("/programs/list", [this](const HttpRequest& req, HttpResponse& res) {
+    int page = intParam(req, "p", 0);
+    std::vector<std::string> names;
+    for (auto& p : programs_) names.push_back(p.file);
+    if (page + 1 > (int)((names.size() + 3) / 4)) return;
+    res.body = listPage(names, page);
+  });
+  on("/programs/get_name", [this](const HttpRequest& req, HttpResponse& res) {
+    int id = intParam(req, "id", -1);
+    if (id < 0 || id >= (int)programs_.size()) {
+      res.status = 400;
+      return;
+    }
+    res.body = upper(programs_[id].file.substr(0, 10));
+  });
+  on("/programs/get", [this](const HttpRequest& req, HttpResponse& res) {
+    int id = intParam(req, "id", -1);
+    if (id < 0 || id >= (int)programs_.size()) {
+      res.status = 400;
+      return;
+    }
+    res.headers.push_back({ "Content-Type", "application/octet-stream" });
+    res.body.assign(programs_[id].var.begin(), programs_[id].var.end());
+  });
+
+  on("/programs/fetch", [this](const HttpRequest& req, HttpResponse& res) {
+    int id = intParam(req, "id", -1);
+    if (id < 0 || id >= (int)programs_.size()) {
+      res.status = 400;
+      return;
+    }
+    auto& p = programs_[id];
+    res.headers.push_back({ "Content-Type", "application/octet-stream" });
+    res.body = assetFrame(0x05, upper(p.file.substr(0, 10)), std::string(p.var.begin(), p.var.end()));
+    if (corruptAssets > 0) {
+      --corruptAssets;
+      res.body.back() ^= 0x01;
+    }
+  });
+
+  on("/programs/bundle", [this](const HttpRequest& req, HttpResponse& res) {
+    std::vector<int> ids;
+    auto it = req.query.find("ids");
+    if (it == req.query.end()) {
+      for (size_t i = 0; i < programs_.size(); ++i) ids.push_back((int)i);
+    } else {
+      for (size_t pos = 0; pos <= it->second.size();) {
+        size_t comma = it->second.find(',', pos);
+        if (comma == std::string::npos) comma = it->second.size();
+        ids.push_back(atoi(it->second.substr(pos, comma - pos).c_str()));
+        pos = comma + 1;
+      }
+    }
+    res.body.push_back((char)ids.size());
+    for (int id : ids) {
+      if (id < 0 || id >= (int)programs_.size() || ids.size() > 255) {
+        res.status = 400;
+        res.body.clear();
+        return;
+      }
+      auto& p = programs_[id];
+      std::string name = upper(p.file.substr(0, 8));
+      name.resize(8, '\0');
+      res.body += name;
+      res.body.push_back((char)(p.var.size() & 0xff));
+      res.body.push_back((char)((p.var.size() >> 8) & 0xff));
+      res.body.append(p.var.begin(), p.var.end());
+    }
+    res.headers.push_back({ "Content-Type", "application/octet-stream" });
+  });
+
+  on("/image/list", [this](const HttpRequest& req, HttpResponse& res) {
+    int page = intParam(req, "p", 0);
+    std::vector<std::string> names;
+    for (size_t i = 0; i < images_.size(); ++i) names.push_back("IMG" + std::to_string(i) + ".BIN");
+    if (page + 1 > (int)(names.size() / 4)) return;
+    res.body = listPage(names, page);
+  });
+  on("/image/get", [this](const HttpRequest& req, HttpResponse& res) {
+    int id = intParam(req, "id", -1);
+    if (id < 0 || id >= (int)images_.size()) {
+      res.status = 400;
+      return;
+    }
+    res.headers.push_back({ "Content-Type", "application/octet-stream" });
+    res.body.assign(images_[id].begin(), images_[id].end());
+  });
+
+  on("/image/fetch", [this](const HttpRequest& req, HttpResponse& res) {
+    int id = intParam(req, "id", -1);
+    if (id < 0 || id >= (int)images_.size()) {
+      res.status = 400;
+      return;
+    }
+    res.headers.push_back({ "Content-Type", "application/octet-stream" });
+    res.body = assetFrame(0x07, "IMG" + std::to_string(id) + ".BIN", std::string(images_[id].begin(), images_[id].end()));
+  });
+
+  on("/gpt/ask", [](const HttpRequest& req, HttpResponse& res) {
+    auto it = req.query.find("question");
+    res.body = gptAnswer(it == req.query.end() ? "" : it->second);
+    res.serverMs = netParams().gptMs;
+  });
+
+  // routes/chatgpt.mjs: the same answer written as the model produces it,
+  // the first part after gptFirstMs and the last one after gptMs
+  on("/gpt/stream", [](const HttpRequest& req, HttpResponse& res) {
+    auto it = req.query.find("question");
+    std::string answer = gptAnswer(it == req.query.end() ? "" : it->second);
+    const NetParams& np = netParams();
+    const size_t kPartLen = 24;  // a few tokens
+    size_t count = (answer.size() + kPartLen - 1) / kPartLen;
+    for (size_t i = 0; i < count; ++i) {
+      double ms = count > 1 ? np.gptFirstMs + (np.gptMs - np.gptFirstMs) * i / (count - 1) : np.gptFirstMs;
+      res.parts.push_back({ ms, answer.substr(i * kPartLen, kPartLen) });
+    }
+  });
+
+  // routes/chatgpt.mjs: a multipart upload (routes/util/multipart.mjs) of
+  // the question and a JPEG; a frame that arrived cut or padded is refused
+  // the way the model would refuse one it cannot read
+  on("/gpt/vision", [](const HttpRequest& req, HttpResponse& res) {
+    auto type = req.headers.find("content-type");
+    size_t b = type == req.headers.end() ? std::string::npos : type->second.find("boundary=");
+    std::map<std::string, std::string> fields;
+    if (req.method == "POST" && b != std::string::npos) {
+      std::string delimiter = "--" + type->second.substr(b + 9);
+      for (size_t pos = req.body.find(delimiter); pos != std::string::npos;) {
+        pos += delimiter.size();
+        if (req.body.compare(pos, 2, "--") == 0) break;
+        size_t headEnd = req.body.find("\r\n\r\n", pos);
+        size_t next = headEnd == std::string::npos ? headEnd : req.body.find("\r\n" + delimiter, headEnd + 4);
+        if (next == std::string::npos) break;
+        std::string head = req.body.substr(pos, headEnd - pos);
+        size_t name = head.find("name=\"");
+        if (name != std::string::npos) {
+          name += 6;
+          fields[head.substr(name, head.find('"', name) - name)] = req.body.substr(headEnd + 4, next - headEnd - 4);
+        }
+        pos = next + 2;
+      }
+    }
+    const std::string& image = fields["image"];
+    if (image.size() < 4 || image.compare(0, 2, "\xFF\xD8") != 0 || image.compare(image.size() - 2, 2, "\xFF\xD9") != 0) {
+      res.status = 400;
+      res.body = "No image provided";
+      return;
+    }
+    res.body = gptAnswer(fields["question"]);
+    res.serverMs = netParams().gptMs;
+  });
+
+  // routes/chat.mjs: messages are chunked into 16-char lines, 7 lines a page
+  on("/chats/messages", [this](const HttpRequest& req, HttpResponse& res) {
+    int page = intParam(req, "p", 0);
+    int room = intParam(req, "c", 0);
+    std::vector<std::string> lines;
+    for (auto& m : rooms_[room]) {
+      for (size_t i = 0; i < m.size(); i += 16) lines.push_back(padEnd(m.substr(i, 16), 16));
+    }
+    int pages = (int)((lines.size() + 6) / 7);
+    int p = std::max(pages - 1 - page, 0);
+    if ((size_t)p * 7 > lines.size()) return;
+    size_t end = std::min((size_t)(p + 1) * 7, lines.size());
+    size_t start = end > 7 ? end - 7 : 0;
+    for (size_t i = start; i < end; ++i) res.body += lines[i];
+  });
+  on("/chats/send", [this](const HttpRequest& req, HttpResponse& res) {
+    int room = intParam(req, "c", 0);
+    auto m = req.query.find("m");
+    auto id = req.query.find("id");
+    if (m == req.query.end()) {
+      res.status = 400;
+      return;
+    }
+    rooms_[room].push_back((id == req.query.end() ? std::string() : id->second.substr(0, 3)) + ":" + m->second);
+    res.body = "OK";
+  });
+
+  // routes/batch.mjs: r0, r1, ... are GETs of this server, e0, e1, ... their
+  // ETags. They run side by side; the answer frames each response as
+  // status:u16 etagLen:u8 etag length:u32 body, in order
+  on("/batch", [this](const HttpRequest& req, HttpResponse& res) {
+    double slowest = 0;
+    for (int i = 0;; ++i) {
+      auto path = req.query.find("r" + std::to_string(i));
+      if (path == req.query.end()) break;
+      HttpRequest sub;
+      sub.method = "GET";
+      sub.atUs = req.atUs;
+      parseTarget(path->second, sub);
+      auto etag = req.query.find("e" + std::to_string(i));
+      if (etag != req.query.end()) sub.headers["if-none-match"] = etag->second;
+      HttpResponse r = handle(sub);
+      for (auto& part : r.parts) r.body += part.second;
+      std::string tag;
+      for (auto& h : r.headers) {
+        if (h.first == "ETag") tag = h.second.substr(0, 255);
+      }
+      slowest = std::max(slowest, r.serverMs >= 0 ? r.serverMs : netParams().serverMs);
+      res.body.push_back((char)(r.status & 0xff));
+      res.body.push_back((char)(r.status >> 8));
+      res.body.push_back((char)tag.size());
+      res.body += tag;
+      for (int b = 0; b < 4; ++b) res.body.push_back((char)((r.body.size() >> (8 * b)) & 0xff));
+      res.body += r.body;
+    }
+    res.headers.push_back({ "Content-Type", "application/octet-stream" });
+    res.serverMs = slowest + netParams().serverMs;
+  });
+
+  // routes/channel.mjs: the WebSocket upgrade; the frames that follow are
+  // modelled by the connection (net.cpp)
+  on("/esp32/channel", [](const HttpRequest& req, HttpResponse& res) {
+    if (!netParams().channel || req.headers.count("upgrade") == 0) {
+      res.status = 404;
+      res.body = "Not Found";
+      return;
+    }
+    res.status = 101;
+    res.headers.push_back({ "Upgrade", "websocket" });
+    res.headers.push_back({ "Connection", "Upgrade" });
+    res.headers.push_back({ "Sec-WebSocket-Accept", "sim" });
+    auto protocol = req.headers.find("sec-websocket-protocol");
+    if (netParams().compact && protocol != req.headers.end() && protocol->second.find("ti32.4") != std::string::npos) {
+      res.headers.push_back({ "Sec-WebSocket-Protocol", "ti32.4" });
+    }
+  });
+
+  // routes/esp32.mjs: results ride on the poll as {"results":[{"id":N,...}]};
+  // an empty poll is held for up to ?wait= ms and answered as soon as a
+  // command is queued, one "ID COMMAND" line each, no more than ?max= lines
+  // in ?bytes=; the rest wait for the next poll
+  on("/esp32/poll", [this](const HttpRequest& req, HttpResponse& res) {
+    addResults(req.body, req.atUs);
+    uint64_t until = req.atUs + (uint64_t)intParam(req, "wait", 0) * 1000;
+    uint64_t answerAt = until;
+    for (auto& q : mailbox_) {
+      if (!q.taken) answerAt = std::min(answerAt, std::max(q.atUs, req.atUs));
+    }
+    // the bench may still queue something before then
+    if (answerAt > nowUs()) {
+      res.held = true;
+      return;
+    }
+    int max = intParam(req, "max", 1 << 30);
+    size_t bytes = (size_t)intParam(req, "bytes", 1 << 30);
+    for (auto& q : mailbox_) {
+      if (q.taken || q.atUs > answerAt) continue;
+      std::string line = std::to_string(q.id) + " " + q.text + "\n";
+      if (max-- <= 0 || res.body.size() + line.size() > bytes) break;
+      q.taken = true;
+      res.body += line;
+    }
+    res.serverMs = (answerAt - req.atUs) / 1000.0;
+    if (res.body.empty()) res.status = 204;
+  });
+}
+
+int SimServer::queueCommand(const std::string& text, uint64_t atUs) {
+  mailbox_.push_back({ nextCommandId_, atUs, text, false });
+  return nextCommandId_++;
+}
+
+bool SimServer::takeCommand(uint64_t upToUs, int* id, std::string* text, uint64_t* atUs) {
+  for (auto& q : mailbox_) {
+    if (q.taken || q.atUs > upToUs) continue;
+    q.taken = true;
+    *id = q.id;
+    *text = q.text;
+    *atUs = q.atUs;
+    return true;
+  }
+  return false;
+}
+
+void SimServer::addResults(const std::string& json, uint64_t atUs) {
+  for (size_t pos = json.find("{\"id\":"); pos != std::string::npos; pos = json.find("{\"id\":", pos + 1)) {
+    int id = atoi(json.c_str() + pos + 6);
+    size_t end = json.find("}", pos);
+    if (!results_.count(id)) results_[id] = { atUs, json.substr(pos, end - pos + 1) };
+  }
+}
+
+bool SimServer::resultAt(int id, uint64_t* us, std::string* result) const {
+  auto it = results_.find(id);
+  if (it == results_.end()) return false;
+  *us = it->second.first;
+  if (result) *result = it->second.second;
+  return true;
+}
+
+// long enough to take three pages on the calculator
+std::string gptAnswer(const std::string& question) {
+  std::string answer = upper("THE ANSWER TO " + question.substr(0, 40) + " IS 42.");
+  for (int step = 1; answer.size() < 600; ++step) {
+    answer += " STEP " + std::to_string(step) + " MULTIPLY THE TENS THEN THE ONES AND ADD THEM.";
+  }
+  return answer;
+}
+
+HttpResponse SimServer::handle(const HttpRequest& req) {
+  HttpResponse res;
+  auto it = routes_.find(req.path);
+  if (it == routes_.end()) {
+    res.status = 404;
+    res.body = "Not Found";
+    return res;
+  }
+  it->second(req, res);
+
+  // routes/util/gzip.mjs: bodies of 64 bytes and more are compressed for a
+  // client that accepts gzip, before the ETag is computed
+  auto encoding = req.headers.find("accept-encoding");
+  if (netParams().gzip && res.status == 200 && !res.held && res.body.size() >= 64 && encoding != req.headers.end() &&
+      encoding->second.find("gzip") != std::string::npos) {
+    res.body = gzip(res.body);
+    res.headers.push_back({ "Content-Encoding", "gzip" });
+  }
+
+  // Express: res.send() and sendFile() tag 200 responses and answer a
+  // matching If-None-Match with an empty 304; a streamed body is not tagged
+  if (req.method == "GET" && res.status == 200 && res.parts.empty()) {
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : res.body) hash = (hash ^ c) * 16777619u;
+    char etag[32];
+    snprintf(etag, sizeof(etag), "W/\"%zx-%08x\"", res.body.size(), hash);
+    auto match = req.headers.find("if-none-match");
+    if (match != req.headers.end() && match->second == etag) {
+      res.status = 304;
+      res.body.clear();
+    }
+    res.headers.push_back({ "ETag", etag });
+  }
+  return res;
+}
+
+void SimServer::loadPrograms(const std::string& dir) {
+  DIR* d = opendir(dir.c_str());
+  if (!d) return;
+  std::vector<std::string> files;
+  while (dirent* e = readdir(d)) {
+    std::string path = dir + "/" + e->d_name;
+    struct stat st;
+    if (e->d_name[0] != '.' && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) files.push_back(e->d_name);
+  }
+  closedir(d);
+  std::sort(files.begin(), files.end());
+  for (auto& f : files) {
+    std::ifstream in(dir + "/" + f, std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    programs_.push_back({ f, prepare8xp(bytes) });
+  }
+}
+
+void SimServer::addSyntheticProgram(size_t varSize) {
+  // ":Disp "HELLO"" repeated; var = size word + tokens
+  static const uint8_t line[] = { 0x3F, 0xDE, 0x2A, 0x48, 0x45, 0x4C, 0x4C, 0x4F, 0x2A };
+  size_t tokens = varSize > 2 ? varSize - 2 : 0;
+  std::vector<uint8_t> var = { (uint8_t)(tokens & 0xff), (uint8_t)(tokens >> 8) };
+  for (size_t i = 0; i < tokens; ++i) var.push_back(line[i % sizeof(line)]);
+  programs_.push_back({ "SYN" + std::to_string(varSize), var });
+}
+
+}  // namespace sim
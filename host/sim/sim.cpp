@@ -0,0 +1,78 @@
+// Virtual clock, parameters, statistics and small helpers.
+
+#include "sim.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace sim {
+
+static uint64_t clockUs = 0;
+static FILE* logSink = nullptr;
+
+uint64_t nowUs() { return clockUs; }
+void advanceUs(uint64_t us) { clockUs += us; }
+void advanceToUs(uint64_t t) { clockUs = std::max(clockUs, t); }
+
+void setLogFile(FILE* f) { logSink = f; }
+FILE* logFile() { return logSink; }
+
+LinkParams& linkParams() {
+  static LinkParams p;
+  return p;
+}
+
+NetParams& netParams() {
+  static NetParams p;
+  return p;
+}
+
+LinkStats& linkStats() {
+  static LinkStats s;
+  return s;
+}
+
+NetStats& netStats() {
+  static NetStats s;
+  return s;
+}
+
+double Series::mean() const {
+  if (samples.empty()) return 0;
+  double sum = 0;
+  for (double v : samples) sum += v;
+  return sum / samples.size();
+}
+
+double Series::percentile(double p) const {
+  if (samples.empty()) return 0;
+  std::vector<double> s = samples;
+  std::sort(s.begin(), s.end());
+  size_t idx = (size_t)(p / 100.0 * (s.size() - 1) + 0.5);
+  return s[std::min(idx, s.size() - 1)];
+}
+
+double Series::max() const {
+  return samples.empty() ? 0 : *std::max_element(samples.begin(), samples.end());
+}
+
+std::vector<uint8_t> prepare8xp(const std::vector<uint8_t>& file) {
+  // same as build/prepare8xp.mjs: strip the 74-byte file header and the
+  // trailing checksum, then prefix the token length
+  std::vector<uint8_t> tokens;
+  if (file.size() > 76) tokens.assign(file.begin() + 74, file.end() - 2);
+  std::vector<uint8_t> var(tokens.size() + 2);
+  var[0] = tokens.size() & 0xff;
+  var[1] = (tokens.size() >> 8) & 0xff;
+  std::copy(tokens.begin(), tokens.end(), var.begin() + 2);
+  return var;
+}
+
+std::string repoRoot() {
+#ifdef SIM_REPO_ROOT
+  return SIM_REPO_ROOT;
+#else
+  return ".";
+#endif
+}
+
+}  // namespace sim
@@ -0,0 +1,326 @@
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+// ============================================================================
+// Host Simulator - virtual clock, TIP/RING link bus, virtual TI-84 and a
+// model of the Node.js server reached over WiFi/ngrok.
+//
+// Everything runs on one thread in virtual time: the firmware advances the
+// clock by blocking (delay, bit-banged link I/O, waiting on sockets) and the
+// simulated peers react at the virtual instant the bytes arrive.
+// ============================================================================
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+// ============================================================================
+// Virtual Clock
+// ============================================================================
+
+uint64_t nowUs();
+void advanceUs(uint64_t us);
+void advanceToUs(uint64_t t);
+
+// Serial output of the firmware goes here (nullptr = discard)
+void setLogFile(FILE* f);
+FILE* logFile();
+
+// ============================================================================
+// Parameters
+// ============================================================================
+
+struct LinkParams {
+  double bitUs = 100.0;          // time per bit on TIP/RING (bit-banged)
+  double turnaroundUs = 1500.0;  // calculator processing time per packet
+  double writeTimeoutUs = 1000.0;// how long a send waits for an absent peer
+  double readTimeoutUs = 30000.0;// how long a get waits for a silent peer
+  double pollUs = 100.0;         // cost of one idle pass through loop()
+  double programTailMs = 150.0;  // BASIC tail after the last Get( before the
+                                 // calculator returns to the home screen
+  double basicStepMs = 30.0;     // BASIC overhead between link statements
+  double errorRate = 0.0;        // chance that an RTS/DATA from the device fails
+                                 // its checksum on the calculator (answered with ERR)
+  int errorEvery = 0;            // > 0: every Nth RTS/DATA from the device fails
+};
+
+struct NetParams {
+  double rttMs = 80.0;           // round trip through the ngrok tunnel
+  double bandwidthKbps = 2000.0; // downstream bandwidth
+  double tlsCpuMs = 350.0;       // ESP32 cost of a full TLS handshake
+  double serverMs = 5.0;         // default handler time on the server
+  double gptMs = 1200.0;         // model latency of /gpt/ask (the whole answer)
+  double gptFirstMs = 300.0;     // /gpt/stream: until the first part of the answer
+  double keepAliveMs = 65000.0;  // keepAliveTimeout in server/index.mjs
+  double mss = 1460.0;           // TCP segment size
+  size_t sndBufBytes = 5744;     // lwIP TCP_SND_BUF: written bytes queued before a write blocks
+  size_t chunkBytes = 0;         // > 0: bodies sent chunked, this size a chunk
+  bool channel = true;           // the server accepts the /esp32/channel WebSocket
+  bool compact = true;           // ... and compact binary requests on it (ti32.4)
+  bool gzip = true;              // the server compresses bodies for clients that accept gzip
+};
+
+LinkParams& linkParams();
+NetParams& netParams();
+
+// ============================================================================
+// Statistics
+// ============================================================================
+
+struct Series {
+  std::vector<double> samples;
+  void add(double v) { samples.push_back(v); }
+  size_t count() const { return samples.size(); }
+  double mean() const;
+  double percentile(double p) const;
+  double max() const;
+  void clear() { samples.clear(); }
+};
+
+struct LinkStats {
+  uint64_t bytes = 0;        // bytes on the wire, both directions
+  uint64_t packets = 0;
+  uint64_t busyUs = 0;       // time the wire was carrying bits
+  uint64_t writeTimeouts = 0;
+  uint64_t readTimeouts = 0;
+  uint64_t checksumErrors = 0; // injected by errorRate or errorEvery
+  Series packetUs;           // wire time + peer turnaround per packet
+  void clear() { *this = LinkStats(); }
+};
+
+struct NetStats {
+  uint64_t connects = 0;
+  uint64_t tlsHandshakes = 0;
+  uint64_t requests = 0;
+  uint64_t bytesDown = 0;
+  uint64_t bytesUp = 0;
+  void clear() { *this = NetStats(); }
+};
+
+LinkStats& linkStats();
+NetStats& netStats();
+
+// ============================================================================
+// Link Bus + Virtual Calculator
+// ============================================================================
+
+struct Packet {
+  uint8_t machine = 0;
+  uint8_t cmd = 0;
+  bool hasData = false;
+  std::vector<uint8_t> data;
+  uint64_t startUs = 0;  // first bit on the wire
+  uint64_t readyUs = 0;  // last bit on the wire
+};
+
+struct CalcVar {
+  uint8_t type = 0;
+  std::vector<uint8_t> name;
+  std::vector<uint8_t> data;
+};
+
+class VirtualCalc {
+public:
+  // ---- script side (what the BASIC program / the user does) ----
+  void startProgram();
+  void endProgram();  // returns to the home screen after programTailMs
+  bool programRunning() const;
+
+  // Send( a variable to the CBL: name bytes as on the link (e.g. {'C'},
+  // {0xAA, 0x00} for Str1)
+  void beginSend(uint8_t type, const std::vector<uint8_t>& name,
+                 const std::vector<uint8_t>& data);
+  // Get( a variable from the CBL
+  void beginGet(uint8_t type, const std::vector<uint8_t>& name);
+
+  bool busy() const { return state_ != Idle; }
+  bool failed() const { return failed_; }
+  const CalcVar& lastGet() const { return lastGet_; }
+
+  // variables that arrived through silent link transfers
+  std::map<std::string, CalcVar>& received() { return received_; }
+  int silentSessions() const { return silentSessions_; }
+  uint64_t lastSilentSessionUs() const { return lastSilentUs_; }  // RTS .. EOT
+
+  void reset();
+
+  // ---- link side ----
+  bool listening() const;
+  void onPacket(const Packet& p);
+
+private:
+  enum State { Idle, SendVar, SendData, GetVar, GetData, Silent };
+  void transmit(uint8_t cmd, const std::vector<uint8_t>* data);
+  void finish(bool ok);
+
+  State state_ = Idle;
+  bool failed_ = false;
+  bool running_ = false;
+  uint64_t homeAtUs_ = 0;
+  CalcVar pending_;
+  CalcVar lastGet_;
+  CalcVar silentVar_;
+  std::map<std::string, CalcVar> received_;
+  int silentSessions_ = 0;
+  uint64_t silentStartUs_ = 0;
+  uint64_t lastSilentUs_ = 0;
+};
+
+class LinkBus {
+public:
+  // device (firmware) side, used by the CBL2 shim; returns ArTICL error codes
+  int deviceSend(const uint8_t* header, const uint8_t* data, int len,
+                 uint8_t (*cb)(int));
+  int deviceGet(uint8_t* header, uint8_t* data, int* len, int maxlen,
+                double timeoutUs);
+  bool incomingStarted() const;
+
+  // calculator side
+  void calcTransmit(Packet p);
+
+  // TIP/RING both high when nobody drives them
+  bool linesIdle() const;
+
+  void reset();
+
+private:
+  std::deque<Packet> toDevice_;
+  uint64_t lastCalcTxEndUs_ = 0;
+};
+
+LinkBus& bus();
+VirtualCalc& calc();
+
+// ============================================================================
+// Network + Server Model
+// ============================================================================
+
+struct HttpRequest {
+  std::string method;
+  std::string path;   // without query
+  std::map<std::string, std::string> query;
+  std::map<std::string, std::string> headers;  // lower-case keys
+  std::string body;
+  uint64_t atUs = 0;  // when the request reached the server
+};
+
+struct HttpResponse {
+  int status = 200;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+  // a streamed body (res.write() in Node): each part is sent this many ms
+  // after the request reached the server, instead of body
+  std::vector<std::pair<double, std::string>> parts;
+  double serverMs = -1;  // handler time, <0 = NetParams::serverMs
+  bool held = false;     // long-poll: not decided yet, ask again later
+};
+
+class SimServer {
+public:
+  using Handler = std::function<void(const HttpRequest&, HttpResponse&)>;
+  SimServer();
+  void on(const std::string& path, Handler h) { routes_[path] = h; }
+  HttpResponse handle(const HttpRequest& req);
+
+  // program catalogue served by /programs/*
+  struct Program { std::string file; std::vector<uint8_t> var; };
+  std::vector<Program>& programs() { return programs_; }
+  void loadPrograms(const std::string& dir);
+  void addSyntheticProgram(size_t varSize);
+
+  std::vector<std::vector<uint8_t>>& images() { return images_; }
+  // the next N /programs/fetch responses change their last body byte after
+  // the checksum is taken
+  int corruptAssets = 0;
+
+  // dashboard side of /esp32 (routes/esp32.mjs): a command queued at a
+  // virtual time, and when its result came back with a poll
+  int queueCommand(const std::string& text, uint64_t atUs);
+  bool resultAt(int id, uint64_t* us, std::string* result = nullptr) const;
+
+  // the channel side: the oldest command queued by upToUs, not taken yet,
+  // and results as they arrive ({"id":..} objects, as many as json holds)
+  bool takeCommand(uint64_t upToUs, int* id, std::string* text, uint64_t* atUs);
+  void addResults(const std::string& json, uint64_t atUs);
+
+private:
+  struct Queued {
+    int id;
+    uint64_t atUs;
+    std::string text;
+    bool taken;
+  };
+  std::vector<Queued> mailbox_;
+  std::map<int, std::pair<uint64_t, std::string>> results_;
+  int nextCommandId_ = 1;
+
+  std::map<std::string, Handler> routes_;
+  std::vector<Program> programs_;
+  std::vector<std::vector<uint8_t>> images_;
+  std::map<int, std::vector<std::string>> rooms_;
+};
+
+SimServer& server();
+
+// "/path?a=1&b=2" into req.path and req.query
+void parseTarget(const std::string& target, HttpRequest& req);
+
+// what /gpt/ask and /gpt/stream answer to question
+std::string gptAnswer(const std::string& question);
+
+// One TCP (optionally TLS) connection from the device to the server.
+class Connection {
+public:
+  explicit Connection(bool secure) : secure_(secure) {}
+  bool open();
+  void close();
+  bool isOpen() const;
+  bool secure() const { return secure_; }
+
+  size_t write(const uint8_t* buf, size_t len);
+  int available();
+  int read();
+  int peek();
+
+private:
+  void dispatch();
+  void respond(const HttpRequest& req);
+  void serviceHeld();
+  // after a 101: WebSocket frames instead of HTTP requests
+  void dispatchFrames();
+  void channelRequest(const std::string& text, uint64_t atUs);
+  void compactRequest(const std::string& frame, uint64_t atUs);
+  void channelAnswer(uint32_t id, const HttpRequest& req);
+  void serviceChannel();
+  void sendFrame(uint8_t op, const std::string& payload, uint64_t startUs);
+  uint64_t deliver(const std::string& wire, uint64_t startUs);
+  bool secure_;
+  bool open_ = false;
+  bool upgraded_ = false;
+  bool closeAfterResponse_ = false;
+  uint64_t closeAtUs_ = 0;
+  uint64_t sentUs_ = 0;  // when the bytes written so far have all left
+  std::string request_;
+  struct Segment { uint64_t atUs; std::string bytes; };
+  std::deque<Segment> inbound_;
+  size_t offset_ = 0;  // read offset into inbound_.front()
+  std::unique_ptr<HttpRequest> held_;
+};
+
+// ============================================================================
+// Helpers shared by shims and the bench
+// ============================================================================
+
+std::vector<uint8_t> prepare8xp(const std::vector<uint8_t>& file);
+std::string repoRoot();
+
+}  // namespace sim
+
+#endif  // HOST_SIM_H
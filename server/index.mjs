@@ -10,7 +10,10 @@ import { chatgpt } from "./routes/chatgpt.mjs";
 import { images } from "./routes/images.mjs";
 import { chat } from "./routes/chat.mjs";
 import { programs } from "./routes/programs.mjs";
+import { batch } from "./routes/batch.mjs";
 import { esp32Routes } from "./routes/esp32.mjs";
+import { createChannel } from "./routes/channel.mjs";
+import { gzipBodies } from "./routes/util/gzip.mjs";
 import { initKeyManager } from "./keyManager.mjs";
 
 const __filename = fileURLToPath(import.meta.url);
@@ -43,7 +46,7 @@ async function main() {
   app.use(bodyParser.json({ limit: "10mb" }));
   app.use(
     bodyParser.raw({
-      type: ["image/jpeg", "image/jpg"],
+      type: ["image/jpeg", "image/jpg", "multipart/form-data"],
       limit: "10mb",
     })
   );
@@ -51,6 +54,7 @@ async function main() {
     console.log(req.headers.authorization);
     next();
   });
+  app.use(gzipBodies());
 
   // Programs
   app.use("/programs", programs());
@@ -64,12 +68,22 @@ async function main() {
   // Images
   app.use("/image", images());
 
-  // ESP32 Mailbox
-  app.use("/esp32", esp32Routes());
+  // Several of the GETs above in one round trip
+  app.use("/batch", batch());
 
-  app.listen(port, () => {
+  // ESP32 Mailbox, and the WebSocket that replaces polling while it is up
+  // DEVICE_AUTH: "user:password", the device's HTTP_USERNAME and HTTP_PASSWORD
+  const channel = createChannel({ credentials: process.env.DEVICE_AUTH });
+  app.use("/esp32", esp32Routes(channel));
+
+  const server = app.listen(port, () => {
     console.log(`listening on ${port}`);
   });
+  // The ESP32 keeps its connections open between commands (HTTP_POOL_IDLE_MS
+  // is 60 s); Node's default of 5 s would make most of them a new TLS handshake
+  server.keepAliveTimeout = 65000;
+  server.headersTimeout = 66000;
+  channel.attach(server, port);
 }
 
 main();
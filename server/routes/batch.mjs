@@ -0,0 +1,68 @@
+import express from "express";
+import http from "http";
+
+// Several GETs of this server in one request (esp32/batch.h). The ESP32
+// sends r0, r1, ... as paths and e0, e1, ... as the ETags it holds for
+// them. They are run side by side through the normal routes over loopback,
+// so ETags and 304s work as they do one by one, and answered in order:
+//
+//   status:u16 etagLen:u8 etag length:u32 body
+//
+// Integers are little-endian and the bodies are not compressed; gzipBodies()
+// may compress the batch as a whole.
+
+const MAX_REQUESTS = 8;
+
+export function batch() {
+  const router = express.Router();
+
+  // A GET of this server, read whole
+  function get(port, path, headers) {
+    return new Promise((resolve, reject) => {
+      http
+        .get({ host: "127.0.0.1", port, path, headers }, (res) => {
+          const chunks = [];
+          res.on("data", (chunk) => chunks.push(chunk));
+          res.on("end", () => resolve({ status: res.statusCode, etag: res.headers.etag ?? "", body: Buffer.concat(chunks) }));
+          res.on("error", reject);
+        })
+        .on("error", reject);
+    });
+  }
+
+  function frame({ status, etag, body }) {
+    const etagBytes = Buffer.from(etag).subarray(0, 255);
+    const head = Buffer.alloc(3);
+    head.writeUInt16LE(status, 0);
+    head[2] = etagBytes.length;
+    const length = Buffer.alloc(4);
+    length.writeUInt32LE(body.length, 0);
+    return Buffer.concat([head, etagBytes, length, body]);
+  }
+
+  router.get("/", async (req, res) => {
+    const paths = [];
+    for (let i = 0; typeof req.query[`r${i}`] === "string"; ++i) paths.push(req.query[`r${i}`]);
+    if (paths.length === 0 || paths.length > MAX_REQUESTS || paths.some((p) => !p.startsWith("/") || p.startsWith("/batch"))) {
+      res.sendStatus(400);
+      return;
+    }
+    const port = req.socket.localPort;
+    const responses = await Promise.all(
+      paths.map((path, i) => {
+        const headers = { "accept-encoding": "identity" };
+        if (req.headers.authorization) headers.authorization = req.headers.authorization;
+        const etag = req.query[`e${i}`];
+        if (typeof etag === "string" && etag) headers["if-none-match"] = etag;
+        return get(port, path, headers).catch((err) => {
+          console.log(`[Batch] GET ${path} failed: ${err.message}`);
+          return { status: 502, etag: "", body: Buffer.alloc(0) };
+        });
+      })
+    );
+    res.type("application/octet-stream");
+    res.send(Buffer.concat(responses.map(frame)));
+  });
+
+  return router;
+}
@@ -0,0 +1,270 @@
+import crypto from "crypto";
+import http from "http";
+import { EventEmitter } from "events";
+import { WIRE_PROTOCOL, decodeRequest } from "./wire.mjs";
+
+// The ESP32's persistent WebSocket (esp32/channel.h). It upgrades
+// /esp32/channel once and then sends everything over it:
+//
+//   device -> server (text)    GET <id> <etag|-> <path> [gzip]
+//                                                         forwarded to this server
+//                              RESULT <json>              emitted as "result"
+//                              LOG <text>                 emitted as "log"
+//   server -> device (text)    CMD <id> <command>         send()
+//   server -> device (binary)  id:u32 status:u16 length:u32 etagLen:u8 etag body
+//
+// The upgrade must carry the device's Basic credentials when DEVICE_AUTH is
+// set. Without it, a second connection is refused while one is open.
+//
+// Binary fields are little-endian. Bit 15 of status marks a gzip body, sent
+// only to a request that accepted one. A body the route streams (no
+// Content-Length) is relayed as it arrives: one frame per part with bit 14
+// of status set, then an empty last frame. GETs go through the normal routes over
+// loopback, so ETags and 304s work as they do over HTTP. A device that offers
+// WIRE_PROTOCOL may also send compact binary requests (wire.mjs), which are
+// answered the same way.
+
+const GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+const CHANNEL_PATH = "/esp32/channel";
+// the device pings every 15 s when it has nothing else to send
+const DEAD_MS = 45000;
+
+const OP_TEXT = 0x1;
+const OP_BINARY = 0x2;
+const OP_CLOSE = 0x8;
+const OP_PING = 0x9;
+const OP_PONG = 0xa;
+
+// Server frames are not masked
+function frame(opcode, payload) {
+  let head;
+  if (payload.length < 126) {
+    head = Buffer.from([0x80 | opcode, payload.length]);
+  } else if (payload.length < 65536) {
+    head = Buffer.alloc(4);
+    head[0] = 0x80 | opcode;
+    head[1] = 126;
+    head.writeUInt16BE(payload.length, 2);
+  } else {
+    head = Buffer.alloc(10);
+    head[0] = 0x80 | opcode;
+    head[1] = 127;
+    head.writeBigUInt64BE(BigInt(payload.length), 2);
+  }
+  return Buffer.concat([head, payload]);
+}
+
+// Whether the upgrade carries the device's Basic credentials
+function authorized(req, expected) {
+  const given = Buffer.from(req.headers.authorization ?? "");
+  return given.length === expected.length && crypto.timingSafeEqual(given, expected);
+}
+
+// credentials: "user:password" as the device sends them (HTTP_USERNAME and
+// HTTP_PASSWORD in esp32/secrets.h). Without them any client may open the
+// channel, but only while the device does not hold it.
+export function createChannel({ credentials = "" } = {}) {
+  const channel = new EventEmitter();
+  let socket = null;
+  let port = 0;
+  const expected = credentials ? Buffer.from("Basic " + Buffer.from(credentials).toString("base64")) : null;
+  if (!expected) {
+    console.log("[Channel] DEVICE_AUTH is not set: the channel is not authenticated");
+  }
+
+  channel.connected = () => socket !== null;
+
+  // A text frame to the device; false while it is not connected
+  channel.send = (text) => {
+    if (!socket) return false;
+    socket.write(frame(OP_TEXT, Buffer.from(text)));
+    return true;
+  };
+
+  // A GET of this server; resolves with the response head, the body (as it
+  // was sent, not decompressed) is read from it
+  function get(path, headers) {
+    return new Promise((resolve, reject) => {
+      http.get({ host: "127.0.0.1", port, path, headers }, resolve).on("error", reject);
+    });
+  }
+
+  // Answers a request with its binary frames
+  async function forward(sock, auth, id, etag, path, gzip) {
+    let status = 502;
+    let tag = "";
+    const send = (flags, body) => {
+      const etagBytes = Buffer.from(tag).subarray(0, 255);
+      const head = Buffer.alloc(11);
+      head.writeUInt32LE(id >>> 0, 0);
+      head.writeUInt16LE(status | flags, 4);
+      head.writeUInt32LE(body.length, 6);
+      head[10] = etagBytes.length;
+      if (sock === socket) {
+        sock.write(frame(OP_BINARY, Buffer.concat([head, etagBytes, body])));
+      }
+    };
+    try {
+      const headers = { "accept-encoding": gzip ? "gzip" : "identity" };
+      if (auth) headers.authorization = auth;
+      if (etag && etag !== "-") headers["if-none-match"] = etag;
+      if (path === null) {
+        status = 400;
+      } else {
+        const res = await get(path, headers);
+        status = res.statusCode;
+        tag = res.headers.etag ?? "";
+        if (res.headers["content-encoding"] === "gzip") status |= 0x8000;
+        if (res.statusCode === 200 && res.headers["content-length"] === undefined) {
+          for await (const chunk of res) send(0x4000, chunk);
+          send(0, Buffer.alloc(0));
+          return;
+        }
+        const chunks = [];
+        for await (const chunk of res) chunks.push(chunk);
+        send(0, Buffer.concat(chunks));
+        return;
+      }
+    } catch (err) {
+      console.log(`[Channel] GET ${path} failed: ${err.message}`);
+    }
+    send(0, Buffer.alloc(0));
+  }
+
+  function handle(sock, auth, compact, opcode, payload) {
+    if (opcode === OP_BINARY && compact) {
+      const req = decodeRequest(payload);
+      if (req.error) {
+        console.log(`[Channel] Bad request: ${req.error}`);
+        forward(sock, auth, req.id, "-", null, false);
+      } else {
+        forward(sock, auth, req.id, req.etag || "-", req.path, req.gzip);
+      }
+    } else if (opcode === OP_PING) {
+      sock.write(frame(OP_PONG, payload));
+    } else if (opcode === OP_CLOSE) {
+      sock.end(frame(OP_CLOSE, Buffer.alloc(0)));
+    } else if (opcode === OP_TEXT) {
+      const text = payload.toString();
+      if (text.startsWith("GET ")) {
+        // "GET <id> <etag|-> <path> [gzip]"
+        const [, id, etag, path, encoding] = text.split(" ");
+        forward(sock, auth, +id, etag, path, encoding === "gzip");
+      } else if (text.startsWith("RESULT ")) {
+        try {
+          channel.emit("result", JSON.parse(text.substring(7)));
+        } catch (err) {
+          console.log(`[Channel] Bad result: ${text.substring(0, 100)}`);
+        }
+      } else if (text.startsWith("LOG ")) {
+        channel.emit("log", text.substring(4));
+      }
+    }
+  }
+
+  function accept(req, sock, head) {
+    const key = req.headers["sec-websocket-key"];
+    if (!key || (req.headers.upgrade ?? "").toLowerCase() !== "websocket") {
+      sock.end("HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n");
+      return;
+    }
+    // pushed commands carry API keys: only the device gets them
+    const trusted = expected !== null && authorized(req, expected);
+    if (expected && !trusted) {
+      console.log("[Channel] Refused an upgrade without the device's credentials");
+      sock.end("HTTP/1.1 401 Unauthorized\r\nConnection: close\r\n\r\n");
+      return;
+    }
+    if (socket && !trusted) {
+      // the device reconnects once its dead connection times out
+      sock.end("HTTP/1.1 409 Conflict\r\nConnection: close\r\n\r\n");
+      return;
+    }
+    const accept = crypto.createHash("sha1").update(key + GUID).digest("base64");
+    // negotiated per connection: an older device only sends text GETs
+    const offered = (req.headers["sec-websocket-protocol"] ?? "").split(",").map((p) => p.trim());
+    const compact = offered.includes(WIRE_PROTOCOL);
+    sock.write(
+      "HTTP/1.1 101 Switching Protocols\r\n" +
+        "Upgrade: websocket\r\n" +
+        "Connection: Upgrade\r\n" +
+        (compact ? `Sec-WebSocket-Protocol: ${WIRE_PROTOCOL}\r\n` : "") +
+        `Sec-WebSocket-Accept: ${accept}\r\n\r\n`
+    );
+    sock.setNoDelay(true);
+
+    // one device: an authenticated connection replaces the old one, which
+    // the device gave up on
+    if (socket) socket.destroy();
+    socket = sock;
+    const auth = req.headers.authorization;
+    console.log(`[Channel] Device connected${compact ? " (compact requests)" : ""}`);
+
+    let buffered = head && head.length ? Buffer.from(head) : Buffer.alloc(0);
+    let timer = null;
+    const alive = () => {
+      clearTimeout(timer);
+      timer = setTimeout(() => sock.destroy(), DEAD_MS);
+    };
+    alive();
+
+    const parse = () => {
+      while (buffered.length >= 2) {
+        const opcode = buffered[0] & 0x0f;
+        const masked = (buffered[1] & 0x80) !== 0;
+        let length = buffered[1] & 0x7f;
+        let pos = 2;
+        if (length === 126) {
+          if (buffered.length < 4) return;
+          length = buffered.readUInt16BE(2);
+          pos = 4;
+        } else if (length === 127) {
+          if (buffered.length < 10) return;
+          length = Number(buffered.readBigUInt64BE(2));
+          pos = 10;
+        }
+        const mask = masked ? buffered.subarray(pos, pos + 4) : null;
+        if (masked) pos += 4;
+        if (buffered.length < pos + length) return;
+        const payload = Buffer.from(buffered.subarray(pos, pos + length));
+        if (mask) {
+          for (let i = 0; i < payload.length; i++) payload[i] ^= mask[i & 3];
+        }
+        buffered = buffered.subarray(pos + length);
+        handle(sock, auth, compact, opcode, payload);
+      }
+    };
+
+    sock.on("data", (data) => {
+      alive();
+      buffered = Buffer.concat([buffered, data]);
+      parse();
+    });
+    sock.on("error", () => {});
+    sock.on("close", () => {
+      clearTimeout(timer);
+      if (socket === sock) {
+        socket = null;
+        console.log("[Channel] Device disconnected");
+        channel.emit("close");
+      }
+    });
+    channel.emit("open");
+    parse();
+  }
+
+  // Takes over upgrades of CHANNEL_PATH on the listening server; requests are
+  // forwarded to localPort
+  channel.attach = (server, localPort) => {
+    port = localPort;
+    server.on("upgrade", (req, sock, head) => {
+      if (new URL(req.url, "http://localhost").pathname !== CHANNEL_PATH) {
+        sock.end("HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n");
+        return;
+      }
+      accept(req, sock, head);
+    });
+  };
+
+  return channel;
+}
@@ -3,6 +3,7 @@ import openai from "openai";
 import i264 from "image-to-base64";
 import jimp from "jimp";
 import { getKeyManager } from "../keyManager.mjs";
+import { parseMultipart } from "./util/multipart.mjs";
 
 export async function chatgpt() {
   const routes = express.Router();
@@ -47,10 +48,59 @@ export async function chatgpt() {
     }
   });
 
-  // vision AI endpoint
+  // the same, written as the model produces it (chunked), so the ESP32 can
+  // show the first page of a long answer while the rest is still coming
+  routes.get("/stream", async (req, res) => {
+    const question = req.query.question ?? "";
+    if (Array.isArray(question)) {
+      res.sendStatus(400);
+      return;
+    }
+
+    try {
+      const stream = await getGptClient().chat.completions.create({
+        messages: [
+          {
+            role: "system",
+            content:
+              "You are answering questions for students. Keep responses under 1000 characters and only answer using uppercase letters.",
+          },
+          { role: "user", content: question },
+        ],
+        model: process.env.TEXT_AI_MODEL || "google/gemini-2.0-flash-exp:free",
+        stream: true,
+      });
+
+      res.type("text/plain");
+      let written = false;
+      for await (const chunk of stream) {
+        const text = chunk.choices[0]?.delta?.content;
+        if (text) {
+          res.write(text);
+          written = true;
+        }
+      }
+      res.end(written ? undefined : "no response");
+    } catch (e) {
+      console.error(e);
+      if (res.headersSent) {
+        res.end();
+      } else {
+        res.sendStatus(500);
+      }
+    }
+  });
+
+  // vision AI endpoint: JSON with a base64 image, or multipart/form-data
+  // with the JPEG as it is (the ESP32's solve command) and a question field
   routes.post("/vision", async (req, res) => {
     try {
-      const { image, question } = req.body;
+      let { image, question } = req.body;
+      if (req.is("multipart/form-data")) {
+        const parts = parseMultipart(req.body, req.headers["content-type"]) ?? {};
+        image = parts.image?.length ? parts.image.toString("base64") : undefined;
+        question = parts.question?.toString();
+      }
       if (!image) {
         return res.status(400).send("No image provided");
       }
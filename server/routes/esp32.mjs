@@ -1,16 +1,26 @@
 import express from "express";
 import { getKeyManager } from "../keyManager.mjs";
 
-export function esp32Routes() {
+// channel: the device's WebSocket (channel.mjs). While it is connected,
+// commands are pushed over it instead of waiting for a poll.
+export function esp32Routes(channel) {
   const router = express.Router();
   const km = getKeyManager();
 
   // In-memory state
-  let pendingCommand = null;
-  let commandResult = null;
+  // Commands wait in `queue` until a poll takes them; `waiting` maps a
+  // command id to whoever waits for its result
+  let queue = [];
+  let nextCommandId = 1;
+  const waiting = new Map();
+  // commands pushed over the channel without a result yet; they are queued
+  // again if the channel drops
+  const pushed = new Map();
+  let heldPoll = null;
   let deviceLogs = [];
   const MAX_LOGS = 100;
   const COMMAND_TIMEOUT = 30000;
+  const MAX_POLL_WAIT = 30000;
 
   // Helper to add logs
   function addLog(message) {
@@ -25,46 +35,140 @@ export function esp32Routes() {
     console.log(`[Device Log] ${message}`);
   }
 
-  // Helper to wait for result
-  async function waitForResult() {
+  // One "ID COMMAND" line per queued command, at most `max` of them in at
+  // most `bytes`, as much as the device said it has room for. The rest stay
+  // queued for its next poll. A command too long to ever fit is failed.
+  function takeCommands(max = Infinity, bytes = Infinity) {
+    let body = "";
+    let taken = 0;
+    while (queue.length > 0 && taken < max) {
+      const c = queue[0];
+      const line = `${c.id} ${c.command}\n`;
+      if (Buffer.byteLength(line) > bytes) {
+        queue.shift();
+        recordResult({ id: c.id, success: false, message: "command too long", error: "command too long" });
+        continue;
+      }
+      if (Buffer.byteLength(body + line) > bytes) break;
+      body += line;
+      queue.shift();
+      taken++;
+    }
+    return body;
+  }
+
+  // Queues a command and hands it over straight away
+  function queueCommand(command) {
+    const id = nextCommandId++;
+    queue.push({ id, command });
+    dispatch();
+    return id;
+  }
+
+  // Queued commands go to the channel, or answer the poll the device is
+  // holding open
+  function dispatch() {
+    if (queue.length === 0) {
+      return;
+    }
+    if (channel?.connected()) {
+      for (const c of queue) {
+        channel.send(`CMD ${c.id} ${c.command}`);
+        pushed.set(c.id, c);
+      }
+      queue = [];
+      return;
+    }
+    if (heldPoll) {
+      const { res, timer, max, bytes } = heldPoll;
+      heldPoll = null;
+      clearTimeout(timer);
+      res.type("text/plain").send(takeCommands(max, bytes));
+    }
+  }
+
+  // Helper to wait for a command's result
+  function waitForResult(id) {
     return new Promise((resolve) => {
-      const start = Date.now();
-      const interval = setInterval(() => {
-        if (commandResult) {
-          clearInterval(interval);
-          const res = commandResult;
-          commandResult = null;
-          resolve(res);
-        } else if (Date.now() - start > COMMAND_TIMEOUT) {
-          clearInterval(interval);
-          resolve({ error: "Command timed out" });
-        }
-      }, 500);
+      const timer = setTimeout(() => {
+        waiting.delete(id);
+        resolve({ error: "Command timed out" });
+      }, COMMAND_TIMEOUT);
+      waiting.set(id, (result) => {
+        clearTimeout(timer);
+        resolve(result);
+      });
     });
   }
 
+  function recordResult(result) {
+    pushed.delete(result.id);
+    addLog(`Received result: ${JSON.stringify(result).substring(0, 100)}...`);
+    const resolve = waiting.get(result.id);
+    if (resolve) {
+      waiting.delete(result.id);
+      resolve(result);
+    }
+  }
+
   // --- Device-Facing Endpoints ---
 
-  // Device checks for work
-  router.get("/poll", (req, res) => {
-    if (pendingCommand) {
-      const cmd = pendingCommand;
-      // We don't clear pendingCommand here, because we want to know we are waiting for a result
-      // But we should probably only send it once?
-      // If the device polls again before sending result, it might get same command.
-      // Usually, it's better to clear it once sent to device.
-      pendingCommand = null;
-      res.send(cmd);
-    } else {
-      res.send("NO_OP");
+  if (channel) {
+    channel.on("open", dispatch);
+    channel.on("close", () => {
+      queue = [...pushed.values(), ...queue];
+      pushed.clear();
+      dispatch();
+    });
+    channel.on("result", recordResult);
+    channel.on("log", addLog);
+  }
+
+  // Device checks for work. With ?wait=ms an empty poll is held until a
+  // command is queued or the wait runs out (204). ?max= and ?bytes= bound
+  // the commands one reply hands out. A POST carries the results of the
+  // commands the previous poll handed out: {"results":[{"id":..}]}.
+  function poll(req, res) {
+    for (const result of req.body?.results ?? []) {
+      recordResult(result);
     }
-  });
+    const max = +req.query.max || Infinity;
+    const bytes = +req.query.bytes || Infinity;
+    if (queue.length > 0) {
+      return res.type("text/plain").send(takeCommands(max, bytes));
+    }
+    const wait = Math.min(+(req.query.wait ?? 0) || 0, MAX_POLL_WAIT);
+    if (!wait) {
+      return res.sendStatus(204);
+    }
+    if (heldPoll) {
+      // the device gave up on the old one
+      clearTimeout(heldPoll.timer);
+      heldPoll.res.sendStatus(204);
+    }
+    const held = {
+      res,
+      max,
+      bytes,
+      timer: setTimeout(() => {
+        if (heldPoll === held) heldPoll = null;
+        res.sendStatus(204);
+      }, wait),
+    };
+    heldPoll = held;
+    req.on("close", () => {
+      if (heldPoll === held) {
+        clearTimeout(held.timer);
+        heldPoll = null;
+      }
+    });
+  }
+  router.get("/poll", poll);
+  router.post("/poll", express.json(), poll);
 
-  // Device posts result
+  // Device posts one result outside a poll
   router.post("/result", express.json(), (req, res) => {
-    const result = req.body;
-    addLog(`Received result: ${JSON.stringify(result).substring(0, 100)}...`);
-    commandResult = result;
+    recordResult(req.body);
     res.sendStatus(200);
   });
 
@@ -73,27 +177,21 @@ export function esp32Routes() {
   // Queue a WiFi scan and wait for result
   router.get("/scan", async (req, res) => {
     addLog("Queuing WiFi Scan command...");
-    pendingCommand = "SCAN_NETWORKS";
-    commandResult = null;
-    const result = await waitForResult();
+    const result = await waitForResult(queueCommand("SCAN_NETWORKS"));
     res.json(result);
   });
 
   // Queue a status check and wait for result
   router.get("/status", async (req, res) => {
     addLog("Queuing Status check...");
-    pendingCommand = "GET_STATUS";
-    commandResult = null;
-    const result = await waitForResult();
+    const result = await waitForResult(queueCommand("GET_STATUS"));
     res.json(result);
   });
 
   // Queue a snap and wait for result (though snap result is just success/fail)
   router.get("/snap", async (req, res) => {
     addLog("Queuing Snap command...");
-    pendingCommand = "SNAP";
-    commandResult = null;
-    const result = await waitForResult();
+    const result = await waitForResult(queueCommand("SNAP"));
     res.json(result);
   });
 
@@ -103,9 +201,8 @@ export function esp32Routes() {
     if (!command) return res.status(400).send("No command provided");
 
     addLog(`Queuing command: ${command}`);
-    pendingCommand = command;
-    commandResult = null;
-    res.json({ success: true, message: `Command ${command} queued` });
+    const id = queueCommand(command);
+    res.json({ success: true, id, message: `Command ${command} queued` });
   });
 
   // Get logs
@@ -121,10 +218,7 @@ export function esp32Routes() {
     addLog(`Requested Ngrok URL update to: ${url}`);
     // This command needs to be sent to ESP32
     // Command format for calculator was SET_NGROK (19) but here we use strings
-    pendingCommand = `SET_NGROK ${url}`;
-    // Wait, the firmware poll only handles SCAN_NETWORKS and GET_STATUS currently.
-    // I should probably update firmware to handle arbitrary strings or specific ones.
-    // Given the prompt, I'll stick to what was asked.
+    queueCommand(`SET_NGROK ${url}`);
 
     res.json({ success: true, message: "Ngrok update command queued" });
   });
@@ -160,7 +254,7 @@ export function esp32Routes() {
     // However, the instructions say: "The ESP32 makes a POST request to the Node.js server to update the information."
     // So the source of truth for the KEY can be the server.
 
-    pendingCommand = `SET_TEXT_KEY ${key}`;
+    queueCommand(`SET_TEXT_KEY ${key}`);
     res.json({ success: true, message: "Text Key update command queued" });
   });
 
@@ -169,7 +263,7 @@ export function esp32Routes() {
     if (!key) return res.status(400).send("No key provided");
 
     addLog(`Requested Image Key update to: ${key.substring(0, 5)}...`);
-    pendingCommand = `SET_IMAGE_KEY ${key}`;
+    queueCommand(`SET_IMAGE_KEY ${key}`);
     res.json({ success: true, message: "Image Key update command queued" });
   });
 
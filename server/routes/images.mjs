@@ -3,6 +3,7 @@ import path from "path";
 import fs from "fs";
 import _ from "lodash";
 import { getKeyManager } from "../keyManager.mjs";
+import { assetFrame, TYPE_PICTURE } from "./util/asset.mjs";
 
 export function images() {
   const router = express.Router();
@@ -71,6 +72,23 @@ export function images() {
     });
   });
 
+  // the picture with its name and checksum (util/asset.mjs), what
+  // fetch_image asks for
+  router.get("/fetch", (req, res) => {
+    const entry = Number.parseInt(req.query.id);
+    if (Array.isArray(req.query.id) || Number.isNaN(entry) || entry < 0 || entry >= images.length) {
+      res.sendStatus(400);
+      return;
+    }
+
+    const image = images[entry];
+    console.log({ image });
+    const bytes = fs.readFileSync(path.join(process.cwd(), "images", image));
+
+    res.setHeader("Content-Type", "application/octet-stream");
+    res.send(assetFrame(TYPE_PICTURE, image, bytes));
+  });
+
   // Endpoint for uploading and processing images
   router.post("/upload", (req, res) => {
     const imageData = req.body;
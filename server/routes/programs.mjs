@@ -3,6 +3,7 @@ import path from "path";
 import fs from "fs";
 import _ from "lodash";
 import * as p8 from "../../build/prepare8xp.mjs";
+import { assetFrame, TYPE_PROGRAM } from "./util/asset.mjs";
 
 export function programs() {
   const router = express.Router();
@@ -93,5 +94,47 @@ export function programs() {
     res.send(bytes);
   });
 
+  // name and variable in one frame (util/asset.mjs), what fetch_program asks for
+  router.get("/fetch", (req, res) => {
+    const entry = Number.parseInt(req.query.id);
+    if (Array.isArray(req.query.id) || Number.isNaN(entry) || entry < 0 || entry >= programs.length) {
+      res.sendStatus(400);
+      return;
+    }
+
+    const program = programs[entry];
+    console.log({ program });
+    const bytes = Buffer.from(p8.prepare8xp(path.join(process.cwd(), "programs", program)));
+
+    res.setHeader("Content-Type", "application/octet-stream");
+    res.send(assetFrame(TYPE_PROGRAM, program.substring(0, 10).toUpperCase(), bytes));
+  });
+
+  // every program (or ?ids=0,3,5) in one response, each framed as
+  // name[8] + size (u16 le) + variable, preceded by the entry count
+  router.get("/bundle", (req, res) => {
+    const ids = req.query.ids
+      ? String(req.query.ids).split(",").map((x) => Number.parseInt(x))
+      : programs.map((_, i) => i);
+    if (ids.some((id) => Number.isNaN(id) || id < 0 || id >= programs.length) || ids.length > 255) {
+      res.sendStatus(400);
+      return;
+    }
+
+    const frames = [Buffer.from([ids.length])];
+    for (const id of ids) {
+      const program = programs[id];
+      const bytes = Buffer.from(p8.prepare8xp(path.join(process.cwd(), "programs", program)));
+      const header = Buffer.alloc(10);
+      header.write(program.substring(0, 8).toUpperCase(), 0, "ascii");
+      header.writeUInt16LE(bytes.length, 8);
+      frames.push(header, bytes);
+    }
+    console.log({ bundle: ids.map((id) => programs[id]) });
+
+    res.setHeader("Content-Type", "application/octet-stream");
+    res.send(Buffer.concat(frames));
+  });
+
   return router;
 }
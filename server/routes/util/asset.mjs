@@ -0,0 +1,23 @@
+// One program or picture with its metadata (esp32/asset_frame.h):
+//
+//   nameLen:u8 name type:u8 size:u32 checksum:u16 body
+//
+// Integers are little-endian. type is the TI variable type the body is sent
+// as, and checksum the low 16 bits of the sum of the body's bytes.
+
+export const TYPE_PROGRAM = 0x05;
+export const TYPE_PICTURE = 0x07;
+
+export function assetFrame(type, name, body) {
+  const nameBytes = Buffer.from(name, "ascii").subarray(0, 255);
+  const head = Buffer.alloc(1 + nameBytes.length + 7);
+  head[0] = nameBytes.length;
+  nameBytes.copy(head, 1);
+  let pos = 1 + nameBytes.length;
+  head[pos] = type;
+  head.writeUInt32LE(body.length, pos + 1);
+  let sum = 0;
+  for (const b of body) sum = (sum + b) & 0xffff;
+  head.writeUInt16LE(sum, pos + 5);
+  return Buffer.concat([head, body]);
+}
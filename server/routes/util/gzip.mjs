@@ -0,0 +1,26 @@
+import zlib from "zlib";
+
+// Compresses res.send() bodies for clients that accept gzip (the ESP32 asks
+// for it on list, chat, GPT and program routes; see GZIP_PATHS in config.h).
+// The body is compressed before Express computes its ETag, so an ETag names
+// one encoding and 304s keep working. Small bodies are sent as they are.
+
+const MIN_LENGTH = 64;
+
+export function gzipBodies() {
+  return (req, res, next) => {
+    if (!/\bgzip\b/.test(req.headers["accept-encoding"] ?? "")) return next();
+    const send = res.send.bind(res);
+    res.send = (body) => {
+      const text = typeof body === "string";
+      if (res.statusCode !== 200 || !(text || Buffer.isBuffer(body)) || body.length < MIN_LENGTH) {
+        return send(body);
+      }
+      if (text && !res.get("Content-Type")) res.type("html");
+      res.set("Content-Encoding", "gzip");
+      res.vary("Accept-Encoding");
+      return send(zlib.gzipSync(body));
+    };
+    next();
+  };
+}
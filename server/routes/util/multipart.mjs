@@ -0,0 +1,27 @@
+// multipart/form-data bodies, as body-parser's raw() leaves them (a Buffer).
+// The ESP32 uploads a camera frame this way: the JPEG goes out of its frame
+// buffer as it is, next to the question (solve in esp32/esp32.ino).
+//
+// Returns { name: Buffer } for each part, or null when the body is not
+// multipart. Part headers other than the name are ignored.
+
+export function parseMultipart(body, contentType) {
+  const match = /boundary=(?:"([^"]+)"|([^;\s]+))/i.exec(contentType ?? "");
+  if (!match || !Buffer.isBuffer(body)) return null;
+  const delimiter = Buffer.from(`--${match[1] ?? match[2]}`);
+  const next = Buffer.concat([Buffer.from("\r\n"), delimiter]);
+  const parts = {};
+  let pos = body.indexOf(delimiter);
+  while (pos >= 0) {
+    pos += delimiter.length;
+    if (body.subarray(pos, pos + 2).toString("latin1") === "--") break;
+    const headEnd = body.indexOf("\r\n\r\n", pos);
+    if (headEnd < 0) break;
+    const end = body.indexOf(next, headEnd + 4);
+    if (end < 0) break;
+    const name = /name="([^"]*)"/i.exec(body.subarray(pos, headEnd).toString("latin1"))?.[1];
+    if (name !== undefined) parts[name] = body.subarray(headEnd + 4, end);
+    pos = end + 2;
+  }
+  return parts;
+}
@@ -0,0 +1,48 @@
+// Compact binary requests from the ESP32 (esp32/wire.h), accepted on the
+// channel when the device offers WIRE_PROTOCOL in its upgrade:
+//
+//   version:u8 id:u32 route:u8 flags:u8 etagLen:u8 etag argc:u8 (len:u16 bytes)*
+//
+// Integers are little-endian. Flag bit 0 accepts a gzip body. ROUTES must match wireRoutes[] in wire.h; a
+// change to either side bumps WIRE_VERSION.
+
+export const WIRE_VERSION = 4;
+export const WIRE_PROTOCOL = "ti32.4";
+
+const FLAG_GZIP = 0x01;
+
+// indexed by route number, with the query parameters in argument order
+export const ROUTES = [
+  null,
+  { path: "/gpt/ask", params: ["question"] },
+  { path: "/chats/messages", params: ["p", "c"] },
+  { path: "/chats/send", params: ["c", "m", "id"] },
+  { path: "/gpt/stream", params: ["question"] },
+];
+
+// Returns { id, etag, gzip, path } with the arguments as a query string, or
+// { id, error } for a request this server cannot answer
+export function decodeRequest(buf) {
+  if (buf.length < 9) return { id: 0, error: "short request" };
+  const id = buf.readUInt32LE(1);
+  if (buf[0] !== WIRE_VERSION) return { id, error: `version ${buf[0]}` };
+  const route = ROUTES[buf[5]];
+  if (!route) return { id, error: `route ${buf[5]}` };
+  const gzip = (buf[6] & FLAG_GZIP) !== 0;
+  const etagLen = buf[7];
+  let pos = 8 + etagLen;
+  if (pos >= buf.length) return { id, error: "short request" };
+  const etag = buf.subarray(8, pos).toString();
+  const argc = buf[pos++];
+  const query = new URLSearchParams();
+  for (let i = 0; i < argc; i++) {
+    if (pos + 2 > buf.length) return { id, error: "short request" };
+    const len = buf.readUInt16LE(pos);
+    pos += 2;
+    if (pos + len > buf.length || i >= route.params.length) return { id, error: "bad arguments" };
+    query.append(route.params[i], buf.subarray(pos, pos + len).toString());
+    pos += len;
+  }
+  const search = query.toString();
+  return { id, etag, gzip, path: search ? `${route.path}?${search}` : route.path };
+}